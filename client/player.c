@@ -27,6 +27,8 @@
 #include <wordexp.h>
 #include <sys/timerfd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 
 #include <glib.h>
 
@@ -149,9 +151,33 @@ struct transport {
 	struct stat stat;
 	struct io *io;
 	uint32_t seq;
-	struct io *timer_io;
+	uint8_t *data;
+	size_t size;
+	size_t offset;
+	bool mapped;
+	uint64_t start;
+	uint64_t interval;
+	uint32_t depth;
 };
 
+#define FEEDER_MAX_BATCH	16
+#define FEEDER_STATS_INTERVAL	1000000000ULL
+
+/* Drives all the transports being sent from a single clock */
+struct feeder {
+	struct io *io;
+	struct queue *transports;
+	uint64_t start;
+	uint64_t period;
+	uint64_t last_stats;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t max_lag;
+	uint32_t late;
+};
+
+static struct feeder *feeder;
+
 static void endpoint_unregister(void *data)
 {
 	struct endpoint *ep = data;
@@ -4628,6 +4654,18 @@ static GDBusProxy *find_link_by_proxy(GDBusProxy *proxy)
 
 static void transport_close(struct transport *transport)
 {
+	if (feeder)
+		queue_remove(feeder->transports, transport);
+
+	if (transport->data) {
+		if (transport->mapped)
+			munmap(transport->data, transport->size);
+		else
+			free(transport->data);
+
+		transport->data = NULL;
+	}
+
 	if (transport->fd < 0)
 		return;
 
@@ -4635,13 +4673,14 @@ static void transport_close(struct transport *transport)
 	transport->fd = -1;
 
 	free(transport->filename);
+	transport->filename = NULL;
 }
 
 static void transport_free(void *data)
 {
 	struct transport *transport = data;
 
-	io_destroy(transport->timer_io);
+	transport_close(transport);
 	io_destroy(transport->io);
 	free(transport);
 }
@@ -5102,6 +5141,7 @@ static int transport_send_seq(struct transport *transport, int fd, uint32_t num)
 {
 	uint8_t *buf;
 	uint32_t i;
+	int secs = 0, nsecs = 0;
 
 	if (!num)
 		return 0;
@@ -5110,18 +5150,17 @@ static int transport_send_seq(struct transport *transport, int fd, uint32_t num)
 	if (!buf)
 		return -ENOMEM;
 
+	elapsed_time(true, &secs, &nsecs);
+
 	for (i = 0; i < num; i++, transport->seq++) {
 		ssize_t ret;
-		int secs = 0, nsecs = 0;
-		off_t offset;
 
 		ret = read(fd, buf, transport->mtu[1]);
 		if (ret <= 0) {
 			if (ret < 0)
 				bt_shell_printf("read failed: %s (%d)",
 						strerror(errno), errno);
-			free(buf);
-			return ret;
+			break;
 		}
 
 		ret = send(transport->sk, buf, ret, 0);
@@ -5131,110 +5170,306 @@ static int transport_send_seq(struct transport *transport, int fd, uint32_t num)
 			free(buf);
 			return -errno;
 		}
+	}
 
-		elapsed_time(!transport->seq, &secs, &nsecs);
+	free(buf);
 
-		if (!transport->seq && fstat(fd, &transport->stat) < 0) {
-			bt_shell_printf("fstat failed: %s (%d)",
-							strerror(errno), errno);
-			free(buf);
-			return -errno;
-		}
+	elapsed_time(false, &secs, &nsecs);
+
+	bt_shell_printf("Sent %u packets in %d.%03ds\n", i, secs,
+						(nsecs + 500000) / 1000000);
+
+	return i;
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int transport_load(struct transport *transport, int fd)
+{
+	size_t len = 0;
+	ssize_t ret;
+
+	if (fstat(fd, &transport->stat) < 0)
+		return -errno;
 
-		offset = lseek(fd, 0, SEEK_CUR);
+	/* Map regular files so packets are sent directly from the page
+	 * cache.
+	 */
+	if (S_ISREG(transport->stat.st_mode) && transport->stat.st_size) {
+		transport->data = mmap(NULL, transport->stat.st_size,
+					PROT_READ, MAP_PRIVATE, fd, 0);
+		if (transport->data != MAP_FAILED) {
+			transport->size = transport->stat.st_size;
+			transport->mapped = true;
+			madvise(transport->data, transport->size,
+							MADV_SEQUENTIAL);
+			return 0;
+		}
 
-		bt_shell_echo("[seq %d %d.%03ds] send: %zd/%zd bytes",
-				transport->seq, secs,
-				(nsecs + 500000) / 1000000,
-				offset, transport->stat.st_size);
+		transport->data = NULL;
 	}
 
-	free(buf);
+	/* Otherwise preload the whole input before starting */
+	do {
+		uint8_t *data;
 
-	return i;
+		if (transport->size == len) {
+			len = len ? len * 2 : 65536;
+			data = realloc(transport->data, len);
+			if (!data)
+				return -ENOMEM;
+
+			transport->data = data;
+		}
+
+		ret = read(fd, transport->data + transport->size,
+						len - transport->size);
+		if (ret < 0)
+			return -errno;
+
+		transport->size += ret;
+	} while (ret);
+
+	return 0;
 }
 
-static bool transport_timer_read(struct io *io, void *user_data)
+static int transport_feed(struct transport *transport, uint64_t now)
 {
-	struct transport *transport = user_data;
-	struct bt_iso_qos qos;
-	socklen_t len;
-	int ret, fd;
-	uint32_t num;
-	uint64_t exp;
+	struct mmsghdr msg[FEEDER_MAX_BATCH];
+	struct iovec iov[FEEDER_MAX_BATCH];
+	uint64_t due;
+	size_t offset = transport->offset;
+	unsigned int i, num;
+	int ret;
 
-	if (transport->fd < 0)
-		return false;
+	/* Number of packets due is derived from the absolute start time so
+	 * timer jitter or missed wakeups do not accumulate as drift.
+	 */
+	due = (now - transport->start) / transport->interval +
+							transport->depth;
+	if (due <= transport->seq)
+		return 0;
+
+	num = MIN(due - transport->seq, FEEDER_MAX_BATCH);
+
+	memset(msg, 0, sizeof(msg));
+
+	for (i = 0; i < num && offset < transport->size; i++) {
+		iov[i].iov_base = transport->data + offset;
+		iov[i].iov_len = MIN(transport->mtu[1],
+					transport->size - offset);
+		offset += iov[i].iov_len;
+
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	if (!i)
+		return 0;
 
-	fd = io_get_fd(io);
-	ret = read(fd, &exp, sizeof(exp));
+	ret = sendmmsg(transport->sk, msg, i, MSG_DONTWAIT);
 	if (ret < 0) {
-		bt_shell_printf("Failed to read: %s (%d)\n", strerror(errno),
-								-errno);
-		return false;
+		if (errno == EAGAIN)
+			return 0;
+
+		return -errno;
 	}
 
-	/* Read QoS if available */
-	memset(&qos, 0, sizeof(qos));
-	len = sizeof(qos);
-	if (getsockopt(transport->sk, SOL_BLUETOOTH, BT_ISO_QOS, &qos,
-							&len) < 0) {
-		bt_shell_printf("Failed to getsockopt(BT_ISO_QOS): %s (%d)\n",
-					strerror(errno), -errno);
-		return false;
+	for (i = 0; i < (unsigned int) ret; i++) {
+		transport->offset += iov[i].iov_len;
+		transport->seq++;
+		feeder->packets++;
+		feeder->bytes += iov[i].iov_len;
 	}
 
-	/* num of packets = latency (ms) / interval (us) */
-	num = (qos.ucast.out.latency * 1000 / qos.ucast.out.interval);
+	return ret;
+}
 
-	ret = transport_send_seq(transport, transport->fd, num);
-	if (ret < 0) {
-		bt_shell_printf("Unable to send: %s (%d)\n",
-					strerror(-ret), ret);
-		return false;
+static void feeder_print_stats(uint64_t now)
+{
+	uint64_t elapsed = (now - feeder->start) / 1000000;
+	uint64_t lag = feeder->max_lag / 1000;
+
+	bt_shell_echo("[%u.%03us] sent: %" PRIu64 " packets %" PRIu64
+			" bytes late %u max lag %" PRIu64 " us",
+			(unsigned int) (elapsed / 1000),
+			(unsigned int) (elapsed % 1000),
+			feeder->packets, feeder->bytes, feeder->late, lag);
+
+	feeder->last_stats = now;
+	feeder->max_lag = 0;
+}
+
+static void feeder_free(void)
+{
+	if (!feeder)
+		return;
+
+	io_destroy(feeder->io);
+	queue_destroy(feeder->transports, NULL);
+	free(feeder);
+	feeder = NULL;
+}
+
+static bool feeder_timer_read(struct io *io, void *user_data)
+{
+	const struct queue_entry *entry;
+	uint64_t exp, now, lag;
+
+	if (read(io_get_fd(io), &exp, sizeof(exp)) < 0) {
+		bt_shell_printf("Failed to read: %s (%d)\n", strerror(errno),
+								-errno);
+		return true;
 	}
 
-	if (!ret) {
+	now = get_time_ns();
+
+	/* More than one expiration means at least one wakeup was missed */
+	if (exp > 1)
+		feeder->late += exp - 1;
+
+	lag = (now - feeder->start) % feeder->period;
+	if (lag > feeder->max_lag)
+		feeder->max_lag = lag;
+
+	for (entry = queue_get_entries(feeder->transports); entry;) {
+		struct transport *transport = entry->data;
+		int ret;
+
+		entry = entry->next;
+
+		ret = transport_feed(transport, now);
+		if (ret < 0)
+			bt_shell_printf("Unable to send: %s (%d)\n",
+						strerror(-ret), ret);
+		else if (transport->offset < transport->size)
+			continue;
+
+		bt_shell_printf("Transport %s complete: %u packets\n",
+				g_dbus_proxy_get_path(transport->proxy),
+				transport->seq);
 		transport_close(transport);
+	}
+
+	if (now - feeder->last_stats >= FEEDER_STATS_INTERVAL ||
+				queue_isempty(feeder->transports))
+		feeder_print_stats(now);
+
+	if (queue_isempty(feeder->transports)) {
+		feeder_free();
 		return false;
 	}
 
 	return true;
 }
 
-static int transport_send(struct transport *transport, int fd,
-					struct bt_iso_qos *qos)
+static int feeder_set_timer(int fd, uint64_t now)
 {
 	struct itimerspec ts;
-	int timer_fd;
+	uint64_t next;
+
+	/* Keep wakeups aligned to the start but skip the periods that have
+	 * already elapsed, otherwise re-arming with a shorter period would
+	 * expire in the past and report the skipped wakeups as late.
+	 */
+	next = feeder->start + ((now - feeder->start) / feeder->period + 1) *
+							feeder->period;
+
+	memset(&ts, 0, sizeof(ts));
+	ts.it_value.tv_sec = next / 1000000000ULL;
+	ts.it_value.tv_nsec = next % 1000000000ULL;
+	ts.it_interval.tv_sec = feeder->period / 1000000000ULL;
+	ts.it_interval.tv_nsec = feeder->period % 1000000000ULL;
+
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &ts, NULL) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int feeder_add(struct transport *transport, uint64_t now)
+{
+	int fd, err;
+
+	if (!feeder) {
+		fd = timerfd_create(CLOCK_MONOTONIC,
+					TFD_NONBLOCK | TFD_CLOEXEC);
+		if (fd < 0)
+			return -errno;
+
+		feeder = new0(struct feeder, 1);
+		feeder->transports = queue_new();
+		feeder->start = now;
+		feeder->last_stats = now;
+		feeder->io = io_new(fd);
+		io_set_close_on_destroy(feeder->io, true);
+		io_set_read_handler(feeder->io, feeder_timer_read, NULL,
+									NULL);
+	}
+
+	/* Wake up at the shortest interval of all transports */
+	if (!feeder->period || transport->interval < feeder->period) {
+		feeder->period = transport->interval;
+
+		err = feeder_set_timer(io_get_fd(feeder->io), now);
+		if (err < 0) {
+			if (queue_isempty(feeder->transports))
+				feeder_free();
+			return err;
+		}
+	}
+
+	queue_push_tail(feeder->transports, transport);
+
+	/* Prefill up to the transport latency */
+	return transport_feed(transport, now);
+}
+
+static int transport_send(struct transport *transport, int fd,
+				struct bt_iso_qos *qos, uint64_t now)
+{
+	int err;
 
 	transport->seq = 0;
 
-	if (!qos)
+	if (!qos || !qos->ucast.out.interval)
 		return transport_send_seq(transport, fd, UINT32_MAX);
 
-	if (transport->fd >= 0)
+	if (transport->fd >= 0 || transport->data)
 		return -EALREADY;
 
-	timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
-	if (timer_fd < 0)
-		return -errno;
-
-	memset(&ts, 0, sizeof(ts));
-	ts.it_value.tv_nsec = qos->ucast.out.latency * 1000000;
-	ts.it_interval.tv_nsec = qos->ucast.out.latency * 1000000;
-
-	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &ts, NULL) < 0)
-		return -errno;
+	err = transport_load(transport, fd);
+	if (err < 0) {
+		transport_close(transport);
+		return err;
+	}
 
 	transport->fd = fd;
+	transport->offset = 0;
+	transport->start = now;
+	transport->interval = qos->ucast.out.interval * 1000ULL;
 
-	transport->timer_io = io_new(timer_fd);
-
-	io_set_read_handler(transport->timer_io, transport_timer_read,
-						transport, NULL);
+	/* num of packets = latency (ms) / interval (us) */
+	transport->depth = qos->ucast.out.latency * 1000 /
+					qos->ucast.out.interval;
+	if (!transport->depth)
+		transport->depth = 1;
+
+	err = feeder_add(transport, now);
+	if (err < 0) {
+		/* File is closed by the caller */
+		transport->fd = -1;
+		transport_close(transport);
+	}
 
-	return transport_send_seq(transport, fd, 1);
+	return err;
 }
 
 static void cmd_send_transport(int argc, char *argv[])
@@ -5244,8 +5479,12 @@ static void cmd_send_transport(int argc, char *argv[])
 	int fd = -1, err;
 	struct bt_iso_qos qos;
 	socklen_t len;
+	uint64_t now;
 	int i;
 
+	/* Transports sent together share the same start time */
+	now = get_time_ns();
+
 	for (i = 1; i < argc; i++) {
 		proxy = g_dbus_proxy_lookup(transports, NULL, argv[i],
 					BLUEZ_MEDIA_TRANSPORT_INTERFACE);
@@ -5281,9 +5520,9 @@ static void cmd_send_transport(int argc, char *argv[])
 							&len) < 0) {
 			bt_shell_printf("Unable to getsockopt(BT_ISO_QOS): %s",
 							strerror(errno));
-			err = transport_send(transport, fd, NULL);
+			err = transport_send(transport, fd, NULL, now);
 		} else
-			err = transport_send(transport, fd, &qos);
+			err = transport_send(transport, fd, &qos, now);
 
 		if (err < 0) {
 			bt_shell_printf("Unable to send: %s (%d)",
@@ -5393,7 +5632,7 @@ static const struct bt_shell_menu transport_menu = {
 	{ "release",     "<transport> [transport1...]", cmd_release_transport,
 						"Release Transport",
 						transport_generator },
-	{ "send",        "<transport> <filename> [transport1...]",
+	{ "send",        "<transport> <filename> [transport1 filename1...]",
 						cmd_send_transport,
 						"Send contents of a file",
 						transport_generator },
@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "lib/bluetooth.h"
 #include "lib/hci.h"
@@ -44,6 +45,8 @@
 #define BIS_SIZE		3
 #define CIG_SIZE		3
 
+#define iso_flags_pb(f)		(f & 0x0003)
+
 #define has_bredr(btdev)	(!((btdev)->features[4] & 0x20))
 #define has_le(btdev)		(!!((btdev)->features[4] & 0x40))
 
@@ -70,6 +73,20 @@ struct btdev_conn {
 	struct btdev *dev;
 	struct btdev_conn *link;
 	void *data;
+	uint64_t iso_anchor;
+	/* Schedule of the SDU whose fragments are being received */
+	uint64_t iso_sdu_slot;
+	uint64_t iso_sdu_due;
+	bool iso_sdu_drop;
+};
+
+/* ISO SDU transmission (completion) or reception (delivery) event */
+struct iso_event {
+	uint64_t time;
+	uint16_t handle;
+	bool deliver;
+	uint16_t len;
+	uint8_t data[];
 };
 
 struct btdev_al {
@@ -148,6 +165,11 @@ struct btdev {
 	uint16_t acl_max_pkt;
 	uint16_t iso_mtu;
 	uint16_t iso_max_pkt;
+	struct btdev_iso_sched *iso_sched;
+	struct queue *iso_events;
+	unsigned int iso_timeout_id;
+	uint16_t iso_pending;
+	uint32_t iso_rand;
 	uint8_t  country_code;
 	uint8_t  bdaddr[6];
 	uint8_t  random_addr[6];
@@ -523,10 +545,35 @@ static void conn_unlink(struct btdev_conn *conn1, struct btdev_conn *conn2)
 	conn2->link = NULL;
 }
 
+static bool match_iso_event_handle(const void *data, const void *match_data)
+{
+	const struct iso_event *evt = data;
+
+	return evt->handle == PTR_TO_UINT(match_data);
+}
+
+/* Packets of a removed CIS/BIS are flushed, neither completed nor sent */
+static void iso_events_remove(struct btdev_conn *conn)
+{
+	struct btdev *dev = conn->dev;
+	struct iso_event *evt;
+
+	while ((evt = queue_remove_if(dev->iso_events, match_iso_event_handle,
+						UINT_TO_PTR(conn->handle)))) {
+		if (!evt->deliver && dev->iso_pending)
+			dev->iso_pending--;
+
+		free(evt);
+	}
+}
+
 static void conn_remove(void *data)
 {
 	struct btdev_conn *conn = data;
 
+	if (conn->type == HCI_ISODATA_PKT)
+		iso_events_remove(conn);
+
 	if (conn->link) {
 		struct btdev_conn *link = conn->link;
 
@@ -572,6 +619,9 @@ static void btdev_reset(struct btdev *btdev)
 
 	queue_remove_all(btdev->conns, NULL, NULL, conn_remove);
 	queue_remove_all(btdev->le_ext_adv, NULL, NULL, le_ext_adv_free);
+
+	queue_remove_all(btdev->iso_events, NULL, NULL, free);
+	btdev->iso_pending = 0;
 }
 
 static int cmd_reset(struct btdev *dev, const void *data, uint8_t len)
@@ -7167,6 +7217,7 @@ struct btdev *btdev_create(enum btdev_type type, uint16_t id)
 
 	btdev->conns = queue_new();
 	btdev->le_ext_adv = queue_new();
+	btdev->iso_events = queue_new();
 
 	btdev->le_al_len = AL_SIZE;
 	btdev->le_rl_len = RL_SIZE;
@@ -7181,12 +7232,17 @@ void btdev_destroy(struct btdev *btdev)
 	if (btdev->inquiry_id > 0)
 		timeout_remove(btdev->inquiry_id);
 
+	if (btdev->iso_timeout_id > 0)
+		timeout_remove(btdev->iso_timeout_id);
+
 	bt_crypto_unref(btdev->crypto);
 	del_btdev(btdev);
 
 	queue_destroy(btdev->conns, conn_remove);
 	queue_destroy(btdev->le_ext_adv, le_ext_adv_free);
+	queue_destroy(btdev->iso_events, free);
 
+	free(btdev->iso_sched);
 	free(btdev);
 }
 
@@ -7504,6 +7560,267 @@ static void send_acl(struct btdev *dev, const void *data, uint16_t len)
 	send_packet(conn->link->dev, iov, 3);
 }
 
+static uint64_t iso_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* Deterministic pseudo random generator (xorshift32) */
+static uint32_t iso_rand(struct btdev *dev)
+{
+	uint32_t x = dev->iso_rand;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	dev->iso_rand = x;
+
+	return x;
+}
+
+static bool iso_conn_timing(struct btdev_conn *conn, uint32_t *interval,
+							uint32_t *latency)
+{
+	struct bt_hci_bis *bis = conn->data;
+	struct btdev *central;
+	struct le_cig *le_cig;
+	uint8_t iso_interval;
+	int cig_idx;
+
+	/* BIS: same values reported in LE BIG Complete */
+	if (bis) {
+		*interval = get_le24(bis->sdu_interval);
+		*latency = *interval;
+		return *interval;
+	}
+
+	cig_idx = parse_cis_handle(conn->handle, NULL);
+	if (cig_idx < 0)
+		return false;
+
+	/* CIG parameters are stored by the Central */
+	central = conn->dev;
+	if (!central->le_cig[cig_idx].activated) {
+		if (!conn->link)
+			return false;
+
+		central = conn->link->dev;
+	}
+
+	le_cig = &central->le_cig[cig_idx];
+
+	/* CIS: same values reported in LE CIS Established, where the ISO
+	 * Interval of both directions is derived from SDU_Interval_C_To_P.
+	 */
+	iso_interval = le_cis_interval(le_cig->params.c_interval);
+	*interval = iso_interval * 1250;
+
+	if (central == conn->dev)
+		*latency = le_cis_latecy(0x02, iso_interval,
+						le_cig->params.c_interval);
+	else
+		*latency = le_cis_latecy(0x02, iso_interval,
+						le_cig->params.p_interval);
+
+	return *interval;
+}
+
+static void iso_event_add(struct btdev *dev, uint64_t time, uint16_t handle,
+				const void *data, uint16_t len)
+{
+	const struct queue_entry *entry;
+	struct iso_event *evt, *last;
+
+	evt = malloc(sizeof(*evt) + len);
+	if (!evt)
+		return;
+
+	evt->time = time;
+	evt->handle = handle;
+	evt->deliver = data ? true : false;
+	evt->len = len;
+
+	if (len)
+		memcpy(evt->data, data, len);
+
+	/* Keep events sorted by time, most are appended */
+	last = queue_peek_tail(dev->iso_events);
+	if (!last || last->time <= time) {
+		queue_push_tail(dev->iso_events, evt);
+		return;
+	}
+
+	last = NULL;
+
+	for (entry = queue_get_entries(dev->iso_events); entry;
+						entry = entry->next) {
+		struct iso_event *e = entry->data;
+
+		if (e->time > time)
+			break;
+
+		last = e;
+	}
+
+	if (last)
+		queue_push_after(dev->iso_events, last, evt);
+	else
+		queue_push_head(dev->iso_events, evt);
+}
+
+static bool iso_sched_timeout(void *user_data);
+
+static void iso_sched_run(struct btdev *dev)
+{
+	struct iso_event *evt;
+	uint64_t now = iso_now();
+
+	while ((evt = queue_peek_head(dev->iso_events))) {
+		struct btdev_conn *conn;
+
+		if (evt->time > now)
+			break;
+
+		queue_pop_head(dev->iso_events);
+
+		conn = queue_find(dev->conns, match_handle,
+						UINT_TO_PTR(evt->handle));
+		if (evt->deliver && conn && conn->link) {
+			uint8_t pkt_type = BT_H4_ISO_PKT;
+			struct iovec iov[2];
+
+			iov[0].iov_base = &pkt_type;
+			iov[0].iov_len = sizeof(pkt_type);
+			iov[1].iov_base = evt->data;
+			iov[1].iov_len = evt->len;
+
+			send_packet(conn->link->dev, iov, 2);
+		} else if (!evt->deliver) {
+			if (dev->iso_pending)
+				dev->iso_pending--;
+
+			num_completed_packets(dev, evt->handle);
+		}
+
+		free(evt);
+	}
+
+	if (dev->iso_timeout_id > 0) {
+		timeout_remove(dev->iso_timeout_id);
+		dev->iso_timeout_id = 0;
+	}
+
+	evt = queue_peek_head(dev->iso_events);
+	if (!evt)
+		return;
+
+	/* Timeouts have millisecond resolution, round up */
+	dev->iso_timeout_id = timeout_add((evt->time - now + 999) / 1000 ? : 1,
+						iso_sched_timeout, dev, NULL);
+}
+
+static bool iso_sched_timeout(void *user_data)
+{
+	struct btdev *dev = user_data;
+
+	dev->iso_timeout_id = 0;
+	iso_sched_run(dev);
+
+	return false;
+}
+
+/* Schedule SDU at the next ISO event of the connection and decide its
+ * fate once, when its first fragment (or the complete SDU) is received.
+ */
+static void iso_sched_sdu_start(struct btdev *dev, struct btdev_conn *conn,
+					uint32_t interval, uint32_t latency)
+{
+	struct btdev_iso_sched *sched = dev->iso_sched;
+	uint64_t now = iso_now(), slot;
+
+	/* Keep events aligned to the first SDU, skipping missed ones */
+	if (!conn->iso_anchor)
+		conn->iso_anchor = now;
+	else if (conn->iso_anchor < now)
+		conn->iso_anchor += (now - conn->iso_anchor + interval - 1) /
+						interval * interval;
+
+	slot = conn->iso_anchor;
+	conn->iso_anchor += interval;
+
+	conn->iso_sdu_slot = slot;
+	conn->iso_sdu_drop = false;
+
+	if (slot - now > latency) {
+		util_debug(dev->debug_callback, dev->debug_data,
+				"ISO handle 0x%04x SDU flushed", conn->handle);
+		conn->iso_sdu_drop = true;
+		return;
+	}
+
+	if (sched->loss && iso_rand(dev) % 100 < sched->loss) {
+		conn->iso_sdu_drop = true;
+		return;
+	}
+
+	conn->iso_sdu_due = slot + latency;
+	if (sched->jitter)
+		conn->iso_sdu_due += iso_rand(dev) % (sched->jitter + 1);
+}
+
+/* Schedule ISO data packet with the SDU it belongs to: the buffer is
+ * released (Number of Completed Packets) at the ISO event of the SDU and
+ * the packet is delivered to the remote after the transport latency,
+ * together with the other fragments of the SDU, unless the SDU is flushed
+ * for waiting longer than that or lost.
+ */
+static bool iso_sched_sdu(struct btdev *dev, struct btdev_conn *conn,
+					const void *data, uint16_t len)
+{
+	const struct bt_hci_iso_hdr *hdr = data;
+	uint32_t interval, latency;
+	uint8_t pb;
+
+	if (!iso_conn_timing(conn, &interval, &latency))
+		return false;
+
+	pb = iso_flags_pb(acl_flags(le16_to_cpu(hdr->handle)));
+
+	/* The host sent more packets than there are buffers, drop it
+	 * together with the rest of its SDU.
+	 */
+	if (dev->iso_pending >= dev->iso_max_pkt) {
+		util_debug(dev->debug_callback, dev->debug_data,
+				"ISO handle 0x%04x buffer overflow: %u >= %u",
+				conn->handle, dev->iso_pending,
+				dev->iso_max_pkt);
+		conn->iso_sdu_drop = true;
+		return true;
+	}
+
+	/* First fragment (0b00) or complete SDU (0b10), continuation and
+	 * last fragments follow the schedule of their first fragment.
+	 */
+	if (pb == 0x00 || pb == 0x02 || !conn->iso_sdu_slot)
+		iso_sched_sdu_start(dev, conn, interval, latency);
+
+	dev->iso_pending++;
+
+	iso_event_add(dev, conn->iso_sdu_slot, conn->handle, NULL, 0);
+
+	if (!conn->iso_sdu_drop)
+		iso_event_add(dev, conn->iso_sdu_due, conn->handle, data, len);
+
+	iso_sched_run(dev);
+
+	return true;
+}
+
 static void send_iso(struct btdev *dev, const void *data, uint16_t len)
 {
 	struct bt_hci_acl_hdr *hdr;
@@ -7523,6 +7840,9 @@ static void send_iso(struct btdev *dev, const void *data, uint16_t len)
 	if (!conn)
 		return;
 
+	if (dev->iso_sched && iso_sched_sdu(dev, conn, data, len))
+		return;
+
 	num_completed_packets(dev, conn->handle);
 
 	if (conn->link)
@@ -7821,6 +8141,30 @@ static const struct btdev_cmd cmd_emu[] = {
 	{}
 };
 
+int btdev_set_iso_sched(struct btdev *btdev,
+				const struct btdev_iso_sched *sched)
+{
+	if (!btdev)
+		return -EINVAL;
+
+	free(btdev->iso_sched);
+	btdev->iso_sched = NULL;
+
+	if (!sched)
+		return 0;
+
+	if (sched->loss > 100)
+		return -EINVAL;
+
+	btdev->iso_sched = util_memdup(sched, sizeof(*sched));
+	btdev->iso_rand = sched->seed ? : 1;
+
+	if (sched->max_pkt)
+		btdev->iso_max_pkt = sched->max_pkt;
+
+	return 0;
+}
+
 int btdev_set_emu_opcode(struct btdev *btdev, uint16_t opcode)
 {
 	if (!btdev)
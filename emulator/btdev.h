@@ -105,3 +105,13 @@ bool btdev_del_hook(struct btdev *btdev, enum btdev_hook_type type,
 int btdev_set_msft_opcode(struct btdev *btdev, uint16_t opcode);
 int btdev_set_aosp_capable(struct btdev *btdev, bool enable);
 int btdev_set_emu_opcode(struct btdev *btdev, uint16_t opcode);
+
+struct btdev_iso_sched {
+	uint16_t max_pkt;	/* ISO buffers, 0 keeps the default */
+	uint8_t  loss;		/* Percentage of SDUs lost */
+	uint32_t jitter;	/* Maximum extra delivery delay (us) */
+	uint32_t seed;		/* Seed of loss and jitter generation */
+};
+
+int btdev_set_iso_sched(struct btdev *btdev,
+				const struct btdev_iso_sched *sched);
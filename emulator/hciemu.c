@@ -628,6 +628,39 @@ void hciemu_set_central_le_al_len(struct hciemu *hciemu, uint8_t len)
 	btdev_set_al_len(dev, len);
 }
 
+static void hciemu_client_set_iso_sched(void *data, void *user_data)
+{
+	struct hciemu_client *client = data;
+
+	btdev_set_iso_sched(client->dev, user_data);
+}
+
+bool hciemu_set_iso_sched(struct hciemu *hciemu, uint16_t max_pkt,
+					uint8_t loss, uint32_t jitter)
+{
+	struct btdev_iso_sched sched;
+	struct btdev *dev;
+
+	if (!hciemu || !hciemu->vhci)
+		return false;
+
+	dev = vhci_get_btdev(hciemu->vhci);
+	if (!dev)
+		return false;
+
+	memset(&sched, 0, sizeof(sched));
+	sched.max_pkt = max_pkt;
+	sched.loss = loss;
+	sched.jitter = jitter;
+
+	if (btdev_set_iso_sched(dev, &sched) < 0)
+		return false;
+
+	queue_foreach(hciemu->clients, hciemu_client_set_iso_sched, &sched);
+
+	return true;
+}
+
 void hciemu_set_central_le_rl_len(struct hciemu *hciemu, uint8_t len)
 {
 	struct btdev *dev;
@@ -70,6 +70,10 @@ void hciemu_set_central_le_al_len(struct hciemu *hciemu, uint8_t len);
 
 void hciemu_set_central_le_rl_len(struct hciemu *hciemu, uint8_t len);
 
+/* Schedule ISO data on the ISO events of the central and the clients */
+bool hciemu_set_iso_sched(struct hciemu *hciemu, uint16_t max_pkt,
+					uint8_t loss, uint32_t jitter);
+
 const uint8_t *hciemu_get_central_adv_addr(struct hciemu *hciemu,
 							uint8_t handle);
 
@@ -54,6 +54,7 @@ static void usage(void)
 		"\t-B                    Create BR/EDR only controller\n"
 		"\t-A                    Create AMP controller\n"
 		"\t-T[num]               Number of test AMP controllers\n"
+		"\t-I[loss,jitter,bufs]  Schedule ISO data on ISO intervals\n"
 		"\t-h, --help            Show help options\n");
 }
 
@@ -67,6 +68,7 @@ static const struct option main_options[] = {
 	{ "amp",     no_argument,       NULL, 'A' },
 	{ "letest",  optional_argument, NULL, 'U' },
 	{ "amptest", optional_argument, NULL, 'T' },
+	{ "iso",     optional_argument, NULL, 'I' },
 	{ "version", no_argument,	NULL, 'v' },
 	{ "help",    no_argument,	NULL, 'h' },
 	{ }
@@ -93,6 +95,8 @@ int main(int argc, char *argv[])
 	int amptest_count = 0;
 	int vhci_count = 0;
 	enum btdev_type type = BTDEV_TYPE_BREDRLE52;
+	struct btdev_iso_sched iso_sched = { .max_pkt = 8 };
+	bool iso_sched_enabled = false;
 	int i;
 
 	mainloop_init();
@@ -100,7 +104,7 @@ int main(int argc, char *argv[])
 	for (;;) {
 		int opt;
 
-		opt = getopt_long(argc, argv, "dSsl::LBAU::T::vh",
+		opt = getopt_long(argc, argv, "dSsl::LBAU::T::I::vh",
 						main_options, NULL);
 		if (opt < 0)
 			break;
@@ -142,6 +146,16 @@ int main(int argc, char *argv[])
 			else
 				amptest_count = 1;
 			break;
+		case 'I':
+			iso_sched_enabled = true;
+			if (optarg && sscanf(optarg, "%hhu,%u,%hu",
+						&iso_sched.loss,
+						&iso_sched.jitter,
+						&iso_sched.max_pkt) < 1) {
+				fprintf(stderr, "Invalid ISO parameters\n");
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'v':
 			printf("%s\n", VERSION);
 			return EXIT_SUCCESS;
@@ -195,6 +209,13 @@ int main(int argc, char *argv[])
 
 		vhci_set_emu_opcode(vhci, 0xfc10);
 		vhci_set_msft_opcode(vhci, 0xfc1e);
+
+		if (iso_sched_enabled &&
+				btdev_set_iso_sched(vhci_get_btdev(vhci),
+							&iso_sched) < 0) {
+			fprintf(stderr, "Invalid ISO parameters\n");
+			return EXIT_FAILURE;
+		}
 	}
 
 	if (serial_enabled) {
@@ -25,6 +25,9 @@
 
 #define G_OBEX_HDR_ENC(id)	((id) & 0xc0)
 
+/* Number of freed headers kept around for reuse */
+#define HEADER_POOL_SIZE	16
+
 struct _GObexHeader {
 	guint8 id;
 	gboolean extdata;
@@ -39,6 +42,37 @@ struct _GObexHeader {
 	} v;
 };
 
+/*
+ * Every packet sent or received carries a few headers (Connection ID,
+ * SRM, Body...) which are freed as soon as the packet is, so recycle
+ * them instead of going through the allocator for each one.
+ */
+static GObexHeader *header_pool[HEADER_POOL_SIZE];
+static guint header_pool_len;
+
+static GObexHeader *header_alloc(void)
+{
+	GObexHeader *header;
+
+	if (header_pool_len == 0)
+		return g_new0(GObexHeader, 1);
+
+	header = header_pool[--header_pool_len];
+	memset(header, 0, sizeof(*header));
+
+	return header;
+}
+
+static void header_release(GObexHeader *header)
+{
+	if (header_pool_len == HEADER_POOL_SIZE) {
+		g_free(header);
+		return;
+	}
+
+	header_pool[header_pool_len++] = header;
+}
+
 static glong utf8_to_utf16(gunichar2 **utf16, const char *utf8) {
 	glong utf16_len;
 	int i;
@@ -142,7 +176,7 @@ GObexHeader *g_obex_header_decode(const void *data, gsize len,
 		return NULL;
 	}
 
-	header = g_new0(GObexHeader, 1);
+	header = header_alloc();
 
 	ptr = get_bytes(&header->id, ptr, sizeof(header->id));
 
@@ -292,7 +326,7 @@ void g_obex_header_free(GObexHeader *header)
 		g_assert_not_reached();
 	}
 
-	g_free(header);
+	header_release(header);
 }
 
 gboolean g_obex_header_get_unicode(GObexHeader *header, const char **str)
@@ -382,7 +416,7 @@ GObexHeader *g_obex_header_new_unicode(guint8 id, const char *str)
 	if (G_OBEX_HDR_ENC(id) != G_OBEX_HDR_ENC_UNICODE)
 		return NULL;
 
-	header = g_new0(GObexHeader, 1);
+	header = header_alloc();
 
 	header->id = id;
 
@@ -406,7 +440,7 @@ GObexHeader *g_obex_header_new_bytes(guint8 id, const void *data, gsize len)
 	if (G_OBEX_HDR_ENC(id) != G_OBEX_HDR_ENC_BYTES)
 		return NULL;
 
-	header = g_new0(GObexHeader, 1);
+	header = header_alloc();
 
 	header->id = id;
 	header->vlen = len;
@@ -442,7 +476,7 @@ GObexHeader *g_obex_header_new_uint8(guint8 id, guint8 val)
 	if (G_OBEX_HDR_ENC(id) != G_OBEX_HDR_ENC_UINT8)
 		return NULL;
 
-	header = g_new0(GObexHeader, 1);
+	header = header_alloc();
 
 	header->id = id;
 	header->vlen = 1;
@@ -463,7 +497,7 @@ GObexHeader *g_obex_header_new_uint32(guint8 id, guint32 val)
 	if (G_OBEX_HDR_ENC(id) != G_OBEX_HDR_ENC_UINT32)
 		return NULL;
 
-	header = g_new0(GObexHeader, 1);
+	header = header_alloc();
 
 	header->id = id;
 	header->vlen = 4;
@@ -21,6 +21,9 @@
 
 #define FINAL_BIT 0x80
 
+/* Number of freed packets kept around for reuse */
+#define PACKET_POOL_SIZE 4
+
 struct _GObexPacket {
 	guint8 opcode;
 	gboolean final;
@@ -40,6 +43,36 @@ struct _GObexPacket {
 	gpointer get_body_data;
 };
 
+/*
+ * With SRM a new packet is created and freed for each chunk of a
+ * transfer, so keep a few of them around instead of reallocating.
+ */
+static GObexPacket *packet_pool[PACKET_POOL_SIZE];
+static guint packet_pool_len;
+
+static GObexPacket *packet_alloc(void)
+{
+	GObexPacket *pkt;
+
+	if (packet_pool_len == 0)
+		return g_new0(GObexPacket, 1);
+
+	pkt = packet_pool[--packet_pool_len];
+	memset(pkt, 0, sizeof(*pkt));
+
+	return pkt;
+}
+
+static void packet_release(GObexPacket *pkt)
+{
+	if (packet_pool_len == PACKET_POOL_SIZE) {
+		g_free(pkt);
+		return;
+	}
+
+	packet_pool[packet_pool_len++] = pkt;
+}
+
 GObexHeader *g_obex_packet_get_header(GObexPacket *pkt, guint8 id)
 {
 	GSList *l;
@@ -222,7 +255,7 @@ GObexPacket *g_obex_packet_new_valist(guint8 opcode, gboolean final,
 
 	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", opcode);
 
-	pkt = g_new0(GObexPacket, 1);
+	pkt = packet_alloc();
 
 	pkt->opcode = opcode;
 	pkt->final = final;
@@ -268,7 +301,7 @@ void g_obex_packet_free(GObexPacket *pkt)
 
 	g_slist_foreach(pkt->headers, header_free, NULL);
 	g_slist_free(pkt->headers);
-	g_free(pkt);
+	packet_release(pkt);
 }
 
 static gboolean parse_headers(GObexPacket *pkt, const void *data, gsize len,
@@ -19,11 +19,14 @@
 #include <ftw.h>
 #include <libgen.h>
 #include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #include <ell/ell.h>
 #include <json-c/json.h>
@@ -37,15 +40,31 @@
 #define MIN_SEQ_CACHE_VALUE	(2 * 32)
 #define MIN_SEQ_CACHE_TIME	(5 * 60)
 
+/*
+ * Configuration changes are appended to a journal next to node.json and
+ * folded back into the JSON snapshot once the journal grows past these
+ * limits, or after MAX_JOURNAL_TIME seconds, whichever comes first.
+ */
+#define MAX_JOURNAL_RECORDS	256
+#define MAX_JOURNAL_SIZE	(64 * 1024)
+#define MAX_JOURNAL_TIME	60
+
 #define CHECK_KEY_IDX_RANGE(x) ((x) <= 4095)
 
 struct mesh_config {
 	json_object *jnode;
 	char *node_dir_path;
+	char *journal_path;
 	uint8_t uuid[16];
 	uint32_t write_seq;
 	struct timeval write_time;
 	struct l_queue *idles;
+	struct l_idle *journal_sync;
+	struct l_timeout *compact_timeout;
+	int journal_fd;
+	uint32_t journal_records;
+	size_t journal_size;
+	bool compacting;
 };
 
 struct write_info {
@@ -57,6 +76,7 @@ struct write_info {
 static const char *cfgnode_name = "/node.json";
 static const char *bak_ext = ".bak";
 static const char *tmp_ext = ".tmp";
+static const char *journal_ext = ".journal";
 
 /* JSON key words */
 static const char *unicastAddress = "unicastAddress";
@@ -101,6 +121,8 @@ static bool save_config(json_object *jnode, const char *fname)
 
 	if (fwrite(str, sizeof(char), strlen(str), outfile) < strlen(str))
 		l_warn("Incomplete write of mesh configuration");
+	else if (fflush(outfile) || fsync(fileno(outfile)) < 0)
+		l_warn("Failed to sync mesh configuration");
 	else
 		result = true;
 
@@ -230,6 +252,315 @@ static json_object *get_element_model(json_object *jnode, int ele_idx,
 	return NULL;
 }
 
+static void journal_sync(struct l_idle *idle, void *user_data)
+{
+	struct mesh_config *cfg = user_data;
+
+	l_idle_remove(cfg->journal_sync);
+	cfg->journal_sync = NULL;
+
+	if (cfg->journal_fd >= 0 && fdatasync(cfg->journal_fd) < 0)
+		l_warn("Failed to sync mesh configuration journal");
+}
+
+static void journal_compact(struct mesh_config *cfg)
+{
+	l_timeout_remove(cfg->compact_timeout);
+	cfg->compact_timeout = NULL;
+
+	if (cfg->compacting)
+		return;
+
+	cfg->compacting = true;
+	mesh_config_save(cfg, false, NULL, NULL);
+}
+
+static void compact_timeout(struct l_timeout *timeout, void *user_data)
+{
+	journal_compact(user_data);
+}
+
+static void journal_close(struct mesh_config *cfg)
+{
+	if (cfg->journal_sync) {
+		l_idle_remove(cfg->journal_sync);
+		cfg->journal_sync = NULL;
+
+		if (cfg->journal_fd >= 0)
+			fdatasync(cfg->journal_fd);
+	}
+
+	l_timeout_remove(cfg->compact_timeout);
+	cfg->compact_timeout = NULL;
+
+	if (cfg->journal_fd >= 0) {
+		close(cfg->journal_fd);
+		cfg->journal_fd = -1;
+	}
+}
+
+/* Called once the JSON snapshot holds everything the journal recorded */
+static void journal_reset(struct mesh_config *cfg)
+{
+	l_timeout_remove(cfg->compact_timeout);
+	cfg->compact_timeout = NULL;
+
+	cfg->journal_records = 0;
+	cfg->journal_size = 0;
+
+	if (cfg->journal_fd < 0) {
+		remove(cfg->journal_path);
+		return;
+	}
+
+	if (ftruncate(cfg->journal_fd, 0) < 0) {
+		l_warn("Failed to truncate mesh configuration journal");
+		close(cfg->journal_fd);
+		cfg->journal_fd = -1;
+		remove(cfg->journal_path);
+	}
+}
+
+static bool journal_append(struct mesh_config *cfg, json_object *jrec)
+{
+	struct iovec iov[2];
+	ssize_t written;
+	size_t len;
+
+	if (cfg->journal_fd < 0)
+		cfg->journal_fd = open(cfg->journal_path,
+				O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+									0644);
+
+	if (cfg->journal_fd < 0) {
+		l_error("Failed to open journal %s", cfg->journal_path);
+		json_object_put(jrec);
+		return mesh_config_save(cfg, true, NULL, NULL);
+	}
+
+	iov[0].iov_base = (void *) json_object_to_json_string_ext(jrec,
+						JSON_C_TO_STRING_PLAIN);
+	iov[0].iov_len = strlen(iov[0].iov_base);
+	iov[1].iov_base = "\n";
+	iov[1].iov_len = 1;
+	len = iov[0].iov_len + iov[1].iov_len;
+
+	written = writev(cfg->journal_fd, iov, 2);
+
+	json_object_put(jrec);
+
+	/*
+	 * A torn record ends journal replay, so anything appended after it
+	 * would be lost: fold everything into the snapshot right away.
+	 */
+	if (written < 0 || (size_t) written != len) {
+		l_warn("Incomplete write of mesh configuration journal");
+		return mesh_config_save(cfg, true, NULL, NULL);
+	}
+
+	cfg->journal_records++;
+	cfg->journal_size += len;
+
+	if (!cfg->journal_sync)
+		cfg->journal_sync = l_idle_create(journal_sync, cfg, NULL);
+
+	if (cfg->journal_records >= MAX_JOURNAL_RECORDS ||
+				cfg->journal_size >= MAX_JOURNAL_SIZE)
+		journal_compact(cfg);
+	else if (!cfg->compact_timeout)
+		cfg->compact_timeout = l_timeout_create(MAX_JOURNAL_TIME,
+						compact_timeout, cfg, NULL);
+
+	return true;
+}
+
+/*
+ * Record the current value of one or more top level node properties
+ * (NULL terminated list). Properties that are no longer present in the
+ * node object are recorded as null, i.e. deleted on replay.
+ */
+static bool journal_node(struct mesh_config *cfg, const char *key, ...)
+{
+	json_object *jrec, *jprops, *jvalue;
+	va_list args;
+
+	jrec = json_object_new_object();
+	if (!jrec)
+		return false;
+
+	jprops = json_object_new_object();
+	if (!jprops) {
+		json_object_put(jrec);
+		return false;
+	}
+
+	json_object_object_add(jrec, "node", jprops);
+
+	va_start(args, key);
+
+	for (; key; key = va_arg(args, const char *)) {
+		if (!json_object_object_get_ex(cfg->jnode, key, &jvalue))
+			jvalue = NULL;
+
+		json_object_object_add(jprops, key, json_object_get(jvalue));
+	}
+
+	va_end(args);
+
+	return journal_append(cfg, jrec);
+}
+
+/* Record the complete state of a single model */
+static bool journal_model(struct mesh_config *cfg, uint16_t ele_addr,
+						uint32_t mod_id, bool vendor)
+{
+	json_object *jrec, *jmodel;
+	int ele_idx;
+
+	ele_idx = get_element_index(cfg->jnode, ele_addr);
+	if (ele_idx < 0)
+		return false;
+
+	jmodel = get_element_model(cfg->jnode, ele_idx, mod_id, vendor);
+	if (!jmodel)
+		return false;
+
+	jrec = json_object_new_object();
+	if (!jrec)
+		return false;
+
+	json_object_object_add(jrec, "element", json_object_new_int(ele_idx));
+	json_object_object_add(jrec, "model", json_object_get(jmodel));
+
+	return journal_append(cfg, jrec);
+}
+
+static void replay_node(json_object *jnode, json_object *jprops)
+{
+	json_object_object_foreach(jprops, key, jvalue) {
+		json_object_object_del(jnode, key);
+
+		if (jvalue)
+			json_object_object_add(jnode, key,
+						json_object_get(jvalue));
+	}
+}
+
+static bool replay_model(json_object *jnode, json_object *jrec,
+							json_object *jmodel)
+{
+	json_object *jvalue, *jelements, *jelement, *jmodels;
+	const char *id;
+	int i, num_mods;
+
+	if (!json_object_object_get_ex(jrec, "element", &jvalue))
+		return false;
+
+	if (!json_object_object_get_ex(jnode, elements, &jelements))
+		return false;
+
+	jelement = json_object_array_get_idx(jelements,
+						json_object_get_int(jvalue));
+	if (!jelement)
+		return false;
+
+	if (!json_object_object_get_ex(jelement, models, &jmodels))
+		return false;
+
+	if (!json_object_object_get_ex(jmodel, modelId, &jvalue))
+		return false;
+
+	id = json_object_get_string(jvalue);
+	num_mods = json_object_array_length(jmodels);
+
+	for (i = 0; i < num_mods; ++i) {
+		json_object *jentry = json_object_array_get_idx(jmodels, i);
+
+		if (!json_object_object_get_ex(jentry, modelId, &jvalue))
+			continue;
+
+		if (strcmp(id, json_object_get_string(jvalue)))
+			continue;
+
+		json_object_array_put_idx(jmodels, i, json_object_get(jmodel));
+		return true;
+	}
+
+	return false;
+}
+
+/* Apply journal records on top of freshly loaded node snapshot */
+static int replay_journal(json_object *jnode, const char *fname,
+							const char *jname)
+{
+	struct stat st, jst;
+	char *str, *line, *end;
+	ssize_t sz;
+	int fd, count = 0;
+
+	fd = open(jname, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	if (fstat(fd, &jst) < 0 || stat(fname, &st) < 0) {
+		close(fd);
+		return 0;
+	}
+
+	/*
+	 * The snapshot is renamed into place before the journal is
+	 * truncated. A journal last modified before its snapshot has
+	 * therefore already been folded into it.
+	 */
+	if (jst.st_mtim.tv_sec < st.st_mtim.tv_sec ||
+			(jst.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+				jst.st_mtim.tv_nsec < st.st_mtim.tv_nsec)) {
+		l_debug("Discarding stale journal %s", jname);
+		close(fd);
+		remove(jname);
+		return 0;
+	}
+
+	str = l_malloc(jst.st_size + 1);
+	sz = read(fd, str, jst.st_size);
+	close(fd);
+
+	if (sz != jst.st_size) {
+		l_error("Failed to read journal %s", jname);
+		l_free(str);
+		return 0;
+	}
+
+	str[sz] = '\0';
+
+	/* Only newline terminated records are complete */
+	for (line = str; (end = strchr(line, '\n')); line = end + 1) {
+		json_object *jrec, *jvalue;
+
+		*end = '\0';
+
+		jrec = json_tokener_parse(line);
+		if (!jrec)
+			break;
+
+		if (json_object_object_get_ex(jrec, "node", &jvalue))
+			replay_node(jnode, jvalue);
+		else if (!json_object_object_get_ex(jrec, "model", &jvalue) ||
+				!replay_model(jnode, jrec, jvalue))
+			l_warn("Skipping journal record: %s", line);
+
+		json_object_put(jrec);
+		count++;
+	}
+
+	l_free(str);
+
+	if (count)
+		l_info("Replayed %d journal records from %s", count, jname);
+
+	return count;
+}
+
 static bool jarray_has_string(json_object *jarray, char *str, size_t len)
 {
 	int i, sz = json_object_array_length(jarray);
@@ -673,7 +1004,7 @@ bool mesh_config_net_key_add(struct mesh_config *cfg, uint16_t idx,
 
 	json_object_array_add(jarray, jentry);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_node(cfg, netKeys, NULL);
 
 fail:
 	if (jentry)
@@ -715,7 +1046,7 @@ bool mesh_config_net_key_update(struct mesh_config *cfg, uint16_t idx,
 	json_object_object_add(jentry, keyRefresh,
 				json_object_new_int(KEY_REFRESH_PHASE_ONE));
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_node(cfg, netKeys, NULL);
 }
 
 bool mesh_config_net_key_del(struct mesh_config *cfg, uint16_t idx)
@@ -735,7 +1066,7 @@ bool mesh_config_net_key_del(struct mesh_config *cfg, uint16_t idx)
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jnode, netKeys);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_node(cfg, netKeys, NULL);
 }
 
 bool mesh_config_write_device_key(struct mesh_config *cfg, uint8_t *key)
@@ -743,7 +1074,7 @@ bool mesh_config_write_device_key(struct mesh_config *cfg, uint8_t *key)
 	if (!cfg || !add_key_value(cfg->jnode, deviceKey, key))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, deviceKey, NULL);
 }
 
 bool mesh_config_write_candidate(struct mesh_config *cfg, uint8_t *key)
@@ -751,7 +1082,7 @@ bool mesh_config_write_candidate(struct mesh_config *cfg, uint8_t *key)
 	if (!cfg || !add_key_value(cfg->jnode, deviceCan, key))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, deviceCan, NULL);
 }
 
 bool mesh_config_read_candidate(struct mesh_config *cfg, uint8_t *key)
@@ -778,7 +1109,7 @@ bool mesh_config_finalize_candidate(struct mesh_config *cfg)
 	if (!add_key_value(cfg->jnode, deviceKey, key))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, deviceCan, deviceKey, NULL);
 }
 
 bool mesh_config_write_token(struct mesh_config *cfg, uint8_t *token)
@@ -786,7 +1117,7 @@ bool mesh_config_write_token(struct mesh_config *cfg, uint8_t *token)
 	if (!cfg || !add_u64_value(cfg->jnode, "token", token))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, "token", NULL);
 }
 
 bool mesh_config_app_key_add(struct mesh_config *cfg, uint16_t net_idx,
@@ -829,7 +1160,7 @@ bool mesh_config_app_key_add(struct mesh_config *cfg, uint16_t net_idx,
 
 	json_object_array_add(jarray, jentry);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_node(cfg, appKeys, NULL);
 
 fail:
 
@@ -871,7 +1202,7 @@ bool mesh_config_app_key_update(struct mesh_config *cfg, uint16_t app_idx,
 	if (!add_key_value(jentry, "key", key))
 		return false;
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_node(cfg, appKeys, NULL);
 }
 
 bool mesh_config_app_key_del(struct mesh_config *cfg, uint16_t net_idx,
@@ -892,7 +1223,7 @@ bool mesh_config_app_key_del(struct mesh_config *cfg, uint16_t net_idx,
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jnode, appKeys);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_node(cfg, appKeys, NULL);
 }
 
 bool mesh_config_model_binding_add(struct mesh_config *cfg, uint16_t ele_addr,
@@ -939,7 +1270,7 @@ bool mesh_config_model_binding_add(struct mesh_config *cfg, uint16_t ele_addr,
 
 	json_object_array_add(jarray, jstring);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_model(cfg, ele_addr, mod_id, vendor);
 }
 
 bool mesh_config_model_binding_del(struct mesh_config *cfg, uint16_t ele_addr,
@@ -975,7 +1306,7 @@ bool mesh_config_model_binding_del(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jmodel, bind);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_model(cfg, ele_addr, mod_id, vendor);
 }
 
 static void free_model(void *data)
@@ -1586,7 +1917,7 @@ bool mesh_config_write_mode(struct mesh_config *cfg, const char *keyword,
 	if (!cfg || !write_mode(cfg->jnode, keyword, value))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, keyword, NULL);
 }
 
 bool mesh_config_write_mode_ex(struct mesh_config *cfg, const char *keyword,
@@ -1634,7 +1965,7 @@ bool mesh_config_write_unicast(struct mesh_config *cfg, uint16_t unicast)
 	if (!cfg || !write_uint16_hex(cfg->jnode, unicastAddress, unicast))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, unicastAddress, NULL);
 }
 
 bool mesh_config_write_relay_mode(struct mesh_config *cfg, uint8_t mode,
@@ -1644,7 +1975,7 @@ bool mesh_config_write_relay_mode(struct mesh_config *cfg, uint8_t mode,
 	if (!cfg || !write_relay_mode(cfg->jnode, mode, count, interval))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, "relay", NULL);
 }
 
 bool mesh_config_write_mpb(struct mesh_config *cfg, uint8_t mode,
@@ -1659,7 +1990,7 @@ bool mesh_config_write_mpb(struct mesh_config *cfg, uint8_t mode,
 			return false;
 	}
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, "mpb", "mpbPeriod", NULL);
 }
 
 bool mesh_config_write_net_transmit(struct mesh_config *cfg, uint8_t cnt,
@@ -1685,7 +2016,7 @@ bool mesh_config_write_net_transmit(struct mesh_config *cfg, uint8_t cnt,
 	json_object_object_del(jnode, retransmit);
 	json_object_object_add(jnode, retransmit, jrtx);
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, retransmit, NULL);
 
 fail:
 	json_object_put(jrtx);
@@ -1710,7 +2041,7 @@ bool mesh_config_write_iv_index(struct mesh_config *cfg, uint32_t idx,
 	if (!write_int(jnode, "IVupdate", tmp))
 		return false;
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_node(cfg, "IVindex", "IVupdate", NULL);
 }
 
 static void add_model(void *a, void *b)
@@ -1845,6 +2176,8 @@ static struct mesh_config *create_config(const char *cfg_path,
 	cfg->jnode = jnode;
 	memcpy(cfg->uuid, uuid, 16);
 	cfg->node_dir_path = l_strdup(cfg_path);
+	cfg->journal_path = l_strdup_printf("%s%s", cfg_path, journal_ext);
+	cfg->journal_fd = -1;
 	cfg->write_seq = node->seq_number;
 	cfg->idles = l_queue_new();
 	gettimeofday(&cfg->write_time, NULL);
@@ -1999,7 +2332,7 @@ bool mesh_config_net_key_set_phase(struct mesh_config *cfg, uint16_t idx,
 		finish_key_refresh(jnode, idx);
 	}
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_node(cfg, netKeys, appKeys, NULL);
 }
 
 bool mesh_config_model_pub_add(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2062,7 +2395,7 @@ bool mesh_config_model_pub_add(struct mesh_config *cfg, uint16_t ele_addr,
 	json_object_object_add(jpub, retransmit, jrtx);
 	json_object_object_add(jmodel, publish, jpub);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_model(cfg, ele_addr, mod_id, vendor);
 
 fail:
 	json_object_put(jpub);
@@ -2095,7 +2428,7 @@ bool mesh_config_model_pub_del(struct mesh_config *cfg, uint16_t addr,
 								publish))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_model(cfg, addr, mod_id, vendor);
 }
 
 static bool del_page(json_object *jarray, uint8_t page)
@@ -2141,7 +2474,7 @@ void mesh_config_comp_page_del(struct mesh_config *cfg, uint8_t page)
 	json_object_object_get_ex(jnode, "pages", &jarray);
 
 	if (del_page(jarray, page))
-		save_config(jnode, cfg->node_dir_path);
+		journal_node(cfg, "pages", NULL);
 }
 
 bool mesh_config_comp_page_add(struct mesh_config *cfg, uint8_t page,
@@ -2181,7 +2514,7 @@ bool mesh_config_comp_page_add(struct mesh_config *cfg, uint8_t page,
 	json_object_array_add(jarray, jstring);
 	l_free(buf);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_node(cfg, "pages", NULL);
 }
 
 bool mesh_config_model_sub_add(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2233,7 +2566,7 @@ bool mesh_config_model_sub_add(struct mesh_config *cfg, uint16_t ele_addr,
 
 	json_object_array_add(jarray, jstring);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_model(cfg, ele_addr, mod_id, vendor);
 }
 
 bool mesh_config_model_sub_del(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2274,7 +2607,7 @@ bool mesh_config_model_sub_del(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!json_object_array_length(jarray))
 		json_object_object_del(jmodel, subscribe);
 
-	return save_config(jnode, cfg->node_dir_path);
+	return journal_model(cfg, ele_addr, mod_id, vendor);
 }
 
 bool mesh_config_model_sub_del_all(struct mesh_config *cfg, uint16_t addr,
@@ -2284,7 +2617,7 @@ bool mesh_config_model_sub_del_all(struct mesh_config *cfg, uint16_t addr,
 								subscribe))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_model(cfg, addr, mod_id, vendor);
 }
 
 bool mesh_config_model_pub_enable(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2313,7 +2646,7 @@ bool mesh_config_model_pub_enable(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!enable)
 		json_object_object_del(jmodel, publish);
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_model(cfg, ele_addr, mod_id, vendor);
 }
 
 bool mesh_config_model_sub_enable(struct mesh_config *cfg, uint16_t ele_addr,
@@ -2342,7 +2675,7 @@ bool mesh_config_model_sub_enable(struct mesh_config *cfg, uint16_t ele_addr,
 	if (!enable)
 		json_object_object_del(jmodel, subscribe);
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_model(cfg, ele_addr, mod_id, vendor);
 }
 
 bool mesh_config_write_seq_number(struct mesh_config *cfg, uint32_t seq,
@@ -2426,7 +2759,7 @@ bool mesh_config_write_ttl(struct mesh_config *cfg, uint8_t ttl)
 	if (!cfg || !write_int(cfg->jnode, defaultTTL, ttl))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, defaultTTL, NULL);
 }
 
 bool mesh_config_update_company_id(struct mesh_config *cfg, uint16_t cid)
@@ -2434,7 +2767,7 @@ bool mesh_config_update_company_id(struct mesh_config *cfg, uint16_t cid)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "cid", cid))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, "cid", NULL);
 }
 
 bool mesh_config_update_product_id(struct mesh_config *cfg, uint16_t pid)
@@ -2442,7 +2775,7 @@ bool mesh_config_update_product_id(struct mesh_config *cfg, uint16_t pid)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "pid", pid))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, "pid", NULL);
 }
 
 bool mesh_config_update_version_id(struct mesh_config *cfg, uint16_t vid)
@@ -2450,7 +2783,7 @@ bool mesh_config_update_version_id(struct mesh_config *cfg, uint16_t vid)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "vid", vid))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, "vid", NULL);
 }
 
 bool mesh_config_update_crpl(struct mesh_config *cfg, uint16_t crpl)
@@ -2458,7 +2791,7 @@ bool mesh_config_update_crpl(struct mesh_config *cfg, uint16_t crpl)
 	if (!cfg || !write_uint16_hex(cfg->jnode, "crpl", crpl))
 		return false;
 
-	return save_config(cfg->jnode, cfg->node_dir_path);
+	return journal_node(cfg, "crpl", NULL);
 }
 
 static bool load_node(const char *fname, const uint8_t uuid[16],
@@ -2471,6 +2804,8 @@ static bool load_node(const char *fname, const uint8_t uuid[16],
 	bool result = false;
 	json_object *jnode;
 	struct mesh_config_node node;
+	char *jname;
+	int records;
 
 	if (!cb) {
 		l_info("Node read callback is required");
@@ -2504,6 +2839,9 @@ static bool load_node(const char *fname, const uint8_t uuid[16],
 	if (!jnode)
 		goto done;
 
+	jname = l_strdup_printf("%s%s", fname, journal_ext);
+	records = replay_journal(jnode, fname, jname);
+
 	memset(&node, 0, sizeof(node));
 
 	node.elements = l_queue_new();
@@ -2519,6 +2857,8 @@ static bool load_node(const char *fname, const uint8_t uuid[16],
 		cfg->jnode = jnode;
 		memcpy(cfg->uuid, uuid, 16);
 		cfg->node_dir_path = l_strdup(fname);
+		cfg->journal_path = jname;
+		cfg->journal_fd = -1;
 		cfg->write_seq = node.seq_number;
 		cfg->idles = l_queue_new();
 		gettimeofday(&cfg->write_time, NULL);
@@ -2529,9 +2869,19 @@ static bool load_node(const char *fname, const uint8_t uuid[16],
 			l_free(cfg->idles);
 			l_free(cfg->node_dir_path);
 			l_free(cfg);
+		} else {
+			jname = NULL;
+
+			/* Fold replayed journal back into the snapshot */
+			if (records) {
+				cfg->journal_records = records;
+				journal_compact(cfg);
+			}
 		}
 	}
 
+	l_free(jname);
+
 	/* Done with the node: free resources */
 	l_free(node.net_transmit);
 	l_queue_destroy(node.netkeys, l_free);
@@ -2563,12 +2913,28 @@ void mesh_config_release(struct mesh_config *cfg)
 		return;
 
 	l_queue_destroy(cfg->idles, release_idle);
+	journal_close(cfg);
 
+	l_free(cfg->journal_path);
 	l_free(cfg->node_dir_path);
 	json_object_put(cfg->jnode);
 	l_free(cfg);
 }
 
+static void sync_dir(const char *fname)
+{
+	char *dir = l_strdup(fname);
+	int fd;
+
+	fd = open(dirname(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+
+	l_free(dir);
+}
+
 static void idle_save_config(struct l_idle *idle, void *user_data)
 {
 	struct write_info *info = user_data;
@@ -2595,6 +2961,13 @@ static void idle_save_config(struct l_idle *idle, void *user_data)
 	l_free(fname_tmp);
 	l_free(fname_bak);
 
+	/* Snapshot must be durable before the journal is dropped */
+	if (result) {
+		sync_dir(fname_cfg);
+		journal_reset(info->cfg);
+	}
+
+	info->cfg->compacting = false;
 	gettimeofday(&info->cfg->write_time, NULL);
 
 	if (info->cb)
@@ -2671,6 +3044,7 @@ bool mesh_config_load_nodes(const char *cfgdir_name, mesh_config_node_func_t cb,
 		fname = l_strdup_printf("%s%s", dirname, cfgnode_name);
 
 		if (!load_node(fname, uuid, cb, user_data)) {
+			char *journal;
 
 			/* Fall-back to Backup version */
 			bak = l_strdup_printf("%s%s", fname, bak_ext);
@@ -2678,6 +3052,12 @@ bool mesh_config_load_nodes(const char *cfgdir_name, mesh_config_node_func_t cb,
 			if (load_node(bak, uuid, cb, user_data)) {
 				remove(fname);
 				rename(bak, fname);
+
+				/* Journal does not apply to older snapshot */
+				journal = l_strdup_printf("%s%s", fname,
+								journal_ext);
+				remove(journal);
+				l_free(journal);
 			}
 
 			l_free(bak);
@@ -2700,6 +3080,8 @@ void mesh_config_destroy_nvm(struct mesh_config *cfg)
 	if (!cfg)
 		return;
 
+	journal_close(cfg);
+
 	node_dir = dirname(cfg->node_dir_path);
 	l_debug("Delete node config %s", node_dir);
 
@@ -29,13 +29,51 @@
 #include "mesh/mesh-io-api.h"
 #include "mesh/mesh-io-generic.h"
 
+/* Upper bound on advertising sets used for concurrent transmission */
+#define EXT_ADV_SETS_MAX	4
+
+/* Initial interval of each advertising set, in ms */
+#define EXT_ADV_INTERVAL	20
+
+/* Events per set activation for packets repeated until canceled */
+#define EXT_ADV_BURST		4
+
+/* Advertising set commands, octets 36 and 37 of supported commands */
+#define EXT_ADV_CMDS_36		0xae
+#define EXT_ADV_CMDS_37		0x60
+
+/* Number of transmitted packets between TX queue latency reports */
+#define TX_STATS_COUNT		256
+
+struct adv_set {
+	struct mesh_io_private *pvt;
+	struct tx_pkt *tx;
+	uint16_t interval;
+	uint8_t handle;
+	uint8_t events;
+	bool disabling;
+};
+
+struct tx_stats {
+	uint32_t count;
+	uint64_t total_us;
+	uint64_t max_us;
+	unsigned int max_queued;
+	unsigned int max_busy;
+};
+
 struct mesh_io_private {
 	struct mesh_io *io;
 	struct bt_hci *hci;
+	unsigned int meta_id;
 	struct l_timeout *tx_timeout;
 	struct l_queue *tx_pkts;
 	struct tx_pkt *tx;
+	struct adv_set sets[EXT_ADV_SETS_MAX];
+	struct tx_stats stats;
 	uint16_t interval;
+	uint8_t num_sets;
+	bool ext_adv;
 	bool sending;
 	bool active;
 };
@@ -49,6 +87,8 @@ struct process_data {
 
 struct tx_pkt {
 	struct mesh_io_send_info	info;
+	uint64_t			queued;
+	uint32_t			ready;
 	bool				delete;
 	uint8_t				len;
 	uint8_t				pkt[30];
@@ -103,26 +143,12 @@ static void process_rx(struct mesh_io_private *pvt, int8_t rssi,
 	l_queue_foreach(pvt->io->rx_regs, process_rx_callbacks, &rx);
 }
 
-static void event_adv_report(struct mesh_io *io, const void *buf, uint8_t size)
+static void process_adv_data(struct mesh_io *io, int8_t rssi,
+					const uint8_t *addr,
+					const uint8_t *adv, uint8_t adv_len)
 {
-	const struct bt_hci_evt_le_adv_report *evt = buf;
-	const uint8_t *adv;
-	const uint8_t *addr;
-	uint32_t instant;
-	uint8_t adv_len;
+	uint32_t instant = get_instant();
 	uint16_t len = 0;
-	int8_t rssi;
-
-	if (evt->event_type != 0x03)
-		return;
-
-	instant = get_instant();
-	adv = evt->data;
-	adv_len = evt->data_len;
-	addr = evt->addr;
-
-	/* rssi is just beyond last byte of data */
-	rssi = (int8_t) adv[adv_len];
 
 	while (len < adv_len - 1) {
 		uint8_t field_len = adv[0];
@@ -144,6 +170,51 @@ static void event_adv_report(struct mesh_io *io, const void *buf, uint8_t size)
 	}
 }
 
+static void event_adv_report(struct mesh_io *io, const void *buf, uint8_t size)
+{
+	const struct bt_hci_evt_le_adv_report *evt = buf;
+
+	if (evt->event_type != 0x03)
+		return;
+
+	/* rssi is just beyond last byte of data */
+	process_adv_data(io, (int8_t) evt->data[evt->data_len], evt->addr,
+						evt->data, evt->data_len);
+}
+
+static void event_ext_adv_report(struct mesh_io *io, const void *buf,
+								uint8_t size)
+{
+	const struct bt_hci_evt_le_ext_adv_report *evt = buf;
+	const struct bt_hci_le_ext_adv_report *report;
+	uint8_t i;
+
+	if (size < sizeof(*evt))
+		return;
+
+	buf += sizeof(*evt);
+	size -= sizeof(*evt);
+
+	for (i = 0; i < evt->num_reports; i++) {
+		report = buf;
+
+		if (size < sizeof(*report) ||
+				size < sizeof(*report) + report->data_len)
+			return;
+
+		/* Legacy ADV_NONCONN_IND */
+		if (L_LE16_TO_CPU(report->event_type) == 0x0010)
+			process_adv_data(io, report->rssi, report->addr,
+						report->data, report->data_len);
+
+		buf += sizeof(*report) + report->data_len;
+		size -= sizeof(*report) + report->data_len;
+	}
+}
+
+static void event_adv_set_term(struct mesh_io *io, const void *buf,
+								uint8_t size);
+
 static void event_callback(const void *buf, uint8_t size, void *user_data)
 {
 	uint8_t event = l_get_u8(buf);
@@ -154,18 +225,78 @@ static void event_callback(const void *buf, uint8_t size, void *user_data)
 		event_adv_report(io, buf + 1, size - 1);
 		break;
 
+	case BT_HCI_EVT_LE_EXT_ADV_REPORT:
+		event_ext_adv_report(io, buf + 1, size - 1);
+		break;
+
+	case BT_HCI_EVT_LE_ADV_SET_TERM:
+		event_adv_set_term(io, buf + 1, size - 1);
+		break;
+
 	default:
 		l_debug("Other Meta Evt - %d", event);
 	}
 }
 
+static void restart_scan(struct mesh_io_private *pvt);
+static void ext_adv_setup(struct mesh_io_private *pvt);
+
+static void hci_ready(struct mesh_io_private *pvt)
+{
+	struct mesh_io *io = pvt->io;
+
+	if (pvt->ext_adv)
+		l_debug("Started mesh on hci %u, %u advertising sets",
+						io->index, pvt->num_sets);
+	else
+		l_debug("Started mesh on hci %u", io->index);
+
+	restart_scan(pvt);
+
+	if (io->ready)
+		io->ready(io->user_data, true);
+}
+
+static void num_adv_sets_callback(const void *data, uint8_t size,
+							void *user_data)
+{
+	const struct bt_hci_rsp_le_read_num_supported_adv_sets *rsp = data;
+	struct mesh_io_private *pvt = user_data;
+
+	if (!rsp->status && rsp->num_of_sets) {
+		pvt->num_sets = L_MIN(rsp->num_of_sets, EXT_ADV_SETS_MAX);
+		ext_adv_setup(pvt);
+	}
+
+	hci_ready(pvt);
+}
+
 static void local_commands_callback(const void *data, uint8_t size,
 							void *user_data)
 {
 	const struct bt_hci_rsp_read_local_commands *rsp = data;
+	struct mesh_io_private *pvt = user_data;
 
-	if (rsp->status)
+	if (rsp->status) {
 		l_error("Failed to read local commands");
+		goto done;
+	}
+
+	/*
+	 * Legacy and extended advertising commands can not be mixed, so
+	 * extended scanning is required as well.
+	 */
+	if (size < sizeof(*rsp) ||
+		(rsp->commands[36] & EXT_ADV_CMDS_36) != EXT_ADV_CMDS_36 ||
+		(rsp->commands[37] & EXT_ADV_CMDS_37) != EXT_ADV_CMDS_37)
+		goto done;
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_READ_NUM_SUPPORTED_ADV_SETS,
+				NULL, 0, num_adv_sets_callback, pvt, NULL);
+	return;
+
+done:
+	hci_ready(pvt);
 }
 
 static void local_features_callback(const void *data, uint8_t size,
@@ -188,21 +319,10 @@ static void hci_generic_callback(const void *data, uint8_t size,
 
 static void configure_hci(struct mesh_io_private *io)
 {
-	struct bt_hci_cmd_le_set_scan_parameters cmd;
 	struct bt_hci_cmd_set_event_mask cmd_sem;
 	struct bt_hci_cmd_le_set_event_mask cmd_slem;
 	struct bt_hci_cmd_le_set_random_address cmd_raddr;
 
-	/* Set scan parameters */
-	cmd.type = 0x00; /* Passive Scanning. No scanning PDUs shall be sent */
-	cmd.interval = 0x0030; /* Scan Interval = N * 0.625ms */
-	cmd.window = 0x0030; /* Scan Window = N * 0.625ms */
-	cmd.own_addr_type = 0x00; /* Public Device Address */
-	/* Accept all advertising packets except directed advertising packets
-	 * not addressed to this device (default).
-	 */
-	cmd.filter_policy = 0x00;
-
 	/* Set event mask
 	 *
 	 * Mask: 0x2000800002008890
@@ -255,7 +375,7 @@ static void configure_hci(struct mesh_io_private *io)
 
 	/* Read local supported commands */
 	bt_hci_send(io->hci, BT_HCI_CMD_READ_LOCAL_COMMANDS, NULL, 0,
-					local_commands_callback, NULL, NULL);
+					local_commands_callback, io, NULL);
 
 	/* Read local supported features */
 	bt_hci_send(io->hci, BT_HCI_CMD_READ_LOCAL_FEATURES, NULL, 0,
@@ -273,9 +393,7 @@ static void configure_hci(struct mesh_io_private *io)
 	bt_hci_send(io->hci, BT_HCI_CMD_LE_SET_RANDOM_ADDRESS, &cmd_raddr,
 			sizeof(cmd_raddr), hci_generic_callback, NULL, NULL);
 
-	/* Scan Params */
-	bt_hci_send(io->hci, BT_HCI_CMD_LE_SET_SCAN_PARAMETERS, &cmd,
-				sizeof(cmd), hci_generic_callback, NULL, NULL);
+	/* Scan parameters are set once the advertising backend is known */
 }
 
 static void scan_enable_rsp(const void *buf, uint8_t size,
@@ -287,16 +405,50 @@ static void scan_enable_rsp(const void *buf, uint8_t size,
 		l_error("LE Scan enable failed (0x%02x)", status);
 }
 
-static void set_recv_scan_enable(const void *buf, uint8_t size,
-							void *user_data)
+static void send_scan_enable(struct mesh_io_private *pvt, bool enable,
+						bt_hci_callback_func_t cb)
 {
-	struct mesh_io_private *pvt = user_data;
+	struct bt_hci_cmd_le_set_ext_scan_enable ext_cmd;
 	struct bt_hci_cmd_le_set_scan_enable cmd;
 
-	cmd.enable = 0x01;	/* Enable scanning */
+	if (pvt->ext_adv) {
+		memset(&ext_cmd, 0, sizeof(ext_cmd));
+		ext_cmd.enable = enable;
+		ext_cmd.filter_dup = 0x00;	/* Report duplicates */
+		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_SCAN_ENABLE,
+				&ext_cmd, sizeof(ext_cmd), cb, pvt, NULL);
+		return;
+	}
+
+	cmd.enable = enable;
 	cmd.filter_dup = 0x00;	/* Report duplicates */
 	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-			&cmd, sizeof(cmd), scan_enable_rsp, pvt, NULL);
+				&cmd, sizeof(cmd), cb, pvt, NULL);
+}
+
+static void set_recv_scan_enable(const void *buf, uint8_t size,
+							void *user_data)
+{
+	send_scan_enable(user_data, true, scan_enable_rsp);
+}
+
+static void set_ext_scan_params(struct mesh_io_private *pvt)
+{
+	uint8_t buf[sizeof(struct bt_hci_cmd_le_set_ext_scan_params) +
+					sizeof(struct bt_hci_le_scan_phy)];
+	struct bt_hci_cmd_le_set_ext_scan_params *cmd = (void *) buf;
+	struct bt_hci_le_scan_phy *phy = (void *) cmd->data;
+
+	cmd->own_addr_type = 0x01;		/* ADDR_TYPE_RANDOM */
+	cmd->filter_policy = 0x00;		/* Accept all */
+	cmd->num_phys = 0x01;			/* LE 1M */
+	phy->type = pvt->active ? 0x01 : 0x00;	/* Passive/Active scanning */
+	phy->interval = L_CPU_TO_LE16(0x0010);	/* 10 ms */
+	phy->window = L_CPU_TO_LE16(0x0010);	/* 10 ms */
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_SCAN_PARAMS,
+			buf, sizeof(buf),
+			set_recv_scan_enable, pvt, NULL);
 }
 
 static void scan_disable_rsp(const void *buf, uint8_t size,
@@ -309,6 +461,11 @@ static void scan_disable_rsp(const void *buf, uint8_t size,
 	if (status)
 		l_error("LE Scan disable failed (0x%02x)", status);
 
+	if (pvt->ext_adv) {
+		set_ext_scan_params(pvt);
+		return;
+	}
+
 	cmd.type = pvt->active ? 0x01 : 0x00;	/* Passive/Active scanning */
 	cmd.interval = L_CPU_TO_LE16(0x0010);	/* 10 ms */
 	cmd.window = L_CPU_TO_LE16(0x0010);	/* 10 ms */
@@ -360,16 +517,11 @@ static bool find_active(const void *a, const void *b)
 
 static void restart_scan(struct mesh_io_private *pvt)
 {
-	struct bt_hci_cmd_le_set_scan_enable cmd;
-
 	if (l_queue_isempty(pvt->io->rx_regs))
 		return;
 
 	pvt->active = l_queue_find(pvt->io->rx_regs, find_active, NULL);
-	cmd.enable = 0x00;	/* Disable scanning */
-	cmd.filter_dup = 0x00;	/* Report duplicates */
-	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-				&cmd, sizeof(cmd), scan_disable_rsp, pvt, NULL);
+	send_scan_enable(pvt, false, scan_disable_rsp);
 }
 
 static void hci_init(void *user_data)
@@ -390,19 +542,19 @@ static void hci_init(void *user_data)
 		result = false;
 	}
 
-	if (result) {
-		configure_hci(io->pvt);
+	if (!result) {
+		if (io->ready)
+			io->ready(io->user_data, false);
 
-		bt_hci_register(io->pvt->hci, BT_HCI_EVT_LE_META_EVENT,
-						event_callback, io, NULL);
-
-		l_debug("Started mesh on hci %u", io->index);
-
-		restart_scan(io->pvt);
+		return;
 	}
 
-	if (io->ready)
-		io->ready(io->user_data, result);
+	io->pvt->meta_id = bt_hci_register(io->pvt->hci,
+						BT_HCI_EVT_LE_META_EVENT,
+						event_callback, io, NULL);
+
+	/* Scanning is started and readiness reported in hci_ready() */
+	configure_hci(io->pvt);
 }
 
 static bool dev_init(struct mesh_io *io, void *opts, void *user_data)
@@ -421,13 +573,93 @@ static bool dev_init(struct mesh_io *io, void *opts, void *user_data)
 	return true;
 }
 
+static void tx_stats_report(struct mesh_io_private *pvt)
+{
+	struct tx_stats *stats = &pvt->stats;
+
+	if (!stats->count)
+		return;
+
+	l_debug("TX queue latency: %u pkts, avg %" PRIu64 " us, "
+				"max %" PRIu64 " us, max queued %u, "
+				"max busy %u/%u", stats->count,
+				stats->total_us / stats->count, stats->max_us,
+				stats->max_queued, stats->max_busy,
+				pvt->ext_adv ? pvt->num_sets : 1);
+
+	memset(stats, 0, sizeof(*stats));
+}
+
+/* Account for the time a packet waited before its first transmission */
+static void tx_stats_update(struct mesh_io_private *pvt, struct tx_pkt *tx,
+							unsigned int busy)
+{
+	struct tx_stats *stats = &pvt->stats;
+	unsigned int queued;
+	uint64_t latency;
+
+	if (!tx->queued)
+		return;
+
+	latency = l_time_diff(tx->queued, l_time_now());
+	tx->queued = 0;
+
+	stats->count++;
+	stats->total_us += latency;
+
+	if (latency > stats->max_us)
+		stats->max_us = latency;
+
+	queued = l_queue_length(pvt->tx_pkts);
+	if (queued > stats->max_queued)
+		stats->max_queued = queued;
+
+	if (busy > stats->max_busy)
+		stats->max_busy = busy;
+
+	if (stats->count >= TX_STATS_COUNT)
+		tx_stats_report(pvt);
+}
+
+/*
+ * Stop and remove the advertising sets so that they do not outlive the
+ * daemon. The last command holds a reference to the HCI so that both get
+ * sent after dev_destroy() has released its own.
+ */
+static void ext_adv_teardown(struct mesh_io_private *pvt)
+{
+	struct bt_hci_cmd_le_set_ext_adv_enable cmd;
+
+	/* Drop events and pending commands referring to the sets */
+	bt_hci_unregister(pvt->hci, pvt->meta_id);
+	bt_hci_flush(pvt->hci);
+
+	/* Disabling with no sets listed disables all of them */
+	memset(&cmd, 0, sizeof(cmd));
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE,
+					&cmd, sizeof(cmd), NULL, NULL, NULL);
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_CLEAR_ADV_SETS, NULL, 0,
+				NULL, bt_hci_ref(pvt->hci),
+				(bt_hci_destroy_func_t) bt_hci_unref);
+}
+
 static bool dev_destroy(struct mesh_io *io)
 {
 	struct mesh_io_private *pvt = io->pvt;
+	int i;
 
 	if (!pvt)
 		return true;
 
+	tx_stats_report(pvt);
+
+	if (pvt->ext_adv)
+		ext_adv_teardown(pvt);
+
+	for (i = 0; i < pvt->num_sets; i++)
+		l_free(pvt->sets[i].tx);
+
 	bt_hci_unref(pvt->hci);
 	l_timeout_remove(pvt->tx_timeout);
 	l_queue_remove_if(pvt->tx_pkts, simple_match, pvt->tx);
@@ -574,6 +806,8 @@ static void send_pkt(struct mesh_io_private *pvt, struct tx_pkt *tx,
 	pvt->tx = tx;
 	pvt->interval = interval;
 
+	tx_stats_update(pvt, tx, 1);
+
 	if (!pvt->sending) {
 		set_send_adv_params(NULL, 0, pvt);
 		return;
@@ -635,51 +869,415 @@ static void tx_to(struct l_timeout *timeout, void *user_data)
 		pvt->tx_timeout = l_timeout_create_ms(ms, tx_to, pvt, NULL);
 }
 
-static void tx_worker(void *user_data)
+static bool tx_delay(struct tx_pkt *tx, uint32_t *delay)
 {
-	struct mesh_io_private *pvt = user_data;
-	struct tx_pkt *tx;
-	uint32_t delay;
-
-	tx = l_queue_peek_head(pvt->tx_pkts);
-	if (!tx)
-		return;
-
 	switch (tx->info.type) {
 	case MESH_IO_TIMING_TYPE_GENERAL:
 		if (tx->info.u.gen.min_delay == tx->info.u.gen.max_delay)
-			delay = tx->info.u.gen.min_delay;
+			*delay = tx->info.u.gen.min_delay;
 		else {
-			l_getrandom(&delay, sizeof(delay));
-			delay %= tx->info.u.gen.max_delay -
+			l_getrandom(delay, sizeof(*delay));
+			*delay %= tx->info.u.gen.max_delay -
 						tx->info.u.gen.min_delay;
-			delay += tx->info.u.gen.min_delay;
+			*delay += tx->info.u.gen.min_delay;
 		}
 		break;
 
 	case MESH_IO_TIMING_TYPE_POLL:
 		if (tx->info.u.poll.min_delay == tx->info.u.poll.max_delay)
-			delay = tx->info.u.poll.min_delay;
+			*delay = tx->info.u.poll.min_delay;
 		else {
-			l_getrandom(&delay, sizeof(delay));
-			delay %= tx->info.u.poll.max_delay -
+			l_getrandom(delay, sizeof(*delay));
+			*delay %= tx->info.u.poll.max_delay -
 						tx->info.u.poll.min_delay;
-			delay += tx->info.u.poll.min_delay;
+			*delay += tx->info.u.poll.min_delay;
 		}
 		break;
 
 	case MESH_IO_TIMING_TYPE_POLL_RSP:
 		/* Delay until Instant + Delay */
-		delay = instant_remaining_ms(tx->info.u.poll_rsp.instant +
+		*delay = instant_remaining_ms(tx->info.u.poll_rsp.instant +
 						tx->info.u.poll_rsp.delay);
-		if (delay > 255)
-			delay = 0;
+		if (*delay > 255)
+			*delay = 0;
 		break;
 
 	default:
+		return false;
+	}
+
+	return true;
+}
+
+static uint16_t tx_interval(struct tx_pkt *tx)
+{
+	if (tx->info.type == MESH_IO_TIMING_TYPE_GENERAL)
+		return tx->info.u.gen.interval;
+
+	return 25;
+}
+
+static void ext_adv_set_addr(struct adv_set *set)
+{
+	struct bt_hci_cmd_le_set_adv_set_rand_addr cmd;
+
+	cmd.handle = set->handle;
+	l_getrandom(cmd.bdaddr, 6);
+	cmd.bdaddr[5] |= 0xc0;
+
+	bt_hci_send(set->pvt->hci, BT_HCI_CMD_LE_SET_ADV_SET_RAND_ADDR,
+				&cmd, sizeof(cmd), NULL, NULL, NULL);
+}
+
+static void ext_adv_params(struct adv_set *set, uint16_t interval,
+						bt_hci_callback_func_t cb)
+{
+	struct bt_hci_cmd_le_set_ext_adv_params cmd;
+	uint32_t hci_interval;
+
+	/* Non-connectable advertising can not be faster than 20 ms */
+	hci_interval = L_MAX((interval * 16) / 10, 0x20);
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.handle = set->handle;
+	cmd.evt_properties = L_CPU_TO_LE16(0x0010); /* ADV_NONCONN_IND */
+	cmd.min_interval[0] = hci_interval;
+	cmd.min_interval[1] = hci_interval >> 8;
+	cmd.min_interval[2] = hci_interval >> 16;
+	memcpy(cmd.max_interval, cmd.min_interval, 3);
+	cmd.channel_map = 0x07;
+	cmd.own_addr_type = 0x01; /* ADDR_TYPE_RANDOM */
+	cmd.filter_policy = 0x03;
+	cmd.tx_power = 0x7f; /* No preference */
+	cmd.primary_phy = 0x01; /* LE 1M */
+	cmd.secondary_phy = 0x01; /* LE 1M */
+
+	set->interval = interval;
+
+	bt_hci_send(set->pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_PARAMS,
+				&cmd, sizeof(cmd), cb, set, NULL);
+}
+
+static void ext_adv_setup(struct mesh_io_private *pvt)
+{
+	struct bt_hci_cmd_le_set_event_mask cmd_slem;
+	int i;
+
+	/*
+	 * Same LE events as configure_hci(), plus
+	 *   LE Extended Advertising Report
+	 *   LE Advertising Set Terminated
+	 */
+	memset(&cmd_slem, 0, sizeof(cmd_slem));
+	cmd_slem.mask[0] = 0x7f;
+	cmd_slem.mask[1] = 0x18;
+	cmd_slem.mask[2] = 0x02;
+
+	bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EVENT_MASK, &cmd_slem,
+			sizeof(cmd_slem), hci_generic_callback, NULL, NULL);
+
+	for (i = 0; i < pvt->num_sets; i++) {
+		struct adv_set *set = &pvt->sets[i];
+
+		set->pvt = pvt;
+		set->handle = i;
+		ext_adv_set_addr(set);
+		ext_adv_params(set, EXT_ADV_INTERVAL, NULL);
+	}
+
+	pvt->ext_adv = true;
+}
+
+static unsigned int ext_adv_busy(struct mesh_io_private *pvt)
+{
+	unsigned int busy = 0;
+	int i;
+
+	for (i = 0; i < pvt->num_sets; i++) {
+		if (pvt->sets[i].tx || pvt->sets[i].disabling)
+			busy++;
+	}
+
+	return busy;
+}
+
+static struct adv_set *ext_adv_find_set(struct mesh_io_private *pvt,
+							uint16_t interval)
+{
+	struct adv_set *found = NULL;
+	int i;
+
+	/* Prefer an idle set that needs no reconfiguration */
+	for (i = 0; i < pvt->num_sets; i++) {
+		struct adv_set *set = &pvt->sets[i];
+
+		if (set->tx || set->disabling)
+			continue;
+
+		if (set->interval == interval)
+			return set;
+
+		if (!found)
+			found = set;
+	}
+
+	return found;
+}
+
+static void ext_tx_schedule(struct mesh_io_private *pvt);
+
+/* Set is idle again: requeue the packet if it has more to send */
+static void ext_adv_done(struct adv_set *set)
+{
+	struct mesh_io_private *pvt = set->pvt;
+	struct tx_pkt *tx = set->tx;
+	bool requeue = false;
+
+	set->tx = NULL;
+
+	if (tx && !tx->delete &&
+			tx->info.type == MESH_IO_TIMING_TYPE_GENERAL) {
+		if (tx->info.u.gen.cnt == MESH_IO_TX_COUNT_UNLIMITED)
+			requeue = true;
+		else if (tx->info.u.gen.cnt > set->events) {
+			tx->info.u.gen.cnt -= set->events;
+			requeue = true;
+		}
+	}
+
+	if (requeue) {
+		tx->ready = get_instant();
+		l_queue_push_tail(pvt->tx_pkts, tx);
+	} else
+		l_free(tx);
+
+	/* At end of any burst of ADVs, change random address */
+	if (l_queue_isempty(pvt->tx_pkts))
+		ext_adv_set_addr(set);
+
+	ext_tx_schedule(pvt);
+}
+
+static void ext_adv_enabled(const void *buf, uint8_t size, void *user_data)
+{
+	struct adv_set *set = user_data;
+	uint8_t status = l_get_u8(buf);
+
+	if (!status || set->disabling || !set->tx)
+		return;
+
+	l_error("LE Ext Adv enable failed (0x%02x)", status);
+	set->tx->delete = true;
+	ext_adv_done(set);
+}
+
+static void ext_adv_enable(const void *buf, uint8_t size, void *user_data)
+{
+	uint8_t data[sizeof(struct bt_hci_cmd_le_set_ext_adv_enable) +
+					sizeof(struct bt_hci_cmd_ext_adv_set)];
+	struct bt_hci_cmd_le_set_ext_adv_enable *cmd = (void *) data;
+	struct bt_hci_cmd_ext_adv_set *adv_set = (void *) (cmd + 1);
+	struct adv_set *set = user_data;
+	uint8_t status = l_get_u8(buf);
+
+	if (set->disabling || !set->tx)
+		return;
+
+	if (status) {
+		l_error("LE Ext Adv data failed (0x%02x)", status);
+		set->tx->delete = true;
+		ext_adv_done(set);
+		return;
+	}
+
+	cmd->enable = 0x01;
+	cmd->num_of_sets = 1;
+	adv_set->handle = set->handle;
+	adv_set->duration = 0;
+	adv_set->max_events = set->events;
+
+	bt_hci_send(set->pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE,
+				data, sizeof(data), ext_adv_enabled, set, NULL);
+}
+
+static void ext_adv_set_data(const void *buf, uint8_t size, void *user_data)
+{
+	uint8_t data[sizeof(struct bt_hci_cmd_le_set_ext_adv_data) + 31];
+	struct bt_hci_cmd_le_set_ext_adv_data *cmd = (void *) data;
+	struct adv_set *set = user_data;
+	struct tx_pkt *tx = set->tx;
+
+	if (set->disabling || !tx)
+		return;
+
+	/* Parameters were updated first */
+	if (buf && l_get_u8(buf)) {
+		l_error("LE Ext Adv params failed (0x%02x)", l_get_u8(buf));
+		set->interval = 0;
+		tx->delete = true;
+		ext_adv_done(set);
+		return;
+	}
+
+	if (tx->len >= 31) {
+		tx->delete = true;
+		ext_adv_done(set);
 		return;
 	}
 
+	cmd->handle = set->handle;
+	cmd->operation = 0x03; /* Complete data */
+	cmd->fragment_preference = 0x01; /* No fragmentation */
+	cmd->data_len = tx->len + 1;
+	cmd->data[0] = tx->len;
+	memcpy(cmd->data + 1, tx->pkt, tx->len);
+
+	bt_hci_send(set->pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_DATA,
+				data, sizeof(*cmd) + cmd->data_len,
+				ext_adv_enable, set, NULL);
+}
+
+static void ext_adv_start(struct adv_set *set, struct tx_pkt *tx)
+{
+	struct mesh_io_private *pvt = set->pvt;
+	uint16_t interval = tx_interval(tx);
+
+	/* Let the controller do the retransmissions */
+	if (tx->info.type != MESH_IO_TIMING_TYPE_GENERAL)
+		set->events = 1;
+	else if (tx->info.u.gen.cnt == MESH_IO_TX_COUNT_UNLIMITED)
+		set->events = EXT_ADV_BURST;
+	else
+		set->events = tx->info.u.gen.cnt;
+
+	set->tx = tx;
+
+	tx_stats_update(pvt, tx, ext_adv_busy(pvt));
+
+	if (set->interval != interval)
+		ext_adv_params(set, interval, ext_adv_set_data);
+	else
+		ext_adv_set_data(NULL, 0, set);
+}
+
+static void ext_adv_disabled(const void *buf, uint8_t size, void *user_data)
+{
+	struct adv_set *set = user_data;
+
+	set->disabling = false;
+	ext_adv_done(set);
+}
+
+static void ext_adv_cancel(struct mesh_io_private *pvt,
+					l_queue_match_func_t match,
+					const void *match_data)
+{
+	uint8_t data[sizeof(struct bt_hci_cmd_le_set_ext_adv_enable) +
+					sizeof(struct bt_hci_cmd_ext_adv_set)];
+	struct bt_hci_cmd_le_set_ext_adv_enable *cmd = (void *) data;
+	struct bt_hci_cmd_ext_adv_set *adv_set = (void *) (cmd + 1);
+	int i;
+
+	for (i = 0; i < pvt->num_sets; i++) {
+		struct adv_set *set = &pvt->sets[i];
+
+		if (!set->tx || set->disabling || !match(set->tx, match_data))
+			continue;
+
+		set->tx->delete = true;
+		set->disabling = true;
+
+		memset(data, 0, sizeof(data));
+		cmd->enable = 0x00;
+		cmd->num_of_sets = 1;
+		adv_set->handle = set->handle;
+
+		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_EXT_ADV_ENABLE,
+				data, sizeof(data), ext_adv_disabled, set, NULL);
+	}
+}
+
+static void event_adv_set_term(struct mesh_io *io, const void *buf,
+								uint8_t size)
+{
+	const struct bt_hci_evt_le_adv_set_term *evt = buf;
+	struct mesh_io_private *pvt = io->pvt;
+	struct adv_set *set;
+
+	if (!pvt || size < sizeof(*evt) || evt->handle >= pvt->num_sets)
+		return;
+
+	set = &pvt->sets[evt->handle];
+
+	/* A pending disable completes the set instead */
+	if (set->disabling)
+		return;
+
+	ext_adv_done(set);
+}
+
+static void ext_tx_to(struct l_timeout *timeout, void *user_data)
+{
+	ext_tx_schedule(user_data);
+}
+
+/* Hand every packet that is due to an idle advertising set */
+static void ext_tx_schedule(struct mesh_io_private *pvt)
+{
+	const struct l_queue_entry *entry, *next;
+	uint32_t now = get_instant();
+	int32_t wait = -1;
+
+	for (entry = l_queue_get_entries(pvt->tx_pkts); entry; entry = next) {
+		struct tx_pkt *tx = entry->data;
+		int32_t remaining = (int32_t) (tx->ready - now);
+		struct adv_set *set;
+
+		next = entry->next;
+
+		if (remaining > 0) {
+			if (wait < 0 || remaining < wait)
+				wait = remaining;
+
+			continue;
+		}
+
+		set = ext_adv_find_set(pvt, tx_interval(tx));
+		if (!set)
+			break;
+
+		l_queue_remove(pvt->tx_pkts, tx);
+		ext_adv_start(set, tx);
+	}
+
+	if (wait < 0)
+		return;
+
+	if (pvt->tx_timeout)
+		l_timeout_modify_ms(pvt->tx_timeout, wait);
+	else
+		pvt->tx_timeout = l_timeout_create_ms(wait, ext_tx_to,
+								pvt, NULL);
+}
+
+static void tx_worker(void *user_data)
+{
+	struct mesh_io_private *pvt = user_data;
+	struct tx_pkt *tx;
+	uint32_t delay;
+
+	if (pvt->ext_adv) {
+		ext_tx_schedule(pvt);
+		return;
+	}
+
+	tx = l_queue_peek_head(pvt->tx_pkts);
+	if (!tx)
+		return;
+
+	if (!tx_delay(tx, &delay))
+		return;
+
 	if (!delay)
 		tx_to(pvt->tx_timeout, pvt);
 	else if (pvt->tx_timeout)
@@ -702,6 +1300,22 @@ static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 	memcpy(&tx->info, info, sizeof(tx->info));
 	memcpy(&tx->pkt, data, len);
 	tx->len = len;
+	tx->queued = l_time_now();
+
+	if (pvt->ext_adv) {
+		uint32_t delay = 0;
+
+		tx_delay(tx, &delay);
+		tx->ready = get_instant() + delay;
+
+		if (info->type == MESH_IO_TIMING_TYPE_POLL_RSP)
+			l_queue_push_head(pvt->tx_pkts, tx);
+		else
+			l_queue_push_tail(pvt->tx_pkts, tx);
+
+		ext_tx_schedule(pvt);
+		return true;
+	}
 
 	if (info->type == MESH_IO_TIMING_TYPE_POLL_RSP)
 		l_queue_push_head(pvt->tx_pkts, tx);
@@ -764,6 +1378,22 @@ static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
 		} while (tx);
 	}
 
+	if (pvt->ext_adv) {
+		if (len == 1)
+			ext_adv_cancel(pvt, find_by_ad_type,
+						L_UINT_TO_PTR(data[0]));
+		else {
+			struct tx_pattern pattern = {
+				.data = data,
+				.len = len
+			};
+
+			ext_adv_cancel(pvt, find_by_pattern, &pattern);
+		}
+
+		return true;
+	}
+
 	if (l_queue_isempty(pvt->tx_pkts)) {
 		send_cancel(pvt);
 		l_timeout_remove(pvt->tx_timeout);
@@ -776,7 +1406,6 @@ static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
 static bool recv_register(struct mesh_io *io, const uint8_t *filter,
 			uint8_t len, mesh_io_recv_func_t cb, void *user_data)
 {
-	struct bt_hci_cmd_le_set_scan_enable cmd;
 	struct mesh_io_private *pvt = io->pvt;
 	bool already_scanning;
 	bool active = false;
@@ -789,11 +1418,7 @@ static bool recv_register(struct mesh_io *io, const uint8_t *filter,
 
 	if (!already_scanning || pvt->active != active) {
 		pvt->active = active;
-		cmd.enable = 0x00;	/* Disable scanning */
-		cmd.filter_dup = 0x00;	/* Report duplicates */
-		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-				&cmd, sizeof(cmd), scan_disable_rsp, pvt, NULL);
-
+		send_scan_enable(pvt, false, scan_disable_rsp);
 	}
 
 	return true;
@@ -802,7 +1427,6 @@ static bool recv_register(struct mesh_io *io, const uint8_t *filter,
 static bool recv_deregister(struct mesh_io *io, const uint8_t *filter,
 								uint8_t len)
 {
-	struct bt_hci_cmd_le_set_scan_enable cmd = {0, 0};
 	struct mesh_io_private *pvt = io->pvt;
 	bool active = false;
 
@@ -811,13 +1435,11 @@ static bool recv_deregister(struct mesh_io *io, const uint8_t *filter,
 		active = true;
 
 	if (l_queue_isempty(io->rx_regs)) {
-		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-					&cmd, sizeof(cmd), NULL, NULL, NULL);
+		send_scan_enable(pvt, false, NULL);
 
 	} else if (active != pvt->active) {
 		pvt->active = active;
-		bt_hci_send(pvt->hci, BT_HCI_CMD_LE_SET_SCAN_ENABLE,
-				&cmd, sizeof(cmd), scan_disable_rsp, pvt, NULL);
+		send_scan_enable(pvt, false, scan_disable_rsp);
 	}
 
 	return true;
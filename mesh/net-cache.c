@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright 2024 NXP
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <ell/ell.h>
+
+#include "mesh/net-cache.h"
+
+/*
+ * Network message cache: a ring of the most recently seen (src, seq, mic)
+ * tuples, indexed by a chained hash table so that duplicate detection
+ * does not depend on the number of cached messages.
+ */
+
+#define NO_ENTRY	-1
+
+struct cache_entry {
+	uint32_t seq;
+	uint32_t mic;
+	uint16_t src;
+	int16_t next;
+};
+
+struct net_cache {
+	struct cache_entry *entries;
+	int16_t *buckets;
+	uint16_t size;
+	uint16_t mask;
+	uint16_t head;
+	uint16_t count;
+};
+
+static uint16_t cache_hash(const struct net_cache *cache, uint16_t src,
+						uint32_t seq, uint32_t mic)
+{
+	uint32_t hash = (seq ^ mic ^ ((uint32_t) src << 8)) * 0x9e3779b1;
+
+	return (hash >> 16) & cache->mask;
+}
+
+struct net_cache *net_cache_new(uint16_t size)
+{
+	struct net_cache *cache;
+	uint16_t buckets = 1;
+
+	if (!size || size > INT16_MAX)
+		return NULL;
+
+	/* Keep the load factor below 1/2 */
+	while (buckets < size * 2)
+		buckets <<= 1;
+
+	cache = l_new(struct net_cache, 1);
+	cache->entries = l_new(struct cache_entry, size);
+	cache->buckets = l_new(int16_t, buckets);
+	cache->size = size;
+	cache->mask = buckets - 1;
+
+	memset(cache->buckets, 0xff, buckets * sizeof(int16_t));
+
+	return cache;
+}
+
+void net_cache_free(struct net_cache *cache)
+{
+	if (!cache)
+		return;
+
+	l_free(cache->entries);
+	l_free(cache->buckets);
+	l_free(cache);
+}
+
+void net_cache_clear(struct net_cache *cache)
+{
+	if (!cache)
+		return;
+
+	memset(cache->buckets, 0xff, (cache->mask + 1) * sizeof(int16_t));
+	cache->head = 0;
+	cache->count = 0;
+}
+
+static void cache_unlink(struct net_cache *cache, int16_t idx)
+{
+	struct cache_entry *entry = &cache->entries[idx];
+	int16_t *link;
+
+	link = &cache->buckets[cache_hash(cache, entry->src, entry->seq,
+								entry->mic)];
+
+	while (*link != idx && *link != NO_ENTRY)
+		link = &cache->entries[*link].next;
+
+	if (*link == idx)
+		*link = entry->next;
+}
+
+/*
+ * Returns true if the message has already been seen. Otherwise the
+ * message is added to the cache, replacing the oldest entry if full.
+ */
+bool net_cache_check(struct net_cache *cache, uint16_t src, uint32_t seq,
+								uint32_t mic)
+{
+	struct cache_entry *entry;
+	uint16_t bucket;
+	int16_t idx;
+
+	bucket = cache_hash(cache, src, seq, mic);
+
+	for (idx = cache->buckets[bucket]; idx != NO_ENTRY;
+					idx = cache->entries[idx].next) {
+		entry = &cache->entries[idx];
+
+		if (entry->seq == seq && entry->mic == mic &&
+							entry->src == src)
+			return true;
+	}
+
+	idx = cache->head;
+
+	if (cache->count == cache->size)
+		cache_unlink(cache, idx);
+	else
+		cache->count++;
+
+	entry = &cache->entries[idx];
+	entry->src = src;
+	entry->seq = seq;
+	entry->mic = mic;
+	entry->next = cache->buckets[bucket];
+	cache->buckets[bucket] = idx;
+
+	cache->head = (idx + 1) % cache->size;
+
+	return false;
+}
@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright 2024 NXP
+ *
+ *
+ */
+
+struct net_cache;
+
+struct net_cache *net_cache_new(uint16_t size);
+void net_cache_free(struct net_cache *cache);
+void net_cache_clear(struct net_cache *cache);
+bool net_cache_check(struct net_cache *cache, uint16_t src, uint32_t seq,
+								uint32_t mic);
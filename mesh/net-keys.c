@@ -27,6 +27,15 @@
 /* This allows daemon to skip decryption on recently seen beacons */
 #define BEACON_CACHE_MAX	10
 
+/*
+ * Number of recently received network PDUs whose decryption result is
+ * kept, so that relayed duplicates and copies heard on several bearers
+ * or by several local nodes are decrypted only once.
+ */
+#define DECRYPT_CACHE_MAX	8
+
+#define NID_MASK		0x7f
+
 struct beacon_rx {
 	uint8_t data[28];
 	uint32_t id;
@@ -67,17 +76,27 @@ struct net_key {
 	bool ivu;
 };
 
+struct decrypt_cache {
+	uint8_t pkt[29];
+	uint8_t plain[29];
+	size_t len;
+	size_t plainlen;
+	uint32_t hash;
+	uint32_t id;
+	uint32_t iv_index;
+	uint32_t age;
+};
+
 static struct l_queue *beacons;
 static struct l_queue *keys;
 static uint32_t last_flooding_id;
 
+/* Keys grouped by NID, so that only candidate keys are tried on receive */
+static struct l_queue *nid_keys[NID_MASK + 1];
+
 /* To avoid re-decrypting same packet for multiple nodes, cache and check */
-static uint8_t cache_pkt[29];
-static uint8_t cache_plain[29];
-static size_t cache_len;
-static size_t cache_plainlen;
-static uint32_t cache_id;
-static uint32_t cache_iv_index;
+static struct decrypt_cache decrypt_cache[DECRYPT_CACHE_MAX];
+static uint32_t decrypt_age;
 
 static bool match_flooding(const void *a, const void *b)
 {
@@ -102,6 +121,43 @@ static bool match_network(const void *a, const void *b)
 	return memcmp(key->net_id, net_id, sizeof(key->net_id)) == 0;
 }
 
+static void nid_index_add(struct net_key *key)
+{
+	if (!nid_keys[key->nid])
+		nid_keys[key->nid] = l_queue_new();
+
+	/* Friendship credentials are tried first, as in the key list */
+	if (key->friend_key)
+		l_queue_push_head(nid_keys[key->nid], key);
+	else
+		l_queue_push_tail(nid_keys[key->nid], key);
+}
+
+static void nid_index_remove(struct net_key *key)
+{
+	l_queue_remove(nid_keys[key->nid], key);
+
+	if (l_queue_isempty(nid_keys[key->nid])) {
+		l_queue_destroy(nid_keys[key->nid], NULL);
+		nid_keys[key->nid] = NULL;
+	}
+}
+
+/*
+ * Drop cached results that are no longer valid: packets decrypted with
+ * a removed key, or packets that no key could decrypt when a new key
+ * shows up.
+ */
+static void decrypt_cache_invalidate(uint32_t id)
+{
+	int i;
+
+	for (i = 0; i < DECRYPT_CACHE_MAX; i++) {
+		if (decrypt_cache[i].id == id)
+			decrypt_cache[i].len = 0;
+	}
+}
+
 /* Key added from Provisioning, NetKey Add or NetKey update */
 uint32_t net_key_add(const uint8_t flooding[16])
 {
@@ -143,6 +199,8 @@ uint32_t net_key_add(const uint8_t flooding[16])
 
 	key->id = ++last_flooding_id;
 	l_queue_push_tail(keys, key);
+	nid_index_add(key);
+	decrypt_cache_invalidate(0);
 	return key->id;
 
 fail:
@@ -181,6 +239,8 @@ uint32_t net_key_frnd_add(uint32_t flooding_id, uint16_t lpn, uint16_t frnd,
 	frnd_key->ref_cnt++;
 	frnd_key->id = ++last_flooding_id;
 	l_queue_push_head(keys, frnd_key);
+	nid_index_add(frnd_key);
+	decrypt_cache_invalidate(0);
 
 	return frnd_key->id;
 }
@@ -193,6 +253,8 @@ void net_key_unref(uint32_t id)
 		if (--key->ref_cnt == 0) {
 			l_timeout_remove(key->observe.timeout);
 			l_queue_remove(keys, key);
+			nid_index_remove(key);
+			decrypt_cache_invalidate(key->id);
 			l_free(key);
 		}
 	}
@@ -223,51 +285,101 @@ bool net_key_retrieve(uint32_t id, uint8_t *flooding)
 static void decrypt_net_pkt(void *a, void *b)
 {
 	const struct net_key *key = a;
+	struct decrypt_cache *entry = b;
 	bool result;
 
-	if (cache_id || !key->ref_cnt || (cache_pkt[0] & 0x7f) != key->nid)
+	if (entry->id || !key->ref_cnt)
 		return;
 
-	result = mesh_crypto_packet_decode(cache_pkt, cache_len, false,
-						cache_plain, cache_iv_index,
+	result = mesh_crypto_packet_decode(entry->pkt, entry->len, false,
+						entry->plain, entry->iv_index,
 						key->enc_key, key->prv_key);
 
 	if (result) {
-		cache_id = key->id;
-		if (cache_plain[1] & 0x80)
-			cache_plainlen = cache_len - 8;
+		entry->id = key->id;
+		if (entry->plain[1] & 0x80)
+			entry->plainlen = entry->len - 8;
 		else
-			cache_plainlen = cache_len - 4;
+			entry->plainlen = entry->len - 4;
 	}
 }
 
+static uint32_t pkt_hash(const uint8_t *pkt, size_t len)
+{
+	uint32_t hash = 2166136261U;
+
+	while (len--) {
+		hash ^= *pkt++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static struct decrypt_cache *decrypt_cache_lookup(uint32_t hash,
+						const uint8_t *pkt, size_t len)
+{
+	struct decrypt_cache *oldest = &decrypt_cache[0];
+	int i;
+
+	for (i = 0; i < DECRYPT_CACHE_MAX; i++) {
+		struct decrypt_cache *entry = &decrypt_cache[i];
+
+		if (entry->len == len && entry->hash == hash &&
+						!memcmp(entry->pkt, pkt, len))
+			return entry;
+
+		if (entry->age < oldest->age)
+			oldest = entry;
+	}
+
+	/* Not cached, hand out the least recently used slot */
+	oldest->len = 0;
+
+	return oldest;
+}
+
 uint32_t net_key_decrypt(uint32_t iv_index, const uint8_t *pkt, size_t len,
 					uint8_t **plain, size_t *plain_len)
 {
-	/* If we already successfully decrypted this packet, use cached data */
-	if (cache_id && cache_len == len && !memcmp(pkt, cache_pkt, len)) {
+	struct decrypt_cache *entry;
+	uint32_t hash;
+
+	if (!len || len > sizeof(entry->pkt))
+		return 0;
+
+	hash = pkt_hash(pkt, len);
+	entry = decrypt_cache_lookup(hash, pkt, len);
+	entry->age = ++decrypt_age;
+
+	/* If we already tried to decrypt this packet, use cached result */
+	if (entry->len) {
+		if (entry->iv_index == iv_index)
+			goto done;
+
 		/* IV Index must match what was used to decrypt */
-		if (cache_iv_index != iv_index)
+		if (entry->id)
 			return 0;
 
-		goto done;
+		/* No key matched with the other IV Index, retry with this one */
 	}
 
-	cache_id = 0;
-	memcpy(cache_pkt, pkt, len);
-	cache_len = len;
-	cache_iv_index = iv_index;
+	memcpy(entry->pkt, pkt, len);
+	entry->len = len;
+	entry->hash = hash;
+	entry->iv_index = iv_index;
+	entry->id = 0;
 
-	/* Try all network keys known to us */
-	l_queue_foreach(keys, decrypt_net_pkt, NULL);
+	/* Try the network keys that match the packet NID */
+	l_queue_foreach(nid_keys[pkt[0] & NID_MASK], decrypt_net_pkt, entry);
 
 done:
-	if (cache_id) {
-		*plain = cache_plain;
-		*plain_len = cache_plainlen;
+	if (entry->id) {
+		*plain = entry->plain;
+		*plain_len = entry->plainlen;
 	}
 
-	return cache_id;
+	return entry->id;
 }
 
 bool net_key_encrypt(uint32_t id, uint32_t iv_index, uint8_t *pkt, size_t len)
@@ -791,6 +903,15 @@ static void free_key(void *data)
 
 void net_key_cleanup(void)
 {
+	int i;
+
+	for (i = 0; i <= NID_MASK; i++) {
+		l_queue_destroy(nid_keys[i], NULL);
+		nid_keys[i] = NULL;
+	}
+
+	memset(decrypt_cache, 0, sizeof(decrypt_cache));
+
 	l_queue_destroy(keys, free_key);
 	keys = NULL;
 	l_queue_destroy(beacons, l_free);
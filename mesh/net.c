@@ -30,6 +30,7 @@
 #include "mesh/model.h"
 #include "mesh/appkey.h"
 #include "mesh/rpl.h"
+#include "mesh/net-cache.h"
 
 #define abs_diff(a, b) ((a) > (b) ? (a) - (b) : (b) - (a))
 
@@ -134,21 +135,16 @@ struct mesh_net {
 	uint16_t features;
 
 	struct l_queue *subnets;
-	struct l_queue *msg_cache;
+	struct net_cache *msg_cache;
 	struct l_queue *replay_cache;
 	struct l_queue *sar_in;
+	struct l_hashmap *sar_in_by_remote;
 	struct l_queue *sar_out;
 	struct l_queue *sar_queue;
 	struct l_queue *frnd_msgs;
 	struct l_queue *friends;
 	struct l_queue *negotiations;
-	struct l_queue *destinations;
-};
-
-struct mesh_msg {
-	uint16_t src;
-	uint32_t seq;
-	uint32_t mic;
+	struct l_hashmap *destinations;
 };
 
 struct mesh_sar {
@@ -642,12 +638,13 @@ struct mesh_net *mesh_net_new(struct mesh_node *node)
 	net->tx_interval = DEFAULT_TRANSMIT_INTERVAL;
 
 	net->subnets = l_queue_new();
-	net->msg_cache = l_queue_new();
+	net->msg_cache = net_cache_new(MSG_CACHE_SIZE);
 	net->sar_in = l_queue_new();
+	net->sar_in_by_remote = l_hashmap_new();
 	net->sar_out = l_queue_new();
 	net->sar_queue = l_queue_new();
 	net->frnd_msgs = l_queue_new();
-	net->destinations = l_queue_new();
+	net->destinations = l_hashmap_new();
 	net->app_keys = l_queue_new();
 	net->replay_cache = l_queue_new();
 
@@ -668,17 +665,19 @@ void mesh_net_free(void *user_data)
 		return;
 
 	l_queue_destroy(net->subnets, subnet_free);
-	l_queue_destroy(net->msg_cache, l_free);
+	net_cache_free(net->msg_cache);
 	l_queue_destroy(net->replay_cache, l_free);
+	l_hashmap_destroy(net->sar_in_by_remote, NULL);
 	l_queue_destroy(net->sar_in, mesh_sar_free);
 	l_queue_destroy(net->sar_out, mesh_sar_free);
 	l_queue_destroy(net->sar_queue, mesh_sar_free);
 	l_queue_destroy(net->frnd_msgs, l_free);
 	l_queue_destroy(net->friends, mesh_friend_free);
 	l_queue_destroy(net->negotiations, mesh_friend_free);
-	l_queue_destroy(net->destinations, l_free);
+	l_hashmap_destroy(net->destinations, l_free);
 	l_queue_destroy(net->app_keys, appkey_key_free);
 
+	rpl_release(net->node);
 	l_free(net);
 }
 
@@ -1033,50 +1032,15 @@ void mesh_net_set_frnd_seq(struct mesh_net *net, bool seq)
 	net->friend_seq = seq;
 }
 
-static bool match_cache(const void *a, const void *b)
-{
-	const struct mesh_msg *msg = a;
-	const struct mesh_msg *tst = b;
-
-	if (msg->seq != tst->seq || msg->mic != tst->mic ||
-					msg->src != tst->src)
-		return false;
-
-	return true;
-}
-
 static bool msg_in_cache(struct mesh_net *net, uint16_t src, uint32_t seq,
 								uint32_t mic)
 {
-	struct mesh_msg *msg;
-	struct mesh_msg tst = {
-		.src = src,
-		.seq = seq,
-		.mic = mic,
-	};
-
-	msg = l_queue_find(net->msg_cache, match_cache, &tst);
-
-	if (msg) {
+	if (net_cache_check(net->msg_cache, src, seq, mic)) {
 		l_debug("Supressing duplicate %4.4x + %6.6x + %8.8x",
 							src, seq, mic);
 		return true;
 	}
 
-	msg = l_new(struct mesh_msg, 1);
-	*msg = tst;
-	l_queue_push_head(net->msg_cache, msg);
-	l_debug("Add %4.4x + %6.6x + %8.8x", src, seq, mic);
-
-	if (l_queue_length(net->msg_cache) > MSG_CACHE_SIZE) {
-		msg = l_queue_peek_tail(net->msg_cache);
-		/* Remove Tail (oldest msg in cache) */
-		l_debug("Remove %4.4x + %6.6x + %8.8x",
-						msg->src, msg->seq, msg->mic);
-		if (l_queue_remove(net->msg_cache, msg))
-			l_free(msg);
-	}
-
 	return false;
 }
 
@@ -1112,14 +1076,6 @@ static bool match_seg_timeout(const void *a, const void *b)
 	return sar->seg_timeout == seg_timeout;
 }
 
-static bool match_dest_dst(const void *a, const void *b)
-{
-	const struct mesh_destination *dest = a;
-	uint16_t dst = L_PTR_TO_UINT(b);
-
-	return dst == dest->dst;
-}
-
 static bool match_frnd_dst(const void *a, const void *b)
 {
 	const struct mesh_friend *frnd = a;
@@ -1173,8 +1129,7 @@ static bool is_us(struct mesh_net *net, uint16_t addr, bool src)
 	if (addr >= net->src_addr && addr <= net->last_addr)
 		return true;
 
-	tst = l_queue_find(net->destinations, match_dest_dst,
-							L_UINT_TO_PTR(addr));
+	tst = l_hashmap_lookup(net->destinations, L_UINT_TO_PTR(addr));
 
 	if (tst == NULL && !src)
 		tst = l_queue_find(net->friends, match_frnd_dst,
@@ -1541,6 +1496,7 @@ static void inmsg_to(struct l_timeout *msg_timeout, void *user_data)
 		return;
 	}
 
+	l_hashmap_remove(net->sar_in_by_remote, L_UINT_TO_PTR(sar->remote));
 	l_queue_remove(net->sar_in, sar);
 	mesh_sar_free(sar);
 }
@@ -1965,8 +1921,7 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 	 * DST could receive additional Segments after
 	 * completing due to a lost ACK, so re-ACK and discard
 	 */
-	sar_in = l_queue_find(net->sar_in, match_sar_remote,
-						L_UINT_TO_PTR(src));
+	sar_in = l_hashmap_lookup(net->sar_in_by_remote, L_UINT_TO_PTR(src));
 
 	/* Discard *old* incoming-SAR-in-progress if this segment newer */
 	seqAuth = seq_auth(seq, seqZero);
@@ -1983,6 +1938,8 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 
 		if (newer) {
 			/* Cancel Old, start New */
+			l_hashmap_remove(net->sar_in_by_remote,
+							L_UINT_TO_PTR(src));
 			l_queue_remove(net->sar_in, sar_in);
 			mesh_sar_free(sar_in);
 			sar_in = NULL;
@@ -2029,6 +1986,8 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 
 		l_debug("First Seg %4.4x", sar_in->flags);
 		l_queue_push_head(net->sar_in, sar_in);
+		l_hashmap_insert(net->sar_in_by_remote, L_UINT_TO_PTR(src),
+								sar_in);
 	}
 
 	seg_off = segO * MAX_SEG_LEN;
@@ -2243,14 +2202,6 @@ static bool check_fast_cache(uint64_t hash)
 	return true;
 }
 
-static bool match_by_dst(const void *a, const void *b)
-{
-	const struct mesh_destination *dest = a;
-	uint16_t dst = L_PTR_TO_UINT(b);
-
-	return dest->dst == dst;
-}
-
 static void send_relay_pkt(struct mesh_net *net, uint8_t *data, uint8_t size)
 {
 	uint8_t packet[30];
@@ -2584,7 +2535,7 @@ static void iv_upd_to(struct l_timeout *upd_timeout, void *user_data)
 							net->iv_index, false);
 		l_queue_foreach(net->subnets, refresh_beacon, net);
 		queue_friend_update(net);
-		l_queue_clear(net->msg_cache, l_free);
+		net_cache_clear(net->msg_cache);
 		break;
 
 	case IV_UPD_INIT:
@@ -3074,7 +3025,7 @@ bool mesh_net_iv_index_update(struct mesh_net *net)
 		return false;
 
 	l_debug("iv_upd_state = IV_UPD_UPDATING");
-	l_queue_clear(net->msg_cache, l_free);
+	net_cache_clear(net->msg_cache);
 
 	if (!mesh_config_write_iv_index(node_config_get(net->node),
 						net->iv_index + 1, true))
@@ -3095,22 +3046,19 @@ bool mesh_net_iv_index_update(struct mesh_net *net)
 
 bool mesh_net_dst_reg(struct mesh_net *net, uint16_t dst)
 {
-	struct mesh_destination *dest = l_queue_find(net->destinations,
-					match_by_dst, L_UINT_TO_PTR(dst));
+	struct mesh_destination *dest;
 
 	if (IS_UNASSIGNED(dst) || IS_ALL_NODES(dst))
 		return false;
 
+	dest = l_hashmap_lookup(net->destinations, L_UINT_TO_PTR(dst));
+
 	if (!dest) {
 		dest = l_new(struct mesh_destination, 1);
-
-		if (dst < 0x8000)
-			l_queue_push_head(net->destinations, dest);
-		else
-			l_queue_push_tail(net->destinations, dest);
+		dest->dst = dst;
+		l_hashmap_insert(net->destinations, L_UINT_TO_PTR(dst), dest);
 	}
 
-	dest->dst = dst;
 	dest->ref_cnt++;
 
 	return true;
@@ -3118,8 +3066,8 @@ bool mesh_net_dst_reg(struct mesh_net *net, uint16_t dst)
 
 bool mesh_net_dst_unreg(struct mesh_net *net, uint16_t dst)
 {
-	struct mesh_destination *dest = l_queue_find(net->destinations,
-					match_by_dst, L_UINT_TO_PTR(dst));
+	struct mesh_destination *dest = l_hashmap_lookup(net->destinations,
+							L_UINT_TO_PTR(dst));
 
 	if (!dest)
 		return false;
@@ -3130,7 +3078,7 @@ bool mesh_net_dst_unreg(struct mesh_net *net, uint16_t dst)
 	if (dest->ref_cnt)
 		return true;
 
-	l_queue_remove(net->destinations, dest);
+	l_hashmap_remove(net->destinations, L_UINT_TO_PTR(dst));
 
 	l_free(dest);
 	return true;
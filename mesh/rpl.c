@@ -20,6 +20,7 @@
 #include <dirent.h>
 #include <errno.h>
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <ell/ell.h>
@@ -32,93 +33,266 @@
 #include "mesh/rpl.h"
 
 const char *rpl_dir = "/rpl";
+static const char *rpl_ext = ".rpl";
 
-bool rpl_put_entry(struct mesh_node *node, uint16_t src, uint32_t iv_index,
-								uint32_t seq)
+/*
+ * Each IV index has a table with one little endian slot per unicast
+ * address, holding the last accepted sequence number + 1 (zero for an
+ * unused slot). Tables are mmapped and flushed in batches: after
+ * RPL_FLUSH_COUNT updates or RPL_FLUSH_TIMEOUT ms, whichever is first.
+ */
+#define RPL_TABLE_ENTRIES	VIRTUAL_ADDRESS_LOW
+#define RPL_TABLE_SIZE		(RPL_TABLE_ENTRIES * sizeof(uint32_t))
+#define RPL_FLUSH_COUNT		64
+#define RPL_FLUSH_TIMEOUT	500
+
+struct rpl_table {
+	uint32_t *slots;
+	uint32_t iv_index;
+};
+
+struct rpl_store {
+	struct mesh_node *node;
+	char *path;
+	/* Tables for the current and previous IV index */
+	struct rpl_table tables[2];
+	struct l_timeout *flush_timeout;
+	unsigned int pending;
+};
+
+static struct l_queue *rpl_stores;
+
+static bool match_store_node(const void *a, const void *b)
 {
+	const struct rpl_store *store = a;
+
+	return store->node == b;
+}
+
+static struct rpl_store *get_store(struct mesh_node *node)
+{
+	struct rpl_store *store;
 	const char *node_path;
-	char src_file[PATH_MAX];
-	char seq_txt[7];
-	bool result = false;
-	DIR *dir;
-	int fd;
 
-	if (!IS_UNICAST(src))
-		return false;
+	store = l_queue_find(rpl_stores, match_store_node, node);
+	if (store)
+		return store;
 
 	node_path = node_get_storage_dir(node);
+	if (!node_path)
+		return NULL;
 
 	if (strlen(node_path) + strlen(rpl_dir) + 15 >= PATH_MAX)
-		return false;
+		return NULL;
 
-	snprintf(src_file, PATH_MAX, "%s%s/%8.8x", node_path, rpl_dir,
-								iv_index);
-	dir = opendir(src_file);
+	store = l_new(struct rpl_store, 1);
+	store->node = node;
+	store->path = l_strdup_printf("%s%s", node_path, rpl_dir);
 
-	if (!dir) {
-		if (mkdir(src_file, 0755) != 0)
-			l_error("Failed to create dir: %s", src_file);
-	} else
-		closedir(dir);
+	if (!rpl_stores)
+		rpl_stores = l_queue_new();
+
+	l_queue_push_tail(rpl_stores, store);
 
-	snprintf(src_file, PATH_MAX, "%s%s/%8.8x/%4.4x", node_path, rpl_dir,
-								iv_index, src);
+	return store;
+}
 
-	fd = open(src_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
-	if (fd >= 0) {
-		snprintf(seq_txt, 7, "%6.6x", seq);
-		if (write(fd, seq_txt, 6) == 6)
-			result = true;
+static void table_close(struct rpl_table *table)
+{
+	if (!table->slots)
+		return;
 
+	msync(table->slots, RPL_TABLE_SIZE, MS_SYNC);
+	munmap(table->slots, RPL_TABLE_SIZE);
+	table->slots = NULL;
+}
+
+static bool table_open(struct rpl_store *store, struct rpl_table *table,
+							uint32_t iv_index)
+{
+	char fname[PATH_MAX];
+	struct stat st;
+	void *slots;
+	int fd;
+
+	snprintf(fname, PATH_MAX, "%s/%8.8x%s", store->path, iv_index,
+								rpl_ext);
+
+	fd = open(fname, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		l_error("Failed to open RPL table(%d): %s", errno, fname);
+		return false;
+	}
+
+	/*
+	 * Reserve the blocks up front: writing to a hole of a shared
+	 * mapping on a full file system raises SIGBUS.
+	 */
+	if (fstat(fd, &st) < 0 || (st.st_size != RPL_TABLE_SIZE &&
+			(ftruncate(fd, 0) < 0 ||
+			posix_fallocate(fd, 0, RPL_TABLE_SIZE) != 0))) {
+		l_error("Failed to allocate RPL table: %s", fname);
 		close(fd);
+		remove(fname);
+		return false;
 	}
 
-	if (!result)
+	slots = mmap(NULL, RPL_TABLE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+								fd, 0);
+	close(fd);
+
+	if (slots == MAP_FAILED) {
+		l_error("Failed to map RPL table(%d): %s", errno, fname);
 		return false;
+	}
 
-	/* Delete RPL entry from old iv_index (if it exists) */
-	iv_index--;
-	snprintf(src_file, PATH_MAX, "%s%s/%8.8x/%4.4x", node_path, rpl_dir,
-								iv_index, src);
-	if (remove(src_file) < 0 && errno != ENOENT)
-		l_error("Failed to remove(%d): %s", errno, src_file);
+	table->slots = slots;
+	table->iv_index = iv_index;
 
-	return result;
+	return true;
 }
 
-void rpl_del_entry(struct mesh_node *node, uint16_t src)
+static void store_flush(struct rpl_store *store)
 {
-	const char *node_path;
-	char rpl_path[PATH_MAX];
-	struct dirent *entry;
-	DIR *dir;
+	int i;
 
-	if (!IS_UNICAST(src))
+	l_timeout_remove(store->flush_timeout);
+	store->flush_timeout = NULL;
+
+	if (!store->pending)
 		return;
 
-	node_path = node_get_storage_dir(node);
+	store->pending = 0;
 
-	if (strlen(node_path) + strlen(rpl_dir) + 15 >= PATH_MAX)
-		return;
+	for (i = 0; i < 2; i++) {
+		struct rpl_table *table = &store->tables[i];
 
-	snprintf(rpl_path, PATH_MAX, "%s%s", node_path, rpl_dir);
-	dir = opendir(rpl_path);
+		if (table->slots && msync(table->slots, RPL_TABLE_SIZE,
+							MS_SYNC) < 0)
+			l_error("Failed to flush RPL(%d): %8.8x", errno,
+							table->iv_index);
+	}
+}
 
-	if (!dir)
+static void flush_timeout(struct l_timeout *timeout, void *user_data)
+{
+	store_flush(user_data);
+}
+
+static struct rpl_table *get_table(struct rpl_store *store, uint32_t iv_index)
+{
+	struct rpl_table *table = NULL;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		table = &store->tables[i];
+
+		if (table->slots && table->iv_index == iv_index)
+			return table;
+	}
+
+	/* Use a free table or replace the oldest one */
+	for (i = 0; i < 2; i++) {
+		table = &store->tables[i];
+
+		if (!table->slots)
+			break;
+	}
+
+	if (table->slots) {
+		table = &store->tables[0];
+
+		if (store->tables[1].iv_index < table->iv_index)
+			table = &store->tables[1];
+
+		if (iv_index < table->iv_index)
+			return NULL;
+
+		store_flush(store);
+		table_close(table);
+	}
+
+	return table_open(store, table, iv_index) ? table : NULL;
+}
+
+static void store_free(void *data)
+{
+	struct rpl_store *store = data;
+
+	store_flush(store);
+	table_close(&store->tables[0]);
+	table_close(&store->tables[1]);
+	l_free(store->path);
+	l_free(store);
+}
+
+bool rpl_put_entry(struct mesh_node *node, uint16_t src, uint32_t iv_index,
+								uint32_t seq)
+{
+	struct rpl_store *store;
+	struct rpl_table *table;
+
+	if (!IS_UNICAST(src) || seq > SEQ_MASK)
+		return false;
+
+	store = get_store(node);
+	if (!store)
+		return false;
+
+	table = get_table(store, iv_index);
+	if (!table)
+		return false;
+
+	l_put_le32(seq + 1, &table->slots[src]);
+
+	if (++store->pending >= RPL_FLUSH_COUNT)
+		store_flush(store);
+	else if (!store->flush_timeout)
+		store->flush_timeout = l_timeout_create_ms(RPL_FLUSH_TIMEOUT,
+						flush_timeout, store, NULL);
+
+	return true;
+}
+
+void rpl_del_entry(struct mesh_node *node, uint16_t src)
+{
+	struct rpl_store *store;
+	int i;
+
+	if (!IS_UNICAST(src))
+		return;
+
+	store = get_store(node);
+	if (!store)
 		return;
 
 	/* Remove all instances of src address */
-	while ((entry = readdir(dir)) != NULL) {
-		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
-			snprintf(rpl_path, PATH_MAX, "%s%s/%s/%4.4x",
-					node_path, rpl_dir, entry->d_name, src);
-			if (remove(rpl_path) < 0)
-				l_error("Failed to remove(%d): %s", errno,
-								rpl_path);
+	for (i = 0; i < 2; i++) {
+		struct rpl_table *table = &store->tables[i];
+
+		if (table->slots && table->slots[src]) {
+			table->slots[src] = 0;
+			store->pending++;
 		}
 	}
 
-	closedir(dir);
+	store_flush(store);
+}
+
+void rpl_release(struct mesh_node *node)
+{
+	struct rpl_store *store;
+
+	store = l_queue_remove_if(rpl_stores, match_store_node, node);
+	if (!store)
+		return;
+
+	store_free(store);
+
+	if (l_queue_isempty(rpl_stores)) {
+		l_queue_destroy(rpl_stores, NULL);
+		rpl_stores = NULL;
+	}
 }
 
 static bool match_src(const void *a, const void *b)
@@ -129,9 +303,32 @@ static bool match_src(const void *a, const void *b)
 	return rpl->src == src;
 }
 
-static void get_entries(const char *iv_path, struct l_queue *rpl_list)
+static void add_entry(struct l_queue *rpl_list, uint16_t src,
+					uint32_t iv_index, uint32_t seq)
 {
 	struct mesh_rpl *rpl;
+
+	rpl = l_queue_find(rpl_list, match_src, L_UINT_TO_PTR(src));
+
+	if (rpl) {
+		/* Replace older entries */
+		if (rpl->iv_index < iv_index) {
+			rpl->iv_index = iv_index;
+			rpl->seq = seq;
+		}
+	} else if (seq <= SEQ_MASK && IS_UNICAST(src)) {
+		rpl = l_new(struct mesh_rpl, 1);
+		rpl->src = src;
+		rpl->iv_index = iv_index;
+		rpl->seq = seq;
+
+		l_queue_push_head(rpl_list, rpl);
+	}
+}
+
+/* Read entries stored by older daemons as one file per src address */
+static void get_legacy_entries(const char *iv_path, struct l_queue *rpl_list)
+{
 	struct dirent *entry;
 	DIR *dir;
 	int fd;
@@ -167,26 +364,9 @@ static void get_entries(const char *iv_path, struct l_queue *rpl_list)
 				continue;
 
 			if (read(fd, seq_txt, 6) == 6 &&
-					sscanf(seq_txt, "%06x", &seq) == 1) {
-
-				rpl = l_queue_find(rpl_list, match_src,
-						L_UINT_TO_PTR(src));
-
-				if (rpl) {
-					/* Replace older entries */
-					if (rpl->iv_index < iv_index) {
-						rpl->iv_index = iv_index;
-						rpl->seq = seq;
-					}
-				} else if (seq <= SEQ_MASK && IS_UNICAST(src)) {
-					rpl = l_new(struct mesh_rpl, 1);
-					rpl->src = src;
-					rpl->iv_index = iv_index;
-					rpl->seq = seq;
-
-					l_queue_push_head(rpl_list, rpl);
-				}
-			}
+					sscanf(seq_txt, "%06x", &seq) == 1)
+				add_entry(rpl_list, src, iv_index, seq);
+
 			close(fd);
 		}
 	}
@@ -194,91 +374,159 @@ static void get_entries(const char *iv_path, struct l_queue *rpl_list)
 	closedir(dir);
 }
 
+static void get_table_entries(struct rpl_table *table,
+						struct l_queue *rpl_list)
+{
+	uint16_t src;
+
+	for (src = 1; src < RPL_TABLE_ENTRIES; src++) {
+		uint32_t val = l_get_le32(&table->slots[src]);
+
+		if (val)
+			add_entry(rpl_list, src, table->iv_index, val - 1);
+	}
+}
+
+static bool parse_table_name(const char *name, uint32_t *iv_index)
+{
+	char ext[5];
+
+	if (strlen(name) != 8 + strlen(rpl_ext))
+		return false;
+
+	if (sscanf(name, "%08x%4s", iv_index, ext) != 2)
+		return false;
+
+	return !strcmp(ext, rpl_ext);
+}
+
+static void migrate_entry(void *data, void *user_data)
+{
+	struct mesh_rpl *rpl = data;
+	struct rpl_store *store = user_data;
+
+	rpl_put_entry(store->node, rpl->src, rpl->iv_index, rpl->seq);
+}
+
 bool rpl_get_list(struct mesh_node *node, struct l_queue *rpl_list)
 {
-	const char *node_path;
+	struct rpl_store *store;
 	struct dirent *entry;
-	char *rpl_path;
-	size_t len;
+	char path[PATH_MAX];
+	bool legacy = false;
 	DIR *dir;
 
 	if (!rpl_list)
 		return false;
 
-	node_path = node_get_storage_dir(node);
+	store = get_store(node);
+	if (!store)
+		return false;
 
-	len = strlen(node_path) + strlen(rpl_dir) + 15;
+	dir = opendir(store->path);
 
-	if (len > PATH_MAX)
+	if (!dir) {
+		l_error("Failed to read RPL dir: %s", store->path);
 		return false;
+	}
 
-	rpl_path = l_malloc(len);
-	snprintf(rpl_path, len, "%s%s", node_path, rpl_dir);
+	while ((entry = readdir(dir)) != NULL) {
+		struct rpl_table *table;
+		uint32_t iv_index;
 
-	dir = opendir(rpl_path);
+		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
+			snprintf(path, PATH_MAX, "%s/%s", store->path,
+								entry->d_name);
+			get_legacy_entries(path, rpl_list);
+			legacy = true;
+		}
 
-	if (!dir) {
-		l_error("Failed to read RPL dir: %s", rpl_path);
-		l_free(rpl_path);
-		return false;
+		if (entry->d_type != DT_REG ||
+				!parse_table_name(entry->d_name, &iv_index))
+			continue;
+
+		table = get_table(store, iv_index);
+		if (table)
+			get_table_entries(table, rpl_list);
 	}
 
+	closedir(dir);
+
+	if (!legacy)
+		return true;
+
+	/* Move entries into the tables, then drop the old layout */
+	l_queue_foreach(rpl_list, migrate_entry, store);
+	store_flush(store);
+
+	dir = opendir(store->path);
+	if (!dir)
+		return true;
+
 	while ((entry = readdir(dir)) != NULL) {
-		/* RPL sequences are stored in files under iv_indexs */
 		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
-			snprintf(rpl_path, len, "%s%s/%s",
-					node_path, rpl_dir, entry->d_name);
-			get_entries(rpl_path, rpl_list);
+			snprintf(path, PATH_MAX, "%s/%s", store->path,
+								entry->d_name);
+			del_path(path);
 		}
 	}
 
-	l_free(rpl_path);
 	closedir(dir);
 
+	l_info("Migrated RPL storage of %s", store->path);
+
 	return true;
 }
 
 void rpl_update(struct mesh_node *node, uint32_t cur)
 {
 	uint32_t old = cur - 1;
-	const char *node_path;
+	struct rpl_store *store;
 	struct dirent *entry;
 	char path[PATH_MAX];
 	DIR *dir;
+	int i;
 
-	node_path = node_get_storage_dir(node);
-	if (!node_path)
-		return;
-
-	if (strlen(node_path) + strlen(rpl_dir) + 15 >= PATH_MAX)
+	store = get_store(node);
+	if (!store)
 		return;
 
 	/* Make sure path exists */
-	snprintf(path, PATH_MAX, "%s%s", node_path, rpl_dir);
-	if (mkdir(path, 0755) != 0 && errno != EEXIST)
-		l_error("Failed to create dir(%d): %s", errno, path);
+	if (mkdir(store->path, 0755) != 0 && errno != EEXIST)
+		l_error("Failed to create dir(%d): %s", errno, store->path);
+
+	for (i = 0; i < 2; i++) {
+		struct rpl_table *table = &store->tables[i];
+
+		if (table->iv_index != cur && table->iv_index != old)
+			table_close(table);
+	}
 
-	dir = opendir(path);
+	dir = opendir(store->path);
 	if (!dir)
 		return;
 
 	/* Cleanup any stale or malformed trees */
 	while ((entry = readdir(dir)) != NULL) {
-		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
-			uint32_t val;
-			bool del = false;
+		uint32_t val;
+		bool del = false;
 
+		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
 			if (strlen(entry->d_name) != 8)
 				del = true;
 			else if (sscanf(entry->d_name, "%08x", &val) != 1)
 				del = true;
-
-			/* Delete all invalid iv_index trees */
-			if (del || (val != cur && val != old)) {
-				snprintf(path, PATH_MAX, "%s%s/%s",
-					node_path, rpl_dir, entry->d_name);
-				del_path(path);
-			}
+		} else if (entry->d_type == DT_REG) {
+			if (!parse_table_name(entry->d_name, &val))
+				continue;
+		} else
+			continue;
+
+		/* Delete all invalid iv_index trees */
+		if (del || (val != cur && val != old)) {
+			snprintf(path, PATH_MAX, "%s/%s", store->path,
+								entry->d_name);
+			del_path(path);
 		}
 	}
 
@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include <glib.h>
 
@@ -118,6 +119,8 @@ static const char *filter_list[] = {
 #define FILTER_BIT_MAX	63
 #define FILTER_ALL	0xFFFFFFFFFFFFFFFFULL
 
+#define CACHE_VERSION_LEN	48
+
 #define PBAP_INTERFACE "org.bluez.obex.PhonebookAccess1"
 #define ERROR_INTERFACE "org.bluez.obex.Error"
 #define PBAP_UUID "0000112f-0000-1000-8000-00805f9b34fb"
@@ -135,6 +138,7 @@ struct pbap_data {
 struct pending_request {
 	struct pbap_data *pbap;
 	DBusMessage *msg;
+	char *filename;
 };
 
 static DBusConnection *conn = NULL;
@@ -154,6 +158,7 @@ static struct pending_request *pending_request_new(struct pbap_data *pbap,
 static void pending_request_free(struct pending_request *p)
 {
 	dbus_message_unref(p->msg);
+	g_free(p->filename);
 	g_free(p);
 }
 
@@ -1022,6 +1027,298 @@ static DBusMessage *pbap_update_version(DBusConnection *connection,
 	return pbap_get_size(connection, message, user_data);
 }
 
+/*
+ * The cache of a phonebook is stored as <key>.vcf next to <key>.version
+ * which contains the DatabaseIdentifier, PrimaryCounter and
+ * SecondaryCounter of the phonebook when it was pulled.
+ */
+static char *cache_filename(struct pbap_data *pbap, const char *suffix)
+{
+	char *key, *dir, *filename;
+
+	key = g_strconcat(g_path_skip_root(pbap->path), suffix, NULL);
+	g_strdelimit(key, "/", '-');
+
+	dir = g_build_filename(g_get_user_cache_dir(), "obexd", "pbap",
+				obc_session_get_destination(pbap->session),
+				NULL);
+	if (g_mkdir_with_parents(dir, 0700) < 0)
+		error("mkdir(%s): %s", dir, strerror(errno));
+
+	filename = g_build_filename(dir, key, NULL);
+
+	g_free(dir);
+	g_free(key);
+
+	return filename;
+}
+
+static void cache_get_version(struct pbap_data *pbap,
+					uint8_t version[CACHE_VERSION_LEN])
+{
+	memcpy(version, pbap->databaseid, 16);
+	memcpy(version + 16, pbap->primary, 16);
+	memcpy(version + 32, pbap->secondary, 16);
+}
+
+/*
+ * Only counters returned by the server tell whether the cache is current,
+ * absent counters read as zero and would always match.
+ */
+static gboolean cache_version_known(struct pbap_data *pbap,
+					struct obc_transfer *transfer)
+{
+	static const uint8_t zero[16];
+	GObexApparam *apparam;
+	const guint8 *data;
+	gsize len;
+
+	apparam = obc_transfer_get_apparam(transfer);
+	if (apparam == NULL)
+		return FALSE;
+
+	if (!g_obex_apparam_get_bytes(apparam, DATABASEID_TAG, &data, &len) ||
+			!g_obex_apparam_get_bytes(apparam, PRIMARY_COUNTER_TAG,
+								&data, &len) ||
+			!g_obex_apparam_get_bytes(apparam,
+						SECONDARY_COUNTER_TAG,
+						&data, &len))
+		return FALSE;
+
+	return memcmp(pbap->primary, zero, sizeof(zero)) ||
+			memcmp(pbap->secondary, zero, sizeof(zero));
+}
+
+static gboolean cache_is_valid(struct pbap_data *pbap)
+{
+	uint8_t version[CACHE_VERSION_LEN];
+	char *filename, *contents = NULL;
+	gboolean valid = FALSE;
+	gsize len;
+
+	filename = cache_filename(pbap, ".vcf");
+	if (!g_file_test(filename, G_FILE_TEST_IS_REGULAR))
+		goto done;
+
+	g_free(filename);
+	filename = cache_filename(pbap, ".version");
+
+	if (!g_file_get_contents(filename, &contents, &len, NULL))
+		goto done;
+
+	cache_get_version(pbap, version);
+
+	valid = len == sizeof(version) && !memcmp(contents, version, len);
+
+done:
+	g_free(contents);
+	g_free(filename);
+
+	return valid;
+}
+
+static void sync_reply(struct pending_request *request, gboolean updated)
+{
+	dbus_bool_t value = updated;
+	char *filename;
+
+	filename = cache_filename(request->pbap, ".vcf");
+
+	g_dbus_send_reply(conn, request->msg,
+					DBUS_TYPE_STRING, &filename,
+					DBUS_TYPE_BOOLEAN, &value,
+					DBUS_TYPE_INVALID);
+
+	g_free(filename);
+	pending_request_free(request);
+}
+
+static void sync_error(struct pending_request *request, const char *message)
+{
+	DBusMessage *reply;
+
+	reply = g_dbus_create_error(request->msg, ERROR_INTERFACE ".Failed",
+							"%s", message);
+	g_dbus_send_message(conn, reply);
+	pending_request_free(request);
+}
+
+static void sync_pull_callback(struct obc_session *session,
+						struct obc_transfer *transfer,
+						GError *err, void *user_data)
+{
+	struct pending_request *request = user_data;
+	struct pbap_data *pbap = request->pbap;
+	uint8_t version[CACHE_VERSION_LEN];
+	char *filename;
+	guint16 phone_book_size;
+	guint8 new_missed_calls;
+	GError *gerr = NULL;
+
+	if (err) {
+		sync_error(request, err->message);
+		return;
+	}
+
+	/* Record the version the pulled phonebook corresponds to */
+	read_return_apparam(transfer, pbap, &phone_book_size,
+							&new_missed_calls);
+
+	filename = cache_filename(pbap, ".vcf");
+	if (rename(request->filename, filename) < 0) {
+		error("rename(%s, %s): %s", request->filename, filename,
+							strerror(errno));
+		unlink(request->filename);
+		g_free(filename);
+		sync_error(request, "Unable to update cache");
+		return;
+	}
+
+	g_free(filename);
+
+	filename = cache_filename(pbap, ".version");
+
+	/* Without a version the cache is refreshed on every Sync */
+	if (!cache_version_known(pbap, transfer)) {
+		if (unlink(filename) < 0 && errno != ENOENT)
+			error("unlink(%s): %s", filename, strerror(errno));
+		g_free(filename);
+		sync_reply(request, TRUE);
+		return;
+	}
+
+	cache_get_version(pbap, version);
+
+	if (!g_file_set_contents(filename, (char *) version, sizeof(version),
+								&gerr)) {
+		error("%s", gerr->message);
+		g_error_free(gerr);
+	}
+
+	g_free(filename);
+
+	sync_reply(request, TRUE);
+}
+
+static void sync_size_callback(struct obc_session *session,
+						struct obc_transfer *transfer,
+						GError *err, void *user_data)
+{
+	struct pending_request *request = user_data;
+	struct pbap_data *pbap = request->pbap;
+	struct obc_transfer *pull;
+	GObexApparam *apparam;
+	guint16 phone_book_size;
+	guint8 new_missed_calls;
+	char *name;
+	GError *gerr = NULL;
+	int fd;
+
+	if (err) {
+		sync_error(request, err->message);
+		return;
+	}
+
+	read_return_apparam(transfer, pbap, &phone_book_size,
+							&new_missed_calls);
+
+	if (cache_version_known(pbap, transfer) && cache_is_valid(pbap)) {
+		DBG("%s unchanged, using cache", pbap->path);
+		sync_reply(request, FALSE);
+		return;
+	}
+
+	/* Pull into a unique file next to the cache, so concurrent Syncs
+	 * don't write to the same file and the rename is atomic.
+	 */
+	request->filename = cache_filename(pbap, ".vcf.XXXXXX");
+	fd = mkstemp(request->filename);
+	if (fd < 0) {
+		error("mkstemp(%s): %s", request->filename, strerror(errno));
+		sync_error(request, "Unable to create cache");
+		return;
+	}
+
+	close(fd);
+
+	name = g_strconcat(g_path_skip_root(pbap->path), ".vcf", NULL);
+
+	pull = obc_transfer_get("x-bt/phonebook", name, request->filename,
+									&gerr);
+
+	g_free(name);
+
+	if (pull == NULL) {
+		unlink(request->filename);
+		goto fail;
+	}
+
+	apparam = g_obex_apparam_set_uint16(NULL, MAXLISTCOUNT_TAG,
+							DEFAULT_COUNT);
+	apparam = g_obex_apparam_set_uint16(apparam, LISTSTARTOFFSET_TAG,
+							DEFAULT_OFFSET);
+	obc_transfer_set_apparam(pull, apparam);
+
+	if (obc_session_queue(session, pull, sync_pull_callback, request,
+								&gerr))
+		return;
+
+fail:
+	sync_error(request, gerr->message);
+	g_error_free(gerr);
+}
+
+static DBusMessage *pbap_sync(DBusConnection *connection,
+					DBusMessage *message, void *user_data)
+{
+	struct pbap_data *pbap = user_data;
+	struct pending_request *request;
+	struct obc_transfer *transfer;
+	GObexApparam *apparam;
+	DBusMessage *reply;
+	GError *err = NULL;
+	char *name;
+
+	if (!pbap->path)
+		return g_dbus_create_error(message,
+					ERROR_INTERFACE ".Forbidden",
+					"Call Select first of all");
+
+	if (!(pbap->supported_features & FOLDER_VERSION_FEATURE) ||
+			!(pbap->supported_features & DATABASEID_FEATURE))
+		return g_dbus_create_error(message,
+					ERROR_INTERFACE ".NotSupported",
+					"Operation is not supported");
+
+	name = g_strconcat(g_path_skip_root(pbap->path), ".vcf", NULL);
+
+	/* Fetch the current version of the phonebook without any entry */
+	transfer = obc_transfer_get("x-bt/phonebook", name, NULL, &err);
+
+	g_free(name);
+
+	if (transfer == NULL)
+		goto fail;
+
+	apparam = g_obex_apparam_set_uint16(NULL, MAXLISTCOUNT_TAG, 0);
+	apparam = g_obex_apparam_set_uint16(apparam, LISTSTARTOFFSET_TAG,
+							DEFAULT_OFFSET);
+	obc_transfer_set_apparam(transfer, apparam);
+
+	request = pending_request_new(pbap, message);
+	if (obc_session_queue(pbap->session, transfer, sync_size_callback,
+							request, &err))
+		return NULL;
+
+	pending_request_free(request);
+
+fail:
+	reply = g_dbus_create_error(message, ERROR_INTERFACE ".Failed", "%s",
+								err->message);
+	g_error_free(err);
+	return reply;
+}
+
 static const GDBusMethodTable pbap_methods[] = {
 	{ GDBUS_ASYNC_METHOD("Select",
 			GDBUS_ARGS({ "location", "s" }, { "phonebook", "s" }),
@@ -1055,6 +1352,9 @@ static const GDBusMethodTable pbap_methods[] = {
 				pbap_list_filter_fields) },
 	{ GDBUS_ASYNC_METHOD("UpdateVersion", NULL, NULL,
 				pbap_update_version) },
+	{ GDBUS_ASYNC_METHOD("Sync", NULL,
+			GDBUS_ARGS({ "filename", "s" }, { "updated", "b" }),
+			pbap_sync) },
 	{ }
 };
 
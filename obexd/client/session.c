@@ -26,6 +26,7 @@
 #include "gdbus/gdbus.h"
 #include "gobex/gobex.h"
 
+#include "obexd/src/obexd.h"
 #include "obexd/src/log.h"
 #include "transfer.h"
 #include "session.h"
@@ -66,6 +67,7 @@ struct pending_request {
 	session_callback_t func;
 	void *data;
 	destroy_t destroy;
+	gboolean active;
 };
 
 struct setpath_data {
@@ -104,6 +106,15 @@ struct obc_session {
 
 static GSList *sessions = NULL;
 
+/*
+ * OPP sessions with a transfer ready to start once the number of active
+ * OPP transfers drops below the --max-transfers limit, served in order so
+ * that a batch queued on one session cannot starve the others.
+ */
+static GSList *waiting = NULL;
+static unsigned int active_transfers = 0;
+static guint waiting_id = 0;
+
 static void session_process_queue(struct obc_session *session);
 static void session_terminate_transfer(struct obc_session *session,
 					struct obc_transfer *transfer,
@@ -164,8 +175,70 @@ static struct pending_request *pending_request_new(struct obc_session *session,
 	return p;
 }
 
+/* Only OPP batches are throttled, other profiles keep a single transfer */
+static gboolean session_transfer_limited(struct obc_session *session)
+{
+	if (obex_option_max_transfers() <= 0)
+		return FALSE;
+
+	return session->driver && g_str_equal(session->driver->service, "OPP");
+}
+
+static gboolean transfer_slot_available(void)
+{
+	int max = obex_option_max_transfers();
+
+	return max <= 0 || active_transfers < (unsigned int) max;
+}
+
+/*
+ * A freed slot belongs to the head of the waiting list, any other session
+ * queues up behind it even if a slot is available at this point.
+ */
+static gboolean transfer_slot_take(struct obc_session *session)
+{
+	if ((waiting && waiting->data != session) ||
+					!transfer_slot_available()) {
+		if (!g_slist_find(waiting, session))
+			waiting = g_slist_append(waiting, session);
+		return FALSE;
+	}
+
+	waiting = g_slist_remove(waiting, session);
+
+	return TRUE;
+}
+
+static gboolean process_waiting(gpointer user_data)
+{
+	waiting_id = 0;
+
+	while (waiting && transfer_slot_available()) {
+		struct obc_session *session = waiting->data;
+
+		session_process_queue(session);
+
+		/* Nothing left to start, let the next session have the slot */
+		if (waiting && waiting->data == session)
+			waiting = g_slist_remove(waiting, session);
+	}
+
+	return FALSE;
+}
+
+static void schedule_waiting(void)
+{
+	if (waiting && waiting_id == 0 && transfer_slot_available())
+		waiting_id = g_idle_add(process_waiting, NULL);
+}
+
 static void pending_request_free(struct pending_request *p)
 {
+	if (p->active) {
+		active_transfers--;
+		schedule_waiting();
+	}
+
 	if (p->req_id > 0)
 		g_obex_cancel_req(p->session->obex, p->req_id, TRUE);
 
@@ -207,6 +280,9 @@ static void session_free(struct obc_session *session)
 {
 	DBG("%p", session);
 
+	waiting = g_slist_remove(waiting, session);
+	schedule_waiting();
+
 	if (session->process_id != 0)
 		g_source_remove(session->process_id);
 
@@ -825,6 +901,12 @@ static int session_process_transfer(struct pending_request *p, GError **err)
 
 	DBG("Tranfer(%p) started", p->transfer);
 	p->session->p = p;
+
+	if (session_transfer_limited(p->session)) {
+		p->active = TRUE;
+		active_transfers++;
+	}
+
 	return 0;
 }
 
@@ -868,9 +950,15 @@ static void session_process_queue(struct obc_session *session)
 
 	obc_session_ref(session);
 
-	while ((p = g_queue_pop_head(session->queue))) {
+	while ((p = g_queue_peek_head(session->queue))) {
 		GError *gerr = NULL;
 
+		if (p->transfer && session_transfer_limited(session) &&
+					!transfer_slot_take(session))
+			break;
+
+		g_queue_pop_head(session->queue);
+
 		if (p->process(p, &gerr) == 0)
 			break;
 
@@ -73,6 +73,7 @@ struct obc_transfer {
 	gint64 size;
 	gint64 transferred;
 	gint64 progress;
+	gint64 rate;
 	guint progress_id;
 };
 
@@ -342,6 +343,20 @@ static gboolean get_transferred(const GDBusPropertyTable *property,
 	return TRUE;
 }
 
+static gboolean get_rate(const GDBusPropertyTable *property,
+					DBusMessageIter *iter, void *data)
+{
+	struct obc_transfer *transfer = data;
+
+	if (transfer->obex == NULL)
+		return FALSE;
+
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT64,
+							&transfer->rate);
+
+	return TRUE;
+}
+
 static const char *status2str(uint8_t status)
 {
 	switch (status) {
@@ -396,6 +411,7 @@ static const GDBusPropertyTable obc_transfer_properties[] = {
 	{ "Size", "t", get_size },
 	{ "Filename", "s", get_filename, NULL, filename_exists },
 	{ "Transferred", "t", get_transferred, NULL, transferred_exists },
+	{ "Rate", "t", get_rate, NULL, transferred_exists },
 	{ "Session", "o", get_session },
 	{ }
 };
@@ -779,9 +795,20 @@ static gboolean report_progress(gpointer data)
 {
 	struct obc_transfer *transfer = data;
 
-	if (transfer->transferred == transfer->progress)
+	if (transfer->transferred == transfer->progress) {
+		/* Nothing transferred during the last second */
+		if (transfer->rate) {
+			transfer->rate = 0;
+			g_dbus_emit_property_changed(transfer->conn,
+						transfer->path,
+						TRANSFER_INTERFACE, "Rate");
+		}
+
 		return TRUE;
+	}
 
+	/* Progress is reported once per second */
+	transfer->rate = transfer->transferred - transfer->progress;
 	transfer->progress = transfer->transferred;
 
 	if (transfer->transferred == transfer->size) {
@@ -795,6 +822,8 @@ static gboolean report_progress(gpointer data)
 
 	g_dbus_emit_property_changed(transfer->conn, transfer->path,
 					TRANSFER_INTERFACE, "Transferred");
+	g_dbus_emit_property_changed(transfer->conn, transfer->path,
+					TRANSFER_INTERFACE, "Rate");
 
 	return TRUE;
 }
@@ -150,6 +150,18 @@ static char *file_stat_line(char *filename, struct stat *fstat,
 	return ret;
 }
 
+/*
+ * Amount of file data the kernel is asked to prefetch ahead of the
+ * current read position, so each OBEX packet is served from the page
+ * cache rather than waiting for slow storage.
+ */
+#define READ_AHEAD_SIZE (256 * 1024)
+
+static void read_ahead(int fd, off_t offset)
+{
+	posix_fadvise(fd, offset, READ_AHEAD_SIZE, POSIX_FADV_WILLNEED);
+}
+
 static void *filesystem_open(const char *name, int oflag, mode_t mode,
 					void *context, size_t *size, int *err)
 {
@@ -181,6 +193,8 @@ static void *filesystem_open(const char *name, int oflag, mode_t mode,
 	if (oflag == O_RDONLY) {
 		if (size)
 			*size = stats.st_size;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		read_ahead(fd, 0);
 		goto done;
 	}
 
@@ -221,12 +235,27 @@ static int filesystem_close(void *object)
 
 static ssize_t filesystem_read(void *object, void *buf, size_t count)
 {
+	int fd = GPOINTER_TO_INT(object);
+	off_t offset;
 	ssize_t ret;
 
-	ret = read(GPOINTER_TO_INT(object), buf, count);
+	ret = read(fd, buf, count);
 	if (ret < 0)
 		return -errno;
 
+	if (ret == 0)
+		return 0;
+
+	/*
+	 * Once half of the prefetched window has been consumed schedule
+	 * the next one, this way the kernel fetches it while the current
+	 * packets are still being sent.
+	 */
+	offset = lseek(fd, 0, SEEK_CUR);
+	if (offset > 0 && offset / (READ_AHEAD_SIZE / 2) !=
+				(offset - ret) / (READ_AHEAD_SIZE / 2))
+		read_ahead(fd, offset + READ_AHEAD_SIZE / 2);
+
 	return ret;
 }
 
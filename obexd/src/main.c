@@ -126,6 +126,7 @@ static char *option_noplugin = NULL;
 
 static gboolean option_autoaccept = FALSE;
 static gboolean option_symlinks = FALSE;
+static int option_max_transfers = 4;
 
 static gboolean parse_debug(const char *key, const char *value,
 				gpointer user_data, GError **error)
@@ -164,6 +165,10 @@ static const GOptionEntry options[] = {
 				"scripts", "FILE" },
 	{ "auto-accept", 'a', 0, G_OPTION_ARG_NONE, &option_autoaccept,
 				"Automatically accept push requests" },
+	{ "max-transfers", 'M', 0, G_OPTION_ARG_INT, &option_max_transfers,
+				"Maximum number of OPP client transfers "
+				"running at the same time, 0 for no limit",
+				"NUM" },
 	{ NULL },
 };
 
@@ -187,6 +192,11 @@ const char *obex_option_capability(void)
 	return option_capability;
 }
 
+int obex_option_max_transfers(void)
+{
+	return option_max_transfers;
+}
+
 static gboolean is_dir(const char *dir)
 {
 	struct stat st;
@@ -79,6 +79,9 @@
 #define DISCONNECT_TIMEOUT 1
 #define START_TIMEOUT 1
 
+/* Socket priority of media channels, above the default of 0 */
+#define AVDTP_MEDIA_PRIORITY 5
+
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 
 struct avdtp_common_header {
@@ -843,6 +846,17 @@ static void handle_transport_connect(struct avdtp *session, GIOChannel *io,
 	} else
 		DBG("Flushable packets enabled");
 
+	/*
+	 * Media packets are time critical, have them scheduled ahead of
+	 * other traffic sharing the controller such as file transfers.
+	 */
+	bt_io_set(stream->io, &err, BT_IO_OPT_PRIORITY, AVDTP_MEDIA_PRIORITY,
+							BT_IO_OPT_INVALID);
+	if (err != NULL) {
+		error("Setting media priority failed: %s", err->message);
+		g_clear_error(&err);
+	}
+
 	sk = g_io_channel_unix_get_fd(stream->io);
 	buf_size = get_send_buffer_size(sk);
 	if (buf_size < 0)
@@ -222,7 +222,7 @@ struct pending_pdu {
 };
 
 struct pending_list_items {
-	GSList *items;
+	uint64_t items;
 	uint32_t start;
 	uint32_t end;
 	uint64_t total;
@@ -2540,40 +2540,35 @@ static const char *subtype_to_string(uint32_t subtype)
 	return "None";
 }
 
-static struct media_item *parse_media_element(struct avrcp *session,
+static bool parse_media_element(struct avrcp *session,
 					uint8_t *operands, uint16_t len)
 {
 	struct avrcp_player *player;
 	struct media_player *mp;
-	struct media_item *item;
 	uint16_t namelen;
 	char name[255];
 	uint64_t uid;
 
 	if (len < 13)
-		return NULL;
+		return false;
 
 	uid = get_be64(&operands[0]);
 
 	namelen = MIN(get_be16(&operands[11]), sizeof(name) - 1);
-	if (namelen > 0) {
+	if (namelen > 0)
 		memcpy(name, &operands[13], namelen);
-		name[namelen] = '\0';
-	}
+	name[namelen] = '\0';
 
 	player = session->controller->player;
 	mp = player->user_data;
 
-	item = media_player_create_item(mp, name, PLAYER_ITEM_TYPE_AUDIO, uid);
-	if (item == NULL)
-		return NULL;
-
-	media_item_set_playable(item, true);
+	/* Only listed, the item object is created on demand */
+	media_player_list_item(mp, name, PLAYER_ITEM_TYPE_AUDIO, uid, true);
 
-	return item;
+	return true;
 }
 
-static struct media_item *parse_media_folder(struct avrcp *session,
+static bool parse_media_folder(struct avrcp *session,
 					uint8_t *operands, uint16_t len)
 {
 	struct avrcp_player *player = session->controller->player;
@@ -2586,25 +2581,25 @@ static struct media_item *parse_media_folder(struct avrcp *session,
 	uint8_t playable;
 
 	if (len < 12)
-		return NULL;
+		return false;
 
 	uid = get_be64(&operands[0]);
 	type = operands[8];
 	playable = operands[9];
 
 	namelen = MIN(get_be16(&operands[12]), sizeof(name) - 1);
-	if (namelen > 0) {
+	if (namelen > 0)
 		memcpy(name, &operands[14], namelen);
-		name[namelen] = '\0';
-	}
+	name[namelen] = '\0';
 
 	item = media_player_create_folder(mp, name, type, uid);
 	if (!item)
-		return NULL;
+		return false;
 
 	media_item_set_playable(item, playable & 0x01);
+	media_player_list_folder(mp, item);
 
-	return item;
+	return true;
 }
 
 static void avrcp_list_items(struct avrcp *session, uint32_t start,
@@ -2617,7 +2612,6 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 	struct avrcp_player *player = session->controller->player;
 	struct pending_list_items *p = player->p;
 	uint16_t count;
-	uint64_t items;
 	size_t i;
 	int err = 0;
 
@@ -2644,7 +2638,7 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 		goto done;
 
 	for (i = 8; count && i + 3 < operand_count; count--) {
-		struct media_item *item;
+		bool listed;
 		uint8_t type;
 		uint16_t len;
 
@@ -2663,30 +2657,29 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 		}
 
 		if (type == 0x03)
-			item = parse_media_element(session, &operands[i], len);
+			listed = parse_media_element(session, &operands[i],
+									len);
 		else
-			item = parse_media_folder(session, &operands[i], len);
+			listed = parse_media_folder(session, &operands[i],
+									len);
 
-		if (item)
-			p->items = g_slist_append(p->items, item);
+		if (listed)
+			p->items++;
 
 		i += len;
 	}
 
-	items = g_slist_length(p->items);
-
 	DBG("start %u end %u items %" PRIu64 " total %" PRIu64 "", p->start,
-						p->end, items, p->total);
+						p->end, p->items, p->total);
 
-	if (items < p->total) {
-		avrcp_list_items(session, p->start + items, p->end);
+	if (p->items < p->total) {
+		avrcp_list_items(session, p->start + p->items, p->end);
 		return FALSE;
 	}
 
 done:
-	media_player_list_complete(player->user_data, p->items, err);
+	media_player_list_complete(player->user_data, err);
 
-	g_slist_free(p->items);
 	g_free(p);
 	player->p = NULL;
 
@@ -3843,6 +3836,16 @@ static void avrcp_uids_changed(struct avrcp *session, struct avrcp_header *pdu)
 	struct avrcp_player *player = session->controller->player;
 
 	player->uid_counter = get_be16(&pdu->params[1]);
+
+	media_player_uids_changed(player->user_data);
+}
+
+static void avrcp_now_playing_content_changed(struct avrcp *session,
+						struct avrcp_header *pdu)
+{
+	struct avrcp_player *player = session->controller->player;
+
+	media_player_playlist_changed(player->user_data);
 }
 
 static gboolean avrcp_handle_event(struct avctp *conn, uint8_t code,
@@ -3905,6 +3908,9 @@ static gboolean avrcp_handle_event(struct avctp *conn, uint8_t code,
 	case AVRCP_EVENT_UIDS_CHANGED:
 		avrcp_uids_changed(session, pdu);
 		break;
+	case AVRCP_EVENT_NOW_PLAYING_CONTENT_CHANGED:
+		avrcp_now_playing_content_changed(session, pdu);
+		break;
 	default:
 		if (event > AVRCP_EVENT_LAST) {
 			warn("Unsupported event: %u", event);
@@ -3989,6 +3995,7 @@ static gboolean avrcp_get_capabilities_resp(struct avctp *conn, uint8_t code,
 		case AVRCP_EVENT_SETTINGS_CHANGED:
 		case AVRCP_EVENT_ADDRESSED_PLAYER_CHANGED:
 		case AVRCP_EVENT_UIDS_CHANGED:
+		case AVRCP_EVENT_NOW_PLAYING_CONTENT_CHANGED:
 		case AVRCP_EVENT_AVAILABLE_PLAYERS_CHANGED:
 			/* These events above requires a player */
 			if (!session->controller ||
@@ -55,6 +55,7 @@
 #include "src/service.h"
 #include "src/log.h"
 #include "src/error.h"
+#include "src/textfile.h"
 
 #define ISO_SOCKET_UUID "6fbaf188-05e0-496a-9885-d6ddfdb4e03e"
 #define PACS_UUID_STR "00001850-0000-1000-8000-00805f9b34fb"
@@ -62,6 +63,9 @@
 #define MEDIA_ENDPOINT_INTERFACE "org.bluez.MediaEndpoint1"
 #define MEDIA_INTERFACE "org.bluez.Media1"
 
+/* Time to wait for the other CIS of a CIG to be enabled before connecting */
+#define CIG_CONNECT_TIMEOUT 50
+
 struct bap_setup {
 	struct bap_ep *ep;
 	struct bt_bap_stream *stream;
@@ -72,6 +76,7 @@ struct bap_setup {
 	unsigned int io_id;
 	bool recreate;
 	bool cig_active;
+	struct bap_cig *cig;
 	struct iovec *caps;
 	struct iovec *metadata;
 	unsigned int id;
@@ -105,7 +110,17 @@ struct bap_data {
 	void *user_data;
 };
 
+struct bap_cig {
+	struct btd_adapter *adapter;
+	uint8_t id;
+	struct queue *setups;
+	unsigned int timeout_id;
+	unsigned int connecting;
+	gint64 start;
+};
+
 static struct queue *sessions;
+static struct queue *cigs;
 
 static bool bap_data_set_user_data(struct bap_data *data, void *user_data)
 {
@@ -781,20 +796,14 @@ fail:
 	return -EINVAL;
 }
 
-static void qos_cb(struct bt_bap_stream *stream, uint8_t code, uint8_t reason,
-					void *user_data)
+static void setup_reply(struct bap_setup *setup, bool success)
 {
-	struct bap_setup *setup = user_data;
 	DBusMessage *reply;
 
-	DBG("stream %p code 0x%02x reason 0x%02x", stream, code, reason);
-
-	setup->id = 0;
-
 	if (!setup->msg)
 		return;
 
-	if (!code)
+	if (success)
 		reply = dbus_message_new_method_return(setup->msg);
 	else
 		reply = btd_error_failed(setup->msg, "Unable to configure");
@@ -805,6 +814,18 @@ static void qos_cb(struct bt_bap_stream *stream, uint8_t code, uint8_t reason,
 	setup->msg = NULL;
 }
 
+static void qos_cb(struct bt_bap_stream *stream, uint8_t code, uint8_t reason,
+					void *user_data)
+{
+	struct bap_setup *setup = user_data;
+
+	DBG("stream %p code 0x%02x reason 0x%02x", stream, code, reason);
+
+	setup->id = 0;
+
+	setup_reply(setup, !code);
+}
+
 static void config_cb(struct bt_bap_stream *stream,
 					uint8_t code, uint8_t reason,
 					void *user_data)
@@ -841,11 +862,15 @@ static void config_cb(struct bt_bap_stream *stream,
 	setup->msg = NULL;
 }
 
+static void cig_remove_setup(struct bap_setup *setup);
+
 static void setup_io_close(void *data, void *user_data)
 {
 	struct bap_setup *setup = data;
 	int fd;
 
+	cig_remove_setup(setup);
+
 	if (setup->io_id) {
 		g_source_remove(setup->io_id);
 		setup->io_id = 0;
@@ -926,6 +951,66 @@ static void setup_free(void *data)
 	free(setup);
 }
 
+static int setup_config_qos(struct bap_data *data, struct bap_setup *setup,
+						struct bt_bap_stream *stream);
+
+static void resume_cb(struct bt_bap_stream *stream, uint8_t code,
+					uint8_t reason, void *user_data)
+{
+	struct bap_setup *setup = user_data;
+
+	DBG("stream %p code 0x%02x reason 0x%02x", stream, code, reason);
+
+	setup->id = 0;
+
+	switch (bt_bap_stream_get_state(stream)) {
+	case BT_BAP_STREAM_STATE_CONFIG:
+		/* Config QoS rejected, retry with the regular procedure */
+		if (code) {
+			setup->id = bt_bap_stream_config(stream, &setup->qos,
+							setup->caps, config_cb,
+							setup);
+			if (setup->id)
+				return;
+
+			break;
+		}
+
+		/* Only the codec is restored when the CIG/CIS are unset, the
+		 * IO assigns them before Config QoS is sent.
+		 */
+		if (!setup_config_qos(setup->ep->data, setup, stream))
+			return;
+
+		bt_bap_stream_release(stream, NULL, NULL);
+		break;
+	case BT_BAP_STREAM_STATE_QOS:
+		setup_reply(setup, !code);
+		return;
+	default:
+		break;
+	}
+
+	setup_reply(setup, false);
+}
+
+static unsigned int setup_stream_config(struct bap_setup *setup)
+{
+	unsigned int id;
+
+	/* Restore the configuration last accepted by the ASE if it matches,
+	 * so Config Codec is skipped when possible and Config QoS is sent as
+	 * soon as the ASE is ready.
+	 */
+	id = bt_bap_stream_resume(setup->stream, &setup->qos, false, resume_cb,
+									setup);
+	if (id)
+		return id;
+
+	return bt_bap_stream_config(setup->stream, &setup->qos, setup->caps,
+							config_cb, setup);
+}
+
 static DBusMessage *set_configuration(DBusConnection *conn, DBusMessage *msg,
 								void *data)
 {
@@ -957,8 +1042,7 @@ static DBusMessage *set_configuration(DBusConnection *conn, DBusMessage *msg,
 	setup->stream = bt_bap_stream_new(ep->data->bap, ep->lpac, ep->rpac,
 						&setup->qos, setup->caps);
 
-	setup->id = bt_bap_stream_config(setup->stream, &setup->qos,
-						setup->caps, config_cb, setup);
+	setup->id = setup_stream_config(setup);
 	if (!setup->id) {
 		DBG("Unable to config stream");
 		setup_free(setup);
@@ -1296,8 +1380,7 @@ static void setup_config(void *data, void *user_data)
 						ep->rpac, &setup->qos,
 						setup->caps);
 
-	setup->id = bt_bap_stream_config(setup->stream, &setup->qos,
-						setup->caps, config_cb, setup);
+	setup->id = setup_stream_config(setup);
 	if (!setup->id) {
 		DBG("Unable to config stream");
 		setup_free(setup);
@@ -1413,6 +1496,168 @@ static bool pac_found_bcast(struct bt_bap_pac *lpac, struct bt_bap_pac *rpac,
 	return true;
 }
 
+static bool bap_cache_filename(struct btd_device *device, char *filename,
+								char *hash)
+{
+	uint8_t *db_hash;
+	char dst_addr[18];
+	int i;
+
+	/* Only cache bonded devices since the values may not be trusted
+	 * otherwise.
+	 */
+	if (!device_is_bonded(device, btd_device_get_bdaddr_type(device)))
+		return false;
+
+	db_hash = gatt_db_get_hash(btd_device_get_gatt_db(device));
+	if (!db_hash)
+		return false;
+
+	for (i = 0; i < 16; i++)
+		sprintf(hash + i * 2, "%02hhx", db_hash[i]);
+
+	ba2str(device_get_address(device), dst_addr);
+
+	create_filename(filename, PATH_MAX, "/%s/cache/%s",
+			btd_adapter_get_storage_dir(device_get_adapter(device)),
+			dst_addr);
+
+	return true;
+}
+
+static void store_pacs_value(uint16_t handle, const uint8_t *value,
+					uint16_t len, void *user_data)
+{
+	GKeyFile *key_file = user_data;
+	char key[7];
+	char *str;
+	uint16_t i;
+
+	sprintf(key, "0x%04x", handle);
+
+	str = g_malloc0(len * 2 + 1);
+
+	for (i = 0; i < len; i++)
+		sprintf(str + i * 2, "%02hhx", value[i]);
+
+	g_key_file_set_string(key_file, "PACS", key, str);
+
+	g_free(str);
+}
+
+static void store_pacs(struct bap_data *data)
+{
+	char filename[PATH_MAX];
+	char hash[33];
+	GKeyFile *key_file;
+	GError *gerr = NULL;
+	char *str;
+	gsize length = 0;
+
+	if (!data->device || !bap_cache_filename(data->device, filename, hash))
+		return;
+
+	key_file = g_key_file_new();
+	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
+		error("Unable to load key file from %s: (%s)", filename,
+								gerr->message);
+		g_clear_error(&gerr);
+	}
+
+	/* Remove current values since they might have changed */
+	g_key_file_remove_group(key_file, "PACS", NULL);
+
+	g_key_file_set_string(key_file, "PACS", "Hash", hash);
+	bt_bap_foreach_cache(data->bap, store_pacs_value, key_file);
+
+	str = g_key_file_to_data(key_file, &length, NULL);
+	if (!g_file_set_contents(filename, str, length, &gerr)) {
+		error("Unable set contents for %s: (%s)", filename,
+								gerr->message);
+		g_error_free(gerr);
+	}
+
+	g_free(str);
+	g_key_file_free(key_file);
+}
+
+static void load_pacs_value(struct bap_data *data, GKeyFile *key_file,
+							const char *key)
+{
+	uint8_t *value = NULL;
+	unsigned int handle;
+	char *str;
+	size_t i, len;
+
+	if (sscanf(key, "0x%04x", &handle) != 1)
+		return;
+
+	str = g_key_file_get_string(key_file, "PACS", key, NULL);
+	if (!str)
+		return;
+
+	/* PAC records can exceed 255 bytes, size the buffer from the string */
+	len = strlen(str) / 2;
+	if (!len || len > UINT16_MAX) {
+		error("Invalid PACS cache value %s length: %zu", key, len);
+		goto done;
+	}
+
+	value = g_malloc(len);
+
+	for (i = 0; i < len; i++) {
+		if (sscanf(str + i * 2, "%02hhx", &value[i]) != 1) {
+			error("Invalid PACS cache value %s", key);
+			goto done;
+		}
+	}
+
+	bt_bap_add_cache(data->bap, handle, value, len);
+
+done:
+	g_free(value);
+	g_free(str);
+}
+
+static void load_pacs(struct bap_data *data)
+{
+	char filename[PATH_MAX];
+	char hash[33];
+	GKeyFile *key_file;
+	char **keys, *str;
+	int i;
+
+	if (!data->device || !bap_cache_filename(data->device, filename, hash))
+		return;
+
+	key_file = g_key_file_new();
+	if (!g_key_file_load_from_file(key_file, filename, 0, NULL))
+		goto done;
+
+	/* Discard the values if the remote database has changed */
+	str = g_key_file_get_string(key_file, "PACS", "Hash", NULL);
+	if (!str || strcmp(str, hash)) {
+		g_free(str);
+		goto done;
+	}
+
+	g_free(str);
+
+	keys = g_key_file_get_keys(key_file, "PACS", NULL, NULL);
+
+	for (i = 0; keys && keys[i]; i++) {
+		if (!strcmp(keys[i], "Hash"))
+			continue;
+
+		load_pacs_value(data, key_file, keys[i]);
+	}
+
+	g_strfreev(keys);
+
+done:
+	g_key_file_free(key_file);
+}
+
 static void bap_ready(struct bt_bap *bap, void *user_data)
 {
 	struct btd_service *service = user_data;
@@ -1427,6 +1672,8 @@ static void bap_ready(struct bt_bap *bap, void *user_data)
 
 	bt_bap_foreach_pac(bap, BT_BAP_SOURCE, pac_select, service);
 	bt_bap_foreach_pac(bap, BT_BAP_SINK, pac_select, service);
+
+	store_pacs(btd_service_get_user_data(service));
 }
 
 static bool match_setup_stream(const void *data, const void *user_data)
@@ -1771,10 +2018,250 @@ static void bap_connect_bcast_io_cb(GIOChannel *chan, GError *err,
 	iso_connect_bcast_cb(chan, err, setup->stream);
 }
 
+static bool match_cig(const void *data, const void *match_data)
+{
+	const struct bap_cig *cig = data;
+	const struct cig_busy_data *info = match_data;
+
+	return cig->adapter == info->adapter && cig->id == info->cig;
+}
+
+static struct bap_cig *cig_find(struct btd_adapter *adapter, uint8_t id)
+{
+	struct cig_busy_data info;
+
+	info.adapter = adapter;
+	info.cig = id;
+
+	return queue_find(cigs, match_cig, &info);
+}
+
+static void cig_free(void *data)
+{
+	struct bap_cig *cig = data;
+
+	if (cig->timeout_id)
+		g_source_remove(cig->timeout_id);
+
+	queue_destroy(cig->setups, NULL);
+	free(cig);
+}
+
+static void cig_check_free(struct bap_cig *cig)
+{
+	if (!queue_isempty(cig->setups) || cig->connecting)
+		return;
+
+	queue_remove(cigs, cig);
+	cig_free(cig);
+
+	if (queue_isempty(cigs)) {
+		queue_destroy(cigs, NULL);
+		cigs = NULL;
+	}
+}
+
+static void cig_connect_done(struct bap_cig *cig)
+{
+	if (--cig->connecting)
+		return;
+
+	DBG("CIG 0x%02x ready in %" G_GINT64_FORMAT " us", cig->id,
+				g_get_monotonic_time() - cig->start);
+
+	cig_check_free(cig);
+}
+
+static void setup_accept_cig(void *data, void *user_data)
+{
+	struct bap_setup *setup = data;
+	struct bap_cig *cig = user_data;
+	int fd;
+
+	if (setup->stream &&
+			bt_bap_stream_io_is_connecting(setup->stream, &fd))
+		setup_accept_io(setup, setup->stream, fd, 0);
+
+	/* Only the setup owning the accepted IO gets the connect callback */
+	if (!setup->io || !setup->cig_active) {
+		setup->cig = NULL;
+		return;
+	}
+
+	cig->connecting++;
+}
+
+/* Trigger the Create CIS of every queued setup at once so the controller
+ * can establish all the CIS of the CIG in a single procedure.
+ */
+static void cig_connect(struct bap_cig *cig)
+{
+	struct queue *setups = cig->setups;
+
+	if (cig->timeout_id) {
+		g_source_remove(cig->timeout_id);
+		cig->timeout_id = 0;
+	}
+
+	cig->setups = queue_new();
+
+	DBG("CIG 0x%02x connecting %u CIS", cig->id, queue_length(setups));
+
+	queue_foreach(setups, setup_accept_cig, cig);
+	queue_destroy(setups, NULL);
+
+	cig_check_free(cig);
+}
+
+static gboolean cig_connect_timeout(gpointer user_data)
+{
+	struct bap_cig *cig = user_data;
+
+	DBG("CIG 0x%02x", cig->id);
+
+	cig->timeout_id = 0;
+	cig_connect(cig);
+
+	return FALSE;
+}
+
+struct cig_pending_data {
+	struct bap_cig *cig;
+	bool pending;
+};
+
+static void setup_cig_pending(void *data, void *user_data)
+{
+	struct bap_setup *setup = data;
+	struct cig_pending_data *info = user_data;
+
+	if (info->pending || !setup->stream || !setup->io ||
+			setup->qos.ucast.cig_id != info->cig->id ||
+			queue_find(info->cig->setups, NULL, setup))
+		return;
+
+	/* CIS already programmed and Enable sent but not completed yet */
+	if (bt_bap_stream_is_enabling(setup->stream))
+		info->pending = true;
+}
+
+static void ep_cig_pending(void *data, void *user_data)
+{
+	struct bap_ep *ep = data;
+
+	queue_foreach(ep->setups, setup_cig_pending, user_data);
+}
+
+static void session_cig_pending(void *data, void *user_data)
+{
+	struct bap_data *session = data;
+	struct cig_pending_data *info = user_data;
+
+	if (device_get_adapter(session->device) != info->cig->adapter)
+		return;
+
+	queue_foreach(session->snks, ep_cig_pending, user_data);
+	queue_foreach(session->srcs, ep_cig_pending, user_data);
+}
+
+/* Queue the setup until every CIS of the CIG, across all the devices of
+ * the adapter (e.g. the members of a coordinated set), is enabled, so
+ * they are connected together instead of one after the other.
+ */
+static bool cig_queue_setup(struct bap_setup *setup)
+{
+	struct btd_adapter *adapter;
+	struct bap_cig *cig;
+	struct cig_pending_data info;
+
+	/* Already queued, or connecting and waiting for its callback */
+	if (setup->cig)
+		return queue_find(setup->cig->setups, NULL, setup);
+
+	if (setup->qos.ucast.cig_id == BT_ISO_QOS_CIG_UNSET)
+		return false;
+
+	adapter = device_get_adapter(setup->ep->data->device);
+
+	cig = cig_find(adapter, setup->qos.ucast.cig_id);
+	if (!cig) {
+		cig = new0(struct bap_cig, 1);
+		cig->adapter = adapter;
+		cig->id = setup->qos.ucast.cig_id;
+		cig->setups = queue_new();
+
+		if (!cigs)
+			cigs = queue_new();
+
+		queue_push_tail(cigs, cig);
+	}
+
+	if (!cig->connecting && queue_isempty(cig->setups))
+		cig->start = g_get_monotonic_time();
+
+	queue_push_tail(cig->setups, setup);
+	setup->cig = cig;
+
+	info.cig = cig;
+	info.pending = false;
+	queue_foreach(sessions, session_cig_pending, &info);
+
+	DBG("CIG 0x%02x setup %p pending %s", cig->id, setup,
+					info.pending ? "true" : "false");
+
+	if (!info.pending)
+		cig_connect(cig);
+	else if (!cig->timeout_id)
+		cig->timeout_id = g_timeout_add(CIG_CONNECT_TIMEOUT,
+						cig_connect_timeout, cig);
+
+	return true;
+}
+
+static void cig_remove_setup(struct bap_setup *setup)
+{
+	struct bap_cig *cig = setup->cig;
+
+	if (!cig)
+		return;
+
+	setup->cig = NULL;
+
+	/* The connect callback won't be called once the IO is closed */
+	if (!queue_remove(cig->setups, setup)) {
+		cig_connect_done(cig);
+		return;
+	}
+
+	if (queue_isempty(cig->setups) && cig->timeout_id) {
+		g_source_remove(cig->timeout_id);
+		cig->timeout_id = 0;
+	}
+
+	cig_check_free(cig);
+}
+
+static void cig_setup_connected(struct bap_setup *setup, GError *err)
+{
+	struct bap_cig *cig = setup->cig;
+
+	if (!cig || queue_find(cig->setups, NULL, setup))
+		return;
+
+	setup->cig = NULL;
+
+	if (err)
+		error("CIG 0x%02x: %s", cig->id, err->message);
+
+	cig_connect_done(cig);
+}
+
 static void bap_connect_io_cb(GIOChannel *chan, GError *err, gpointer user_data)
 {
 	struct bap_setup *setup = user_data;
 
+	cig_setup_connected(setup, err);
+
 	if (!setup->stream)
 		return;
 
@@ -1797,6 +2284,9 @@ static void setup_connect_io(struct bap_data *data, struct bap_setup *setup,
 	}
 
 	if (bt_bap_stream_io_is_connecting(stream, &fd)) {
+		if (!defer && cig_queue_setup(setup))
+			return;
+
 		setup_accept_io(setup, stream, fd, defer);
 		return;
 	}
@@ -2062,6 +2552,29 @@ static void setup_create_io(struct bap_data *data, struct bap_setup *setup,
 	}
 }
 
+/* Create the IO, which assigns the CIG/CIS when unset, then Config QoS */
+static int setup_config_qos(struct bap_data *data, struct bap_setup *setup,
+						struct bt_bap_stream *stream)
+{
+	setup_create_io(data, setup, stream, true);
+	if (!setup->io) {
+		error("Unable to create io");
+		return -EIO;
+	}
+
+	if (bt_bap_stream_get_type(stream) != BT_BAP_STREAM_TYPE_UCAST)
+		return 0;
+
+	/* Wait QoS response to respond */
+	setup->id = bt_bap_stream_qos(stream, &setup->qos, qos_cb, setup);
+	if (!setup->id) {
+		error("Failed to Configure QoS");
+		bt_bap_stream_release(stream, NULL, NULL);
+	}
+
+	return 0;
+}
+
 static void bap_state(struct bt_bap_stream *stream, uint8_t old_state,
 				uint8_t new_state, void *user_data)
 {
@@ -2090,29 +2603,10 @@ static void bap_state(struct bt_bap_stream *stream, uint8_t old_state,
 			queue_remove(data->streams, stream);
 		break;
 	case BT_BAP_STREAM_STATE_CONFIG:
-		if (setup && !setup->id) {
-			setup_create_io(data, setup, stream, true);
-			if (!setup->io) {
-				error("Unable to create io");
-				if (old_state != BT_BAP_STREAM_STATE_RELEASING)
-					bt_bap_stream_release(stream, NULL,
-								NULL);
-				return;
-			}
-
-			if (bt_bap_stream_get_type(stream) ==
-					BT_BAP_STREAM_TYPE_UCAST) {
-				/* Wait QoS response to respond */
-				setup->id = bt_bap_stream_qos(stream,
-								&setup->qos,
-								qos_cb,	setup);
-				if (!setup->id) {
-					error("Failed to Configure QoS");
-					bt_bap_stream_release(stream,
-								NULL, NULL);
-				}
-			}
-		}
+		if (setup && !setup->id &&
+				setup_config_qos(data, setup, stream) < 0 &&
+				old_state != BT_BAP_STREAM_STATE_RELEASING)
+			bt_bap_stream_release(stream, NULL, NULL);
 		break;
 	case BT_BAP_STREAM_STATE_QOS:
 		if (bt_bap_stream_get_type(stream) ==
@@ -2549,6 +3043,8 @@ static int bap_accept(struct btd_service *service)
 		return -EINVAL;
 	}
 
+	load_pacs(data);
+
 	if (!bt_bap_attach(data->bap, client)) {
 		error("BAP unable to attach");
 		return -EINVAL;
@@ -2573,6 +3069,9 @@ static int bap_disconnect(struct btd_service *service)
 	queue_remove_all(data->snks, ep_remove, NULL, NULL);
 	queue_remove_all(data->srcs, ep_remove, NULL, NULL);
 
+	/* Store values reconciled in the background after ready */
+	store_pacs(data);
+
 	bt_bap_detach(data->bap);
 
 	btd_service_disconnecting_complete(service, 0);
@@ -27,6 +27,7 @@
 
 #include "gdbus/gdbus.h"
 
+#include "src/btd.h"
 #include "src/plugin.h"
 #include "src/adapter.h"
 #include "src/device.h"
@@ -43,6 +44,7 @@
 #include "src/shared/att.h"
 #include "src/shared/bap.h"
 #include "src/shared/bap-debug.h"
+#include "src/shared/lc3.h"
 
 #include "avdtp.h"
 #include "media.h"
@@ -100,6 +102,9 @@ struct media_endpoint {
 	size_t			size;		/* Endpoint capabilities size */
 	uint8_t                 *metadata;      /* Endpoint property metadata */
 	size_t                  metadata_size;  /* Endpoint metadata size */
+	char			**presets;	/* Endpoint selection policy */
+	struct queue		*select_cache;	/* Policy results */
+	GSList			*selects;	/* Pending policy replies */
 	guint			hs_watch;
 	guint			ag_watch;
 	guint			watch;
@@ -166,11 +171,15 @@ static void media_endpoint_cancel_all(struct media_endpoint *endpoint)
 		media_endpoint_cancel(endpoint->requests->data);
 }
 
+static void select_cache_free(void *data);
+static void select_policy_cancel_all(struct media_endpoint *endpoint);
+
 static void media_endpoint_destroy(struct media_endpoint *endpoint)
 {
 	DBG("sender=%s path=%s", endpoint->sender, endpoint->path);
 
 	media_endpoint_cancel_all(endpoint);
+	select_policy_cancel_all(endpoint);
 
 	g_slist_free_full(endpoint->transports,
 				(GDestroyNotify) media_transport_destroy);
@@ -182,6 +191,8 @@ static void media_endpoint_destroy(struct media_endpoint *endpoint)
 	}
 
 	g_dbus_remove_watch(btd_get_dbus_connection(), endpoint->watch);
+	queue_destroy(endpoint->select_cache, select_cache_free);
+	g_strfreev(endpoint->presets);
 	g_free(endpoint->capabilities);
 	g_free(endpoint->metadata);
 	g_free(endpoint->sender);
@@ -920,6 +931,408 @@ done:
 	data->cb(data->pac, err, &caps, &meta, &qos, data->user_data);
 }
 
+/*
+ * In-daemon selection policy: when the endpoint, or main.conf, lists
+ * preferred LC3 presets the first one supported by both PACs is used
+ * directly and SelectProperties is only called when none matches.
+ */
+#define SELECT_CACHE_MAX	16
+
+struct select_preset {
+	const char *name;
+	uint8_t freq;
+	uint8_t duration;
+	uint16_t len;
+	struct bt_bap_qos qos;
+	uint8_t framing;
+	uint8_t target_latency;
+};
+
+#define SELECT_PRESET(_name, _freq, _duration, _len, _qos, _framing, _lat) \
+	{ \
+		.name = _name, \
+		.freq = LC3_CONFIG_FREQ_##_freq, \
+		.duration = LC3_CONFIG_DURATION_##_duration, \
+		.len = _len, \
+		.qos = _qos, \
+		.framing = _framing, \
+		.target_latency = _lat, \
+	}
+
+/* Low latency (_1) and high reliability (_2) variants of a config */
+#define SELECT_PRESETS(_cfg, _freq, _duration, _len, _framing) \
+	SELECT_PRESET(#_cfg "_1", _freq, _duration, _len, \
+			LC3_QOS_##_cfg##_1, LC3_QOS_##_framing, \
+			BT_BAP_CONFIG_LATENCY_BALANCED), \
+	SELECT_PRESET(#_cfg "_2", _freq, _duration, _len, \
+			LC3_QOS_##_cfg##_2, LC3_QOS_##_framing, \
+			BT_BAP_CONFIG_LATENCY_HIGH)
+
+static const struct select_preset select_presets[] = {
+	SELECT_PRESETS(8_1, 8KHZ, 7_5, 26, UNFRAMED),
+	SELECT_PRESETS(8_2, 8KHZ, 10, 30, UNFRAMED),
+	SELECT_PRESETS(16_1, 16KHZ, 7_5, 30, UNFRAMED),
+	SELECT_PRESETS(16_2, 16KHZ, 10, 40, UNFRAMED),
+	SELECT_PRESETS(24_1, 24KHZ, 7_5, 45, UNFRAMED),
+	SELECT_PRESETS(24_2, 24KHZ, 10, 60, UNFRAMED),
+	SELECT_PRESETS(32_1, 32KHZ, 7_5, 60, UNFRAMED),
+	SELECT_PRESETS(32_2, 32KHZ, 10, 80, UNFRAMED),
+	SELECT_PRESETS(44_1, 44KHZ, 7_5, 98, FRAMED),
+	SELECT_PRESETS(44_2, 44KHZ, 10, 130, FRAMED),
+	SELECT_PRESETS(48_1, 48KHZ, 7_5, 75, UNFRAMED),
+	SELECT_PRESETS(48_2, 48KHZ, 10, 100, UNFRAMED),
+	SELECT_PRESETS(48_3, 48KHZ, 7_5, 90, UNFRAMED),
+	SELECT_PRESETS(48_4, 48KHZ, 10, 120, UNFRAMED),
+	SELECT_PRESETS(48_5, 48KHZ, 7_5, 117, UNFRAMED),
+	SELECT_PRESETS(48_6, 48KHZ, 10, 155, UNFRAMED),
+};
+
+/* Fingerprint of the remote PAC a policy result applies to */
+struct select_cache {
+	struct iovec *caps;
+	uint32_t locations;
+	uint32_t location;
+	uint32_t pd_min;
+	uint32_t pd_max;
+	uint16_t latency;
+	uint8_t phy;
+	const struct select_preset *preset;
+};
+
+struct select_reply {
+	struct media_endpoint *endpoint;
+	struct bt_bap_pac *pac;
+	bt_bap_pac_select_t cb;
+	void *user_data;
+	guint id;
+	struct iovec caps;
+	uint8_t data[LC3_CONFIG_CHAN_ALLOC_LEN + 1 + 10];
+	struct bt_bap_qos qos;
+};
+
+struct lc3_caps {
+	uint16_t freq;
+	uint8_t duration;
+	uint8_t chan_count;
+	uint16_t len_min;
+	uint16_t len_max;
+};
+
+static void select_cache_free(void *data)
+{
+	struct select_cache *entry = data;
+
+	util_iov_free(entry->caps, 1);
+	free(entry);
+}
+
+static const struct select_preset *select_preset_find(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(select_presets); i++) {
+		if (!strcmp(select_presets[i].name, name))
+			return &select_presets[i];
+	}
+
+	return NULL;
+}
+
+static void parse_lc3_caps(size_t i, uint8_t l, uint8_t t, uint8_t *v,
+							void *user_data)
+{
+	struct lc3_caps *caps = user_data;
+
+	switch (t) {
+	case LC3_FREQ:
+		if (l == 2)
+			caps->freq = get_le16(v);
+		break;
+	case LC3_DURATION:
+		if (l == 1)
+			caps->duration = v[0];
+		break;
+	case LC3_CHAN_COUNT:
+		if (l == 1)
+			caps->chan_count = v[0];
+		break;
+	case LC3_FRAME_LEN:
+		if (l == 4) {
+			caps->len_min = get_le16(v);
+			caps->len_max = get_le16(v + 2);
+		}
+		break;
+	}
+}
+
+static bool lc3_caps_parse(struct iovec *data, struct lc3_caps *caps)
+{
+	struct util_ltv_index idx;
+	uint8_t *v, len;
+
+	if (!data || !data->iov_len)
+		return false;
+
+	memset(caps, 0, sizeof(*caps));
+
+	/* Absence of Audio Channel Counts means 1 channel */
+	caps->chan_count = LC3_CHAN_COUNT_SUPPORT;
+
+	/* Merged PAC records may repeat a type, walk them entry by entry */
+	if (!util_ltv_index_init(&idx, data->iov_base, data->iov_len))
+		return util_ltv_foreach(data->iov_base, data->iov_len, NULL,
+						parse_lc3_caps, caps);
+
+	util_ltv_index_get_le16(&idx, LC3_FREQ, &caps->freq);
+	util_ltv_index_get_u8(&idx, LC3_DURATION, &caps->duration);
+	util_ltv_index_get_u8(&idx, LC3_CHAN_COUNT, &caps->chan_count);
+
+	v = util_ltv_index_get(&idx, LC3_FRAME_LEN, &len);
+	if (v && len == 4) {
+		caps->len_min = get_le16(v);
+		caps->len_max = get_le16(v + 2);
+	}
+
+	return true;
+}
+
+static bool select_preset_supported(const struct select_preset *preset,
+					const struct lc3_caps *caps,
+					uint8_t channels)
+{
+	return (caps->freq & BIT(preset->freq - 1)) &&
+			(caps->duration & BIT(preset->duration)) &&
+			(caps->chan_count & BIT(channels - 1)) &&
+			preset->len >= caps->len_min &&
+			preset->len <= caps->len_max;
+}
+
+static uint8_t location_channels(uint32_t location)
+{
+	uint8_t channels = 0;
+
+	for (; location; location &= location - 1)
+		channels++;
+
+	return channels ? channels : 1;
+}
+
+static const struct select_preset *select_policy_eval(
+					struct media_endpoint *endpoint,
+					struct bt_bap_pac *rpac,
+					uint32_t location)
+{
+	uint8_t channels = location_channels(location);
+	struct iovec lcaps = {
+		.iov_base = endpoint->capabilities,
+		.iov_len = endpoint->size,
+	};
+	struct lc3_caps lc3_lcaps, lc3_rcaps;
+	struct iovec *rcaps;
+	char **name;
+
+	bt_bap_pac_get_codec(rpac, NULL, &rcaps, NULL);
+
+	/* Parse the capabilities once for all the presets */
+	if (!lc3_caps_parse(&lcaps, &lc3_lcaps) ||
+			!lc3_caps_parse(rcaps, &lc3_rcaps))
+		return NULL;
+
+	for (name = endpoint->presets; *name; name++) {
+		const struct select_preset *preset;
+
+		preset = select_preset_find(g_strstrip(*name));
+		if (!preset) {
+			DBG("Unknown preset %s", *name);
+			continue;
+		}
+
+		if (select_preset_supported(preset, &lc3_lcaps, channels) &&
+			select_preset_supported(preset, &lc3_rcaps, channels))
+			return preset;
+	}
+
+	return NULL;
+}
+
+static bool match_select_cache(const void *data, const void *match_data)
+{
+	const struct select_cache *entry = data;
+	const struct select_cache *match = match_data;
+
+	if (entry->locations != match->locations ||
+			entry->location != match->location ||
+			entry->pd_min != match->pd_min ||
+			entry->pd_max != match->pd_max ||
+			entry->latency != match->latency ||
+			entry->phy != match->phy)
+		return false;
+
+	return util_iov_memcmp(entry->caps, match->caps) == 0;
+}
+
+static bool select_policy_lookup(struct media_endpoint *endpoint,
+					struct bt_bap_pac *rpac,
+					uint32_t location,
+					struct bt_bap_pac_qos *rqos,
+					const struct select_preset **preset)
+{
+	struct select_cache match, *entry;
+
+	memset(&match, 0, sizeof(match));
+	bt_bap_pac_get_codec(rpac, NULL, &match.caps, NULL);
+	match.locations = bt_bap_pac_get_locations(rpac);
+	match.location = location;
+
+	if (rqos) {
+		match.pd_min = rqos->pd_min;
+		match.pd_max = rqos->pd_max;
+		match.latency = rqos->latency;
+		match.phy = rqos->phy;
+	}
+
+	entry = queue_find(endpoint->select_cache, match_select_cache, &match);
+	if (entry) {
+		*preset = entry->preset;
+		return true;
+	}
+
+	if (!endpoint->select_cache)
+		endpoint->select_cache = queue_new();
+
+	if (queue_length(endpoint->select_cache) >= SELECT_CACHE_MAX)
+		select_cache_free(queue_pop_head(endpoint->select_cache));
+
+	entry = util_memdup(&match, sizeof(match));
+	entry->caps = util_iov_dup(match.caps, 1);
+	entry->preset = select_policy_eval(endpoint, rpac, location);
+	queue_push_tail(endpoint->select_cache, entry);
+
+	*preset = entry->preset;
+
+	return false;
+}
+
+static gboolean select_policy_reply(gpointer user_data)
+{
+	struct select_reply *reply = user_data;
+	struct media_endpoint *endpoint = reply->endpoint;
+	struct iovec meta = {};
+
+	endpoint->selects = g_slist_remove(endpoint->selects, reply);
+
+	reply->cb(reply->pac, 0, &reply->caps, &meta, &reply->qos,
+							reply->user_data);
+	free(reply);
+
+	return FALSE;
+}
+
+static void select_policy_cancel_all(struct media_endpoint *endpoint)
+{
+	while (endpoint->selects) {
+		struct select_reply *reply = endpoint->selects->data;
+
+		endpoint->selects = g_slist_remove(endpoint->selects, reply);
+		g_source_remove(reply->id);
+		reply->cb(reply->pac, -ECANCELED, NULL, NULL, NULL,
+							reply->user_data);
+		free(reply);
+	}
+}
+
+static void select_policy_qos(const struct select_preset *preset,
+					uint8_t channels,
+					struct bt_bap_pac_qos *rqos,
+					struct bt_bap_qos *qos)
+{
+	struct bt_bap_io_qos *io_qos = &qos->ucast.io_qos;
+
+	*qos = preset->qos;
+
+	/* Mark CIG and CIS to be auto assigned */
+	qos->ucast.cig_id = BT_ISO_QOS_CIG_UNSET;
+	qos->ucast.cis_id = BT_ISO_QOS_CIS_UNSET;
+	qos->ucast.framing = preset->framing;
+	qos->ucast.target_latency = preset->target_latency;
+	io_qos->sdu *= channels;
+
+	if (!rqos)
+		return;
+
+	/* Stay within the remote preferences */
+	if (rqos->phy && !(rqos->phy & io_qos->phy))
+		io_qos->phy = BT_BAP_CONFIG_PHY_1M;
+
+	if (rqos->latency && io_qos->latency > rqos->latency)
+		io_qos->latency = rqos->latency;
+
+	if (rqos->pd_max && qos->ucast.delay > rqos->pd_max)
+		qos->ucast.delay = rqos->pd_max;
+
+	if (qos->ucast.delay < rqos->pd_min)
+		qos->ucast.delay = rqos->pd_min;
+}
+
+static int select_policy(struct media_endpoint *endpoint,
+				struct bt_bap_pac *lpac, struct bt_bap_pac *rpac,
+				uint32_t location, struct bt_bap_pac_qos *qos,
+				bt_bap_pac_select_t cb, void *cb_data)
+{
+	const struct select_preset *preset;
+	struct select_reply *reply;
+	struct iovec iov;
+	bool cached;
+
+	if (!endpoint->presets || endpoint->codec != LC3_ID)
+		return -ENOENT;
+
+	cached = select_policy_lookup(endpoint, rpac, location, qos, &preset);
+	if (!preset) {
+		DBG("policy declined%s", cached ? " (cached)" : "");
+		return -ENOENT;
+	}
+
+	DBG("preset %s%s location 0x%08x", preset->name,
+					cached ? " (cached)" : "", location);
+
+	reply = new0(struct select_reply, 1);
+	reply->endpoint = endpoint;
+	reply->pac = lpac;
+	reply->cb = cb;
+	reply->user_data = cb_data;
+
+	iov.iov_base = reply->data;
+	iov.iov_len = 0;
+
+	util_iov_push_u8(&iov, 0x02);
+	util_iov_push_u8(&iov, LC3_CONFIG_FREQ);
+	util_iov_push_u8(&iov, preset->freq);
+	util_iov_push_u8(&iov, 0x02);
+	util_iov_push_u8(&iov, LC3_CONFIG_DURATION);
+	util_iov_push_u8(&iov, preset->duration);
+	util_iov_push_u8(&iov, 0x03);
+	util_iov_push_u8(&iov, LC3_CONFIG_FRAME_LEN);
+	util_iov_push_le16(&iov, preset->len);
+
+	if (location) {
+		util_iov_push_u8(&iov, LC3_CONFIG_CHAN_ALLOC_LEN);
+		util_iov_push_u8(&iov, LC3_CONFIG_CHAN_ALLOC);
+		util_iov_push_le32(&iov, location);
+	}
+
+	reply->caps = iov;
+
+	select_policy_qos(preset, location_channels(location), qos,
+								&reply->qos);
+
+	/* Reply from the main loop, like the endpoint would */
+	reply->id = g_idle_add(select_policy_reply, reply);
+	endpoint->selects = g_slist_prepend(endpoint->selects, reply);
+
+	return 0;
+}
+
 static int pac_select(struct bt_bap_pac *lpac, struct bt_bap_pac *rpac,
 			uint32_t location, struct bt_bap_pac_qos *qos,
 			bt_bap_pac_select_t cb, void *cb_data, void *user_data)
@@ -938,6 +1351,9 @@ static int pac_select(struct bt_bap_pac *lpac, struct bt_bap_pac *rpac,
 	if (!caps)
 		return -EINVAL;
 
+	if (!select_policy(endpoint, lpac, rpac, location, qos, cb, cb_data))
+		return 0;
+
 	msg = dbus_message_new_method_call(endpoint->sender, endpoint->path,
 						MEDIA_ENDPOINT_INTERFACE,
 						"SelectProperties");
@@ -1439,6 +1855,48 @@ static const struct media_endpoint_init {
 			experimental_bcast_sink_ep_supported },
 };
 
+static char **select_presets_load(const char *uuid)
+{
+	GKeyFile *conf = btd_get_main_conf();
+	const char *key;
+
+	if (!conf)
+		return NULL;
+
+	if (!strcasecmp(uuid, PAC_SINK_UUID))
+		key = "SinkPresets";
+	else if (!strcasecmp(uuid, PAC_SOURCE_UUID))
+		key = "SourcePresets";
+	else
+		return NULL;
+
+	g_key_file_set_list_separator(conf, ',');
+
+	return g_key_file_get_string_list(conf, "BAP", key, NULL, NULL);
+}
+
+static char **parse_presets(DBusMessageIter *iter)
+{
+	DBusMessageIter array;
+	GPtrArray *presets;
+
+	presets = g_ptr_array_new();
+
+	dbus_message_iter_recurse(iter, &array);
+
+	while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRING) {
+		const char *name;
+
+		dbus_message_iter_get_basic(&array, &name);
+		g_ptr_array_add(presets, g_strdup(name));
+		dbus_message_iter_next(&array);
+	}
+
+	g_ptr_array_add(presets, NULL);
+
+	return (char **) g_ptr_array_free(presets, FALSE);
+}
+
 static struct media_endpoint *
 media_endpoint_create(struct media_adapter *adapter,
 						const char *sender,
@@ -1453,6 +1911,7 @@ media_endpoint_create(struct media_adapter *adapter,
 						int size,
 						uint8_t *metadata,
 						int metadata_size,
+						char **presets,
 						int *err)
 {
 	struct media_endpoint *endpoint;
@@ -1484,6 +1943,11 @@ media_endpoint_create(struct media_adapter *adapter,
 		endpoint->metadata_size = metadata_size;
 	}
 
+	if (presets)
+		endpoint->presets = g_strdupv(presets);
+	else
+		endpoint->presets = select_presets_load(uuid);
+
 	endpoint->adapter = adapter;
 
 	for (i = 0; i < ARRAY_SIZE(init_table); i++) {
@@ -1533,7 +1997,8 @@ static int parse_properties(DBusMessageIter *props, const char **uuid,
 				uint16_t *cid, uint16_t *vid,
 				struct bt_bap_pac_qos *qos,
 				uint8_t **capabilities, int *size,
-				uint8_t **metadata, int *metadata_size)
+				uint8_t **metadata, int *metadata_size,
+				char ***presets)
 {
 	gboolean has_uuid = FALSE;
 	gboolean has_codec = FALSE;
@@ -1630,6 +2095,10 @@ static int parse_properties(DBusMessageIter *props, const char **uuid,
 				return -EINVAL;
 			dbus_message_iter_get_basic(&value,
 						    &qos->supported_context);
+		} else if (strcasecmp(key, "Presets") == 0) {
+			if (var != DBUS_TYPE_ARRAY || *presets)
+				return -EINVAL;
+			*presets = parse_presets(&value);
 		}
 
 		dbus_message_iter_next(props);
@@ -1642,6 +2111,7 @@ static DBusMessage *register_endpoint(DBusConnection *conn, DBusMessage *msg,
 					void *data)
 {
 	struct media_adapter *adapter = data;
+	struct media_endpoint *endpoint;
 	DBusMessageIter args, props;
 	const char *sender, *path, *uuid;
 	gboolean delay_reporting = FALSE;
@@ -1651,6 +2121,7 @@ static DBusMessage *register_endpoint(DBusConnection *conn, DBusMessage *msg,
 	struct bt_bap_pac_qos qos = {};
 	uint8_t *capabilities = NULL;
 	uint8_t *metadata = NULL;
+	char **presets = NULL;
 	int size = 0;
 	int metadata_size = 0;
 	int err;
@@ -1671,13 +2142,18 @@ static DBusMessage *register_endpoint(DBusConnection *conn, DBusMessage *msg,
 
 	if (parse_properties(&props, &uuid, &delay_reporting, &codec, &cid,
 			&vid, &qos, &capabilities, &size, &metadata,
-			&metadata_size) < 0)
+			&metadata_size, &presets) < 0) {
+		g_strfreev(presets);
 		return btd_error_invalid_args(msg);
+	}
 
-	if (media_endpoint_create(adapter, sender, path, uuid, delay_reporting,
-					codec, cid, vid, &qos, capabilities,
-					size, metadata, metadata_size,
-					&err) == NULL) {
+	endpoint = media_endpoint_create(adapter, sender, path, uuid,
+					delay_reporting, codec, cid, vid, &qos,
+					capabilities, size, metadata,
+					metadata_size, presets, &err);
+	g_strfreev(presets);
+
+	if (endpoint == NULL) {
 		if (err == -EPROTONOSUPPORT)
 			return btd_error_not_supported(msg);
 		else
@@ -2709,6 +3185,7 @@ static void app_register_endpoint(void *data, void *user_data)
 	int size = 0;
 	uint8_t *metadata = NULL;
 	int metadata_size = 0;
+	char **presets = NULL;
 	DBusMessageIter iter, array;
 	struct media_endpoint *endpoint;
 
@@ -2841,12 +3318,21 @@ static void app_register_endpoint(void *data, void *user_data)
 		dbus_message_iter_get_basic(&iter, &qos.supported_context);
 	}
 
+	if (g_dbus_proxy_get_property(proxy, "Presets", &iter)) {
+		if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+			goto fail;
+
+		presets = parse_presets(&iter);
+	}
+
 	endpoint = media_endpoint_create(app->adapter, app->sender, path, uuid,
 						delay_reporting, codec,
 						vendor.cid, vendor.vid, &qos,
 						capabilities, size,
 						metadata, metadata_size,
-						&app->err);
+						presets, &app->err);
+	g_strfreev(presets);
+
 	if (!endpoint) {
 		error("Unable to register endpoint %s:%s: %s", app->sender,
 						path, strerror(-app->err));
@@ -37,6 +37,9 @@
 #define MEDIA_FOLDER_INTERFACE "org.bluez.MediaFolder1"
 #define MEDIA_ITEM_INTERFACE "org.bluez.MediaItem1"
 
+#define MEDIA_WINDOW_SIZE	32	/* Items fetched at once */
+#define MEDIA_WINDOW_MAX	8	/* Windows cached per folder */
+
 struct player_callback {
 	const struct media_player_callback *cbs;
 	void *user_data;
@@ -59,12 +62,33 @@ struct media_item {
 	GHashTable		*metadata;	/* Item metadata */
 };
 
+/* Listed item, only backed by an object once played or requested */
+struct media_entry {
+	char			*name;		/* Item name */
+	player_item_type_t	type;		/* Item type */
+	bool			playable;	/* Item playable flag */
+	uint64_t		uid;		/* Item uid */
+	struct media_item	*item;		/* Item object, if any */
+};
+
+struct media_window {
+	struct media_folder	*folder;	/* NULL once cancelled */
+	uint32_t		start;		/* Index of the first entry */
+	uint32_t		count;		/* Number of entries */
+	struct media_entry	entries[MEDIA_WINDOW_SIZE];
+};
+
 struct media_folder {
 	struct media_folder	*parent;
 	struct media_item	*item;		/* Folder item */
 	uint32_t		number_of_items;/* Number of items */
 	GSList			*subfolders;
 	GSList			*items;
+	GSList			*listed;	/* Items being listed */
+	GSList			*windows;	/* Windows, most recent first */
+	uint32_t		range_start;	/* GetItems/queued ListItems */
+	uint32_t		range_count;	/* GetItems count */
+	uint32_t		range_end;	/* Queued ListItems end */
 	DBusMessage		*msg;
 };
 
@@ -88,6 +112,7 @@ struct media_player {
 	struct player_callback	*cb;
 	GSList			*pending;
 	GSList			*folders;
+	struct media_window	*fetch;		/* Window being fetched */
 };
 
 static void append_track(void *key, void *value, void *user_data)
@@ -617,63 +642,6 @@ static DBusMessage *media_player_release(DBusConnection *conn, DBusMessage *msg,
 	return g_dbus_create_reply(msg, DBUS_TYPE_INVALID);
 }
 
-static void parse_folder_list(gpointer data, gpointer user_data)
-{
-	struct media_item *item = data;
-	DBusMessageIter *array = user_data;
-	DBusMessageIter entry;
-
-	dbus_message_iter_open_container(array, DBUS_TYPE_DICT_ENTRY, NULL,
-								&entry);
-
-	dbus_message_iter_append_basic(&entry, DBUS_TYPE_OBJECT_PATH,
-								&item->path);
-
-	g_dbus_get_properties(btd_get_dbus_connection(), item->path,
-						MEDIA_ITEM_INTERFACE, &entry);
-
-	dbus_message_iter_close_container(array, &entry);
-}
-
-void media_player_list_complete(struct media_player *mp, GSList *items,
-								int err)
-{
-	struct media_folder *folder = mp->scope;
-	DBusMessage *reply;
-	DBusMessageIter iter, array;
-
-	if (folder == NULL || folder->msg == NULL)
-		return;
-
-	if (err < 0) {
-		reply = btd_error_failed(folder->msg, strerror(-err));
-		goto done;
-	}
-
-	reply = dbus_message_new_method_return(folder->msg);
-
-	dbus_message_iter_init_append(reply, &iter);
-
-	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
-					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
-					DBUS_TYPE_OBJECT_PATH_AS_STRING
-					DBUS_TYPE_ARRAY_AS_STRING
-					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
-					DBUS_TYPE_STRING_AS_STRING
-					DBUS_TYPE_VARIANT_AS_STRING
-					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
-					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
-					&array);
-
-	g_slist_foreach(items, parse_folder_list, &array);
-	dbus_message_iter_close_container(&iter, &array);
-
-done:
-	g_dbus_send_message(btd_get_dbus_connection(), reply);
-	dbus_message_unref(folder->msg);
-	folder->msg = NULL;
-}
-
 static struct media_item *
 media_player_create_subfolder(struct media_player *mp, const char *name,
 								uint64_t uid)
@@ -888,6 +856,14 @@ static DBusMessage *media_folder_list_items(DBusConnection *conn,
 	if (folder->msg != NULL)
 		return btd_error_failed(msg, strerror(EBUSY));
 
+	/* Wait for the window being fetched in the background */
+	if (mp->fetch) {
+		folder->range_start = start;
+		folder->range_end = end;
+		folder->msg = dbus_message_ref(msg);
+		return NULL;
+	}
+
 	err = cb->cbs->list_items(mp, folder->item->name, start, end,
 							cb->user_data);
 	if (err < 0)
@@ -920,11 +896,35 @@ static void media_item_destroy(void *data)
 	media_item_free(item);
 }
 
+static void media_window_free(void *data)
+{
+	struct media_window *window = data;
+	uint32_t i;
+
+	for (i = 0; i < window->count; i++)
+		g_free(window->entries[i].name);
+
+	g_free(window);
+}
+
+static void media_player_flush_windows(struct media_player *mp,
+						struct media_folder *folder)
+{
+	g_slist_free_full(folder->windows, media_window_free);
+	folder->windows = NULL;
+
+	/* Drop whatever the window being fetched receives */
+	if (mp->fetch && mp->fetch->folder == folder)
+		mp->fetch->folder = NULL;
+}
+
 static void media_folder_destroy(void *data)
 {
 	struct media_folder *folder = data;
 
 	g_slist_free_full(folder->subfolders, media_folder_destroy);
+	g_slist_free_full(folder->windows, media_window_free);
+	g_slist_free(folder->listed);
 	g_slist_free_full(folder->items, media_item_destroy);
 
 	if (folder->msg != NULL)
@@ -945,6 +945,9 @@ static void media_player_change_scope(struct media_player *mp,
 
 	DBG("%s", folder->item->name);
 
+	/* Listed windows only apply to the scope they were fetched in */
+	media_player_flush_windows(mp, mp->scope);
+
 	/* Skip setting current folder if folder is current playlist/search */
 	if (folder == mp->playlist || folder == mp->search)
 		goto cleanup;
@@ -956,6 +959,8 @@ static void media_player_change_scope(struct media_player *mp,
 		goto done;
 
 cleanup:
+	g_slist_free(mp->scope->listed);
+	mp->scope->listed = NULL;
 	g_slist_free_full(mp->scope->items, media_item_destroy);
 	mp->scope->items = NULL;
 
@@ -1115,6 +1120,492 @@ static gboolean get_items(const GDBusPropertyTable *property,
 	return TRUE;
 }
 
+static const char *type_to_string(uint8_t type);
+static struct media_item *media_folder_find_item(struct media_folder *folder,
+								uint64_t uid);
+static struct media_item *media_folder_create_item(struct media_player *mp,
+						struct media_folder *folder,
+						const char *name,
+						player_item_type_t type,
+						uint64_t uid);
+
+static void parse_folder_list(gpointer data, gpointer user_data)
+{
+	struct media_item *item = data;
+	DBusMessageIter *array = user_data;
+	DBusMessageIter entry;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_DICT_ENTRY, NULL,
+								&entry);
+
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_OBJECT_PATH,
+								&item->path);
+
+	g_dbus_get_properties(btd_get_dbus_connection(), item->path,
+						MEDIA_ITEM_INTERFACE, &entry);
+
+	dbus_message_iter_close_container(array, &entry);
+}
+
+static struct media_window *media_folder_find_window(
+						struct media_folder *folder,
+						uint32_t index)
+{
+	GSList *l;
+
+	for (l = folder->windows; l; l = l->next) {
+		struct media_window *window = l->data;
+
+		if (index < window->start ||
+				index - window->start >= MEDIA_WINDOW_SIZE)
+			continue;
+
+		/* Keep the most recently used windows first */
+		folder->windows = g_slist_delete_link(folder->windows, l);
+		folder->windows = g_slist_prepend(folder->windows, window);
+
+		return window;
+	}
+
+	return NULL;
+}
+
+static void media_folder_add_window(struct media_folder *folder,
+						struct media_window *window)
+{
+	GSList *last;
+
+	folder->windows = g_slist_prepend(folder->windows, window);
+
+	if (g_slist_length(folder->windows) <= MEDIA_WINDOW_MAX)
+		return;
+
+	/* Objects of evicted entries are kept in folder->items */
+	last = g_slist_last(folder->windows);
+	media_window_free(last->data);
+	folder->windows = g_slist_delete_link(folder->windows, last);
+}
+
+static int media_folder_fetch(struct media_player *mp,
+				struct media_folder *folder, uint32_t index)
+{
+	struct player_callback *cb = mp->cb;
+	struct media_window *window;
+	uint32_t start, end;
+	int err;
+
+	if (mp->fetch)
+		return -EINPROGRESS;
+
+	start = index - index % MEDIA_WINDOW_SIZE;
+	end = start + MEDIA_WINDOW_SIZE - 1;
+
+	if (folder->number_of_items && end >= folder->number_of_items)
+		end = folder->number_of_items - 1;
+
+	DBG("%s start %u end %u", folder->item->name, start, end);
+
+	window = g_new0(struct media_window, 1);
+	window->folder = folder;
+	window->start = start;
+	mp->fetch = window;
+
+	err = cb->cbs->list_items(mp, folder->item->name, start, end,
+							cb->user_data);
+	if (err < 0) {
+		mp->fetch = NULL;
+		media_window_free(window);
+	}
+
+	return err;
+}
+
+/* Fetch the next window in the background once the client is past the
+ * middle of the current one.
+ */
+static void media_folder_prefetch(struct media_player *mp,
+						struct media_folder *folder,
+						struct media_window *window)
+{
+	uint32_t next = window->start + MEDIA_WINDOW_SIZE;
+	GSList *l;
+
+	/* A partial window is the end of the folder */
+	if (window->count < MEDIA_WINDOW_SIZE)
+		return;
+
+	if (folder->number_of_items && next >= folder->number_of_items)
+		return;
+
+	if (folder->range_start + folder->range_count <
+				window->start + MEDIA_WINDOW_SIZE / 2)
+		return;
+
+	for (l = folder->windows; l; l = l->next) {
+		struct media_window *w = l->data;
+
+		if (w->start == next)
+			return;
+	}
+
+	media_folder_fetch(mp, folder, next);
+}
+
+static void append_entry(DBusMessageIter *array, struct media_entry *entry,
+								uint32_t index)
+{
+	DBusMessageIter dict;
+	const char *type = type_to_string(entry->type);
+	dbus_bool_t playable = entry->playable;
+
+	dbus_message_iter_open_container(array, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+
+	dict_append_entry(&dict, "Index", DBUS_TYPE_UINT32, &index);
+
+	if (entry->name)
+		dict_append_entry(&dict, "Name", DBUS_TYPE_STRING,
+							&entry->name);
+
+	dict_append_entry(&dict, "Type", DBUS_TYPE_STRING, &type);
+	dict_append_entry(&dict, "Playable", DBUS_TYPE_BOOLEAN, &playable);
+
+	if (entry->item)
+		dict_append_entry(&dict, "Item", DBUS_TYPE_OBJECT_PATH,
+							&entry->item->path);
+
+	dbus_message_iter_close_container(array, &dict);
+}
+
+static DBusMessage *media_folder_range_reply(struct media_folder *folder,
+						struct media_window *window)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	uint32_t i, count;
+
+	reply = dbus_message_new_method_return(folder->msg);
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&array);
+
+	/* Ranges are cut at the end of the window */
+	i = folder->range_start - window->start;
+	for (count = 0; i < window->count && count < folder->range_count;
+							i++, count++)
+		append_entry(&array, &window->entries[i], window->start + i);
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static void media_folder_list_range(struct media_player *mp,
+						struct media_folder *folder)
+{
+	struct media_window *window;
+	DBusMessage *reply;
+	int err;
+
+	window = media_folder_find_window(folder, folder->range_start);
+	if (window == NULL) {
+		err = media_folder_fetch(mp, folder, folder->range_start);
+
+		/* Replied once the window has been received */
+		if (err == 0 || err == -EINPROGRESS)
+			return;
+
+		reply = btd_error_failed(folder->msg, strerror(-err));
+		goto done;
+	}
+
+	reply = media_folder_range_reply(folder, window);
+
+	media_folder_prefetch(mp, folder, window);
+
+done:
+	g_dbus_send_message(btd_get_dbus_connection(), reply);
+	dbus_message_unref(folder->msg);
+	folder->msg = NULL;
+}
+
+static bool media_folder_range_pending(struct media_folder *folder)
+{
+	return folder->msg && dbus_message_is_method_call(folder->msg,
+						MEDIA_FOLDER_INTERFACE,
+						"GetItems");
+}
+
+static void media_window_add_entry(struct media_window *window,
+						struct media_item *item,
+						const char *name,
+						player_item_type_t type,
+						uint64_t uid, bool playable)
+{
+	struct media_entry *entry;
+
+	if (window->count == MEDIA_WINDOW_SIZE)
+		return;
+
+	entry = &window->entries[window->count++];
+	entry->name = g_strdup(name);
+	entry->type = type;
+	entry->playable = playable;
+	entry->uid = uid;
+	entry->item = item;
+}
+
+void media_player_list_item(struct media_player *mp, const char *name,
+						player_item_type_t type,
+						uint64_t uid, bool playable)
+{
+	struct media_folder *folder = mp->scope;
+	struct media_item *item;
+
+	if (folder == NULL)
+		return;
+
+	if (mp->fetch) {
+		folder = mp->fetch->folder;
+		if (folder == NULL)
+			return;
+
+		/* Reuse the object if there is one, e.g. for the track */
+		item = media_folder_find_item(folder, uid);
+		media_window_add_entry(mp->fetch, item, name, type, uid,
+								playable);
+		return;
+	}
+
+	item = media_folder_create_item(mp, folder, name, type, uid);
+	if (item == NULL)
+		return;
+
+	media_item_set_playable(item, playable);
+
+	folder->listed = g_slist_prepend(folder->listed, item);
+}
+
+void media_player_list_folder(struct media_player *mp,
+						struct media_item *item)
+{
+	struct media_folder *folder = mp->scope;
+
+	if (folder == NULL)
+		return;
+
+	if (mp->fetch) {
+		if (mp->fetch->folder)
+			media_window_add_entry(mp->fetch, item, item->name,
+						item->type, item->uid,
+						item->playable);
+		return;
+	}
+
+	folder->listed = g_slist_prepend(folder->listed, item);
+}
+
+static void media_folder_list_queued(struct media_player *mp,
+						struct media_folder *folder)
+{
+	struct player_callback *cb = mp->cb;
+	DBusMessage *reply;
+	int err;
+
+	err = cb->cbs->list_items(mp, folder->item->name, folder->range_start,
+					folder->range_end, cb->user_data);
+	if (err == 0)
+		return;
+
+	reply = btd_error_failed(folder->msg, strerror(-err));
+	g_dbus_send_message(btd_get_dbus_connection(), reply);
+	dbus_message_unref(folder->msg);
+	folder->msg = NULL;
+}
+
+static void media_folder_fetch_complete(struct media_player *mp,
+						struct media_window *window,
+						int err)
+{
+	struct media_folder *folder = window->folder;
+	DBusMessage *reply;
+	bool requested;
+
+	/* Cancelled by a scope change or a flush, the requests waiting for
+	 * it are served again from the current scope.
+	 */
+	if (folder == NULL) {
+		media_window_free(window);
+		folder = mp->scope;
+		goto done;
+	}
+
+	if (err < 0) {
+		requested = media_folder_range_pending(folder) &&
+				folder->range_start >= window->start &&
+				folder->range_start - window->start <
+							MEDIA_WINDOW_SIZE;
+
+		media_window_free(window);
+
+		/* Retry unless it was the window requested */
+		if (requested) {
+			reply = btd_error_failed(folder->msg, strerror(-err));
+			g_dbus_send_message(btd_get_dbus_connection(), reply);
+			dbus_message_unref(folder->msg);
+			folder->msg = NULL;
+			return;
+		}
+	} else
+		media_folder_add_window(folder, window);
+
+done:
+	if (folder->msg == NULL)
+		return;
+
+	if (media_folder_range_pending(folder))
+		media_folder_list_range(mp, folder);
+	else if (dbus_message_is_method_call(folder->msg,
+						MEDIA_FOLDER_INTERFACE,
+						"ListItems"))
+		media_folder_list_queued(mp, folder);
+}
+
+void media_player_list_complete(struct media_player *mp, int err)
+{
+	struct media_folder *folder = mp->scope;
+	struct media_window *window;
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	GSList *items;
+
+	if (folder == NULL)
+		return;
+
+	window = mp->fetch;
+	if (window) {
+		mp->fetch = NULL;
+		media_folder_fetch_complete(mp, window, err);
+		return;
+	}
+
+	items = g_slist_reverse(folder->listed);
+	folder->listed = NULL;
+
+	if (folder->msg == NULL) {
+		g_slist_free(items);
+		return;
+	}
+
+	if (err < 0) {
+		g_slist_free(items);
+		reply = btd_error_failed(folder->msg, strerror(-err));
+		goto done;
+	}
+
+	reply = dbus_message_new_method_return(folder->msg);
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_OBJECT_PATH_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&array);
+
+	g_slist_foreach(items, parse_folder_list, &array);
+	dbus_message_iter_close_container(&iter, &array);
+
+	g_slist_free(items);
+
+done:
+	g_dbus_send_message(btd_get_dbus_connection(), reply);
+	dbus_message_unref(folder->msg);
+	folder->msg = NULL;
+}
+
+static DBusMessage *media_folder_get_items(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct media_player *mp = data;
+	struct media_folder *folder = mp->scope;
+	struct player_callback *cb = mp->cb;
+	uint32_t start, count;
+
+	if (!dbus_message_get_args(msg, NULL,
+					DBUS_TYPE_UINT32, &start,
+					DBUS_TYPE_UINT32, &count,
+					DBUS_TYPE_INVALID) || !count)
+		return btd_error_invalid_args(msg);
+
+	if (folder->number_of_items && start >= folder->number_of_items)
+		return btd_error_invalid_args(msg);
+
+	if (cb->cbs->list_items == NULL)
+		return btd_error_not_supported(msg);
+
+	if (folder->msg != NULL)
+		return btd_error_failed(msg, strerror(EBUSY));
+
+	folder->range_start = start;
+	folder->range_count = count;
+	folder->msg = dbus_message_ref(msg);
+
+	media_folder_list_range(mp, folder);
+
+	return NULL;
+}
+
+static DBusMessage *media_folder_get_item(DBusConnection *conn,
+						DBusMessage *msg, void *data)
+{
+	struct media_player *mp = data;
+	struct media_folder *folder = mp->scope;
+	struct media_window *window;
+	struct media_entry *entry;
+	uint32_t index;
+
+	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &index,
+							DBUS_TYPE_INVALID))
+		return btd_error_invalid_args(msg);
+
+	window = media_folder_find_window(folder, index);
+	if (window == NULL || index - window->start >= window->count)
+		return btd_error_does_not_exist(msg);
+
+	entry = &window->entries[index - window->start];
+
+	if (entry->item == NULL) {
+		entry->item = media_folder_create_item(mp, folder, entry->name,
+							entry->type,
+							entry->uid);
+		if (entry->item == NULL)
+			return btd_error_failed(msg, strerror(ENOMEM));
+
+		media_item_set_playable(entry->item, entry->playable);
+	}
+
+	return g_dbus_create_reply(msg, DBUS_TYPE_OBJECT_PATH,
+						&entry->item->path,
+						DBUS_TYPE_INVALID);
+}
+
 static const GDBusMethodTable media_folder_methods[] = {
 	{ GDBUS_ASYNC_METHOD("Search",
 			GDBUS_ARGS({ "string", "s" }, { "filter", "a{sv}" }),
@@ -1124,6 +1615,14 @@ static const GDBusMethodTable media_folder_methods[] = {
 			GDBUS_ARGS({ "filter", "a{sv}" }),
 			GDBUS_ARGS({ "items", "a{oa{sv}}" }),
 			media_folder_list_items) },
+	{ GDBUS_EXPERIMENTAL_ASYNC_METHOD("GetItems",
+			GDBUS_ARGS({ "start", "u" }, { "count", "u" }),
+			GDBUS_ARGS({ "items", "aa{sv}" }),
+			media_folder_get_items) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetItem",
+			GDBUS_ARGS({ "index", "u" }),
+			GDBUS_ARGS({ "item", "o" }),
+			media_folder_get_item) },
 	{ GDBUS_ASYNC_METHOD("ChangeFolder",
 			GDBUS_ARGS({ "folder", "o" }), NULL,
 			media_folder_change_folder) },
@@ -1240,6 +1739,9 @@ void media_player_destroy(struct media_player *mp)
 	g_slist_free_full(mp->pending, g_free);
 	g_slist_free_full(mp->folders, media_folder_destroy);
 
+	if (mp->fetch)
+		media_window_free(mp->fetch);
+
 	g_timer_destroy(mp->progress);
 	g_free(mp->cb);
 	g_free(mp->status);
@@ -1560,6 +2062,33 @@ void media_player_set_playlist(struct media_player *mp, const char *name)
 					MEDIA_PLAYER_INTERFACE, "Playlist");
 }
 
+void media_player_playlist_changed(struct media_player *mp)
+{
+	if (mp->playlist == NULL)
+		return;
+
+	DBG("%s", mp->playlist->item->name);
+
+	media_player_flush_windows(mp, mp->playlist);
+}
+
+static void media_folder_flush(gpointer data, gpointer user_data)
+{
+	struct media_folder *folder = data;
+	struct media_player *mp = user_data;
+
+	media_player_flush_windows(mp, folder);
+	g_slist_foreach(folder->subfolders, media_folder_flush, mp);
+}
+
+void media_player_uids_changed(struct media_player *mp)
+{
+	DBG("%s", mp->path);
+
+	/* Listed UIDs are no longer valid */
+	g_slist_foreach(mp->folders, media_folder_flush, mp);
+}
+
 static struct media_item *media_folder_find_item(struct media_folder *folder,
 								uint64_t uid)
 {
@@ -84,6 +84,8 @@ void media_player_set_searchable(struct media_player *mp, bool enabled);
 void media_player_set_folder(struct media_player *mp, const char *path,
 								uint32_t items);
 void media_player_set_playlist(struct media_player *mp, const char *name);
+void media_player_playlist_changed(struct media_player *mp);
+void media_player_uids_changed(struct media_player *mp);
 struct media_item *media_player_set_playlist_item(struct media_player *mp,
 								uint64_t uid);
 
@@ -98,8 +100,12 @@ struct media_item *media_player_create_item(struct media_player *mp,
 
 void media_player_play_item_complete(struct media_player *mp, int err);
 void media_item_set_playable(struct media_item *item, bool value);
-void media_player_list_complete(struct media_player *mp, GSList *items,
-								int err);
+void media_player_list_item(struct media_player *mp, const char *name,
+						player_item_type_t type,
+						uint64_t uid, bool playable);
+void media_player_list_folder(struct media_player *mp,
+						struct media_item *item);
+void media_player_list_complete(struct media_player *mp, int err);
 void media_player_change_folder_complete(struct media_player *player,
 						const char *path, uint64_t uid,
 						int ret);
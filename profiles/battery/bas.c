@@ -25,6 +25,9 @@
 
 #include "src/shared/util.h"
 #include "src/shared/queue.h"
+#include "src/shared/att.h"
+#include "src/shared/gatt-db.h"
+#include "src/shared/gatt-client.h"
 
 #include "attrib/gattrib.h"
 #include "attrib/att.h"
@@ -35,9 +38,13 @@
 #define ATT_NOTIFICATION_HEADER_SIZE 3
 #define ATT_READ_RESPONSE_HEADER_SIZE 1
 
+#define BATTERY_LEVEL_UUID16 0x2a19
+
 struct bt_bas {
 	int ref_count;
 	GAttrib *attrib;
+	struct bt_gatt_client *client;
+	unsigned int read_id;
 	struct gatt_primary *primary;
 	uint16_t handle;
 	uint16_t ccc_handle;
@@ -305,6 +312,92 @@ bool bt_bas_attach(struct bt_bas *bas, void *attrib)
 	return true;
 }
 
+static void client_notify_cb(uint16_t value_handle, const uint8_t *value,
+					uint16_t length, void *user_data)
+{
+	if (length)
+		DBG("Battery Level at %u", value[0]);
+}
+
+static void client_register_cb(uint16_t att_ecode, void *user_data)
+{
+	if (att_ecode) {
+		error("Battery Level: notification failed: 0x%04x", att_ecode);
+		return;
+	}
+
+	DBG("Battery Level: notification enabled");
+}
+
+static void client_read_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct bt_bas *bas = user_data;
+
+	bas->read_id = 0;
+
+	if (!success) {
+		error("Reading Battery Level failed: %s",
+						att_ecode2str(att_ecode));
+		return;
+	}
+
+	if (length)
+		DBG("Battery Level at %u", value[0]);
+}
+
+static void foreach_bas_char(struct gatt_db_attribute *attr, void *user_data)
+{
+	struct bt_bas *bas = user_data;
+	uint16_t value_handle;
+	bt_uuid_t uuid, level_uuid;
+
+	if (bas->handle)
+		return;
+
+	if (!gatt_db_attribute_get_char_data(attr, NULL, &value_handle, NULL,
+							NULL, &uuid))
+		return;
+
+	bt_uuid16_create(&level_uuid, BATTERY_LEVEL_UUID16);
+	if (!bt_uuid_cmp(&level_uuid, &uuid))
+		bas->handle = value_handle;
+}
+
+bool bt_bas_attach_client(struct bt_bas *bas, struct bt_gatt_client *client)
+{
+	struct gatt_db_attribute *attr;
+
+	if (!bas || bas->attrib || bas->client || !bas->primary)
+		return false;
+
+	/* Use the characteristics already discovered by the client */
+	if (!bas->handle) {
+		attr = gatt_db_get_attribute(bt_gatt_client_get_db(client),
+						bas->primary->range.start);
+		if (!attr)
+			return false;
+
+		gatt_db_service_foreach_char(attr, foreach_bas_char, bas);
+		if (!bas->handle)
+			return false;
+
+		DBG("Battery handle: 0x%04x", bas->handle);
+	}
+
+	bas->client = bt_gatt_client_ref(client);
+
+	bas->read_id = bt_gatt_client_read_value(bas->client, bas->handle,
+						client_read_cb, bas, NULL);
+
+	bas->id = bt_gatt_client_register_notify(bas->client, bas->handle,
+						client_register_cb,
+						client_notify_cb, bas, NULL);
+
+	return true;
+}
+
 static void cancel_gatt_req(struct gatt_request *req)
 {
 	if (g_attrib_cancel(req->bas->attrib, req->id))
@@ -313,7 +406,20 @@ static void cancel_gatt_req(struct gatt_request *req)
 
 void bt_bas_detach(struct bt_bas *bas)
 {
-	if (!bas || !bas->attrib)
+	if (!bas)
+		return;
+
+	if (bas->client) {
+		bt_gatt_client_cancel(bas->client, bas->read_id);
+		bas->read_id = 0;
+		bt_gatt_client_unregister_notify(bas->client, bas->id);
+		bas->id = 0;
+		bt_gatt_client_unref(bas->client);
+		bas->client = NULL;
+		return;
+	}
+
+	if (!bas->attrib)
 		return;
 
 	if (bas->id > 0) {
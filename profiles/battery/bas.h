@@ -9,6 +9,7 @@
  */
 
 struct bt_bas;
+struct bt_gatt_client;
 
 struct bt_bas *bt_bas_new(void *primary);
 
@@ -16,4 +17,5 @@ struct bt_bas *bt_bas_ref(struct bt_bas *bas);
 void bt_bas_unref(struct bt_bas *bas);
 
 bool bt_bas_attach(struct bt_bas *bas, void *gatt);
+bool bt_bas_attach_client(struct bt_bas *bas, struct bt_gatt_client *client);
 void bt_bas_detach(struct bt_bas *bas);
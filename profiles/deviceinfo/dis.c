@@ -26,6 +26,7 @@
 #include "src/shared/queue.h"
 #include "src/shared/att.h"
 #include "src/shared/gatt-db.h"
+#include "src/shared/gatt-client.h"
 
 #include "attrib/gattrib.h"
 #include "attrib/att.h"
@@ -44,6 +45,8 @@ struct bt_dis {
 	uint16_t		product;
 	uint16_t		version;
 	GAttrib			*attrib;	/* GATT connection */
+	struct bt_gatt_client	*client;	/* GATT client */
+	unsigned int		read_id;
 	struct gatt_primary	*primary;	/* Primary details */
 	bt_dis_notify		notify;
 	void			*notify_data;
@@ -189,6 +192,27 @@ static bool set_and_store_gatt_req(struct bt_dis *dis,
 	return queue_push_head(dis->gatt_op, req);
 }
 
+static void pnpid_parse(struct bt_dis *dis, const uint8_t *value,
+								size_t vlen)
+{
+	if (vlen < PNP_ID_SIZE) {
+		error("Error reading PNP_ID: Invalid value length");
+		return;
+	}
+
+	dis->source = value[0];
+	dis->vendor = get_le16(&value[1]);
+	dis->product = get_le16(&value[3]);
+	dis->version = get_le16(&value[5]);
+
+	DBG("source: 0x%02X vendor: 0x%04X product: 0x%04X version: 0x%04X",
+			dis->source, dis->vendor, dis->product, dis->version);
+
+	if (dis->notify)
+		dis->notify(dis->source, dis->vendor, dis->product,
+						dis->version, dis->notify_data);
+}
+
 static void read_pnpid_cb(guint8 status, const guint8 *pdu, guint16 len,
 							gpointer user_data)
 {
@@ -210,22 +234,24 @@ static void read_pnpid_cb(guint8 status, const guint8 *pdu, guint16 len,
 		return;
 	}
 
-	if (vlen < 7) {
-		error("Error reading PNP_ID: Invalid pdu length received");
-		return;
-	}
+	pnpid_parse(dis, value, vlen);
+}
 
-	dis->source = value[0];
-	dis->vendor = get_le16(&value[1]);
-	dis->product = get_le16(&value[3]);
-	dis->version = get_le16(&value[5]);
+static void read_pnpid_client_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct bt_dis *dis = user_data;
 
-	DBG("source: 0x%02X vendor: 0x%04X product: 0x%04X version: 0x%04X",
-			dis->source, dis->vendor, dis->product, dis->version);
+	dis->read_id = 0;
 
-	if (dis->notify)
-		dis->notify(dis->source, dis->vendor, dis->product,
-						dis->version, dis->notify_data);
+	if (!success) {
+		error("Error reading PNP_ID value: %s",
+						att_ecode2str(att_ecode));
+		return;
+	}
+
+	pnpid_parse(dis, value, length);
 }
 
 static void read_char(struct bt_dis *dis, GAttrib *attrib, uint16_t handle,
@@ -311,6 +337,33 @@ bool bt_dis_attach(struct bt_dis *dis, void *attrib)
 	return true;
 }
 
+bool bt_dis_attach_client(struct bt_dis *dis, struct bt_gatt_client *client)
+{
+	struct gatt_db_attribute *attr;
+
+	if (dis->attrib || dis->client)
+		return false;
+
+	/* Use the characteristics already discovered by the client */
+	if (!dis->handle && dis->primary) {
+		attr = gatt_db_get_attribute(bt_gatt_client_get_db(client),
+						dis->primary->range.start);
+		if (attr)
+			gatt_db_service_foreach_char(attr, foreach_dis_char,
+									dis);
+	}
+
+	if (!dis->handle)
+		return false;
+
+	dis->client = bt_gatt_client_ref(client);
+	dis->read_id = bt_gatt_client_read_value(dis->client, dis->handle,
+						read_pnpid_client_cb, dis,
+						NULL);
+
+	return true;
+}
+
 static void cancel_gatt_req(struct gatt_request *req)
 {
 	if (g_attrib_cancel(req->dis->attrib, req->id))
@@ -319,6 +372,14 @@ static void cancel_gatt_req(struct gatt_request *req)
 
 void bt_dis_detach(struct bt_dis *dis)
 {
+	if (dis->client) {
+		bt_gatt_client_cancel(dis->client, dis->read_id);
+		dis->read_id = 0;
+		bt_gatt_client_unref(dis->client);
+		dis->client = NULL;
+		return;
+	}
+
 	if (!dis->attrib)
 		return;
 
@@ -9,6 +9,7 @@
  */
 
 struct bt_dis;
+struct bt_gatt_client;
 
 struct bt_dis *bt_dis_new(struct gatt_db *db);
 struct bt_dis *bt_dis_new_primary(void *primary);
@@ -17,6 +18,7 @@ struct bt_dis *bt_dis_ref(struct bt_dis *dis);
 void bt_dis_unref(struct bt_dis *dis);
 
 bool bt_dis_attach(struct bt_dis *dis, void *gatt);
+bool bt_dis_attach_client(struct bt_dis *dis, struct bt_gatt_client *client);
 void bt_dis_detach(struct bt_dis *dis);
 
 typedef void (*bt_dis_notify) (uint8_t source, uint16_t vendor,
@@ -13,9 +13,12 @@
 
 #define _GNU_SOURCE
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <sys/socket.h>
 
 #include <glib.h>
 
@@ -43,6 +46,13 @@
 #define ECHO_TIMEOUT	1 /* second */
 #define HDP_ECHO_LEN	15
 
+/* Number of SDUs a streaming data channel can queue before being read */
+#define HDP_STREAMING_SDUS	32
+/* Unprivileged SO_RCVBUF requests are clamped to net.core.rmem_max, whose
+ * default is 208 KiB, so do not ask for more than that.
+ */
+#define HDP_STREAMING_BUF_MAX	(208 * 1024)
+
 static GSList *applications = NULL;
 static GSList *devices = NULL;
 static uint8_t next_app_id = HDP_MDEP_INITIAL;
@@ -875,6 +885,32 @@ fail:
 	return FALSE;
 }
 
+/*
+ * Streaming channels carry continuous sensor data with no retransmission,
+ * so give the socket enough room for the application to read several SDUs
+ * per wakeup instead of dropping them when it falls behind.
+ */
+static void set_streaming_buffer(int fd, uint16_t imtu)
+{
+	int size = MIN(HDP_STREAMING_SDUS * imtu, HDP_STREAMING_BUF_MAX);
+	socklen_t len = sizeof(size);
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0) {
+		error("setsockopt(SO_RCVBUF) failed: %s (%d)",
+						strerror(errno), errno);
+		return;
+	}
+
+	/* The kernel may clamp the request, report what was applied */
+	if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &len) < 0) {
+		error("getsockopt(SO_RCVBUF) failed: %s (%d)",
+						strerror(errno), errno);
+		return;
+	}
+
+	DBG("imtu %u receive buffer %d", imtu, size);
+}
+
 static gboolean check_channel_conf(struct hdp_channel *chan)
 {
 	GError *err = NULL;
@@ -926,6 +962,9 @@ static gboolean check_channel_conf(struct hdp_channel *chan)
 	if (chan->imtu != imtu || chan->omtu != omtu)
 		return FALSE;
 
+	if (chan->config == HDP_STREAMING_DC)
+		set_streaming_buffer(fd, imtu);
+
 	return TRUE;
 }
 
@@ -36,6 +36,7 @@
 #include "src/shared/queue.h"
 #include "src/shared/att.h"
 #include "src/shared/gatt-db.h"
+#include "src/shared/gatt-client.h"
 #include "src/log.h"
 
 #include "attrib/att.h"
@@ -76,6 +77,7 @@ struct bt_hog {
 	struct gatt_db_attribute *attr;
 	struct gatt_primary	*primary;
 	GAttrib			*attrib;
+	struct bt_gatt_client	*client;
 	GSList			*reports;
 	struct bt_uhid		*uhid;
 	int			uhid_fd;
@@ -116,9 +118,22 @@ struct report {
 	uint8_t			*value;
 };
 
+/* Input report received before UHID_START */
+struct report_input {
+	struct report		*report;
+	uint16_t		len;
+	uint8_t			data[];
+};
+
+typedef void (*gatt_result_t)(uint8_t status, const uint8_t *value,
+					uint16_t length, void *user_data);
+
 struct gatt_request {
 	unsigned int id;
+	bool client;
+	uint16_t handle;
 	struct bt_hog *hog;
+	gatt_result_t func;
 	void *user_data;
 };
 
@@ -173,10 +188,66 @@ static void remove_gatt_req(struct gatt_request *req, uint8_t status)
 	destroy_gatt_req(req);
 }
 
-static void write_char(struct bt_hog *hog, GAttrib *attrib, uint16_t handle,
+static void attrib_read_cb(guint8 status, const guint8 *pdu, guint16 len,
+							gpointer user_data)
+{
+	struct gatt_request *req = user_data;
+
+	if (!status && (!len || pdu[0] != ATT_OP_READ_RESP))
+		status = ATT_ECODE_IO;
+
+	if (status) {
+		req->func(status, NULL, 0, req);
+		return;
+	}
+
+	req->func(status, pdu + 1, len - 1, req);
+}
+
+static void attrib_write_cb(guint8 status, const guint8 *pdu, guint16 len,
+							gpointer user_data)
+{
+	struct gatt_request *req = user_data;
+
+	req->func(status, NULL, 0, req);
+}
+
+static uint8_t client_status(bool success, uint8_t att_ecode)
+{
+	if (success)
+		return 0;
+
+	/* Requests failing without an ATT error, e.g. on disconnect */
+	return att_ecode ? att_ecode : ATT_ECODE_IO;
+}
+
+static void client_read_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct gatt_request *req = user_data;
+
+	req->func(client_status(success, att_ecode), value, length, req);
+}
+
+static void client_write_cb(bool success, uint8_t att_ecode, void *user_data)
+{
+	struct gatt_request *req = user_data;
+
+	req->func(client_status(success, att_ecode), NULL, 0, req);
+}
+
+static void cancel_op(struct bt_hog *hog, bool client, unsigned int id)
+{
+	if (client)
+		bt_gatt_client_cancel(hog->client, id);
+	else
+		g_attrib_cancel(hog->attrib, id);
+}
+
+static void write_char(struct bt_hog *hog, uint16_t handle,
 					const uint8_t *value, size_t vlen,
-					GAttribResultFunc func,
-					gpointer user_data)
+					gatt_result_t func, void *user_data)
 {
 	struct gatt_request *req;
 	unsigned int id;
@@ -185,22 +256,31 @@ static void write_char(struct bt_hog *hog, GAttrib *attrib, uint16_t handle,
 	if (!req)
 		return;
 
-	id = gatt_write_char(attrib, handle, value, vlen, func, req);
+	req->func = func;
+	req->client = hog->client != NULL;
+
+	if (req->client)
+		id = bt_gatt_client_write_value(hog->client, handle, value,
+						vlen, client_write_cb, req,
+						NULL);
+	else
+		id = gatt_write_char(hog->attrib, handle, value, vlen,
+						attrib_write_cb, req);
 	if (!id) {
 		error("hog: Could not write char");
+		destroy_gatt_req(req);
 		return;
 	}
 
 	if (!set_and_store_gatt_req(hog, req, id)) {
 		error("hog: Failed to queue write char req");
-		g_attrib_cancel(attrib, id);
-		free(req);
+		cancel_op(hog, req->client, id);
+		destroy_gatt_req(req);
 	}
 }
 
-static unsigned int read_char(struct bt_hog *hog, GAttrib *attrib,
-				uint16_t handle, GAttribResultFunc func,
-				gpointer user_data)
+static unsigned int read_char(struct bt_hog *hog, uint16_t handle,
+					gatt_result_t func, void *user_data)
 {
 	struct gatt_request *req;
 	unsigned int id;
@@ -209,22 +289,42 @@ static unsigned int read_char(struct bt_hog *hog, GAttrib *attrib,
 	if (!req)
 		return 0;
 
-	id = gatt_read_char(attrib, handle, func, req);
+	req->func = func;
+	req->client = hog->client != NULL;
+	req->handle = handle;
+
+	/* Like gatt_read_char, continue with Read Blob for long values */
+	if (req->client)
+		id = bt_gatt_client_read_long_value(hog->client, handle, 0,
+						client_read_cb, req, NULL);
+	else
+		id = gatt_read_char(hog->attrib, handle, attrib_read_cb, req);
 	if (!id) {
 		error("hog: Could not read char");
+		destroy_gatt_req(req);
 		return 0;
 	}
 
 	if (!set_and_store_gatt_req(hog, req, id)) {
 		error("hog: Failed to queue read char req");
-		g_attrib_cancel(attrib, id);
-		free(req);
+		cancel_op(hog, req->client, id);
+		destroy_gatt_req(req);
 		return 0;
 	}
 
 	return id;
 }
 
+static void write_cmd(struct bt_hog *hog, uint16_t handle,
+					const uint8_t *value, size_t vlen)
+{
+	if (hog->client)
+		bt_gatt_client_write_without_response(hog->client, handle,
+							false, value, vlen);
+	else
+		gatt_write_cmd(hog->attrib, handle, value, vlen, NULL, NULL);
+}
+
 static void discover_desc(struct bt_hog *hog, GAttrib *attrib,
 				uint16_t start, uint16_t end, gatt_cb_t func,
 				gpointer user_data)
@@ -322,25 +422,26 @@ static void find_included(struct bt_hog *hog, GAttrib *attrib,
 	}
 }
 
-static void report_value_cb(const guint8 *pdu, guint16 len, gpointer user_data)
+static void report_input(struct report *report, const uint8_t *data,
+								uint16_t len)
 {
-	struct report *report = user_data;
 	struct bt_hog *hog = report->hog;
-	struct uhid_event ev;
-	uint8_t *buf;
+	struct report_input *input;
 	int err;
 
-	if (len < ATT_NOTIFICATION_HEADER_SIZE) {
-		error("Malformed ATT notification");
-		return;
-	}
+	/* If uhid had not sent UHID_START yet queue up the input */
+	if (!hog->uhid_created || !hog->uhid_start) {
+		if (!hog->input)
+			hog->input = queue_new();
 
-	pdu += ATT_NOTIFICATION_HEADER_SIZE;
-	len -= ATT_NOTIFICATION_HEADER_SIZE;
+		input = malloc(sizeof(*input) + len);
+		input->report = report;
+		input->len = len;
+		memcpy(input->data, data, len);
 
-	memset(&ev, 0, sizeof(ev));
-	ev.type = UHID_INPUT;
-	buf = ev.u.input.data;
+		queue_push_tail(hog->input, input);
+		return;
+	}
 
 	/* BLUETOOTH SPECIFICATION Page 16 of 26
 	 * HID Service Specification
@@ -349,29 +450,39 @@ static void report_value_cb(const guint8 *pdu, guint16 len, gpointer user_data)
 	 * descriptor where there is more than one instance of the Report
 	 * characteristic for any given Report Type.
 	 */
-	if (report->numbered && report->id) {
-		buf[0] = report->id;
-		len = MIN(len, sizeof(ev.u.input.data) - 1);
-		memcpy(buf + 1, pdu, len);
-		ev.u.input.size = ++len;
-	} else {
-		len = MIN(len, sizeof(ev.u.input.data));
-		memcpy(buf, pdu, len);
-		ev.u.input.size = len;
-	}
+	err = bt_uhid_input(hog->uhid, report->numbered ? report->id : 0,
+								data, len);
+	if (err < 0)
+		error("bt_uhid_input: %s (%d)", strerror(-err), -err);
+}
 
-	/* If uhid had not sent UHID_START yet queue up the input */
-	if (!hog->uhid_created || !hog->uhid_start) {
-		if (!hog->input)
-			hog->input = queue_new();
+static void report_value_cb(const guint8 *pdu, guint16 len, gpointer user_data)
+{
+	struct report *report = user_data;
 
-		queue_push_tail(hog->input, util_memdup(&ev, sizeof(ev)));
+	if (len < ATT_NOTIFICATION_HEADER_SIZE) {
+		error("Malformed ATT notification");
 		return;
 	}
 
-	err = bt_uhid_send(hog->uhid, &ev);
-	if (err < 0)
-		error("bt_uhid_send: %s (%d)", strerror(-err), -err);
+	report_input(report, pdu + ATT_NOTIFICATION_HEADER_SIZE,
+					len - ATT_NOTIFICATION_HEADER_SIZE);
+}
+
+static void report_notify_cb(uint16_t value_handle, const uint8_t *value,
+					uint16_t length, void *user_data)
+{
+	report_input(user_data, value, length);
+}
+
+static void report_register_cb(uint16_t att_ecode, void *user_data)
+{
+	struct report *report = user_data;
+
+	if (att_ecode)
+		error("Unable to enable report notification: handle 0x%04x "
+					"(0x%02x)", report->value_handle,
+					att_ecode);
 }
 
 static void report_notify_destroy(void *user_data)
@@ -383,12 +494,56 @@ static void report_notify_destroy(void *user_data)
 	report->notifyid = 0;
 }
 
-static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
-					guint16 plen, gpointer user_data)
+static bool report_register_notify(struct report *report)
+{
+	struct bt_hog *hog = report->hog;
+
+	/* Input reports go straight from bt_gatt_client to uHID, which
+	 * also takes care of enabling notifications.
+	 */
+	if (hog->client)
+		report->notifyid = bt_gatt_client_register_notify(hog->client,
+						report->value_handle,
+						report_register_cb,
+						report_notify_cb, report,
+						report_notify_destroy);
+	else
+		report->notifyid = g_attrib_register(hog->attrib,
+						ATT_OP_HANDLE_NOTIFY,
+						report->value_handle,
+						report_value_cb, report,
+						report_notify_destroy);
+
+	if (!report->notifyid) {
+		error("Unable to register report notification: handle 0x%04x",
+					report->value_handle);
+		return false;
+	}
+
+	return true;
+}
+
+static void report_unregister_notify(struct report *report)
+{
+	struct bt_hog *hog = report->hog;
+
+	if (!report->notifyid)
+		return;
+
+	if (hog->client)
+		bt_gatt_client_unregister_notify(hog->client,
+							report->notifyid);
+	else
+		g_attrib_unregister(hog->attrib, report->notifyid);
+
+	report->notifyid = 0;
+}
+
+static void report_ccc_written_cb(uint8_t status, const uint8_t *value,
+					uint16_t length, void *user_data)
 {
 	struct gatt_request *req = user_data;
 	struct report *report = req->user_data;
-	struct bt_hog *hog = report->hog;
 
 	if (status != 0) {
 		error("Write report characteristic descriptor failed: %s",
@@ -399,16 +554,8 @@ static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
 	if (report->notifyid)
 		goto remove;
 
-	report->notifyid = g_attrib_register(hog->attrib,
-					ATT_OP_HANDLE_NOTIFY,
-					report->value_handle,
-					report_value_cb, report,
-					report_notify_destroy);
-	if (!report->notifyid) {
-		error("Unable to register report notification: handle 0x%04x",
-					report->value_handle);
+	if (!report_register_notify(report))
 		goto remove;
-	}
 
 	DBG("Report characteristic descriptor written: notifications enabled");
 
@@ -416,19 +563,18 @@ remove:
 	remove_gatt_req(req, status);
 }
 
-static void write_ccc(struct bt_hog *hog, GAttrib *attrib, uint16_t handle,
-							void *user_data)
+static void write_ccc(struct bt_hog *hog, uint16_t handle, void *user_data)
 {
 	uint8_t value[2];
 
 	put_le16(GATT_CLIENT_CHARAC_CFG_NOTIF_BIT, value);
 
-	write_char(hog, attrib, handle, value, sizeof(value),
-					report_ccc_written_cb, user_data);
+	write_char(hog, handle, value, sizeof(value), report_ccc_written_cb,
+								user_data);
 }
 
-static void ccc_read_cb(guint8 status, const guint8 *pdu, guint16 len,
-							gpointer user_data)
+static void ccc_read_cb(uint8_t status, const uint8_t *value,
+					uint16_t length, void *user_data)
 {
 	struct gatt_request *req = user_data;
 	struct report *report = req->user_data;
@@ -438,7 +584,7 @@ static void ccc_read_cb(guint8 status, const guint8 *pdu, guint16 len,
 		goto remove;
 	}
 
-	write_ccc(report->hog, report->hog->attrib, report->ccc_handle, report);
+	write_ccc(report->hog, report->ccc_handle, report);
 
 remove:
 	remove_gatt_req(req, status);
@@ -458,40 +604,128 @@ static const char *type_to_string(uint8_t type)
 	return NULL;
 }
 
-static void report_reference_cb(guint8 status, const guint8 *pdu,
-					guint16 plen, gpointer user_data)
+static void db_write_value_cb(struct gatt_db_attribute *attr, int err,
+							void *user_data)
 {
-	struct gatt_request *req = user_data;
-	struct report *report = req->user_data;
+	if (err)
+		error("Error writing value to gatt db: %s", strerror(-err));
+}
 
-	if (status != 0) {
-		error("Read Report Reference descriptor failed: %s",
-							att_ecode2str(status));
-		goto remove;
+static void db_read_value_cb(struct gatt_db_attribute *attr, int err,
+					const uint8_t *value, size_t length,
+					void *user_data)
+{
+	struct iovec *iov = user_data;
+
+	if (err) {
+		error("Error reading value from gatt db: %s", strerror(-err));
+		return;
 	}
 
-	if (plen != 3) {
-		error("Malformed ATT read response");
-		goto remove;
+	iov->iov_base = (void *) value;
+	iov->iov_len = length;
+}
+
+/* Values which cannot change while the database is valid are cached in
+ * the gatt_db so they don't have to be read again on every connection.
+ */
+static void db_store_value(struct bt_hog *hog, uint16_t handle,
+					const uint8_t *value, uint16_t length)
+{
+	struct gatt_db_attribute *attr;
+
+	if (!hog->gatt_db || !length)
+		return;
+
+	attr = gatt_db_get_attribute(hog->gatt_db, handle);
+	if (!attr)
+		return;
+
+	gatt_db_attribute_write(attr, 0, value, length, 0, NULL,
+						db_write_value_cb, NULL);
+}
+
+static bool db_load_value(struct bt_hog *hog, uint16_t handle,
+							struct iovec *iov)
+{
+	struct gatt_db_attribute *attr;
+
+	iov->iov_base = NULL;
+	iov->iov_len = 0;
+
+	if (!hog->gatt_db)
+		return false;
+
+	attr = gatt_db_get_attribute(hog->gatt_db, handle);
+	if (!attr)
+		return false;
+
+	gatt_db_attribute_read(attr, 0, BT_ATT_OP_READ_REQ, NULL,
+						db_read_value_cb, iov);
+
+	return iov->iov_len > 0;
+}
+
+static bool report_reference_parse(struct report *report,
+					const uint8_t *value, uint16_t length)
+{
+	if (length != 2) {
+		error("Malformed Report Reference value");
+		return false;
 	}
 
-	report->id = pdu[1];
-	report->type = pdu[2];
+	report->id = value[0];
+	report->type = value[1];
 
 	DBG("Report 0x%04x: id 0x%02x type %s", report->value_handle,
 				report->id, type_to_string(report->type));
 
 	/* Enable notifications only for Input Reports */
-	if (report->type == HOG_REPORT_TYPE_INPUT)
-		read_char(report->hog, report->hog->attrib, report->ccc_handle,
-							ccc_read_cb, report);
+	if (report->type == HOG_REPORT_TYPE_INPUT) {
+		if (report->hog->client)
+			report_register_notify(report);
+		else
+			read_char(report->hog, report->ccc_handle,
+						ccc_read_cb, report);
+	}
+
+	return true;
+}
+
+static void report_reference_cb(uint8_t status, const uint8_t *value,
+					uint16_t length, void *user_data)
+{
+	struct gatt_request *req = user_data;
+	struct report *report = req->user_data;
+
+	if (status != 0) {
+		error("Read Report Reference descriptor failed: %s",
+							att_ecode2str(status));
+		goto remove;
+	}
+
+	if (report_reference_parse(report, value, length))
+		db_store_value(req->hog, req->handle, value, length);
 
 remove:
 	remove_gatt_req(req, status);
 }
 
-static void external_report_reference_cb(guint8 status, const guint8 *pdu,
-					guint16 plen, gpointer user_data);
+static void read_report_reference(struct report *report, uint16_t handle)
+{
+	struct iovec iov;
+
+	if (db_load_value(report->hog, handle, &iov) &&
+			report_reference_parse(report, iov.iov_base,
+							iov.iov_len))
+		return;
+
+	read_char(report->hog, handle, report_reference_cb, report);
+}
+
+static void external_report_reference_cb(uint8_t status,
+					const uint8_t *value, uint16_t length,
+					void *user_data);
 
 static void discover_external_cb(uint8_t status, GSList *descs, void *user_data)
 {
@@ -507,9 +741,8 @@ static void discover_external_cb(uint8_t status, GSList *descs, void *user_data)
 	for ( ; descs; descs = descs->next) {
 		struct gatt_desc *desc = descs->data;
 
-		read_char(hog, hog->attrib, desc->handle,
-						external_report_reference_cb,
-						hog);
+		read_char(hog, desc->handle, external_report_reference_cb,
+									hog);
 	}
 
 remove:
@@ -551,8 +784,8 @@ static void discover_report_cb(uint8_t status, GSList *descs, void *user_data)
 			report->ccc_handle = desc->handle;
 			break;
 		case GATT_REPORT_REFERENCE:
-			read_char(hog, hog->attrib, desc->handle,
-						report_reference_cb, report);
+			read_char(hog, desc->handle, report_reference_cb,
+									report);
 			break;
 		}
 	}
@@ -571,8 +804,8 @@ static void discover_report(struct bt_hog *hog, GAttrib *attrib,
 	discover_desc(hog, attrib, start, end, discover_report_cb, user_data);
 }
 
-static void report_read_cb(guint8 status, const guint8 *pdu, guint16 len,
-							gpointer user_data)
+static void report_read_cb(uint8_t status, const uint8_t *value,
+					uint16_t length, void *user_data)
 {
 	struct gatt_request *req = user_data;
 	struct report *report = req->user_data;
@@ -585,8 +818,8 @@ static void report_read_cb(guint8 status, const guint8 *pdu, guint16 len,
 	if (report->value)
 		free(report->value);
 
-	report->value = util_memdup(pdu, len);
-	report->len = len;
+	report->value = util_memdup(value, length);
+	report->len = length;
 
 remove:
 	remove_gatt_req(req, status);
@@ -620,7 +853,7 @@ static struct report *report_new(struct bt_hog *hog, struct gatt_char *chr)
 	report->properties = chr->properties;
 	hog->reports = g_slist_append(hog->reports, report);
 
-	read_char(hog, hog->attrib, chr->value_handle, report_read_cb, report);
+	read_char(hog, chr->value_handle, report_read_cb, report);
 
 	return report;
 }
@@ -664,37 +897,58 @@ remove:
 	remove_gatt_req(req, status);
 }
 
-static void external_report_reference_cb(guint8 status, const guint8 *pdu,
-					guint16 plen, gpointer user_data)
+static void foreach_external_service(struct gatt_db_attribute *attr,
+							void *user_data);
+
+static bool external_report_parse(struct bt_hog *hog, const uint8_t *value,
+							uint16_t length)
 {
-	struct gatt_request *req = user_data;
-	struct bt_hog *hog = req->user_data;
 	uint16_t uuid16;
 	bt_uuid_t uuid;
 
-	if (status != 0) {
-		error("Read External Report Reference descriptor failed: %s",
-							att_ecode2str(status));
-		goto remove;
-	}
-
-	if (plen != 3) {
-		error("Malformed ATT read response");
-		goto remove;
+	if (length != 2) {
+		error("Malformed External Report Reference value");
+		return false;
 	}
 
-	uuid16 = get_le16(&pdu[1]);
+	uuid16 = get_le16(value);
 	DBG("External report reference read, external report characteristic "
 						"UUID: 0x%04x", uuid16);
 
 	/* Do not discover if is not a Report */
 	if (uuid16 != HOG_REPORT_UUID)
-		goto remove;
+		return true;
+
+	/* Reports are already known if the database is available */
+	if (hog->gatt_db) {
+		gatt_db_foreach_service(hog->gatt_db, NULL,
+						foreach_external_service, hog);
+		return true;
+	}
 
 	bt_uuid16_create(&uuid, uuid16);
 	discover_char(hog, hog->attrib, 0x0001, 0xffff, &uuid,
 					external_service_char_cb, hog);
 
+	return true;
+}
+
+static void external_report_reference_cb(uint8_t status,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct gatt_request *req = user_data;
+	struct bt_hog *hog = req->user_data;
+
+	if (status != 0) {
+		error("Read External Report Reference descriptor failed: %s",
+							att_ecode2str(status));
+		goto remove;
+	}
+
+	if (external_report_parse(hog, value, length))
+		db_store_value(hog, req->handle, value, length);
+
 remove:
 	remove_gatt_req(req, status);
 }
@@ -766,8 +1020,8 @@ static struct report *find_report_by_rtype(struct bt_hog *hog, uint8_t rtype,
 	return find_report(hog, type, id);
 }
 
-static void output_written_cb(guint8 status, const guint8 *pdu,
-					guint16 plen, gpointer user_data)
+static void output_written_cb(uint8_t status, const uint8_t *value,
+					uint16_t length, void *user_data)
 {
 	struct gatt_request *req = user_data;
 
@@ -804,11 +1058,10 @@ static void forward_report(struct uhid_event *ev, void *user_data)
 		return;
 
 	if (report->properties & GATT_CHR_PROP_WRITE)
-		write_char(hog, hog->attrib, report->value_handle,
-				data, size, output_written_cb, hog);
+		write_char(hog, report->value_handle, data, size,
+						output_written_cb, hog);
 	else if (report->properties & GATT_CHR_PROP_WRITE_WITHOUT_RESP)
-		gatt_write_cmd(hog->attrib, report->value_handle,
-						data, size, NULL, NULL);
+		write_cmd(hog, report->value_handle, data, size);
 }
 
 static void set_numbered(void *data, void *user_data)
@@ -834,13 +1087,15 @@ static void set_numbered(void *data, void *user_data)
 
 static bool input_dequeue(const void *data, const void *match_data)
 {
-	const struct uhid_event *ev = data;
+	const struct report_input *input = data;
+	const struct report *report = input->report;
 	const struct bt_hog *hog = match_data;
 	int err;
 
-	err = bt_uhid_send(hog->uhid, ev);
+	err = bt_uhid_input(hog->uhid, report->numbered ? report->id : 0,
+						input->data, input->len);
 	if (err < 0) {
-		error("bt_uhid_send: %s (%d)", strerror(-err), -err);
+		error("bt_uhid_input: %s (%d)", strerror(-err), -err);
 		return false;
 	}
 
@@ -862,10 +1117,8 @@ static void start_flags(struct uhid_event *ev, void *user_data)
 	queue_remove_all(hog->input, input_dequeue, hog, free);
 }
 
-static void set_report_cb(guint8 status, const guint8 *pdu,
-					guint16 plen, gpointer user_data)
+static void set_report_reply(struct bt_hog *hog, uint8_t status)
 {
-	struct bt_hog *hog = user_data;
 	struct uhid_event rsp;
 	int err;
 
@@ -884,6 +1137,18 @@ static void set_report_cb(guint8 status, const guint8 *pdu,
 		error("bt_uhid_send: %s", strerror(-err));
 }
 
+static void set_report_cb(guint8 status, const guint8 *pdu,
+					guint16 plen, gpointer user_data)
+{
+	set_report_reply(user_data, status);
+}
+
+static void set_report_client_cb(bool success, uint8_t att_ecode,
+							void *user_data)
+{
+	set_report_reply(user_data, client_status(success, att_ecode));
+}
+
 static void set_report(struct uhid_event *ev, void *user_data)
 {
 	struct bt_hog *hog = user_data;
@@ -894,7 +1159,7 @@ static void set_report(struct uhid_event *ev, void *user_data)
 
 	/* uhid never sends reqs in parallel; if there's a req, it timed out */
 	if (hog->setrep_att) {
-		g_attrib_cancel(hog->attrib, hog->setrep_att);
+		cancel_op(hog, hog->client, hog->setrep_att);
 		hog->setrep_att = 0;
 	}
 
@@ -921,7 +1186,14 @@ static void set_report(struct uhid_event *ev, void *user_data)
 	if (hog->attrib == NULL)
 		return;
 
-	hog->setrep_att = gatt_write_char(hog->attrib,
+	if (hog->client)
+		hog->setrep_att = bt_gatt_client_write_value(hog->client,
+						report->value_handle,
+						data, size,
+						set_report_client_cb, hog,
+						NULL);
+	else
+		hog->setrep_att = gatt_write_char(hog->attrib,
 						report->value_handle,
 						data, size, set_report_cb,
 						hog);
@@ -933,7 +1205,7 @@ static void set_report(struct uhid_event *ev, void *user_data)
 	return;
 fail:
 	/* cancel the request on failure */
-	set_report_cb(err, NULL, 0, hog);
+	set_report_reply(hog, err);
 }
 
 static void report_reply(struct bt_hog *hog, uint8_t status, uint8_t id,
@@ -997,6 +1269,20 @@ exit:
 	report_reply(hog, status, report->id, report->numbered, len, pdu);
 }
 
+static void get_report_client_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	struct report *report = user_data;
+	uint8_t status = client_status(success, att_ecode);
+
+	if (status != 0)
+		error("Error reading Report value: %s", att_ecode2str(status));
+
+	report_reply(report->hog, status, report->id, report->numbered,
+								length, value);
+}
+
 static void get_report(struct uhid_event *ev, void *user_data)
 {
 	struct bt_hog *hog = user_data;
@@ -1005,7 +1291,7 @@ static void get_report(struct uhid_event *ev, void *user_data)
 
 	/* uhid never sends reqs in parallel; if there's a req, it timed out */
 	if (hog->getrep_att) {
-		g_attrib_cancel(hog->attrib, hog->getrep_att);
+		cancel_op(hog, hog->client, hog->getrep_att);
 		hog->getrep_att = 0;
 	}
 
@@ -1018,7 +1304,13 @@ static void get_report(struct uhid_event *ev, void *user_data)
 		goto fail;
 	}
 
-	hog->getrep_att = gatt_read_char(hog->attrib,
+	if (hog->client)
+		hog->getrep_att = bt_gatt_client_read_value(hog->client,
+						report->value_handle,
+						get_report_client_cb, report,
+						NULL);
+	else
+		hog->getrep_att = gatt_read_char(hog->attrib,
 						report->value_handle,
 						get_report_cb, report);
 	if (!hog->getrep_att) {
@@ -1099,20 +1391,11 @@ static void uhid_create(struct bt_hog *hog, uint8_t *report_map,
 	DBG("HoG created uHID device");
 }
 
-static void db_report_map_write_value_cb(struct gatt_db_attribute *attr,
-						int err, void *user_data)
-{
-	if (err)
-		error("Error writing report map value to gatt db");
-}
-
-static void report_map_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
-							gpointer user_data)
+static void report_map_read_cb(uint8_t status, const uint8_t *value,
+					uint16_t length, void *user_data)
 {
 	struct gatt_request *req = user_data;
 	struct bt_hog *hog = req->user_data;
-	uint8_t *value;
-	ssize_t vlen;
 
 	remove_gatt_req(req, status);
 
@@ -1121,25 +1404,12 @@ static void report_map_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
 		return;
 	}
 
-	value = new0(uint8_t, plen);
-
-	vlen = dec_read_resp(pdu, plen, value, plen);
-	if (vlen < 0) {
-		error("ATT protocol error");
-		goto done;
-	}
-
-	uhid_create(hog, value, vlen);
+	uhid_create(hog, (uint8_t *) value, length);
 
 	/* Cache the report map if gatt_db is available  */
-	if (hog->report_map_attr) {
-		gatt_db_attribute_write(hog->report_map_attr, 0, value, vlen, 0,
-					NULL, db_report_map_write_value_cb,
-					NULL);
-	}
-
-done:
-	free(value);
+	if (hog->report_map_attr)
+		gatt_db_attribute_write(hog->report_map_attr, 0, value, length,
+					0, NULL, db_write_value_cb, NULL);
 }
 
 static void read_report_map(struct bt_hog *hog)
@@ -1151,17 +1421,32 @@ static void read_report_map(struct bt_hog *hog)
 
 	handle = gatt_db_attribute_get_handle(hog->report_map_attr);
 
-	hog->report_map_id = read_char(hog, hog->attrib, handle,
-						report_map_read_cb, hog);
+	hog->report_map_id = read_char(hog, handle, report_map_read_cb, hog);
 }
 
-static void info_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
-							gpointer user_data)
+static bool info_parse(struct bt_hog *hog, const uint8_t *value,
+							uint16_t length)
+{
+	if (length != HID_INFO_SIZE) {
+		error("Malformed HID Information value");
+		return false;
+	}
+
+	hog->bcdhid = get_le16(&value[0]);
+	hog->bcountrycode = value[2];
+	hog->flags = value[3];
+
+	DBG("bcdHID: 0x%04X bCountryCode: 0x%02X Flags: 0x%02X",
+			hog->bcdhid, hog->bcountrycode, hog->flags);
+
+	return true;
+}
+
+static void info_read_cb(uint8_t status, const uint8_t *value,
+					uint16_t length, void *user_data)
 {
 	struct gatt_request *req = user_data;
 	struct bt_hog *hog = req->user_data;
-	uint8_t value[HID_INFO_SIZE];
-	ssize_t vlen;
 
 	if (status != 0) {
 		error("HID Information read failed: %s",
@@ -1169,30 +1454,29 @@ static void info_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
 		goto remove;
 	}
 
-	vlen = dec_read_resp(pdu, plen, value, sizeof(value));
-	if (vlen != 4) {
-		error("ATT protocol error");
-		goto remove;
-	}
-
-	hog->bcdhid = get_le16(&value[0]);
-	hog->bcountrycode = value[2];
-	hog->flags = value[3];
-
-	DBG("bcdHID: 0x%04X bCountryCode: 0x%02X Flags: 0x%02X",
-			hog->bcdhid, hog->bcountrycode, hog->flags);
+	if (info_parse(hog, value, length))
+		db_store_value(hog, req->handle, value, length);
 
 remove:
 	remove_gatt_req(req, status);
 }
 
-static void proto_mode_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
-							gpointer user_data)
+static void read_info(struct bt_hog *hog, uint16_t handle)
+{
+	struct iovec iov;
+
+	if (db_load_value(hog, handle, &iov) &&
+			info_parse(hog, iov.iov_base, iov.iov_len))
+		return;
+
+	read_char(hog, handle, info_read_cb, hog);
+}
+
+static void proto_mode_read_cb(uint8_t status, const uint8_t *value,
+					uint16_t length, void *user_data)
 {
 	struct gatt_request *req = user_data;
 	struct bt_hog *hog = req->user_data;
-	uint8_t value;
-	ssize_t vlen;
 
 	if (status != 0) {
 		error("Protocol Mode characteristic read failed: %s",
@@ -1200,20 +1484,18 @@ static void proto_mode_read_cb(guint8 status, const guint8 *pdu, guint16 plen,
 		goto remove;
 	}
 
-	vlen = dec_read_resp(pdu, plen, &value, sizeof(value));
-	if (vlen < 0) {
-		error("ATT protocol error");
+	if (length < 1) {
+		error("Malformed Protocol Mode value");
 		goto remove;
 	}
 
-	if (value == HOG_PROTO_MODE_BOOT) {
+	if (value[0] == HOG_PROTO_MODE_BOOT) {
 		uint8_t nval = HOG_PROTO_MODE_REPORT;
 
 		DBG("HoG is operating in Boot Procotol Mode");
 
-		gatt_write_cmd(hog->attrib, hog->proto_mode_handle, &nval,
-						sizeof(nval), NULL, NULL);
-	} else if (value == HOG_PROTO_MODE_REPORT)
+		write_cmd(hog, hog->proto_mode_handle, &nval, sizeof(nval));
+	} else if (value[0] == HOG_PROTO_MODE_REPORT)
 		DBG("HoG is operating in Report Protocol Mode");
 
 remove:
@@ -1269,8 +1551,8 @@ static void char_discovered_cb(uint8_t status, GSList *chars, void *user_data)
 			discover_report(hog, hog->attrib, start, end, report);
 		} else if (bt_uuid_cmp(&uuid, &report_map_uuid) == 0) {
 			DBG("HoG discovering report map");
-			read_char(hog, hog->attrib, chr->value_handle,
-						report_map_read_cb, hog);
+			read_char(hog, chr->value_handle, report_map_read_cb,
+									hog);
 			discover_external(hog, hog->attrib, start, end, hog);
 		} else if (bt_uuid_cmp(&uuid, &info_uuid) == 0)
 			info_handle = chr->value_handle;
@@ -1282,12 +1564,11 @@ static void char_discovered_cb(uint8_t status, GSList *chars, void *user_data)
 
 	if (proto_mode_handle) {
 		hog->proto_mode_handle = proto_mode_handle;
-		read_char(hog, hog->attrib, proto_mode_handle,
-						proto_mode_read_cb, hog);
+		read_char(hog, proto_mode_handle, proto_mode_read_cb, hog);
 	}
 
 	if (info_handle)
-		read_char(hog, hog->attrib, info_handle, info_read_cb, hog);
+		read_char(hog, info_handle, info_read_cb, hog);
 
 remove:
 	remove_gatt_req(req, status);
@@ -1303,9 +1584,12 @@ static void report_free(void *data)
 
 static bool cancel_gatt_req(const void *data, const void *user_data)
 {
-	struct gatt_request *req = (void *) data;
+	const struct gatt_request *req = data;
 	const struct bt_hog *hog = user_data;
 
+	if (req->client)
+		return bt_gatt_client_cancel(hog->client, req->id);
+
 	return g_attrib_cancel(hog->attrib, req->id);
 }
 
@@ -1341,7 +1625,6 @@ struct bt_hog *bt_hog_new_default(const char *name, uint16_t vendor,
 static void foreach_hog_report(struct gatt_db_attribute *attr, void *user_data)
 {
 	struct report *report = user_data;
-	struct bt_hog *hog = report->hog;
 	const bt_uuid_t *uuid;
 	bt_uuid_t ref_uuid, ccc_uuid;
 	uint16_t handle;
@@ -1351,8 +1634,7 @@ static void foreach_hog_report(struct gatt_db_attribute *attr, void *user_data)
 
 	bt_uuid16_create(&ref_uuid, GATT_REPORT_REFERENCE);
 	if (!bt_uuid_cmp(&ref_uuid, uuid)) {
-		read_char(hog, hog->attrib, handle, report_reference_cb,
-								report);
+		read_report_reference(report, handle);
 		return;
 	}
 
@@ -1390,47 +1672,55 @@ static struct report *report_add(struct bt_hog *hog,
 
 	hog->reports = g_slist_append(hog->reports, report);
 
-	read_char(hog, hog->attrib, report->value_handle, report_read_cb,
-								report);
+	read_char(hog, report->value_handle, report_read_cb, report);
 
 	return report;
 }
 
+static void foreach_external_chrc(struct gatt_db_attribute *attr,
+							void *user_data)
+{
+	struct bt_hog *hog = user_data;
+	struct report *report;
+	bt_uuid_t uuid, report_uuid;
+
+	gatt_db_attribute_get_char_data(attr, NULL, NULL, NULL, NULL, &uuid);
+
+	bt_uuid16_create(&report_uuid, HOG_REPORT_UUID);
+	if (bt_uuid_cmp(&report_uuid, &uuid))
+		return;
+
+	report = report_add(hog, attr);
+	gatt_db_service_foreach_desc(attr, foreach_hog_report, report);
+}
+
+static void foreach_external_service(struct gatt_db_attribute *attr,
+							void *user_data)
+{
+	gatt_db_service_foreach_char(attr, foreach_external_chrc, user_data);
+}
+
 static void foreach_hog_external(struct gatt_db_attribute *attr,
 							void *user_data)
 {
 	struct bt_hog *hog = user_data;
 	const bt_uuid_t *uuid;
 	bt_uuid_t ext_uuid;
+	struct iovec iov;
 	uint16_t handle;
 
 	handle = gatt_db_attribute_get_handle(attr);
 	uuid = gatt_db_attribute_get_type(attr);
 
 	bt_uuid16_create(&ext_uuid, GATT_EXTERNAL_REPORT_REFERENCE);
-	if (!bt_uuid_cmp(&ext_uuid, uuid))
-		read_char(hog, hog->attrib, handle,
-					external_report_reference_cb, hog);
-}
-
-static void db_report_map_read_value_cb(struct gatt_db_attribute *attrib,
-						int err, const uint8_t *value,
-						size_t length, void *user_data)
-{
-	struct iovec *map = user_data;
-
-	if (err) {
-		error("Error reading report map from gatt db %s",
-								strerror(-err));
+	if (bt_uuid_cmp(&ext_uuid, uuid))
 		return;
-	}
 
-	if (!length)
+	if (db_load_value(hog, handle, &iov) &&
+			external_report_parse(hog, iov.iov_base, iov.iov_len))
 		return;
 
-
-	map->iov_len = length;
-	map->iov_base = (void *) value;
+	read_char(hog, handle, external_report_reference_cb, hog);
 }
 
 static void foreach_hog_chrc(struct gatt_db_attribute *attr, void *user_data)
@@ -1439,7 +1729,7 @@ static void foreach_hog_chrc(struct gatt_db_attribute *attr, void *user_data)
 	bt_uuid_t uuid, report_uuid, report_map_uuid, info_uuid;
 	bt_uuid_t proto_mode_uuid, ctrlpt_uuid;
 	uint16_t handle, value_handle;
-	struct iovec map = {};
+	struct iovec map;
 
 	gatt_db_attribute_get_char_data(attr, &handle, &value_handle, NULL,
 					NULL, &uuid);
@@ -1454,18 +1744,13 @@ static void foreach_hog_chrc(struct gatt_db_attribute *attr, void *user_data)
 	bt_uuid16_create(&report_map_uuid, HOG_REPORT_MAP_UUID);
 	if (!bt_uuid_cmp(&report_map_uuid, &uuid)) {
 
-		if (hog->gatt_db) {
-			/* Try to read the cache of report map if available */
+		if (hog->gatt_db)
 			hog->report_map_attr = gatt_db_get_attribute(
 								hog->gatt_db,
 								value_handle);
-			gatt_db_attribute_read(hog->report_map_attr, 0,
-						BT_ATT_OP_READ_REQ, NULL,
-						db_report_map_read_value_cb,
-						&map);
-		}
 
-		if (map.iov_len) {
+		/* Try to read the cache of report map if available */
+		if (db_load_value(hog, value_handle, &map)) {
 			/* Report map found in the cache, straight to creating
 			 * UHID to optimize reconnection.
 			 */
@@ -1477,15 +1762,14 @@ static void foreach_hog_chrc(struct gatt_db_attribute *attr, void *user_data)
 
 	bt_uuid16_create(&info_uuid, HOG_INFO_UUID);
 	if (!bt_uuid_cmp(&info_uuid, &uuid)) {
-		read_char(hog, hog->attrib, value_handle, info_read_cb, hog);
+		read_info(hog, value_handle);
 		return;
 	}
 
 	bt_uuid16_create(&proto_mode_uuid, HOG_PROTO_MODE_UUID);
 	if (!bt_uuid_cmp(&proto_mode_uuid, &uuid)) {
 		hog->proto_mode_handle = value_handle;
-		read_char(hog, hog->attrib, value_handle, proto_mode_read_cb,
-									hog);
+		read_char(hog, value_handle, proto_mode_read_cb, hog);
 	}
 
 	bt_uuid16_create(&ctrlpt_uuid, HOG_CONTROL_POINT_UUID);
@@ -1758,7 +2042,49 @@ remove:
 	remove_gatt_req(req, status);
 }
 
+static void foreach_primary(struct gatt_db_attribute *attr, void *user_data)
+{
+	struct bt_hog *hog = user_data;
+	struct gatt_primary primary;
+	bt_uuid_t uuid;
+
+	memset(&primary, 0, sizeof(primary));
+
+	gatt_db_attribute_get_service_data(attr, &primary.range.start,
+						&primary.range.end, NULL,
+						&uuid);
+	bt_uuid_to_string(&uuid, primary.uuid, sizeof(primary.uuid));
+
+	if (strcmp(primary.uuid, SCAN_PARAMETERS_UUID) == 0) {
+		if (!hog->scpp)
+			hog->scpp = bt_scpp_new(&primary);
+		return;
+	}
+
+	if (strcmp(primary.uuid, DEVICE_INFORMATION_UUID) == 0) {
+		if (!hog->dis) {
+			hog->dis = bt_dis_new_primary(&primary);
+			bt_dis_set_notification(hog->dis, dis_notify, hog);
+		}
+		return;
+	}
+
+	if (strcmp(primary.uuid, BATTERY_UUID) == 0) {
+		queue_push_head(hog->bas, bt_bas_new(&primary));
+		return;
+	}
+
+	if (strcmp(primary.uuid, HOG_UUID) == 0)
+		hog_attach_instance(hog, attr);
+}
+
 bool bt_hog_attach(struct bt_hog *hog, void *gatt)
+{
+	return bt_hog_attach_client(hog, gatt, NULL);
+}
+
+bool bt_hog_attach_client(struct bt_hog *hog, void *gatt,
+					struct bt_gatt_client *client)
 {
 	GSList *l;
 
@@ -1767,31 +2093,62 @@ bool bt_hog_attach(struct bt_hog *hog, void *gatt)
 
 	hog->attrib = g_attrib_ref(gatt);
 
+	if (client)
+		hog->client = bt_gatt_client_ref(client);
+
 	if (!hog->attr && !hog->primary) {
-		discover_primary(hog, hog->attrib, NULL, primary_cb, hog);
-		return true;
+		if (!client) {
+			discover_primary(hog, hog->attrib, NULL, primary_cb,
+									hog);
+			return true;
+		}
+
+		/* Services have already been discovered by the client */
+		if (!hog->gatt_db)
+			hog->gatt_db = gatt_db_ref(
+					bt_gatt_client_get_db(client));
+
+		gatt_db_foreach_service(hog->gatt_db, NULL, foreach_primary,
+									hog);
+		if (!hog->attr) {
+			DBG("No HID service found");
+			return true;
+		}
 	}
 
-	if (hog->scpp)
-		bt_scpp_attach(hog->scpp, gatt);
+	if (client) {
+		bt_scpp_attach_client(hog->scpp, client);
 
-	if (hog->dis)
-		bt_dis_attach(hog->dis, gatt);
+		if (hog->dis)
+			bt_dis_attach_client(hog->dis, client);
 
-	queue_foreach(hog->bas, (void *) bt_bas_attach, gatt);
+		queue_foreach(hog->bas, (void *) bt_bas_attach_client, client);
+	} else {
+		if (hog->scpp)
+			bt_scpp_attach(hog->scpp, gatt);
+
+		if (hog->dis)
+			bt_dis_attach(hog->dis, gatt);
+
+		queue_foreach(hog->bas, (void *) bt_bas_attach, gatt);
+	}
 
 	for (l = hog->instances; l; l = l->next) {
 		struct bt_hog *instance = l->data;
 
-		bt_hog_attach(instance, gatt);
+		bt_hog_attach_client(instance, gatt, client);
 	}
 
 	if (!hog->uhid_created) {
 		DBG("HoG discovering characteristics");
-		if (hog->attr)
+		if (hog->attr) {
 			gatt_db_service_foreach_char(hog->attr,
 							foreach_hog_chrc, hog);
-		else
+
+			/* Nothing left to read if all values were cached */
+			if (queue_isempty(hog->gatt_op))
+				read_report_map(hog);
+		} else
 			discover_char(hog, hog->attrib,
 					hog->primary->range.start,
 					hog->primary->range.end, NULL,
@@ -1807,17 +2164,10 @@ bool bt_hog_attach(struct bt_hog *hog, void *gatt)
 	for (l = hog->reports; l; l = l->next) {
 		struct report *r = l->data;
 
-		if (r->notifyid)
+		if (r->notifyid || r->type != HOG_REPORT_TYPE_INPUT)
 			continue;
 
-		r->notifyid = g_attrib_register(hog->attrib,
-					ATT_OP_HANDLE_NOTIFY,
-					r->value_handle,
-					report_value_cb, r,
-					report_notify_destroy);
-		if (!r->notifyid)
-			error("Unable to register report notification: "
-				"handle 0x%04x", r->value_handle);
+		report_register_notify(r);
 	}
 
 	return true;
@@ -1861,14 +2211,8 @@ void bt_hog_detach(struct bt_hog *hog)
 		bt_hog_detach(instance);
 	}
 
-	for (l = hog->reports; l; l = l->next) {
-		struct report *r = l->data;
-
-		if (r->notifyid > 0) {
-			g_attrib_unregister(hog->attrib, r->notifyid);
-			r->notifyid = 0;
-		}
-	}
+	for (l = hog->reports; l; l = l->next)
+		report_unregister_notify(l->data);
 
 	if (hog->scpp)
 		bt_scpp_detach(hog->scpp);
@@ -1879,6 +2223,8 @@ void bt_hog_detach(struct bt_hog *hog)
 	queue_remove_all(hog->gatt_op, cancel_gatt_req, hog, destroy_gatt_req);
 	g_attrib_unref(hog->attrib);
 	hog->attrib = NULL;
+	bt_gatt_client_unref(hog->client);
+	hog->client = NULL;
 	uhid_destroy(hog);
 }
 
@@ -1892,8 +2238,7 @@ int bt_hog_set_control_point(struct bt_hog *hog, bool suspend)
 	if (hog->ctrlpt_handle == 0)
 		return -ENOTSUP;
 
-	gatt_write_cmd(hog->attrib, hog->ctrlpt_handle, &value,
-					sizeof(value), NULL, NULL);
+	write_cmd(hog, hog->ctrlpt_handle, &value, sizeof(value));
 
 	return 0;
 }
@@ -1916,12 +2261,11 @@ int bt_hog_send_report(struct bt_hog *hog, void *data, size_t size, int type)
 	DBG("hog: Write report, handle 0x%X", report->value_handle);
 
 	if (report->properties & GATT_CHR_PROP_WRITE)
-		write_char(hog, hog->attrib, report->value_handle,
-				data, size, output_written_cb, hog);
+		write_char(hog, report->value_handle, data, size,
+						output_written_cb, hog);
 
 	if (report->properties & GATT_CHR_PROP_WRITE_WITHOUT_RESP)
-		gatt_write_cmd(hog->attrib, report->value_handle,
-						data, size, NULL, NULL);
+		write_cmd(hog, report->value_handle, data, size);
 
 	for (l = hog->instances; l; l = l->next) {
 		struct bt_hog *instance = l->data;
@@ -9,6 +9,7 @@
  */
 
 struct bt_hog;
+struct bt_gatt_client;
 
 struct bt_hog *bt_hog_new_default(const char *name, uint16_t vendor,
 					uint16_t product, uint16_t version,
@@ -22,6 +23,8 @@ struct bt_hog *bt_hog_ref(struct bt_hog *hog);
 void bt_hog_unref(struct bt_hog *hog);
 
 bool bt_hog_attach(struct bt_hog *hog, void *gatt);
+bool bt_hog_attach_client(struct bt_hog *hog, void *gatt,
+					struct bt_gatt_client *client);
 void bt_hog_detach(struct bt_hog *hog);
 
 int bt_hog_set_control_point(struct bt_hog *hog, bool suspend);
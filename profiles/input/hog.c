@@ -195,7 +195,8 @@ static int hog_accept(struct btd_service *service)
 	}
 
 	/* TODO: Replace GAttrib with bt_gatt_client */
-	bt_hog_attach(dev->hog, attrib);
+	bt_hog_attach_client(dev->hog, attrib,
+					btd_device_get_gatt_client(device));
 
 	btd_service_connecting_complete(service, 0);
 
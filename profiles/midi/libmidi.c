@@ -479,3 +479,30 @@ _finish:
 
 	return i + midi_size;
 }
+
+bool midi_read_packet(struct midi_read_parser *parser, const uint8_t *data,
+                      size_t size, snd_seq_event_t *ev,
+                      midi_read_packet_cb read_cb, void *user_data)
+{
+	size_t i = 0;
+
+	/* header, timestamp and at least one MIDI byte */
+	if (size < 3)
+		return false;
+
+	midi_read_reset(parser);
+
+	while (i < size) {
+		size_t count = midi_read_raw(parser, data + i, size - i, ev);
+
+		if (count == 0)
+			return false;
+
+		if (ev->type != SND_SEQ_EVENT_NONE)
+			read_cb(ev, user_data);
+
+		i += count;
+	}
+
+	return true;
+}
@@ -108,4 +108,15 @@ static inline void midi_read_reset(struct midi_read_parser *parser)
 size_t midi_read_raw(struct midi_read_parser *parser, const uint8_t *data,
                      size_t size, snd_seq_event_t *ev /* OUT */);
 
+typedef void (*midi_read_packet_cb)(const snd_seq_event_t *ev, void *);
+
+/* Parses a whole BLE-MIDI packet in one pass, calling read_cb for each
+   sequencer event found. ev is used as template for the events, so
+   source and destination can be set in advance. It returns false if the
+   packet is malformed.
+ */
+bool midi_read_packet(struct midi_read_parser *parser, const uint8_t *data,
+                      size_t size, snd_seq_event_t *ev,
+                      midi_read_packet_cb read_cb, void *user_data);
+
 #endif /* LIBMIDI_H */
@@ -92,12 +92,18 @@ static bool midi_write_cb(struct io *io, void *user_data)
 	return true;
 }
 
+static void midi_io_event_cb(const snd_seq_event_t *ev, void *user_data)
+{
+	struct midi *midi = user_data;
+
+	snd_seq_event_output(midi->seq_handle, (snd_seq_event_t *) ev);
+}
+
 static void midi_io_value_cb(uint16_t value_handle, const uint8_t *value,
                              uint16_t length, void *user_data)
 {
 	struct midi *midi = user_data;
 	snd_seq_event_t ev;
-	unsigned int i = 0;
 
 	if (length < 3) {
 		warn("MIDI I/O: Wrong packet format: length is %u bytes but it should "
@@ -110,24 +116,12 @@ static void midi_io_value_cb(uint16_t value_handle, const uint8_t *value,
 	snd_seq_ev_set_subs(&ev);
 	snd_seq_ev_set_direct(&ev);
 
-	midi_read_reset(&midi->midi_in);
-
-	while (i < length) {
-		size_t count = midi_read_raw(&midi->midi_in, value + i, length - i, &ev);
-
-		if (count == 0)
-			goto _err;
-
-		if (ev.type != SND_SEQ_EVENT_NONE)
-			snd_seq_event_output_direct(midi->seq_handle, &ev);
-
-		i += count;
-	}
-
-	return;
+	/* Events of the whole packet are buffered and flushed at once */
+	if (!midi_read_packet(&midi->midi_in, value, length, &ev,
+	                      midi_io_event_cb, midi))
+		error("Wrong BLE-MIDI message");
 
-_err:
-	error("Wrong BLE-MIDI message");
+	snd_seq_drain_output(midi->seq_handle);
 }
 
 static void midi_io_ccc_written_cb(uint16_t att_ecode, void *user_data)
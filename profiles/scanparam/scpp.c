@@ -26,6 +26,9 @@
 
 #include "src/shared/util.h"
 #include "src/shared/queue.h"
+#include "src/shared/att.h"
+#include "src/shared/gatt-db.h"
+#include "src/shared/gatt-client.h"
 
 #include "attrib/att.h"
 #include "attrib/gattrib.h"
@@ -43,6 +46,7 @@
 struct bt_scpp {
 	int ref_count;
 	GAttrib *attrib;
+	struct bt_gatt_client *client;
 	struct gatt_primary *primary;
 	uint16_t interval;
 	uint16_t window;
@@ -294,6 +298,99 @@ bool bt_scpp_attach(struct bt_scpp *scan, void *attrib)
 	return true;
 }
 
+static void write_scan_params_client(struct bt_scpp *scan)
+{
+	uint8_t value[4];
+
+	put_le16(scan->interval, &value[0]);
+	put_le16(scan->window, &value[2]);
+
+	bt_gatt_client_write_without_response(scan->client, scan->iwhandle,
+						false, value, sizeof(value));
+}
+
+static void refresh_notify_cb(uint16_t value_handle, const uint8_t *value,
+					uint16_t length, void *user_data)
+{
+	struct bt_scpp *scan = user_data;
+
+	if (!length)
+		return;
+
+	DBG("Server requires refresh: %d", value[0]);
+
+	if (value[0] == SERVER_REQUIRES_REFRESH)
+		write_scan_params_client(scan);
+}
+
+static void refresh_register_cb(uint16_t att_ecode, void *user_data)
+{
+	if (att_ecode) {
+		error("Scan Refresh: notification failed: 0x%04x", att_ecode);
+		return;
+	}
+
+	DBG("Scan Refresh: notification enabled");
+}
+
+static void foreach_scpp_char(struct gatt_db_attribute *attr, void *user_data)
+{
+	struct bt_scpp *scan = user_data;
+	uint16_t value_handle;
+	bt_uuid_t uuid, iwin_uuid, refresh_uuid;
+
+	if (!gatt_db_attribute_get_char_data(attr, NULL, &value_handle, NULL,
+							NULL, &uuid))
+		return;
+
+	bt_uuid16_create(&iwin_uuid, SCAN_INTERVAL_WIN_UUID);
+	if (!bt_uuid_cmp(&iwin_uuid, &uuid)) {
+		scan->iwhandle = value_handle;
+		DBG("Scan Interval Window handle: 0x%04x", scan->iwhandle);
+		return;
+	}
+
+	bt_uuid16_create(&refresh_uuid, SCAN_REFRESH_UUID);
+	if (!bt_uuid_cmp(&refresh_uuid, &uuid)) {
+		scan->refresh_handle = value_handle;
+		DBG("Scan Refresh handle: 0x%04x", scan->refresh_handle);
+	}
+}
+
+bool bt_scpp_attach_client(struct bt_scpp *scan,
+					struct bt_gatt_client *client)
+{
+	struct gatt_db_attribute *attr;
+
+	if (!scan || scan->attrib || scan->client || !scan->primary)
+		return false;
+
+	/* Use the characteristics already discovered by the client */
+	if (!scan->iwhandle) {
+		attr = gatt_db_get_attribute(bt_gatt_client_get_db(client),
+						scan->primary->range.start);
+		if (!attr)
+			return false;
+
+		gatt_db_service_foreach_char(attr, foreach_scpp_char, scan);
+		if (!scan->iwhandle)
+			return false;
+	}
+
+	scan->client = bt_gatt_client_ref(client);
+
+	write_scan_params_client(scan);
+
+	if (scan->refresh_handle)
+		scan->refresh_cb_id = bt_gatt_client_register_notify(
+						scan->client,
+						scan->refresh_handle,
+						refresh_register_cb,
+						refresh_notify_cb, scan, NULL);
+
+	return true;
+}
+
 static void cancel_gatt_req(void *data, void *user_data)
 {
 	unsigned int id = PTR_TO_UINT(data);
@@ -304,7 +401,19 @@ static void cancel_gatt_req(void *data, void *user_data)
 
 void bt_scpp_detach(struct bt_scpp *scan)
 {
-	if (!scan || !scan->attrib)
+	if (!scan)
+		return;
+
+	if (scan->client) {
+		bt_gatt_client_unregister_notify(scan->client,
+							scan->refresh_cb_id);
+		scan->refresh_cb_id = 0;
+		bt_gatt_client_unref(scan->client);
+		scan->client = NULL;
+		return;
+	}
+
+	if (!scan->attrib)
 		return;
 
 	if (scan->refresh_cb_id > 0) {
@@ -9,6 +9,7 @@
  */
 
 struct bt_scpp;
+struct bt_gatt_client;
 
 struct bt_scpp *bt_scpp_new(void *primary);
 
@@ -16,6 +17,8 @@ struct bt_scpp *bt_scpp_ref(struct bt_scpp *scan);
 void bt_scpp_unref(struct bt_scpp *scan);
 
 bool bt_scpp_attach(struct bt_scpp *scan, void *gatt);
+bool bt_scpp_attach_client(struct bt_scpp *scan,
+					struct bt_gatt_client *client);
 void bt_scpp_detach(struct bt_scpp *scan);
 
 bool bt_scpp_set_interval(struct bt_scpp *scan, uint16_t value);
@@ -162,6 +162,12 @@ static const char *avdtp_options[] = {
 	NULL
 };
 
+static const char *bap_options[] = {
+	"SinkPresets",
+	"SourcePresets",
+	NULL
+};
+
 static const char *advmon_options[] = {
 	"RSSISamplingPeriod",
 	NULL
@@ -178,6 +184,7 @@ static const struct group_table {
 	{ "GATT",	gatt_options },
 	{ "CSIS",	csip_options },
 	{ "AVDTP",	avdtp_options },
+	{ "BAP",	bap_options },
 	{ "AdvMon",	advmon_options },
 	{ }
 };
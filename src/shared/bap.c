@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
 #include "lib/bluetooth.h"
 #include "lib/uuid.h"
@@ -137,6 +138,48 @@ struct bt_bap_req {
 	void *user_data;
 };
 
+/* Last configuration accepted by a remote ASE */
+struct bap_ase_cache {
+	uint8_t id;
+	uint8_t dir;
+	struct bt_bap_codec codec;
+	struct iovec *cc;
+	struct iovec *meta;
+};
+
+/* PACS characteristic value, either read or restored from a cache */
+struct bap_pacs_value {
+	uint16_t handle;
+	struct iovec *value;
+	bt_gatt_client_read_callback_t func;
+	bool cached;
+};
+
+struct bap_read {
+	struct bt_bap *bap;
+	uint16_t handle;
+	bt_gatt_client_read_callback_t func;
+};
+
+struct bap_resume {
+	unsigned int id;
+	struct bt_bap_qos qos;
+	uint8_t target;
+	uint8_t wait;
+	bool ready;
+	bt_bap_stream_func_t func;
+	void *user_data;
+};
+
+/* Time spent in each stage of a unicast stream setup, in microseconds */
+struct bap_stream_timing {
+	bool fast;			/* Resumed from cached configuration */
+	uint32_t config;		/* Config Codec -> Codec Configured */
+	uint32_t qos;			/* Codec Configured -> QoS Configured */
+	uint32_t enable;		/* QoS Configured/Enable -> Enabling */
+	uint32_t streaming;		/* Enabling -> Streaming */
+};
+
 typedef void (*bap_notify_t)(struct bt_bap *bap, uint16_t value_handle,
 				const uint8_t *value, uint16_t length,
 				void *user_data);
@@ -166,6 +209,8 @@ struct bt_bap {
 	struct queue *streams;
 	struct queue *local_eps;
 	struct queue *remote_eps;
+	struct queue *ase_cache;
+	struct queue *pacs_values;
 
 	struct queue *pac_cbs;
 	struct queue *ready_cbs;
@@ -251,7 +296,11 @@ struct bt_bap_stream {
 	struct bt_bap_stream *link;
 	struct bt_bap_stream_io *io;
 	const struct bt_bap_stream_ops *ops;
+	struct bap_resume *resume;
+	struct bap_stream_timing timing;
+	uint64_t timing_mark;
 	bool client;
+	bool enabling;
 	void *user_data;
 };
 
@@ -294,6 +343,9 @@ struct bt_subgroup {
 	struct bt_bap_codec codec;
 	struct iovec *caps;
 	struct iovec *meta;
+	struct util_ltv_index caps_idx;
+	struct util_ltv_index meta_idx;
+	bool indexed;
 	struct queue *bises;
 };
 
@@ -1097,6 +1149,7 @@ static void bap_stream_free(void *data)
 	stream_io_unref(stream->io);
 	util_iov_free(stream->cc, 1);
 	util_iov_free(stream->meta, 1);
+	free(stream->resume);
 	free(stream);
 }
 
@@ -1209,11 +1262,81 @@ static void stream_stop_complete(struct bt_bap_stream *stream, uint8_t code,
 		bap_stream_io_detach(stream);
 }
 
+static uint64_t bap_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void bap_stream_timing_start(struct bt_bap_stream *stream, bool fast)
+{
+	memset(&stream->timing, 0, sizeof(stream->timing));
+	stream->timing.fast = fast;
+	stream->timing_mark = bap_time_us();
+}
+
+static void bap_stream_timing_update(struct bt_bap_stream *stream)
+{
+	struct bap_stream_timing *timing = &stream->timing;
+	uint32_t *stage;
+	uint64_t now;
+
+	if (!stream->timing_mark || stream->ep->old_state == stream->ep->state)
+		return;
+
+	switch (stream->ep->state) {
+	case BT_ASCS_ASE_STATE_CONFIG:
+		stage = &timing->config;
+		break;
+	case BT_ASCS_ASE_STATE_QOS:
+		stage = &timing->qos;
+		break;
+	case BT_ASCS_ASE_STATE_ENABLING:
+		stage = &timing->enable;
+		break;
+	case BT_ASCS_ASE_STATE_STREAMING:
+		stage = &timing->streaming;
+		break;
+	default:
+		stream->timing_mark = 0;
+		return;
+	}
+
+	now = bap_time_us();
+	*stage = now - stream->timing_mark;
+	stream->timing_mark = now;
+
+	if (stream->ep->state != BT_ASCS_ASE_STATE_STREAMING)
+		return;
+
+	stream->timing_mark = 0;
+
+	DBG(stream->bap, "stream %p %s setup: config %u qos %u enable %u "
+			"streaming %u us", stream,
+			timing->fast ? "fast" : "full", timing->config,
+			timing->qos, timing->enable, timing->streaming);
+}
+
+static void bap_ase_cache_update(struct bt_bap *bap,
+					struct bt_bap_stream *stream);
+static void bap_resume_update(struct bt_bap *bap,
+					struct bt_bap_stream *stream);
+
 static void bap_stream_state_changed(struct bt_bap_stream *stream)
 {
 	struct bt_bap *bap = stream->bap;
 	const struct queue_entry *entry;
 
+	bap_stream_timing_update(stream);
+	bap_ase_cache_update(bap, stream);
+	bap_resume_update(bap, stream);
+
+	/* Enable has been answered by the state change */
+	stream->enabling = false;
+
 	/* Pre notification updates */
 	switch (stream->ep->state) {
 	case BT_ASCS_ASE_STATE_IDLE:
@@ -1600,6 +1723,9 @@ static unsigned int bap_ucast_config(struct bt_bap_stream *stream,
 
 	stream->qos = *qos;
 
+	if (!stream->resume)
+		bap_stream_timing_start(stream, false);
+
 	return req->id;
 }
 
@@ -1716,12 +1842,23 @@ static unsigned int bap_ucast_enable(struct bt_bap_stream *stream,
 
 	ret = bap_stream_metadata(stream, BT_ASCS_ENABLE, data, func,
 					user_data);
-	if (!ret || !enable_links)
+	if (!ret)
 		return ret;
 
-	if (stream->link)
-		bap_stream_metadata(stream->link, BT_ASCS_ENABLE, data,
-					NULL, NULL);
+	stream->enabling = true;
+
+	if (!stream->resume) {
+		stream->timing.enable = 0;
+		stream->timing.streaming = 0;
+		stream->timing_mark = bap_time_us();
+	}
+
+	if (!enable_links)
+		return ret;
+
+	if (stream->link && bap_stream_metadata(stream->link, BT_ASCS_ENABLE,
+						data, NULL, NULL))
+		stream->link->enabling = true;
 
 	return ret;
 }
@@ -3044,34 +3181,51 @@ static void *ltv_merge(struct iovec *data, struct iovec *cont)
 	return iov_append(data, cont->iov_len, cont->iov_base);
 }
 
-static void bap_pac_foreach_channel(size_t i, uint8_t l, uint8_t t, uint8_t *v,
-					void *user_data)
+static void bap_pac_add_channel(struct bt_bap_pac *pac, uint8_t count)
 {
-	struct bt_bap_pac *pac = user_data;
 	struct bt_bap_chan *chan;
 
-	if (!v)
-		return;
-
 	if (!pac->channels)
 		pac->channels = queue_new();
 
 	chan = new0(struct bt_bap_chan, 1);
-	chan->count = *v;
+	chan->count = count;
 	chan->location = bt_bap_pac_get_locations(pac) ? : pac->qos.location;
 
 	queue_push_tail(pac->channels, chan);
 }
 
+static void bap_pac_foreach_channel(size_t i, uint8_t l, uint8_t t, uint8_t *v,
+					void *user_data)
+{
+	struct bt_bap_pac *pac = user_data;
+
+	if (!v)
+		return;
+
+	bap_pac_add_channel(pac, *v);
+}
+
 static void bap_pac_update_channels(struct bt_bap_pac *pac, struct iovec *data)
 {
+	struct util_ltv_index idx;
 	uint8_t type = 0x03;
+	uint8_t count;
 
 	if (!data)
 		return;
 
-	util_ltv_foreach(data->iov_base, data->iov_len, &type,
-				bap_pac_foreach_channel, pac);
+	/* Blobs repeating the channel count entry are walked entry by entry
+	 * so that every channel count is kept.
+	 */
+	if (!util_ltv_index_init(&idx, data->iov_base, data->iov_len)) {
+		util_ltv_foreach(data->iov_base, data->iov_len, &type,
+					bap_pac_foreach_channel, pac);
+		return;
+	}
+
+	if (util_ltv_index_get_u8(&idx, type, &count))
+		bap_pac_add_channel(pac, count);
 }
 
 static void bap_pac_merge(struct bt_bap_pac *pac, struct iovec *data,
@@ -3629,6 +3783,26 @@ static void bap_detached(void *data, void *user_data)
 	cb->detached(bap, cb->user_data);
 }
 
+static void bap_ase_cache_free(void *data)
+{
+	struct bap_ase_cache *cache = data;
+
+	if (!cache)
+		return;
+
+	util_iov_free(cache->cc, 1);
+	util_iov_free(cache->meta, 1);
+	free(cache);
+}
+
+static void bap_pacs_value_free(void *data)
+{
+	struct bap_pacs_value *value = data;
+
+	util_iov_free(value->value, 1);
+	free(value);
+}
+
 static void bap_free(void *data)
 {
 	struct bt_bap *bap = data;
@@ -3644,6 +3818,8 @@ static void bap_free(void *data)
 	queue_destroy(bap->state_cbs, bap_state_free);
 	queue_destroy(bap->local_eps, free);
 	queue_destroy(bap->remote_eps, bap_ep_free);
+	queue_destroy(bap->ase_cache, bap_ase_cache_free);
+	queue_destroy(bap->pacs_values, bap_pacs_value_free);
 
 	queue_destroy(bap->reqs, bap_req_free);
 	queue_destroy(bap->notify, NULL);
@@ -3736,6 +3912,8 @@ struct bt_bap *bt_bap_new(struct gatt_db *ldb, struct gatt_db *rdb)
 
 	bap->rdb = bdb;
 	bap->remote_eps = queue_new();
+	bap->ase_cache = queue_new();
+	bap->pacs_values = queue_new();
 
 done:
 	return bt_bap_ref(bap);
@@ -4030,6 +4208,188 @@ static void read_pac_supported_context(bool success, uint8_t att_ecode,
 	pacs->supported_source_context_value = le16_to_cpu(ctx->src);
 }
 
+static bool match_pacs_value(const void *data, const void *match_data)
+{
+	const struct bap_pacs_value *value = data;
+
+	return value->handle == PTR_TO_UINT(match_data);
+}
+
+static struct bap_pacs_value *bap_pacs_value_set(struct bt_bap *bap,
+						uint16_t handle,
+						const uint8_t *value,
+						uint16_t len)
+{
+	struct bap_pacs_value *entry;
+	struct iovec iov = {
+		.iov_base = (void *) value,
+		.iov_len = len,
+	};
+
+	entry = queue_find(bap->pacs_values, match_pacs_value,
+						UINT_TO_PTR(handle));
+	if (!entry) {
+		entry = new0(struct bap_pacs_value, 1);
+		entry->handle = handle;
+		queue_push_tail(bap->pacs_values, entry);
+	}
+
+	util_iov_free(entry->value, 1);
+	entry->value = util_iov_dup(&iov, 1);
+
+	return entry;
+}
+
+static bool match_pac_stream(const void *data, const void *match_data)
+{
+	const struct bt_bap_stream *stream = data;
+
+	return stream->rpac == match_data;
+}
+
+static void bap_pac_clear(void *data, void *user_data)
+{
+	struct bt_bap_pac *pac = data;
+
+	util_iov_free(pac->data, 1);
+	pac->data = NULL;
+	util_iov_free(pac->metadata, 1);
+	pac->metadata = NULL;
+	queue_destroy(pac->channels, free);
+	pac->channels = NULL;
+}
+
+/* Rebuild the remote PAC records of a given type after the value of one of
+ * its characteristics turned out to differ from the cached one.
+ */
+static void bap_pacs_reload(struct bt_bap *bap, uint8_t type,
+				bt_gatt_client_read_callback_t func)
+{
+	struct queue *queue;
+	const struct queue_entry *entry;
+	unsigned int i, len;
+
+	queue = type == BT_BAP_SINK ? bap->rdb->sinks : bap->rdb->sources;
+	len = queue_length(queue);
+
+	queue_foreach(queue, bap_pac_clear, NULL);
+
+	for (entry = queue_get_entries(bap->pacs_values); entry;
+						entry = entry->next) {
+		struct bap_pacs_value *value = entry->data;
+
+		if (value->func == func)
+			bap_parse_pacs(bap, type, queue, value->value->iov_base,
+						value->value->iov_len);
+	}
+
+	entry = queue_get_entries(queue);
+	for (i = 0; entry; i++) {
+		struct bt_bap_pac *pac = entry->data;
+
+		entry = entry->next;
+
+		if (i >= len) {
+			queue_foreach(bap->pac_cbs, notify_pac_added, pac);
+			continue;
+		}
+
+		/* Drop records no longer reported unless they are in use */
+		if (pac->data ||
+			queue_find(bap->streams, match_pac_stream, pac))
+			continue;
+
+		queue_remove(queue, pac);
+		queue_foreach(bap->pac_cbs, notify_pac_removed, pac);
+		bap_pac_free(pac);
+	}
+}
+
+static void bap_read_pacs_cb(bool success, uint8_t att_ecode,
+				const uint8_t *value, uint16_t length,
+				void *user_data)
+{
+	struct bap_read *read = user_data;
+	struct bt_bap *bap = read->bap;
+	struct bap_pacs_value *entry;
+
+	entry = queue_find(bap->pacs_values, match_pacs_value,
+						UINT_TO_PTR(read->handle));
+
+	/* Reconcile the value restored from cache */
+	if (entry && entry->cached) {
+		entry->cached = false;
+
+		if (!success || (entry->value->iov_len == length &&
+				!memcmp(entry->value->iov_base, value, length)))
+			return;
+
+		DBG(bap, "PACS value 0x%04x changed", read->handle);
+
+		bap_pacs_value_set(bap, read->handle, value, length);
+
+		if (read->func == read_sink_pac)
+			bap_pacs_reload(bap, BT_BAP_SINK, read->func);
+		else if (read->func == read_source_pac)
+			bap_pacs_reload(bap, BT_BAP_SOURCE, read->func);
+		else
+			read->func(success, att_ecode, value, length, bap);
+
+		return;
+	}
+
+	if (success)
+		bap_pacs_value_set(bap, read->handle, value,
+						length)->func = read->func;
+
+	read->func(success, att_ecode, value, length, bap);
+}
+
+static void bap_read_value(struct bt_bap *bap, uint16_t handle,
+				bt_gatt_client_read_callback_t func)
+{
+	struct bap_read *read;
+
+	read = new0(struct bap_read, 1);
+	read->bap = bap;
+	read->handle = handle;
+	read->func = func;
+
+	if (!bt_gatt_client_read_value(bap->client, handle, bap_read_pacs_cb,
+								read, free))
+		free(read);
+}
+
+static void bap_read_pacs(struct bt_bap *bap, uint16_t handle,
+				bt_gatt_client_read_callback_t func)
+{
+	struct bap_pacs_value *entry;
+
+	entry = queue_find(bap->pacs_values, match_pacs_value,
+						UINT_TO_PTR(handle));
+	if (!entry || !entry->cached) {
+		bap_read_value(bap, handle, func);
+		return;
+	}
+
+	DBG(bap, "handle 0x%04x restored from cache", handle);
+
+	/* Use the cached value right away, it is read again to reconcile
+	 * once the session is ready.
+	 */
+	entry->func = func;
+	func(true, 0, entry->value->iov_base, entry->value->iov_len, bap);
+}
+
+static void bap_pacs_reconcile(void *data, void *user_data)
+{
+	struct bap_pacs_value *value = data;
+	struct bt_bap *bap = user_data;
+
+	if (value->cached && value->func)
+		bap_read_value(bap, value->handle, value->func);
+}
+
 static void foreach_pacs_char(struct gatt_db_attribute *attr, void *user_data)
 {
 	struct bt_bap *bap = user_data;
@@ -4059,8 +4419,7 @@ static void foreach_pacs_char(struct gatt_db_attribute *attr, void *user_data)
 		if (!pacs->sink)
 			pacs->sink = attr;
 
-		bt_gatt_client_read_value(bap->client, value_handle,
-						read_sink_pac, bap, NULL);
+		bap_read_pacs(bap, value_handle, read_sink_pac);
 	}
 
 	if (!bt_uuid_cmp(&uuid, &uuid_source)) {
@@ -4073,8 +4432,7 @@ static void foreach_pacs_char(struct gatt_db_attribute *attr, void *user_data)
 		if (!pacs->source)
 			pacs->source = attr;
 
-		bt_gatt_client_read_value(bap->client, value_handle,
-						read_source_pac, bap, NULL);
+		bap_read_pacs(bap, value_handle, read_source_pac);
 	}
 
 	if (!bt_uuid_cmp(&uuid, &uuid_sink_loc)) {
@@ -4086,8 +4444,7 @@ static void foreach_pacs_char(struct gatt_db_attribute *attr, void *user_data)
 			return;
 
 		pacs->sink_loc = attr;
-		bt_gatt_client_read_value(bap->client, value_handle,
-						read_sink_pac_loc, bap, NULL);
+		bap_read_pacs(bap, value_handle, read_sink_pac_loc);
 	}
 
 	if (!bt_uuid_cmp(&uuid, &uuid_source_loc)) {
@@ -4099,8 +4456,7 @@ static void foreach_pacs_char(struct gatt_db_attribute *attr, void *user_data)
 			return;
 
 		pacs->source_loc = attr;
-		bt_gatt_client_read_value(bap->client, value_handle,
-						read_source_pac_loc, bap, NULL);
+		bap_read_pacs(bap, value_handle, read_source_pac_loc);
 	}
 
 	if (!bt_uuid_cmp(&uuid, &uuid_context)) {
@@ -4111,8 +4467,7 @@ static void foreach_pacs_char(struct gatt_db_attribute *attr, void *user_data)
 			return;
 
 		pacs->context = attr;
-		bt_gatt_client_read_value(bap->client, value_handle,
-						read_pac_context, bap, NULL);
+		bap_read_pacs(bap, value_handle, read_pac_context);
 	}
 
 	if (!bt_uuid_cmp(&uuid, &uuid_supported_context)) {
@@ -4124,9 +4479,7 @@ static void foreach_pacs_char(struct gatt_db_attribute *attr, void *user_data)
 			return;
 
 		pacs->supported_context = attr;
-		bt_gatt_client_read_value(bap->client, value_handle,
-						read_pac_supported_context,
-						bap, NULL);
+		bap_read_pacs(bap, value_handle, read_pac_supported_context);
 	}
 }
 
@@ -4316,6 +4669,7 @@ static void ep_status_metadata(struct bt_bap *bap, struct bt_bap_endpoint *ep,
 							struct iovec *iov)
 {
 	struct bt_ascs_ase_status_metadata *meta;
+	struct iovec data;
 
 	meta = util_iov_pull_mem(iov, sizeof(*meta));
 	if (!meta) {
@@ -4325,6 +4679,227 @@ static void ep_status_metadata(struct bt_bap *bap, struct bt_bap_endpoint *ep,
 
 	DBG(bap, "CIS 0x%02x CIG 0x%02x metadata len %u",
 			meta->cis_id, meta->cig_id, meta->len);
+
+	data.iov_base = util_iov_pull_mem(iov, meta->len);
+	if (!data.iov_base || !ep->stream)
+		return;
+
+	data.iov_len = meta->len;
+
+	util_iov_free(ep->stream->meta, 1);
+	ep->stream->meta = util_iov_dup(&data, 1);
+}
+
+static bool match_ase_cache(const void *data, const void *match_data)
+{
+	const struct bap_ase_cache *cache = data;
+	const struct bt_bap_stream *stream = match_data;
+
+	return cache->id == stream->ep->id && cache->dir == stream->ep->dir &&
+			bap_codec_equal(&cache->codec, &stream->rpac->codec);
+}
+
+static void bap_ase_cache_update(struct bt_bap *bap,
+					struct bt_bap_stream *stream)
+{
+	struct bap_ase_cache *cache;
+
+	if (!stream->client || !stream->rpac || !stream->cc)
+		return;
+
+	if (stream->ep->state != BT_ASCS_ASE_STATE_QOS &&
+			stream->ep->state != BT_ASCS_ASE_STATE_ENABLING)
+		return;
+
+	cache = queue_find(bap->ase_cache, match_ase_cache, stream);
+	if (!cache) {
+		cache = new0(struct bap_ase_cache, 1);
+		cache->id = stream->ep->id;
+		cache->dir = stream->ep->dir;
+		cache->codec = stream->rpac->codec;
+		queue_push_tail(bap->ase_cache, cache);
+	}
+
+	if (stream->ep->state == BT_ASCS_ASE_STATE_ENABLING) {
+		util_iov_free(cache->meta, 1);
+		cache->meta = util_iov_dup(stream->meta, 1);
+		return;
+	}
+
+	util_iov_free(cache->cc, 1);
+	cache->cc = util_iov_dup(stream->cc, 1);
+}
+
+static void bap_resume_complete(struct bt_bap_stream *stream, uint8_t code,
+							uint8_t reason)
+{
+	struct bap_resume *resume = stream->resume;
+
+	DBG(stream->bap, "stream %p code 0x%02x reason 0x%02x", stream, code,
+								reason);
+
+	stream->resume = NULL;
+
+	if (resume->func)
+		resume->func(stream, code, reason, resume->user_data);
+
+	free(resume);
+}
+
+static void bap_resume_group_update(struct bt_bap *bap,
+					struct bt_bap_stream *stream,
+					uint8_t cig);
+
+static void bap_resume_rsp(struct bt_bap_stream *stream, uint8_t code,
+					uint8_t reason, void *user_data)
+{
+	struct bt_bap *bap = user_data;
+	uint8_t cig;
+
+	if (!code || !queue_find(bap->streams, NULL, stream) ||
+						!stream->resume)
+		return;
+
+	/* Don't attempt the rejected configuration again */
+	bap_ase_cache_free(queue_remove_if(bap->ase_cache, match_ase_cache,
+								stream));
+
+	cig = stream->qos.ucast.cig_id;
+	bap_resume_complete(stream, code, reason);
+	bap_resume_group_update(bap, stream, cig);
+}
+
+static bool bap_resume_step(struct bt_bap_stream *stream)
+{
+	struct bap_resume *resume = stream->resume;
+	struct bap_ase_cache *cache;
+	unsigned int id;
+
+	cache = queue_find(stream->bap->ase_cache, match_ase_cache, stream);
+	if (!cache)
+		return false;
+
+	resume->ready = false;
+
+	switch (stream->ep->state) {
+	case BT_ASCS_ASE_STATE_CONFIG:
+		/* Skip Config Codec if the server kept the configuration */
+		if (!util_iov_memcmp(stream->cc, cache->cc)) {
+			resume->wait = BT_ASCS_ASE_STATE_QOS;
+			id = bap_ucast_qos(stream, &resume->qos,
+						bap_resume_rsp, stream->bap);
+			break;
+		}
+		/* fall through */
+	case BT_ASCS_ASE_STATE_IDLE:
+		resume->wait = BT_ASCS_ASE_STATE_CONFIG;
+		id = bap_ucast_config(stream, &resume->qos, cache->cc,
+						bap_resume_rsp, stream->bap);
+		break;
+	case BT_ASCS_ASE_STATE_QOS:
+		resume->wait = BT_ASCS_ASE_STATE_ENABLING;
+		id = bap_stream_metadata(stream, BT_ASCS_ENABLE, cache->meta,
+						bap_resume_rsp, stream->bap);
+		break;
+	default:
+		return false;
+	}
+
+	return id != 0;
+}
+
+static bool bap_resume_in_group(struct bt_bap_stream *stream,
+					struct bt_bap_stream *ref, uint8_t cig)
+{
+	if (!stream->resume)
+		return false;
+
+	/* Streams without an assigned CIG are not grouped with any other */
+	if (cig == BT_ISO_QOS_CIG_UNSET)
+		return stream == ref;
+
+	return stream->qos.ucast.cig_id == cig;
+}
+
+/* Move the stream to the next resume operation, returns true if a request
+ * has been queued.
+ */
+static bool bap_resume_advance(struct bt_bap_stream *stream)
+{
+	if (stream->ep->state == stream->resume->target) {
+		bap_resume_complete(stream, 0x00, 0x00);
+		return false;
+	}
+
+	if (!bap_resume_step(stream)) {
+		bap_resume_complete(stream, BT_ASCS_RSP_UNSPECIFIED, 0x00);
+		return false;
+	}
+
+	return true;
+}
+
+/* Advance all the ASEs of a CIG together once each of them has reached the
+ * state requested by the previous operation, so the next operation is sent
+ * as a single Control Point write without waiting for BAP_PROCESS_TIMEOUT.
+ */
+static void bap_resume_group_update(struct bt_bap *bap,
+					struct bt_bap_stream *ref,
+					uint8_t cig)
+{
+	const struct queue_entry *entry;
+	bool queued = false;
+
+	for (entry = queue_get_entries(bap->streams); entry;
+						entry = entry->next) {
+		struct bt_bap_stream *stream = entry->data;
+
+		if (!bap_resume_in_group(stream, ref, cig))
+			continue;
+
+		if (!stream->resume->ready)
+			return;
+	}
+
+	entry = queue_get_entries(bap->streams);
+	while (entry) {
+		struct bt_bap_stream *stream = entry->data;
+
+		entry = entry->next;
+
+		if (!bap_resume_in_group(stream, ref, cig))
+			continue;
+
+		if (bap_resume_advance(stream))
+			queued = true;
+	}
+
+	if (queued && !bap->req)
+		bap_process_queue(bap);
+}
+
+static void bap_resume_update(struct bt_bap *bap, struct bt_bap_stream *stream)
+{
+	struct bap_resume *resume = stream->resume;
+	uint8_t cig = stream->qos.ucast.cig_id;
+
+	if (!resume)
+		return;
+
+	switch (stream->ep->state) {
+	case BT_ASCS_ASE_STATE_IDLE:
+	case BT_ASCS_ASE_STATE_RELEASING:
+		bap_resume_complete(stream, BT_ASCS_RSP_UNSPECIFIED, 0x00);
+		break;
+	default:
+		if (stream->ep->state != resume->wait)
+			return;
+
+		resume->ready = true;
+		break;
+	}
+
+	bap_resume_group_update(bap, stream, cig);
 }
 
 static void bap_ep_set_status(struct bt_bap *bap, struct bt_bap_endpoint *ep,
@@ -4471,6 +5046,16 @@ static void bap_endpoint_attach(struct bt_bap *bap, struct bt_bap_endpoint *ep)
 						bap_endpoint_notify, ep);
 }
 
+static void req_enable_failed(void *data, void *user_data)
+{
+	struct bt_bap_req *req = data;
+	struct bt_bap *bap = user_data;
+
+	if (req->op == BT_ASCS_ENABLE &&
+			queue_find(bap->streams, NULL, req->stream))
+		req->stream->enabling = false;
+}
+
 static void bap_cp_notify(struct bt_bap *bap, uint16_t value_handle,
 				const uint8_t *value, uint16_t length,
 				void *user_data)
@@ -4516,6 +5101,12 @@ static void bap_cp_notify(struct bt_bap *bap, uint16_t value_handle,
 	}
 
 done:
+	/* The ASEs won't change state if the Enable has been rejected */
+	if (!ase_rsp || ase_rsp->code) {
+		req_enable_failed(req, bap);
+		queue_foreach(req->group, req_enable_failed, bap);
+	}
+
 	bap_req_complete(req, ase_rsp);
 	bap_process_queue(bap);
 }
@@ -4625,6 +5216,9 @@ static void bap_idle(void *data)
 	bap->idle_id = 0;
 
 	bap_notify_ready(bap);
+
+	if (bap->client)
+		queue_foreach(bap->pacs_values, bap_pacs_reconcile, bap);
 }
 
 bool bt_bap_attach(struct bt_bap *bap, struct bt_gatt_client *client)
@@ -4772,6 +5366,44 @@ void bt_bap_detach(struct bt_bap *bap)
 	queue_foreach(bap_cbs, bap_detached, bap);
 }
 
+bool bt_bap_add_cache(struct bt_bap *bap, uint16_t handle,
+			const uint8_t *value, uint16_t len)
+{
+	/* Only useful before the remote PACS has been discovered */
+	if (!bap || !bap->rdb || bap->rdb->pacs || !value)
+		return false;
+
+	bap_pacs_value_set(bap, handle, value, len)->cached = true;
+
+	return true;
+}
+
+static void bap_foreach_cache(void *data, void *user_data)
+{
+	struct bap_pacs_value *value = data;
+	struct {
+		bt_bap_value_func_t func;
+		void *data;
+	} *foreach = user_data;
+
+	foreach->func(value->handle, value->value->iov_base,
+			value->value->iov_len, foreach->data);
+}
+
+void bt_bap_foreach_cache(struct bt_bap *bap, bt_bap_value_func_t func,
+							void *user_data)
+{
+	struct {
+		bt_bap_value_func_t func;
+		void *data;
+	} foreach = { func, user_data };
+
+	if (!bap || !func)
+		return;
+
+	queue_foreach(bap->pacs_values, bap_foreach_cache, &foreach);
+}
+
 bool bt_bap_set_debug(struct bt_bap *bap, bt_bap_debug_func_t func,
 			void *user_data, bt_bap_destroy_func_t destroy)
 {
@@ -5425,6 +6057,69 @@ unsigned int bt_bap_stream_release(struct bt_bap_stream *stream,
 	return id;
 }
 
+unsigned int bt_bap_stream_resume(struct bt_bap_stream *stream,
+					struct bt_bap_qos *qos, bool enable,
+					bt_bap_stream_func_t func,
+					void *user_data)
+{
+	struct bap_ase_cache *cache;
+	struct bap_resume *resume;
+	static unsigned int id;
+
+	if (!bap_stream_valid(stream) || !stream->client || stream->resume ||
+									!qos)
+		return 0;
+
+	if (bt_bap_stream_get_type(stream) != BT_BAP_STREAM_TYPE_UCAST)
+		return 0;
+
+	/* Only resume if the requested configuration is the cached one */
+	cache = queue_find(stream->bap->ase_cache, match_ase_cache, stream);
+	if (!cache || util_iov_memcmp(stream->cc, cache->cc))
+		return 0;
+
+	resume = new0(struct bap_resume, 1);
+	resume->id = ++id ? id : ++id;
+	resume->qos = *qos;
+
+	/* Config QoS can't be sent until the CIG and CIS have been assigned,
+	 * which normally happens when the caller creates the ISO socket, so
+	 * only restore the codec configuration in that case.
+	 */
+	if (qos->ucast.cig_id == BT_ISO_QOS_CIG_UNSET ||
+			qos->ucast.cis_id == BT_ISO_QOS_CIS_UNSET)
+		resume->target = BT_ASCS_ASE_STATE_CONFIG;
+	else if (enable)
+		resume->target = BT_ASCS_ASE_STATE_ENABLING;
+	else
+		resume->target = BT_ASCS_ASE_STATE_QOS;
+	resume->func = func;
+	resume->user_data = user_data;
+
+	if (stream->ep->state >= resume->target) {
+		free(resume);
+		return 0;
+	}
+
+	stream->resume = resume;
+
+	/* Only the first operation is queued here, so resuming all the
+	 * streams of a CIG in a row still results in a single write.
+	 */
+	if (!bap_resume_step(stream)) {
+		stream->resume = NULL;
+		free(resume);
+		return 0;
+	}
+
+	bap_stream_timing_start(stream, true);
+
+	DBG(stream->bap, "stream %p id %u target %s", stream, resume->id,
+				bt_bap_stream_statestr(resume->target));
+
+	return resume->id;
+}
+
 uint8_t bt_bap_stream_get_dir(struct bt_bap_stream *stream)
 {
 	if (!stream)
@@ -5542,6 +6237,14 @@ int bt_bap_stream_cancel(struct bt_bap_stream *stream, unsigned int id)
 	if (!stream)
 		return -EINVAL;
 
+	if (stream->resume && stream->resume->id == id) {
+		free(stream->resume);
+		stream->resume = NULL;
+		bap_resume_group_update(stream->bap, stream,
+						stream->qos.ucast.cig_id);
+		return 0;
+	}
+
 	if (stream->bap->req && stream->bap->req->id == id) {
 		req = stream->bap->req;
 		stream->bap->req = NULL;
@@ -5720,6 +6423,14 @@ bool bt_bap_stream_io_is_connecting(struct bt_bap_stream *stream, int *fd)
 	return io->connecting;
 }
 
+bool bt_bap_stream_is_enabling(struct bt_bap_stream *stream)
+{
+	if (!stream)
+		return false;
+
+	return stream->enabling;
+}
+
 bool bt_bap_new_bcast_source(struct bt_bap *bap, const char *name)
 {
 	struct bt_bap_endpoint *ep;
@@ -5884,130 +6595,83 @@ static void add_new_subgroup(struct bt_base *base,
 	sgrp->meta = util_iov_dup(stream->meta, 1);
 	sgrp->bises = queue_new();
 
+	/* Index once so matching other streams does not parse it again */
+	sgrp->indexed = util_ltv_index_init(&sgrp->caps_idx,
+				sgrp->caps ? sgrp->caps->iov_base : NULL,
+				sgrp->caps ? sgrp->caps->iov_len : 0) &&
+			util_ltv_index_init(&sgrp->meta_idx,
+				sgrp->meta ? sgrp->meta->iov_base : NULL,
+				sgrp->meta ? sgrp->meta->iov_len : 0);
+
 	stream->qos.bcast.bis = base->next_bis_index++;
 	add_new_bis(sgrp, stream->qos.bcast.bis,
 					NULL);
 	queue_push_tail(base->subgroups, sgrp);
 }
 
-struct bt_ltv_match {
-	uint8_t l;
-	uint8_t *v;
-	bool found;
-};
-
-struct bt_ltv_search {
-	struct iovec *iov;
-	bool found;
-};
-
-static void match_ltv(size_t i, uint8_t l, uint8_t t, uint8_t *v,
-					void *user_data)
-{
-	struct bt_ltv_match *ltv_match = user_data;
-
-	if (ltv_match->found == true)
-		return;
-
-	if (ltv_match->l != l)
-		return;
-
-	if (!memcmp(v, ltv_match->v, l))
-		ltv_match->found = true;
-}
-
-static void search_ltv(size_t i, uint8_t l, uint8_t t, uint8_t *v,
-					void *user_data)
+static bool bap_ltv_index(struct util_ltv_index *idx, struct iovec *iov)
 {
-	struct bt_ltv_search *ltv_search = user_data;
-	struct bt_ltv_match ltv_match;
-
-	ltv_match.found = false;
-	ltv_match.l = l;
-	ltv_match.v = v;
-
-	util_ltv_foreach(ltv_search->iov->iov_base,
-			ltv_search->iov->iov_len, &t,
-			match_ltv, &ltv_match);
+	if (!iov)
+		return util_ltv_index_init(idx, NULL, 0);
 
-	/* Once "found" has been updated to "false",
-	 * do not overwrite it anymore.
-	 * It means that an ltv was not found in the search list,
-	 * and this should be detected back in the parent function.
-	 */
-	if (ltv_search->found)
-		ltv_search->found = ltv_match.found;
+	return util_ltv_index_init(idx, iov->iov_base, iov->iov_len);
 }
 
-static bool compare_ltv(struct iovec *iov1,
-		struct iovec *iov2)
+static bool subgroup_match_meta(struct bt_subgroup *subgroup,
+				struct iovec *meta,
+				struct util_ltv_index *meta_idx,
+				bool indexed)
 {
-	struct bt_ltv_search ltv_search;
-
-	if ((!iov1) && (!iov2))
+	if (!subgroup->meta && !meta)
 		return true;
 
-	if ((!iov1) || (!iov2))
+	if (!subgroup->meta || !meta)
 		return false;
 
-	/* Compare metadata length */
-	if (iov1->iov_len != iov2->iov_len)
+	if (subgroup->meta->iov_len != meta->iov_len)
 		return false;
 
-	ltv_search.found = true;
-	ltv_search.iov = iov2;
-
-	util_ltv_foreach(iov1->iov_base,
-			iov1->iov_len, NULL,
-			search_ltv, &ltv_search);
+	/* Fallback to a plain comparison if entries could not be indexed */
+	if (!subgroup->indexed || !indexed)
+		return !util_iov_memcmp(subgroup->meta, meta);
 
-	return ltv_search.found;
+	return util_ltv_index_equal(&subgroup->meta_idx, meta_idx);
 }
 
-struct bt_ltv_extract {
+/* Extract the BIS specific codec configuration, i.e. the entries not
+ * present with the same value in the subgroup.
+ */
+static struct iovec *extract_diff_caps(struct bt_subgroup *subgroup,
+					struct iovec *bis_caps)
+{
+	struct util_ltv_index idx;
 	struct iovec *result;
-	struct iovec *src;
-};
+	uint16_t i;
 
-static void extract_ltv(size_t i, uint8_t l, uint8_t t, uint8_t *v,
-					void *user_data)
-{
-	struct bt_ltv_extract *ext_data = user_data;
-	struct bt_ltv_match ltv_match;
-	uint8_t ltv_len = 0;
+	if (!bis_caps || !bis_caps->iov_len)
+		return new0(struct iovec, 1);
 
-	ltv_match.found = false;
-	ltv_match.l = l;
-	ltv_match.v = v;
+	if (!subgroup->indexed || !bap_ltv_index(&idx, bis_caps))
+		return util_iov_dup(bis_caps, 1);
 
-	/* Search each BIS caps ltv in subgroup caps
-	 * to extract the one that are BIS specific
-	 */
-	util_ltv_foreach(ext_data->src->iov_base,
-			ext_data->src->iov_len, &t,
-			match_ltv, &ltv_match);
+	result = new0(struct iovec, 1);
+	result->iov_base = util_malloc(bis_caps->iov_len);
 
-	if (!ltv_match.found) {
-		ltv_len = l + 1;
-		iov_append(ext_data->result, 1, &ltv_len);
-		iov_append(ext_data->result, 1, &t);
-		iov_append(ext_data->result, l, &v);
-	}
-}
+	for (i = 0; i < idx.num; i++) {
+		uint8_t t = idx.types[i];
+		uint8_t *v, l;
 
-static struct iovec *extract_diff_caps(
-		struct iovec *subgroup_caps, struct iovec *bis_caps)
-{
-	struct bt_ltv_extract ext_data;
+		if (util_ltv_index_match(&subgroup->caps_idx, &idx, t))
+			continue;
 
-	ext_data.src = subgroup_caps;
-	ext_data.result = new0(struct iovec, 1);
+		v = util_ltv_index_get(&idx, t, &l);
 
-	util_ltv_foreach(bis_caps->iov_base,
-			bis_caps->iov_len, NULL,
-			extract_ltv, &ext_data);
+		util_iov_push_u8(result, l + 1);
+		util_iov_push_u8(result, t);
+		util_iov_push_mem(result, l, v);
+	}
 
-	return ext_data.result;
+	return result;
 }
 
 static void set_base_subgroup(void *data, void *user_data)
@@ -6032,12 +6696,16 @@ static void set_base_subgroup(void *data, void *user_data)
 		/* Verify if a subgroup has the same metadata */
 		const struct queue_entry *entry;
 		struct bt_subgroup *subgroup = NULL;
-		bool same_meta = false;
+		struct util_ltv_index meta_idx;
+		bool indexed, same_meta = false;
+
+		indexed = bap_ltv_index(&meta_idx, stream->meta);
 
 		for (entry = queue_get_entries(base->subgroups);
 						entry; entry = entry->next) {
 			subgroup = entry->data;
-			same_meta = compare_ltv(subgroup->meta,	stream->meta);
+			same_meta = subgroup_match_meta(subgroup, stream->meta,
+							&meta_idx, indexed);
 			if (same_meta)
 				break;
 		}
@@ -6051,9 +6719,7 @@ static void set_base_subgroup(void *data, void *user_data)
 			/* Subgroup found with the same metadata.
 			 * Extract different codec capabilities.
 			 */
-			bis_caps = extract_diff_caps(
-					subgroup->caps,
-					stream->cc);
+			bis_caps = extract_diff_caps(subgroup, stream->cc);
 
 			stream->qos.bcast.bis = base->next_bis_index++;
 			add_new_bis(subgroup,
@@ -121,6 +121,8 @@ typedef void (*bt_bap_stream_func_t)(struct bt_bap_stream *stream,
 					uint8_t code, uint8_t reason,
 					void *user_data);
 typedef void (*bt_bap_func_t)(struct bt_bap *bap, void *user_data);
+typedef void (*bt_bap_value_func_t)(uint16_t handle, const uint8_t *value,
+					uint16_t len, void *user_data);
 
 /* Local PAC related functions */
 struct bt_bap_pac_qos {
@@ -199,6 +201,11 @@ bool bt_bap_attach(struct bt_bap *bap, struct bt_gatt_client *client);
 bool bt_bap_attach_broadcast(struct bt_bap *bap);
 void bt_bap_detach(struct bt_bap *bap);
 
+bool bt_bap_add_cache(struct bt_bap *bap, uint16_t handle,
+			const uint8_t *value, uint16_t len);
+void bt_bap_foreach_cache(struct bt_bap *bap, bt_bap_value_func_t func,
+							void *user_data);
+
 bool bt_bap_set_debug(struct bt_bap *bap, bt_bap_debug_func_t cb,
 			void *user_data, bt_bap_destroy_func_t destroy);
 
@@ -290,6 +297,11 @@ unsigned int bt_bap_stream_release(struct bt_bap_stream *stream,
 					bt_bap_stream_func_t func,
 					void *user_data);
 
+unsigned int bt_bap_stream_resume(struct bt_bap_stream *stream,
+					struct bt_bap_qos *qos, bool enable,
+					bt_bap_stream_func_t func,
+					void *user_data);
+
 uint8_t bt_bap_stream_get_dir(struct bt_bap_stream *stream);
 uint32_t bt_bap_stream_get_location(struct bt_bap_stream *stream);
 struct iovec *bt_bap_stream_get_config(struct bt_bap_stream *stream);
@@ -313,6 +325,7 @@ uint8_t bt_bap_stream_io_dir(struct bt_bap_stream *stream);
 
 int bt_bap_stream_io_connecting(struct bt_bap_stream *stream, int fd);
 bool bt_bap_stream_io_is_connecting(struct bt_bap_stream *stream, int *fd);
+bool bt_bap_stream_is_enabling(struct bt_bap_stream *stream);
 
 bool bt_bap_new_bcast_source(struct bt_bap *bap, const char *name);
 void bt_bap_update_bcast_source(struct bt_bap_pac *pac,
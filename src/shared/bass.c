@@ -24,6 +24,7 @@
 
 #include "src/shared/queue.h"
 #include "src/shared/util.h"
+#include "src/shared/timeout.h"
 #include "src/shared/att.h"
 #include "src/shared/gatt-db.h"
 #include "src/shared/gatt-client.h"
@@ -31,6 +32,9 @@
 
 #define MAX_BIS_BITMASK_IDX		31
 
+/* Time to keep an unused PA sync before terminating it */
+#define PA_SYNC_LINGER_TIMEOUT		10
+
 #define DBG(_bass, fmt, arg...) \
 	bass_debug(_bass, "%s:%s() " fmt, __FILE__, __func__, ## arg)
 
@@ -47,6 +51,13 @@ struct bt_bcast_recv_state {
 	struct bt_bass_db *bdb;
 	struct gatt_db_attribute *attr;
 	struct gatt_db_attribute *ccc;
+
+	/* Last value notified, to skip notifying unchanged states */
+	struct bt_att *notify_att;
+	uint8_t value[BT_ATT_MAX_VALUE_LEN];
+	uint16_t value_len;
+	bool notified;
+	unsigned int notify_id;
 };
 
 struct bt_bass_db {
@@ -85,9 +96,39 @@ struct bt_bass_notify {
 	void *user_data;
 };
 
+/* PA sync to a Broadcast Source, shared by the sources added by Broadcast
+ * Assistants for the same broadcast until a BIG sync is created from it:
+ *
+ * - Sources added while the PA sync is being established, or while it
+ *   waits for a Broadcast_Code, share it.
+ * - Once the last source is gone a PA sync that has not been used for a
+ *   BIG sync lingers for PA_SYNC_LINGER_TIMEOUT, so adding the broadcast
+ *   again within that time skips the PA sync.
+ *
+ * A PA sync socket leaves BT_CONNECT2 once a BIG sync has been accepted
+ * from it, so it is never used for a second BIG sync: sources added later
+ * open a new PA sync, and other sources already sharing it stay
+ * synchronized to the PA only.
+ */
+struct bt_bass_pa_sync {
+	bdaddr_t adapter_bdaddr;
+	bdaddr_t addr;
+	uint8_t addr_type;
+	uint8_t sid;
+	uint32_t bid;
+	bool encrypted;
+	GIOChannel *listen_io;
+	GIOChannel *pa_sync_io;
+	bool accepted;
+	struct queue *srcs;
+	unsigned int linger_id;
+	guint hup_id;
+};
+
 static struct queue *bass_db;
 static struct queue *bass_cbs;
 static struct queue *sessions;
+static struct queue *pa_syncs;
 
 #define DEFAULT_IO_QOS \
 { \
@@ -119,6 +160,7 @@ static struct bt_iso_qos default_qos = {
 };
 
 static void bass_bcast_src_free(void *data);
+static void bass_pa_sync_release(struct bt_bcast_src *bcast_src);
 
 static void bass_debug(struct bt_bass *bass, const char *format, ...)
 {
@@ -208,7 +250,7 @@ static int bass_build_bcast_src(struct bt_bcast_src *bcast_src,
 	if (num_subgroups == 0)
 		goto done;
 
-	subgroup_data = new0(struct bt_bass_subgroup_data, 1);
+	subgroup_data = new0(struct bt_bass_subgroup_data, num_subgroups);
 	if (!subgroup_data) {
 		DBG(bcast_src->bass, "Unable to allocate memory");
 		return -1;
@@ -302,14 +344,13 @@ done:
 	return 0;
 }
 
-static struct iovec *bass_parse_bcast_src(struct bt_bcast_src *bcast_src)
+static bool bass_encode_bcast_src(struct bt_bcast_src *bcast_src,
+					struct iovec *iov, size_t size)
 {
-	size_t len = 0;
-	uint8_t *notif = NULL;
-	struct iovec *iov;
+	size_t len;
 
 	if (!bcast_src)
-		return NULL;
+		return false;
 
 	len = BT_BASS_BCAST_SRC_LEN + bcast_src->num_subgroups *
 			BT_BASS_BCAST_SRC_SUBGROUP_LEN;
@@ -322,17 +363,9 @@ static struct iovec *bass_parse_bcast_src(struct bt_bcast_src *bcast_src)
 		len += bcast_src->subgroup_data[i].meta_len;
 	}
 
-	notif = malloc0(len);
-	if (!notif)
-		return NULL;
-
-	iov = new0(struct iovec, 1);
-	if (!iov) {
-		free(notif);
-		return NULL;
-	}
+	if (len > size)
+		return false;
 
-	iov->iov_base = notif;
 	iov->iov_len = 0;
 
 	util_iov_push_u8(iov, bcast_src->id);
@@ -364,7 +397,105 @@ static struct iovec *bass_parse_bcast_src(struct bt_bcast_src *bcast_src)
 				bcast_src->subgroup_data[i].meta);
 	}
 
-	return iov;
+	return true;
+}
+
+static bool bass_src_attr_match(const void *data, const void *match_data)
+{
+	const struct bt_bcast_src *bcast_src = data;
+	const struct gatt_db_attribute *attr = match_data;
+
+	return (bcast_src->attr == attr);
+}
+
+static struct bt_bcast_recv_state *bass_get_recv_state(
+					struct bt_bass_db *bdb,
+					struct gatt_db_attribute *attr)
+{
+	for (int i = 0; i < NUM_BCAST_RECV_STATES; i++) {
+		if (bdb->bcast_recv_states[i] &&
+				bdb->bcast_recv_states[i]->attr == attr)
+			return bdb->bcast_recv_states[i];
+	}
+
+	return NULL;
+}
+
+static void bass_recv_state_notify(struct bt_bcast_recv_state *state,
+					const uint8_t *value, uint16_t len,
+					struct bt_att *att)
+{
+	/* Nothing to tell if the client already has this value */
+	if (state->notified && state->notify_att == att &&
+			state->value_len == len &&
+			(!len || !memcmp(state->value, value, len)))
+		return;
+
+	if (len)
+		memcpy(state->value, value, len);
+
+	state->value_len = len;
+	state->notify_att = att;
+	state->notified = true;
+
+	gatt_db_attribute_notify(state->attr, value, len, att);
+}
+
+static void bass_notify_bcast_src(struct bt_bcast_src *bcast_src)
+{
+	struct bt_bcast_recv_state *state;
+	uint8_t buf[BT_ATT_MAX_VALUE_LEN];
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = 0,
+	};
+
+	state = bass_get_recv_state(bcast_src->bass->ldb, bcast_src->attr);
+	if (!state)
+		return;
+
+	/* Any pending update is superseded by this one */
+	timeout_remove(state->notify_id);
+	state->notify_id = 0;
+
+	if (!bass_encode_bcast_src(bcast_src, &iov, sizeof(buf))) {
+		DBG(bcast_src->bass, "Broadcast Receive State too long");
+		return;
+	}
+
+	bass_recv_state_notify(state, iov.iov_base, iov.iov_len,
+					bt_bass_get_att(bcast_src->bass));
+}
+
+static bool bass_recv_state_flush(void *user_data)
+{
+	struct bt_bcast_recv_state *state = user_data;
+	struct bt_bcast_src *bcast_src;
+
+	state->notify_id = 0;
+
+	bcast_src = queue_find(state->bdb->bcast_srcs, bass_src_attr_match,
+							state->attr);
+	if (bcast_src)
+		bass_notify_bcast_src(bcast_src);
+
+	return false;
+}
+
+/* Notify the state of a source once the current event has been
+ * processed, so that the changes caused by a single PA or BIG sync
+ * event, one per BIS, or by control point operations handled together
+ * only take one notification.
+ */
+static void bass_schedule_notify(struct bt_bcast_src *bcast_src)
+{
+	struct bt_bcast_recv_state *state;
+
+	state = bass_get_recv_state(bcast_src->bass->ldb, bcast_src->attr);
+	if (!state || state->notify_id)
+		return;
+
+	state->notify_id = timeout_add(0, bass_recv_state_flush, state, NULL);
 }
 
 static bool bass_check_cp_command_subgroup_data_len(uint8_t num_subgroups,
@@ -502,6 +633,7 @@ static void bass_handle_remove_src_op(struct bt_bass *bass,
 {
 	struct bt_bass_remove_src_params *params;
 	struct bt_bcast_src *bcast_src;
+	struct bt_bcast_recv_state *state;
 	int att_err = 0;
 
 	/* Get Remove Source command parameters */
@@ -532,7 +664,14 @@ static void bass_handle_remove_src_op(struct bt_bass *bass,
 
 	/* Accept the operation and remove source */
 	queue_remove(bass->ldb->bcast_srcs, bcast_src);
-	gatt_db_attribute_notify(bcast_src->attr, NULL, 0, att);
+
+	state = bass_get_recv_state(bass->ldb, bcast_src->attr);
+	if (state) {
+		timeout_remove(state->notify_id);
+		state->notify_id = 0;
+		bass_recv_state_notify(state, NULL, 0, att);
+	}
+
 	bass_bcast_src_free(bcast_src);
 
 done:
@@ -540,14 +679,6 @@ done:
 			att_err);
 }
 
-static bool bass_src_attr_match(const void *data, const void *match_data)
-{
-	const struct bt_bcast_src *bcast_src = data;
-	const struct gatt_db_attribute *attr = match_data;
-
-	return (bcast_src->attr == attr);
-}
-
 static gboolean check_io_err(GIOChannel *io)
 {
 	struct pollfd fds;
@@ -573,7 +704,6 @@ static void connect_cb(GIOChannel *io, GError *gerr,
 				gpointer user_data)
 {
 	struct bt_bcast_src *bcast_src = user_data;
-	struct iovec *notif;
 	int bis_idx;
 	int i;
 
@@ -617,18 +747,10 @@ static void connect_cb(GIOChannel *io, GError *gerr,
 		queue_destroy(bcast_src->bises, bass_bis_unref);
 		bcast_src->bises = NULL;
 
-		/* Close listen io */
-		g_io_channel_shutdown(bcast_src->listen_io, TRUE, NULL);
-		g_io_channel_unref(bcast_src->listen_io);
-		bcast_src->listen_io = NULL;
-
-		/* Close pa sync io */
-		if (bcast_src->pa_sync_io) {
-			g_io_channel_shutdown(bcast_src->pa_sync_io,
-					TRUE, NULL);
-			g_io_channel_unref(bcast_src->pa_sync_io);
-			bcast_src->pa_sync_io = NULL;
-		}
+		/* Drop the reference to the PA sync, which is terminated
+		 * once no other source uses it since it cannot be reused.
+		 */
+		bass_pa_sync_release(bcast_src);
 
 		for (i = 0; i < bcast_src->num_subgroups; i++)
 			bcast_src->subgroup_data[i].bis_sync =
@@ -645,16 +767,7 @@ static void connect_cb(GIOChannel *io, GError *gerr,
 	}
 
 	/* Send notification to client */
-	notif = bass_parse_bcast_src(bcast_src);
-	if (!notif)
-		return;
-
-	gatt_db_attribute_notify(bcast_src->attr,
-					notif->iov_base, notif->iov_len,
-					bt_bass_get_att(bcast_src->bass));
-
-	free(notif->iov_base);
-	free(notif);
+	bass_schedule_notify(bcast_src);
 }
 
 static bool bass_trigger_big_sync(struct bt_bcast_src *bcast_src)
@@ -671,27 +784,213 @@ static bool bass_trigger_big_sync(struct bt_bcast_src *bcast_src)
 	return false;
 }
 
+static uint8_t bass_get_pending_bis(struct bt_bcast_src *bcast_src,
+								uint8_t *bis)
+{
+	uint8_t num_bis = 0;
+
+	for (int i = 0; i < bcast_src->num_subgroups; i++) {
+		uint32_t pending = bcast_src->subgroup_data[i].pending_bis_sync;
+
+		if (pending == BIS_SYNC_NO_PREF)
+			continue;
+
+		for (int bis_idx = 0; bis_idx < MAX_BIS_BITMASK_IDX; bis_idx++)
+			if (pending & (1 << bis_idx))
+				bis[num_bis++] = bis_idx + 1;
+	}
+
+	return num_bis;
+}
+
+static bool bass_big_sync(struct bt_bcast_src *bcast_src)
+{
+	struct bt_bass_pa_sync *pa_sync = bcast_src->pa_sync;
+	uint8_t bis[ISO_MAX_NUM_BIS];
+	uint8_t num_bis;
+	GError *gerr = NULL;
+
+	if (!pa_sync || !pa_sync->pa_sync_io)
+		return false;
+
+	/* Only one BIG sync can be created from a PA sync, since the socket
+	 * leaves BT_CONNECT2 once it has been accepted.
+	 */
+	if (pa_sync->accepted) {
+		DBG(bcast_src->bass, "BIG sync already created from PA sync");
+		return false;
+	}
+
+	num_bis = bass_get_pending_bis(bcast_src, bis);
+
+	/* The PA sync may have been created for another source, so
+	 * always bind it to the BISes of this one.
+	 */
+	if (!bt_io_bcast_accept(pa_sync->pa_sync_io,
+				connect_cb, bcast_src, NULL, &gerr,
+				BT_IO_OPT_ISO_BC_NUM_BIS, num_bis,
+				BT_IO_OPT_ISO_BC_BIS, bis,
+				BT_IO_OPT_INVALID)) {
+		DBG(bcast_src->bass, "bt_io_bcast_accept: %s",
+						gerr->message);
+		g_error_free(gerr);
+		return false;
+	}
+
+	pa_sync->accepted = true;
+
+	if (!bcast_src->bises)
+		bcast_src->bises = queue_new();
+
+	return true;
+}
+
+static void bass_pa_synced(void *data, void *user_data)
+{
+	struct bt_bcast_src *bcast_src = data;
+
+	bcast_src->sync_state = BT_BASS_SYNCHRONIZED_TO_PA;
+
+	if (bcast_src->pa_sync->encrypted) {
+		/* BIG is encrypted. Wait for Client to provide the
+		 * Broadcast_Code
+		 */
+		bcast_src->enc = BT_BASS_BIG_ENC_STATE_BCODE_REQ;
+	} else {
+		/* BIG is not encrypted. Try to synchronize */
+		bcast_src->enc = BT_BASS_BIG_ENC_STATE_NO_ENC;
+
+		if (bass_trigger_big_sync(bcast_src) &&
+					bass_big_sync(bcast_src))
+			return;
+	}
+
+	bass_schedule_notify(bcast_src);
+}
+
+static void bass_pa_sync_unlink(void *data, void *user_data)
+{
+	struct bt_bcast_src *bcast_src = data;
+
+	bcast_src->pa_sync = NULL;
+}
+
+static void bass_pa_sync_linger_stop(struct bt_bass_pa_sync *pa_sync)
+{
+	timeout_remove(pa_sync->linger_id);
+	pa_sync->linger_id = 0;
+
+	if (pa_sync->hup_id) {
+		g_source_remove(pa_sync->hup_id);
+		pa_sync->hup_id = 0;
+	}
+}
+
+static void bass_pa_sync_free(void *data)
+{
+	struct bt_bass_pa_sync *pa_sync = data;
+
+	bass_pa_sync_linger_stop(pa_sync);
+
+	if (pa_sync->listen_io) {
+		g_io_channel_shutdown(pa_sync->listen_io, TRUE, NULL);
+		g_io_channel_unref(pa_sync->listen_io);
+	}
+
+	if (pa_sync->pa_sync_io) {
+		g_io_channel_shutdown(pa_sync->pa_sync_io, TRUE, NULL);
+		g_io_channel_unref(pa_sync->pa_sync_io);
+	}
+
+	queue_foreach(pa_sync->srcs, bass_pa_sync_unlink, NULL);
+	queue_destroy(pa_sync->srcs, NULL);
+
+	free(pa_sync);
+}
+
+static void bass_pa_sync_drop(struct bt_bass_pa_sync *pa_sync)
+{
+	queue_remove(pa_syncs, pa_sync);
+	bass_pa_sync_free(pa_sync);
+}
+
+static bool bass_pa_sync_expired(void *user_data)
+{
+	struct bt_bass_pa_sync *pa_sync = user_data;
+
+	pa_sync->linger_id = 0;
+	bass_pa_sync_drop(pa_sync);
+
+	return false;
+}
+
+static gboolean bass_pa_sync_hup(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct bt_bass_pa_sync *pa_sync = user_data;
+
+	/* PA sync lost while lingering */
+	pa_sync->hup_id = 0;
+	bass_pa_sync_drop(pa_sync);
+
+	return FALSE;
+}
+
+static void bass_pa_sync_release(struct bt_bcast_src *bcast_src)
+{
+	struct bt_bass_pa_sync *pa_sync = bcast_src->pa_sync;
+
+	if (!pa_sync)
+		return;
+
+	bcast_src->pa_sync = NULL;
+
+	queue_remove(pa_sync->srcs, bcast_src);
+	if (!queue_isempty(pa_sync->srcs))
+		return;
+
+	/* Nobody is waiting for a PA sync still being established, and a
+	 * PA sync that has been used for a BIG sync cannot be accepted again.
+	 */
+	if (!pa_sync->pa_sync_io || pa_sync->accepted) {
+		bass_pa_sync_drop(pa_sync);
+		return;
+	}
+
+	pa_sync->linger_id = timeout_add_seconds(PA_SYNC_LINGER_TIMEOUT,
+						bass_pa_sync_expired,
+						pa_sync, NULL);
+	pa_sync->hup_id = g_io_add_watch(pa_sync->pa_sync_io,
+					G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+					bass_pa_sync_hup, pa_sync);
+}
+
+static void bass_pa_sync_failed(void *data, void *user_data)
+{
+	struct bt_bcast_src *bcast_src = data;
+
+	/* Mark PA sync as failed and notify client */
+	bcast_src->sync_state = BT_BASS_FAILED_TO_SYNCHRONIZE_TO_PA;
+	bcast_src->pa_sync = NULL;
+
+	bass_schedule_notify(bcast_src);
+}
 
 static void confirm_cb(GIOChannel *io, gpointer user_data)
 {
-	struct bt_bcast_src *bcast_src = user_data;
+	struct bt_bass_pa_sync *pa_sync = user_data;
 	int sk, err;
 	socklen_t len;
 	struct bt_iso_qos qos;
-	struct iovec *notif;
-	GError *gerr = NULL;
 
 	if (check_io_err(io)) {
-		DBG(bcast_src->bass, "PA sync failed");
-
-		/* Mark PA sync as failed and notify client */
-		bcast_src->sync_state = BT_BASS_FAILED_TO_SYNCHRONIZE_TO_PA;
-		goto notify;
+		queue_foreach(pa_sync->srcs, bass_pa_sync_failed, NULL);
+		bass_pa_sync_drop(pa_sync);
+		return;
 	}
 
-	bcast_src->sync_state = BT_BASS_SYNCHRONIZED_TO_PA;
-	bcast_src->pa_sync_io = io;
-	g_io_channel_ref(bcast_src->pa_sync_io);
+	pa_sync->pa_sync_io = io;
+	g_io_channel_ref(pa_sync->pa_sync_io);
 
 	len = sizeof(qos);
 	memset(&qos, 0, len);
@@ -699,43 +998,101 @@ static void confirm_cb(GIOChannel *io, gpointer user_data)
 	sk = g_io_channel_unix_get_fd(io);
 
 	err = getsockopt(sk, SOL_BLUETOOTH, BT_ISO_QOS, &qos, &len);
-	if (err < 0) {
-		DBG(bcast_src->bass, "Failed to get iso qos");
+	if (err < 0)
 		return;
+
+	pa_sync->encrypted = qos.bcast.encryption;
+
+	queue_foreach(pa_sync->srcs, bass_pa_synced, NULL);
+}
+
+static bool bass_pa_sync_match(const void *data, const void *match_data)
+{
+	const struct bt_bass_pa_sync *pa_sync = data;
+	const struct bt_bcast_src *bcast_src = match_data;
+
+	return !bacmp(&pa_sync->adapter_bdaddr,
+				&bcast_src->bass->ldb->adapter_bdaddr) &&
+		!bacmp(&pa_sync->addr, &bcast_src->addr) &&
+		pa_sync->addr_type == bcast_src->addr_type &&
+		pa_sync->sid == bcast_src->sid &&
+		pa_sync->bid == bcast_src->bid &&
+		!pa_sync->accepted;
+}
+
+static bool bass_pa_sync_attach(struct bt_bcast_src *bcast_src,
+					uint8_t num_bis, uint8_t *bis)
+{
+	struct bt_bass *bass = bcast_src->bass;
+	struct bt_bass_pa_sync *pa_sync;
+	struct bt_iso_qos iso_qos = default_qos;
+	uint8_t addr_type;
+	GError *err = NULL;
+
+	pa_sync = queue_find(pa_syncs, bass_pa_sync_match, bcast_src);
+	if (pa_sync) {
+		DBG(bass, "Reusing PA sync");
+
+		bass_pa_sync_linger_stop(pa_sync);
+
+		queue_push_tail(pa_sync->srcs, bcast_src);
+		bcast_src->pa_sync = pa_sync;
+
+		/* If still being established the source is updated
+		 * together with the others when it completes.
+		 */
+		if (pa_sync->pa_sync_io)
+			bass_pa_synced(bcast_src, NULL);
+
+		return true;
 	}
 
-	if (!qos.bcast.encryption) {
-		/* BIG is not encrypted. Try to synchronize */
-		bcast_src->enc = BT_BASS_BIG_ENC_STATE_NO_ENC;
+	pa_sync = new0(struct bt_bass_pa_sync, 1);
+	bacpy(&pa_sync->adapter_bdaddr, &bass->ldb->adapter_bdaddr);
+	bacpy(&pa_sync->addr, &bcast_src->addr);
+	pa_sync->addr_type = bcast_src->addr_type;
+	pa_sync->sid = bcast_src->sid;
+	pa_sync->bid = bcast_src->bid;
 
-		if (bass_trigger_big_sync(bcast_src)) {
-			if (!bt_io_bcast_accept(bcast_src->pa_sync_io,
-				connect_cb, bcast_src, NULL, &gerr,
-				BT_IO_OPT_INVALID)) {
-				DBG(bcast_src->bass, "bt_io_bcast_accept: %s",
-				gerr->message);
-				g_error_free(gerr);
-			}
-			return;
-		}
+	/* Convert to three-value type */
+	if (bcast_src->addr_type)
+		addr_type = BDADDR_LE_RANDOM;
+	else
+		addr_type = BDADDR_LE_PUBLIC;
 
-		goto notify;
+	pa_sync->listen_io = bt_io_listen(NULL, confirm_cb, pa_sync, NULL,
+					&err,
+					BT_IO_OPT_SOURCE_BDADDR,
+					&bass->ldb->adapter_bdaddr,
+					BT_IO_OPT_DEST_BDADDR,
+					&bcast_src->addr,
+					BT_IO_OPT_DEST_TYPE,
+					addr_type,
+					BT_IO_OPT_MODE, BT_IO_MODE_ISO,
+					BT_IO_OPT_QOS, &iso_qos,
+					BT_IO_OPT_ISO_BC_SID, bcast_src->sid,
+					BT_IO_OPT_ISO_BC_NUM_BIS, num_bis,
+					BT_IO_OPT_ISO_BC_BIS, bis,
+					BT_IO_OPT_INVALID);
+	if (!pa_sync->listen_io) {
+		DBG(bass, "%s", err->message);
+		g_error_free(err);
+		free(pa_sync);
+		return false;
 	}
 
-	/* BIG is encrypted. Wait for Client to provide the Broadcast_Code */
-	bcast_src->enc = BT_BASS_BIG_ENC_STATE_BCODE_REQ;
+	g_io_channel_ref(pa_sync->listen_io);
 
-notify:
-	notif = bass_parse_bcast_src(bcast_src);
-	if (!notif)
-		return;
+	pa_sync->srcs = queue_new();
+	queue_push_tail(pa_sync->srcs, bcast_src);
+	bcast_src->pa_sync = pa_sync;
 
-	gatt_db_attribute_notify(bcast_src->attr,
-					notif->iov_base, notif->iov_len,
-					bt_bass_get_att(bcast_src->bass));
+	if (!pa_syncs)
+		pa_syncs = queue_new();
 
-	free(notif->iov_base);
-	free(notif);
+	queue_push_tail(pa_syncs, pa_sync);
+
+	return true;
 }
 
 static struct bt_bass *bass_get_session(struct bt_att *att, struct gatt_db *db,
@@ -824,13 +1181,8 @@ static void bass_handle_add_src_op(struct bt_bass *bass,
 	uint8_t src_id = 0;
 	struct gatt_db_attribute *attr;
 	uint8_t pa_sync;
-	GIOChannel *io;
-	GError *err = NULL;
-	struct bt_iso_qos iso_qos = default_qos;
 	uint8_t num_bis = 0;
 	uint8_t bis[ISO_MAX_NUM_BIS];
-	struct iovec *notif;
-	uint8_t addr_type;
 
 	gatt_db_attribute_write_result(attrib, id, 0x00);
 
@@ -956,58 +1308,26 @@ static void bass_handle_add_src_op(struct bt_bass *bass,
 	}
 
 	if (pa_sync != PA_SYNC_NO_SYNC) {
-		/* Convert to three-value type */
-		if (bcast_src->addr_type)
-			addr_type = BDADDR_LE_RANDOM;
-		else
-			addr_type = BDADDR_LE_PUBLIC;
-
 		/* If requested by client, try to synchronize to the source */
-		io = bt_io_listen(NULL, confirm_cb, bcast_src, NULL, &err,
-					BT_IO_OPT_SOURCE_BDADDR,
-					&bass->ldb->adapter_bdaddr,
-					BT_IO_OPT_DEST_BDADDR,
-					&bcast_src->addr,
-					BT_IO_OPT_DEST_TYPE,
-					addr_type,
-					BT_IO_OPT_MODE, BT_IO_MODE_ISO,
-					BT_IO_OPT_QOS, &iso_qos,
-					BT_IO_OPT_ISO_BC_SID, bcast_src->sid,
-					BT_IO_OPT_ISO_BC_NUM_BIS, num_bis,
-					BT_IO_OPT_ISO_BC_BIS, bis,
-					BT_IO_OPT_INVALID);
-
-		if (!io) {
-			DBG(bass, "%s", err->message);
-			g_error_free(err);
-			goto err;
-		}
-
-		bcast_src->listen_io = io;
-		g_io_channel_ref(bcast_src->listen_io);
-
 		if (num_bis > 0 && !bcast_src->bises)
 			bcast_src->bises = queue_new();
+
+		if (!bass_pa_sync_attach(bcast_src, num_bis, bis))
+			goto err;
 	} else {
 		for (int i = 0; i < bcast_src->num_subgroups; i++)
 			bcast_src->subgroup_data[i].bis_sync =
 				bcast_src->subgroup_data[i].pending_bis_sync;
 
-		notif = bass_parse_bcast_src(bcast_src);
-		if (!notif)
-			return;
-
-		gatt_db_attribute_notify(bcast_src->attr,
-				notif->iov_base, notif->iov_len,
-				bt_bass_get_att(bcast_src->bass));
-
-		free(notif->iov_base);
-		free(notif);
+		bass_schedule_notify(bcast_src);
 	}
 
 	return;
 
 err:
+	queue_remove(bass->ldb->bcast_srcs, bcast_src);
+	queue_destroy(bcast_src->bises, NULL);
+
 	if (bcast_src->subgroup_data) {
 		for (int i = 0; i < bcast_src->num_subgroups; i++)
 			free(bcast_src->subgroup_data[i].meta);
@@ -1030,8 +1350,6 @@ static void bass_handle_set_bcast_code_op(struct bt_bass *bass,
 	int sk, err;
 	socklen_t len;
 	struct bt_iso_qos qos;
-	GError *gerr = NULL;
-	struct iovec *notif;
 
 	/* Get Set Broadcast Code command parameters */
 	params = util_iov_pull_mem(iov, sizeof(*params));
@@ -1053,16 +1371,7 @@ static void bass_handle_set_bcast_code_op(struct bt_bass *bass,
 	if (!bass_trigger_big_sync(bcast_src)) {
 		bcast_src->enc = BT_BASS_BIG_ENC_STATE_DEC;
 
-		notif = bass_parse_bcast_src(bcast_src);
-		if (!notif)
-			return;
-
-		gatt_db_attribute_notify(bcast_src->attr,
-					notif->iov_base, notif->iov_len,
-					bt_bass_get_att(bcast_src->bass));
-
-		free(notif->iov_base);
-		free(notif);
+		bass_schedule_notify(bcast_src);
 		return;
 	}
 
@@ -1072,10 +1381,10 @@ static void bass_handle_set_bcast_code_op(struct bt_bass *bass,
 	len = sizeof(qos);
 	memset(&qos, 0, len);
 
-	if (!bcast_src->pa_sync_io)
+	if (!bcast_src->pa_sync || !bcast_src->pa_sync->pa_sync_io)
 		return;
 
-	sk = g_io_channel_unix_get_fd(bcast_src->pa_sync_io);
+	sk = g_io_channel_unix_get_fd(bcast_src->pa_sync->pa_sync_io);
 
 	err = getsockopt(sk, SOL_BLUETOOTH, BT_ISO_QOS, &qos, &len);
 	if (err < 0) {
@@ -1092,11 +1401,7 @@ static void bass_handle_set_bcast_code_op(struct bt_bass *bass,
 		return;
 	}
 
-	if (!bt_io_bcast_accept(bcast_src->pa_sync_io, connect_cb,
-		bcast_src, NULL, &gerr,  BT_IO_OPT_INVALID)) {
-		DBG(bcast_src->bass, "bt_io_bcast_accept: %s", gerr->message);
-		g_error_free(gerr);
-	}
+	bass_big_sync(bcast_src);
 }
 
 #define BASS_OP(_str, _op, _size, _func) \
@@ -1184,7 +1489,11 @@ static void bass_bcast_recv_state_read(struct gatt_db_attribute *attrib,
 					void *user_data)
 {
 	struct bt_bass_db *bdb = user_data;
-	struct iovec *rsp;
+	uint8_t buf[BT_ATT_MAX_VALUE_LEN];
+	struct iovec rsp = {
+		.iov_base = buf,
+		.iov_len = 0,
+	};
 	struct bt_bcast_src *bcast_src;
 	struct bt_bass *bass = bass_get_session(att, bdb->db,
 						&bdb->adapter_bdaddr);
@@ -1200,20 +1509,15 @@ static void bass_bcast_recv_state_read(struct gatt_db_attribute *attrib,
 	}
 
 	/* Build read response */
-	rsp = bass_parse_bcast_src(bcast_src);
-
-	if (!rsp) {
+	if (!bass_encode_bcast_src(bcast_src, &rsp, sizeof(buf))) {
 		gatt_db_attribute_read_result(attrib, id,
 					BT_ATT_ERROR_UNLIKELY,
 					NULL, 0);
 		return;
 	}
 
-	gatt_db_attribute_read_result(attrib, id, 0, rsp->iov_base,
-						rsp->iov_len);
-
-	free(rsp->iov_base);
-	free(rsp);
+	gatt_db_attribute_read_result(attrib, id, 0, rsp.iov_base,
+						rsp.iov_len);
 }
 
 static void bcast_recv_new(struct bt_bass_db *bdb, int i)
@@ -1277,17 +1581,9 @@ static void bass_bcast_src_free(void *data)
 
 	free(bcast_src->subgroup_data);
 
-	if (bcast_src->listen_io) {
-		g_io_channel_shutdown(bcast_src->listen_io, TRUE, NULL);
-		g_io_channel_unref(bcast_src->listen_io);
-	}
-
-	if (bcast_src->pa_sync_io) {
-		g_io_channel_shutdown(bcast_src->pa_sync_io, TRUE, NULL);
-		g_io_channel_unref(bcast_src->pa_sync_io);
-	}
-
+	/* Terminate the BIG sync but keep the PA sync around */
 	queue_destroy(bcast_src->bises, bass_bis_unref);
+	bass_pa_sync_release(bcast_src);
 
 	free(bcast_src);
 }
@@ -1318,6 +1614,21 @@ static void read_bcast_recv_state(bool success, uint8_t att_ecode,
 	}
 }
 
+static bool bass_bcast_src_equal(struct bt_bcast_src *bcast_src,
+				const uint8_t *value, uint16_t length)
+{
+	uint8_t buf[BT_ATT_MAX_VALUE_LEN];
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = 0,
+	};
+
+	if (!bass_encode_bcast_src(bcast_src, &iov, sizeof(buf)))
+		return false;
+
+	return iov.iov_len == length && !memcmp(buf, value, length);
+}
+
 static void bcast_recv_state_notify(struct bt_bass *bass, uint16_t value_handle,
 				const uint8_t *value, uint16_t length,
 				void *user_data)
@@ -1342,6 +1653,10 @@ static void bcast_recv_state_notify(struct bt_bass *bass, uint16_t value_handle,
 		bcast_src->attr = attr;
 	}
 
+	/* Skip parsing again if the state has not changed */
+	if (!new_src && bass_bcast_src_equal(bcast_src, value, length))
+		return;
+
 	if (bass_build_bcast_src(bcast_src, value, length)
 							&& new_src) {
 		bass_bcast_src_free(bcast_src);
@@ -1511,11 +1826,36 @@ bool bt_bass_attach(struct bt_bass *bass, struct bt_gatt_client *client)
 	return true;
 }
 
+static void bass_recv_states_forget(struct bt_bass *bass)
+{
+	struct bt_att *att = bt_bass_get_att(bass);
+
+	if (!att || !bass->ldb)
+		return;
+
+	/* A new bearer may be allocated at the same address, so the last
+	 * notified values must not be matched against it.
+	 */
+	for (int i = 0; i < NUM_BCAST_RECV_STATES; i++) {
+		struct bt_bcast_recv_state *state =
+					bass->ldb->bcast_recv_states[i];
+
+		if (!state || state->notify_att != att)
+			continue;
+
+		state->notify_att = NULL;
+		state->notified = false;
+	}
+}
+
 bool bt_bass_set_att(struct bt_bass *bass, struct bt_att *att)
 {
 	if (!bass)
 		return false;
 
+	if (bass->att != att)
+		bass_recv_states_forget(bass);
+
 	bass->att = att;
 	return true;
 }
@@ -1533,6 +1873,8 @@ void bt_bass_detach(struct bt_bass *bass)
 	if (!queue_remove(sessions, bass))
 		return;
 
+	bass_recv_states_forget(bass);
+
 	bt_gatt_client_unref(bass->client);
 	bass->client = NULL;
 
@@ -1549,6 +1891,14 @@ static void bass_db_free(void *data)
 	gatt_db_unref(bdb->db);
 	queue_destroy(bdb->bcast_srcs, bass_bcast_src_free);
 
+	for (int i = 0; i < NUM_BCAST_RECV_STATES; i++) {
+		if (!bdb->bcast_recv_states[i])
+			continue;
+
+		timeout_remove(bdb->bcast_recv_states[i]->notify_id);
+		free(bdb->bcast_recv_states[i]);
+	}
+
 	free(bdb);
 }
 
@@ -42,6 +42,8 @@ struct bt_bass_subgroup_data {
 	uint8_t *meta;
 };
 
+struct bt_bass_pa_sync;
+
 /* BASS Broadcast Source structure */
 struct bt_bcast_src {
 	struct bt_bass *bass;
@@ -56,8 +58,7 @@ struct bt_bcast_src {
 	uint8_t bad_code[BT_BASS_BCAST_CODE_SIZE];
 	uint8_t num_subgroups;
 	struct bt_bass_subgroup_data *subgroup_data;
-	GIOChannel *listen_io;
-	GIOChannel *pa_sync_io;
+	struct bt_bass_pa_sync *pa_sync;
 	struct queue *bises;
 };
 
@@ -179,8 +179,11 @@ static void process_response(struct bt_hci *hci, uint16_t opcode,
 
 	cmd = queue_remove_if(hci->rsp_queue, match_cmd_opcode,
 						UINT_TO_PTR(opcode));
-	if (!cmd)
+	if (!cmd) {
+		/* Flushed command, its credit may unblock queued ones */
+		wakeup_writer(hci);
 		return;
+	}
 
 	/* Take a reference before calling the callback since that can unref
 	 * its reference destroying the instance.
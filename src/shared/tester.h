@@ -28,6 +28,7 @@ int tester_run(void);
 
 bool tester_use_quiet(void);
 bool tester_use_debug(void);
+bool tester_use_perf(void);
 
 void tester_print(const char *format, ...)
 				__attribute__((format(printf, 1, 2)));
@@ -233,3 +233,47 @@ int bt_uhid_send(struct bt_uhid *uhid, const struct uhid_event *ev)
 	/* uHID kernel driver does not handle partial writes */
 	return len != sizeof(*ev) ? -EIO : 0;
 }
+
+/* Send an input report without writing a full struct uhid_event, only the
+ * UHID_INPUT2 header and the report itself are written.
+ *
+ * /dev/uhid only implements write() and expects a whole event per call, a
+ * writev() would be split into one write per iovec, so the event has to be
+ * contiguous.
+ */
+int bt_uhid_input(struct bt_uhid *uhid, uint8_t number, const void *data,
+								size_t size)
+{
+	struct uhid_event ev;
+	size_t ev_len;
+	ssize_t len;
+	uint8_t *buf;
+
+	if (!uhid->io)
+		return -ENOTCONN;
+
+	if (size > UHID_DATA_MAX - !!number)
+		size = UHID_DATA_MAX - !!number;
+
+	ev.type = UHID_INPUT2;
+	ev.u.input2.size = size + !!number;
+
+	buf = ev.u.input2.data;
+
+	/* Numbered reports are prefixed with the report id */
+	if (number)
+		*buf++ = number;
+
+	if (size)
+		memcpy(buf, data, size);
+
+	ev_len = sizeof(ev.type) + sizeof(ev.u.input2.size) +
+							ev.u.input2.size;
+
+	len = write(io_get_fd(uhid->io), &ev, ev_len);
+	if (len < 0)
+		return -errno;
+
+	/* uHID kernel driver does not handle partial writes */
+	return len != (ssize_t) ev_len ? -EIO : 0;
+}
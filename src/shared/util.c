@@ -218,6 +218,152 @@ bool util_ltv_foreach(const uint8_t *data, uint8_t len, uint8_t *type,
 	return true;
 }
 
+/* Index LTV entries by type so they can be looked up without parsing the
+ * data again. Fails if the data is malformed or a type is repeated, in which
+ * case callers shall fallback to util_ltv_foreach.
+ */
+bool util_ltv_index_init(struct util_ltv_index *idx, void *data, size_t len)
+{
+	size_t i;
+
+	if (!idx)
+		return false;
+
+	memset(idx, 0, sizeof(*idx));
+
+	if (len >= UINT16_MAX)
+		return false;
+
+	idx->data = data;
+	idx->len = data ? len : 0;
+
+	for (i = 0; i < idx->len; i += idx->data[i] + 1) {
+		uint8_t l = idx->data[i], t;
+
+		/* Skip padding */
+		if (!l)
+			continue;
+
+		if (i + l >= idx->len)
+			return false;
+
+		t = idx->data[i + 1];
+		if (idx->offset[t])
+			return false;
+
+		/* Offset of the length octet plus one so 0 means absent */
+		idx->offset[t] = i + 1;
+		idx->types[idx->num++] = t;
+	}
+
+	return true;
+}
+
+uint8_t *util_ltv_index_get(const struct util_ltv_index *idx, uint8_t type,
+							uint8_t *len)
+{
+	uint16_t offset;
+
+	if (!idx || !idx->offset[type])
+		return NULL;
+
+	offset = idx->offset[type] - 1;
+
+	if (len)
+		*len = idx->data[offset] - 1;
+
+	return &idx->data[offset + 2];
+}
+
+bool util_ltv_index_get_u8(const struct util_ltv_index *idx, uint8_t type,
+							uint8_t *value)
+{
+	uint8_t *v, len;
+
+	v = util_ltv_index_get(idx, type, &len);
+	if (!v || len < sizeof(*value))
+		return false;
+
+	*value = *v;
+
+	return true;
+}
+
+bool util_ltv_index_get_le16(const struct util_ltv_index *idx, uint8_t type,
+							uint16_t *value)
+{
+	uint8_t *v, len;
+
+	v = util_ltv_index_get(idx, type, &len);
+	if (!v || len < sizeof(*value))
+		return false;
+
+	*value = get_le16(v);
+
+	return true;
+}
+
+bool util_ltv_index_get_le32(const struct util_ltv_index *idx, uint8_t type,
+							uint32_t *value)
+{
+	uint8_t *v, len;
+
+	v = util_ltv_index_get(idx, type, &len);
+	if (!v || len < sizeof(*value))
+		return false;
+
+	*value = get_le32(v);
+
+	return true;
+}
+
+/* Update the value of an existing entry in place, the length must match */
+bool util_ltv_index_set(struct util_ltv_index *idx, uint8_t type,
+					const void *value, uint8_t len)
+{
+	uint8_t *v, l;
+
+	v = util_ltv_index_get(idx, type, &l);
+	if (!v || l != len)
+		return false;
+
+	memcpy(v, value, len);
+
+	return true;
+}
+
+/* Check if an entry is present with the same value in both indexes */
+bool util_ltv_index_match(const struct util_ltv_index *idx,
+					const struct util_ltv_index *other,
+					uint8_t type)
+{
+	uint8_t *v1, *v2, l1, l2;
+
+	v1 = util_ltv_index_get(idx, type, &l1);
+	v2 = util_ltv_index_get(other, type, &l2);
+	if (!v1 || !v2 || l1 != l2)
+		return false;
+
+	return !memcmp(v1, v2, l1);
+}
+
+/* Compare entries regardless of their order */
+bool util_ltv_index_equal(const struct util_ltv_index *idx1,
+					const struct util_ltv_index *idx2)
+{
+	uint16_t i;
+
+	if (!idx1 || !idx2 || idx1->num != idx2->num)
+		return false;
+
+	for (i = 0; i < idx1->num; i++) {
+		if (!util_ltv_index_match(idx1, idx2, idx1->types[i]))
+			return false;
+	}
+
+	return true;
+}
+
 /* Helper to print debug information of LTV entries */
 bool util_debug_ltv(const uint8_t *data, uint8_t len,
 			const struct util_ltv_debugger *debugger, size_t num,
@@ -144,6 +144,34 @@ typedef void (*util_ltv_func_t)(size_t i, uint8_t l, uint8_t t, uint8_t *v,
 bool util_ltv_foreach(const uint8_t *data, uint8_t len, uint8_t *type,
 			util_ltv_func_t func, void *user_data);
 
+/* Indexed view of LTV entries, values are not copied so the data must
+ * outlive the index.
+ */
+struct util_ltv_index {
+	uint8_t *data;
+	size_t len;
+	uint16_t num;
+	uint8_t types[UINT8_MAX + 1];
+	uint16_t offset[UINT8_MAX + 1];
+};
+
+bool util_ltv_index_init(struct util_ltv_index *idx, void *data, size_t len);
+uint8_t *util_ltv_index_get(const struct util_ltv_index *idx, uint8_t type,
+							uint8_t *len);
+bool util_ltv_index_get_u8(const struct util_ltv_index *idx, uint8_t type,
+							uint8_t *value);
+bool util_ltv_index_get_le16(const struct util_ltv_index *idx, uint8_t type,
+							uint16_t *value);
+bool util_ltv_index_get_le32(const struct util_ltv_index *idx, uint8_t type,
+							uint32_t *value);
+bool util_ltv_index_set(struct util_ltv_index *idx, uint8_t type,
+					const void *value, uint8_t len);
+bool util_ltv_index_match(const struct util_ltv_index *idx,
+					const struct util_ltv_index *other,
+					uint8_t type);
+bool util_ltv_index_equal(const struct util_ltv_index *idx1,
+					const struct util_ltv_index *idx2);
+
 unsigned char util_get_dt(const char *parent, const char *name);
 
 ssize_t util_getrandom(void *buf, size_t buflen, unsigned int flags);
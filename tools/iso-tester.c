@@ -467,6 +467,7 @@ struct test_data {
 	int step;
 	bool reconnect;
 	bool suspending;
+	gint64 cig_start;
 };
 
 struct iso_client_data {
@@ -487,6 +488,7 @@ struct iso_client_data {
 	size_t base_len;
 	bool listen_bind;
 	bool pa_bind;
+	bool sched;
 };
 
 static void mgmt_debug(const char *str, void *user_data)
@@ -580,6 +582,7 @@ static void read_index_list_callback(uint8_t status, uint16_t length,
 					const void *param, void *user_data)
 {
 	struct test_data *data = tester_get_data();
+	const struct iso_client_data *isodata = data->test_data;
 
 	tester_print("Read Index List callback");
 	tester_print("  Status: 0x%02x", status);
@@ -605,6 +608,13 @@ static void read_index_list_callback(uint8_t status, uint16_t length,
 	if (tester_use_debug())
 		hciemu_set_debug(data->hciemu, hciemu_debug, "hciemu: ", NULL);
 
+	if (isodata && isodata->sched &&
+			!hciemu_set_iso_sched(data->hciemu, 0, 0, 0)) {
+		tester_warn("Failed to setup ISO scheduling");
+		tester_pre_setup_failed();
+		return;
+	}
+
 	tester_print("New hciemu instance created");
 }
 
@@ -985,6 +995,13 @@ static const struct iso_client_data connect_16_2_1_send = {
 	.send = &send_16_2_1,
 };
 
+static const struct iso_client_data connect_16_2_1_send_sched = {
+	.qos = QOS_16_2_1,
+	.expect_err = 0,
+	.send = &send_16_2_1,
+	.sched = true,
+};
+
 static const struct iso_client_data listen_16_2_1_recv = {
 	.qos = QOS_16_2_1,
 	.expect_err = 0,
@@ -2229,6 +2246,10 @@ static gboolean iso_connect(GIOChannel *io, GIOCondition cond,
 		tester_test_failed();
 	} else {
 		data->step--;
+		if (!data->step && data->cig_start)
+			tester_print("CIG ready in %" G_GINT64_FORMAT " us",
+				g_get_monotonic_time() - data->cig_start);
+
 		if (data->step)
 			tester_print("Step %u", data->step);
 		else if (isodata->send)
@@ -2344,6 +2365,12 @@ static void setup_connect_many(struct test_data *data, uint8_t n, uint8_t *num,
 	GIOChannel *io;
 	unsigned int i;
 
+	/* Time from the first CIS connect until the last one is established
+	 * when the CIS are spread over several peers.
+	 */
+	if (!isodata->bcast && n > 1 && !isodata->defer)
+		data->cig_start = g_get_monotonic_time();
+
 	for (i = 0; i < n; ++i) {
 		sk[i] = setup_sock(data, num[i]);
 		if (sk[i] < 0)
@@ -2351,6 +2378,9 @@ static void setup_connect_many(struct test_data *data, uint8_t n, uint8_t *num,
 	}
 
 	if (isodata->defer) {
+		if (!isodata->bcast && n > 1)
+			data->cig_start = g_get_monotonic_time();
+
 		for (i = 0; i < n; ++i)
 			if (connect_deferred(sk[i]) < 0)
 				return;
@@ -3172,6 +3202,9 @@ int main(int argc, char *argv[])
 	test_iso("ISO Send - Success", &connect_16_2_1_send, setup_powered,
 							test_connect);
 
+	test_iso("ISO Send Scheduled - Success", &connect_16_2_1_send_sched,
+						setup_powered, test_connect);
+
 	test_iso("ISO Receive - Success", &listen_16_2_1_recv, setup_powered,
 							test_listen);
 
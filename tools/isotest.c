@@ -30,6 +30,8 @@
 #include <sys/ioctl.h>
 #include <sys/uio.h>
 #include <linux/sockios.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
 #include <time.h>
 #include <inttypes.h>
 #include <sys/wait.h>
@@ -50,6 +52,10 @@
 #define DEFAULT_BIG_ID 0x01
 #define DEFAULT_BIS_ID 0x01
 
+/* Benchmark SDU header: sequence number and send time */
+#define BENCH_HDR_SIZE	12
+#define BENCH_TX_RING	1024
+
 /* Test modes */
 enum {
 	SEND,
@@ -79,6 +85,15 @@ static bool inout;
 
 static uint8_t num_bis = 1;
 
+/* Benchmark duration/report interval in seconds */
+static int bench_time;
+
+struct bench_samples {
+	uint32_t *val;
+	size_t num;
+	size_t len;
+};
+
 struct lookup_table {
 	const char *name;
 	int flag;
@@ -713,6 +728,211 @@ static void recv_mode(int fd, int sk, char *peer)
 	}
 }
 
+static uint64_t bench_now(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_push(struct bench_samples *s, uint32_t val)
+{
+	if (s->num == s->len) {
+		uint32_t *v;
+
+		v = realloc(s->val, (s->len ? s->len * 2 : 1024) *
+							sizeof(*v));
+		if (!v)
+			return;
+
+		s->val = v;
+		s->len = s->len ? s->len * 2 : 1024;
+	}
+
+	s->val[s->num++] = val;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	uint32_t v1 = *(const uint32_t *) a;
+	uint32_t v2 = *(const uint32_t *) b;
+
+	return v1 < v2 ? -1 : v1 > v2;
+}
+
+static void bench_print(const char *label, struct bench_samples *s)
+{
+	if (!s->num) {
+		syslog(LOG_INFO, "%s: no samples", label);
+		return;
+	}
+
+	qsort(s->val, s->num, sizeof(*s->val), bench_cmp);
+
+	syslog(LOG_INFO, "%s: min %u p50 %u p90 %u p99 %u max %u us",
+			label, s->val[0], s->val[s->num / 2],
+			s->val[s->num * 90 / 100], s->val[s->num * 99 / 100],
+			s->val[s->num - 1]);
+}
+
+static void bench_recv_report(uint64_t start, uint32_t packets, long total,
+				uint32_t lost, uint32_t reordered,
+				struct bench_samples *lat,
+				struct bench_samples *jitter)
+{
+	uint64_t elapsed = bench_now(CLOCK_MONOTONIC) - start;
+	float secs = elapsed / 1000000000.0;
+
+	syslog(LOG_INFO, "Received %u packets (%ld bytes) in %.2f sec "
+			"speed %.2f kb/s", packets, total, secs,
+			secs ? (float)(total * 8 / secs) / 1024.0 : 0);
+	syslog(LOG_INFO, "Lost %u (%.2f%%) reordered %u", lost,
+			packets + lost ? lost * 100.0 / (packets + lost) : 0,
+			reordered);
+
+	bench_print("Latency", lat);
+	bench_print("Jitter", jitter);
+}
+
+/* Latency is only meaningful if sender and receiver share the monotonic
+ * clock, e.g. two controllers on the same host or the emulator.
+ */
+static void bench_recv_mode(int fd, int sk, char *peer)
+{
+	struct bench_samples lat, jitter;
+	uint64_t start = 0, last = 0;
+	uint32_t expected = 0, packets = 0, lost = 0, reordered = 0;
+	uint32_t prev_lat = 0;
+	long total = 0;
+	int len;
+
+	memset(&lat, 0, sizeof(lat));
+	memset(&jitter, 0, sizeof(jitter));
+
+	if (defer_setup && !peer) {
+		len = read(sk, buf, data_size);
+		if (len < 0)
+			syslog(LOG_ERR, "Initial read error: %s (%d)",
+						strerror(errno), errno);
+	}
+
+	syslog(LOG_INFO, "Receiving ...");
+
+	while (1) {
+		uint64_t now, ts;
+		uint32_t seq, l;
+
+		len = recv(sk, buf, data_size, 0);
+		if (len <= 0) {
+			if (len < 0 && errno == ENOTCONN)
+				continue;
+
+			if (len < 0)
+				syslog(LOG_ERR, "Read failed: %s (%d)",
+						strerror(errno), errno);
+			break;
+		}
+
+		now = bench_now(CLOCK_MONOTONIC);
+
+		if (len < BENCH_HDR_SIZE)
+			continue;
+
+		seq = get_le32(buf);
+		ts = get_le64(buf + 4);
+
+		if (!packets) {
+			start = last = now;
+			expected = seq;
+		}
+
+		if (seq == expected) {
+			expected++;
+		} else if (seq > expected) {
+			lost += seq - expected;
+			expected = seq + 1;
+		} else {
+			/* Late packet previously accounted as lost */
+			reordered++;
+			if (lost)
+				lost--;
+		}
+
+		packets++;
+		total += len;
+
+		l = now > ts ? (now - ts) / 1000 : 0;
+		bench_push(&lat, l);
+
+		if (packets > 1)
+			bench_push(&jitter, l > prev_lat ? l - prev_lat :
+								prev_lat - l);
+		prev_lat = l;
+
+		if (fd >= 0 && write(fd, buf, len) < 0) {
+			syslog(LOG_ERR, "Write failed: %s (%d)",
+						strerror(errno), errno);
+			break;
+		}
+
+		if (now - last >= SEC_USEC(bench_time) * 1000ULL) {
+			bench_recv_report(start, packets, total, lost,
+						reordered, &lat, &jitter);
+			last = now;
+		}
+	}
+
+	if (packets)
+		bench_recv_report(start, packets, total, lost, reordered,
+							&lat, &jitter);
+
+	free(lat.val);
+	free(jitter.val);
+}
+
+/* Collect kernel software TX timestamps, reported in CLOCK_REALTIME */
+static void bench_read_tx(int sk, uint64_t *sent, struct bench_samples *s)
+{
+	char control[256];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	while (1) {
+		struct scm_timestamping *tss = NULL;
+		struct sock_extended_err *serr = NULL;
+		uint64_t ts;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(sk, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			return;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET &&
+				cmsg->cmsg_type == SCM_TIMESTAMPING)
+				tss = (void *) CMSG_DATA(cmsg);
+			else if (cmsg->cmsg_level == SOL_BLUETOOTH &&
+					cmsg->cmsg_type == BT_SCM_ERROR)
+				serr = (void *) CMSG_DATA(cmsg);
+		}
+
+		if (!tss || !serr || serr->ee_errno != ENOMSG ||
+			serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING ||
+			serr->ee_info != SCM_TSTAMP_SND)
+			continue;
+
+		ts = tss->ts[0].tv_sec * 1000000000ULL + tss->ts[0].tv_nsec;
+		if (ts >= sent[serr->ee_data % BENCH_TX_RING])
+			bench_push(s, (ts - sent[serr->ee_data %
+						BENCH_TX_RING]) / 1000);
+	}
+}
+
 static int open_file(const char *filename)
 {
 	int fd = -1;
@@ -807,6 +1027,32 @@ static int read_file(int fd, ssize_t count, bool rewind)
 	return len;
 }
 
+static void bench_send_report(int sk, uint64_t start, uint32_t packets,
+				long total, struct bt_iso_io_qos *out,
+				bool tx_ts, uint64_t *sent,
+				struct bench_samples *tx)
+{
+	uint64_t elapsed = bench_now(CLOCK_MONOTONIC) - start;
+	float secs = elapsed / 1000000000.0;
+
+	syslog(LOG_INFO, "Sent %u/%" PRIu64 " packets (%ld bytes) in "
+			"%.2f sec speed %.2f kb/s", packets,
+			elapsed / 1000 / out->interval, total, secs,
+			(float)(total * 8 / secs) / 1024.0);
+
+	if (!tx_ts) {
+		syslog(LOG_INFO, "TX timestamps not available");
+		return;
+	}
+
+	/* Give pending timestamps a chance to be reported */
+	usleep(out->latency * 1000);
+	bench_read_tx(sk, sent, tx);
+
+	syslog(LOG_INFO, "TX timestamps %zu/%u", tx->num, packets);
+	bench_print("TX delay", tx);
+}
+
 static void do_send(int sk, int fd, char *peer, bool repeat)
 {
 	uint32_t seq;
@@ -816,6 +1062,10 @@ static void do_send(int sk, int fd, char *peer, bool repeat)
 	struct bt_iso_qos qos;
 	uint32_t num;
 	struct bt_iso_io_qos *out;
+	struct bench_samples tx;
+	uint64_t bench_start = 0, sent[BENCH_TX_RING];
+	long total = 0;
+	bool tx_ts = false;
 
 	syslog(LOG_INFO, "Sending ...");
 
@@ -868,6 +1118,29 @@ static void do_send(int sk, int fd, char *peer, bool repeat)
 	for (int i = 6; i < out->sdu; i++)
 		buf[i] = 0x7f;
 
+	if (bench_time) {
+		uint32_t flags = SOF_TIMESTAMPING_SOFTWARE |
+					SOF_TIMESTAMPING_TX_SOFTWARE |
+					SOF_TIMESTAMPING_OPT_ID |
+					SOF_TIMESTAMPING_OPT_TSONLY;
+
+		if (out->sdu < BENCH_HDR_SIZE || data_size < BENCH_HDR_SIZE) {
+			syslog(LOG_ERR, "SDU too small for benchmark: %u",
+								out->sdu);
+			exit(1);
+		}
+
+		tx_ts = !setsockopt(sk, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+							sizeof(flags));
+
+		memset(&tx, 0, sizeof(tx));
+		memset(sent, 0, sizeof(sent));
+		bench_start = bench_now(CLOCK_MONOTONIC);
+
+		/* Benchmark uses generated data only */
+		fd = -1;
+	}
+
 	if (clock_gettime(CLOCK_MONOTONIC, &t_start) < 0) {
 		perror("clock_gettime");
 		exit(EXIT_FAILURE);
@@ -884,6 +1157,12 @@ static void do_send(int sk, int fd, char *peer, bool repeat)
 		} else
 			send_len = out->sdu;
 
+		if (bench_time) {
+			put_le32(seq, buf);
+			put_le64(bench_now(CLOCK_MONOTONIC), buf + 4);
+			sent[seq % BENCH_TX_RING] = bench_now(CLOCK_REALTIME);
+		}
+
 		send_len = send(sk, buf, send_len, 0);
 		if (send_len <= 0) {
 			syslog(LOG_ERR, "send failed: %s (%d)",
@@ -891,6 +1170,22 @@ static void do_send(int sk, int fd, char *peer, bool repeat)
 			exit(1);
 		}
 
+		if (bench_time) {
+			total += send_len;
+
+			if (tx_ts)
+				bench_read_tx(sk, sent, &tx);
+
+			if (bench_now(CLOCK_MONOTONIC) - bench_start >=
+					SEC_USEC(bench_time) * 1000ULL) {
+				bench_send_report(sk, bench_start, seq + 1,
+							total, out, tx_ts,
+							sent, &tx);
+				free(tx.val);
+				return;
+			}
+		}
+
 		ioctl(sk, TIOCOUTQ, &used);
 
 		if (!quiet)
@@ -1140,7 +1435,8 @@ static void usage(void)
 		"\t[-G, --CIG/BIG <value>]\n"
 		"\t[-T, --CIS/BIS <value>]\n"
 		"\t[-V, --type <value>] address type (help for list)\n"
-		"\t[-N, --nbis <value>] Number of BISes to create/synchronize to\n");
+		"\t[-N, --nbis <value>] Number of BISes to create/synchronize to\n"
+		"\t[-z, --bench <seconds>] Benchmark duration\n");
 }
 
 static const struct option main_options[] = {
@@ -1171,6 +1467,7 @@ static const struct option main_options[] = {
 	{ "CIS/BIS",   required_argument, NULL, 'T'},
 	{ "type",      required_argument, NULL, 'V'},
 	{ "nbis",      required_argument, NULL, 'N'},
+	{ "bench",     required_argument, NULL, 'z'},
 	{}
 };
 
@@ -1212,7 +1509,7 @@ int main(int argc, char *argv[])
 		int opt;
 
 		opt = getopt_long(argc, argv,
-			"d::cmr::s::nb:i:j:hqt:CV:W:M:S:P:F:I:L:Y:R:B:G:T:e:k:N:",
+			"d::cmr::s::nb:i:j:hqt:CV:W:M:S:P:F:I:L:Y:R:B:G:T:e:k:N:z:",
 			main_options, NULL);
 		if (opt < 0)
 			break;
@@ -1395,6 +1692,11 @@ int main(int argc, char *argv[])
 			}
 			break;
 
+		case 'z':
+			if (optarg)
+				bench_time = atoi(optarg);
+			break;
+
 		/* fall through */
 		default:
 			usage();
@@ -1426,7 +1728,8 @@ int main(int argc, char *argv[])
 	if (!(argc - optind)) {
 		switch (mode) {
 		case RECV:
-			do_listen(filename, recv_mode, NULL);
+			do_listen(filename, bench_time ? bench_recv_mode :
+						recv_mode, NULL);
 			goto done;
 
 		case DUMP:
@@ -1519,7 +1822,8 @@ int main(int argc, char *argv[])
 			break;
 
 		case RECV:
-			do_listen(filename, recv_mode, argv[optind + i]);
+			do_listen(filename, bench_time ? bench_recv_mode :
+					recv_mode, argv[optind + i]);
 			break;
 
 		case DUMP:
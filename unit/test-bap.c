@@ -52,6 +52,7 @@ struct test_data {
 	struct iovec *caps;
 	struct test_config *cfg;
 	struct bt_bap_stream *stream;
+	unsigned int resume_id;
 	size_t iovcnt;
 	struct iovec *iov;
 };
@@ -2825,6 +2826,175 @@ static void test_scc_metadata(void)
 			SCC_SRC_METADATA_STREAMING);
 }
 
+static void bap_resume(struct bt_bap_stream *stream,
+					uint8_t code, uint8_t reason,
+					void *user_data)
+{
+	if (code)
+		tester_test_failed();
+}
+
+static void state_release_resume(struct bt_bap_stream *stream,
+					uint8_t old_state, uint8_t new_state,
+					void *user_data)
+{
+	struct test_data *data = user_data;
+	bool enable = data->cfg->state == BT_BAP_STREAM_STATE_ENABLING;
+	unsigned int id;
+
+	switch (new_state) {
+	case BT_BAP_STREAM_STATE_CONFIG:
+		/* Server kept the configuration on release */
+		if (old_state != BT_BAP_STREAM_STATE_RELEASING)
+			break;
+
+		data->resume_id = bt_bap_stream_resume(data->stream,
+							&data->cfg->qos,
+							enable, bap_resume,
+							data);
+		g_assert(data->resume_id);
+		break;
+	case BT_BAP_STREAM_STATE_QOS:
+	case BT_BAP_STREAM_STATE_ENABLING:
+		if (new_state != data->cfg->state || data->resume_id)
+			break;
+
+		id = bt_bap_stream_release(data->stream, bap_release, data);
+		g_assert(id);
+		break;
+	}
+}
+
+static struct test_config cfg_snk_qos_resume = {
+	.cc = LC3_CONFIG_16_2,
+	.qos = LC3_QOS_16_2_1,
+	.snk = true,
+	.state = BT_BAP_STREAM_STATE_QOS,
+	.state_func = state_release_resume,
+};
+
+/* ATT: Write Command (0x52) len 23
+ *  Handle: 0x0022
+ *    Data: 080101
+ * ATT: Handle Value Notification (0x1b) len 7
+ *  Handle: 0x0022
+ *    Data: 0801010000
+ * ATT: Handle Value Notification (0x1b) len 5
+ *   Handle: 0x0016
+ *     Data: 0106
+ * ATT: Handle Value Notification (0x1b) len 37
+ *   Handle: 0x0016
+ *     Data: 01010102010a00204e00409c00204e00409c00_cfg
+ */
+#define ASE_SNK_RELEASE_CACHE(_cfg...) \
+	IOV_DATA(0x52, 0x22, 0x00, 0x08, 0x01, 0x01), \
+	IOV_DATA(0x1b, 0x22, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00), \
+	IOV_NULL, \
+	IOV_DATA(0x1b, 0x16, 0x00, 0x01, 0x06), \
+	IOV_NULL, \
+	IOV_DATA(0x1b, 0x16, 0x00, 0x01, 0x01, 0x02, 0x01, 0x0a, 0x00, \
+			0x20, 0x4e, 0x00, 0x40, 0x9c, 0x00, 0x20, 0x4e, 0x00, \
+			0x40, 0x9c, 0x00, _cfg)
+
+#define ASE_SNK_RELEASE_CACHE_16_2 \
+	ASE_SNK_RELEASE_CACHE(0x06, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x02, 0x01, \
+			0x03, 0x02, 0x02, 0x01, 0x03, 0x04, 0x28, 0x00)
+
+#define QOS_SNK_16_2_1 \
+	QOS_SNK(0x10, 0x27, 0x00, 0x00, 0x02, 0x28, 0x00, 0x02, 0x0a, 0x00, \
+		0x40, 0x9c, 0x00)
+
+/* Config Codec is skipped since the server kept the cached configuration */
+#define SCC_SNK_QOS_RESUME \
+	SCC_SNK_16_2_1, \
+	ASE_SNK_RELEASE_CACHE_16_2, \
+	QOS_SNK_16_2_1
+
+static struct test_config cfg_snk_enable_resume = {
+	.cc = LC3_CONFIG_16_2,
+	.qos = LC3_QOS_16_2_1,
+	.snk = true,
+	.state = BT_BAP_STREAM_STATE_ENABLING,
+	.state_func = state_release_resume,
+};
+
+/* The cached metadata of the Enabling state is used for Enable */
+#define SCC_SNK_ENABLE_RESUME \
+	SCC_SNK_ENABLE, \
+	ASE_SNK_RELEASE_CACHE_16_2, \
+	QOS_SNK_16_2_1, \
+	IOV_DATA(0x52, 0x22, 0x00, 0x03, 0x01, 0x01, 0x04, 0x03, 0x02, 0x01, \
+			00), \
+	IOV_DATA(0x1b, 0x22, 0x00, 0x03, 0x01, 0x01, 0x00, 0x00), \
+	IOV_NULL, \
+	IOV_DATA(0x1b, 0x16, 0x00, 0x01, 0x03, 0x00, 0x00, 0x04, 0x03, 0x02, \
+			0x01, 0x00)
+
+static void state_release_resume_unset(struct bt_bap_stream *stream,
+					uint8_t old_state, uint8_t new_state,
+					void *user_data)
+{
+	struct test_data *data = user_data;
+	struct bt_bap_qos qos = data->cfg->qos;
+	unsigned int id;
+
+	switch (new_state) {
+	case BT_BAP_STREAM_STATE_CONFIG:
+		if (old_state != BT_BAP_STREAM_STATE_RELEASING)
+			break;
+
+		/* CIG/CIS are only assigned once the ISO socket is created so
+		 * resume must not send Config QoS with unset ids.
+		 */
+		qos.ucast.cig_id = BT_ISO_QOS_CIG_UNSET;
+		qos.ucast.cis_id = BT_ISO_QOS_CIS_UNSET;
+
+		id = bt_bap_stream_resume(data->stream, &qos, false,
+						bap_resume, data);
+		g_assert(!id);
+		break;
+	case BT_BAP_STREAM_STATE_QOS:
+		id = bt_bap_stream_release(data->stream, bap_release, data);
+		g_assert(id);
+		break;
+	}
+}
+
+static struct test_config cfg_snk_unset_resume = {
+	.cc = LC3_CONFIG_16_2,
+	.qos = LC3_QOS_16_2_1,
+	.snk = true,
+	.state = BT_BAP_STREAM_STATE_QOS,
+	.state_func = state_release_resume_unset,
+};
+
+/* No Config QoS is written since the CIG/CIS are not assigned yet */
+#define SCC_SNK_UNSET_RESUME \
+	SCC_SNK_16_2_1, \
+	ASE_SNK_RELEASE_CACHE_16_2
+
+/* Test Purpose:
+ * Verify that a Unicast Client IUT can restore the configuration last accepted
+ * by an ASE after it has been released.
+ *
+ * Pass verdict:
+ * The IUT successfully writes to the ASE Control Point characteristic the
+ * cached Config QoS and Enable operations without waiting for a new Config
+ * Codec.
+ */
+static void test_scc_resume(void)
+{
+	define_test("BAP/UCL/SCC Resume [UCL SRC Resume to QoS Configured "
+			"state]",
+			test_client, &cfg_snk_qos_resume, SCC_SNK_QOS_RESUME);
+	define_test("BAP/UCL/SCC Resume [UCL SRC Resume to Enabling state]",
+			test_client, &cfg_snk_enable_resume,
+			SCC_SNK_ENABLE_RESUME);
+	define_test("BAP/UCL/SCC Resume [UCL SRC Resume with unset CIG/CIS]",
+			test_client, &cfg_snk_unset_resume,
+			SCC_SNK_UNSET_RESUME);
+}
+
 static void test_scc(void)
 {
 	test_scc_cc_lc3();
@@ -2835,6 +3005,7 @@ static void test_scc(void)
 	test_scc_disable();
 	test_scc_release();
 	test_scc_metadata();
+	test_scc_resume();
 }
 
 int main(int argc, char *argv[])
@@ -39,6 +39,11 @@ struct test_data {
 	struct queue *ccc_states;
 	size_t iovcnt;
 	struct iovec *iov;
+	unsigned int notify_count;
+	void (*notify_func)(struct test_data *data);
+	struct bt_bass *bass2;
+	struct bt_att *att2;
+	int fd2;
 };
 
 struct ccc_state {
@@ -485,6 +490,148 @@ struct ccc_state {
 	BASS_CP_WRITE_REQ(0x05, 0x05), \
 	IOV_DATA(0x01, 0x12, 0x09, 0x00, 0x81)
 
+/* ATT: Write Command (0x52) len 21
+ *   Handle: 0x0009 Type: Broadcast Audio Scan Control Point (0x2bc7)
+ *     Data: 0200F2698BE807C0003412000010270100000000
+ *       Opcode: Add Source
+ *       Advertiser_Address_Type: Public Device or Public Identity Address
+ *       Advertiser_Address: c0:07:e8:8b:69:f2
+ *       Advertising_SID: 0x00
+ *       Broadcast_ID: 0x001234
+ *       PA_Sync: Do not synchronize to PA
+ *       PA_Interval: 0x2710
+ *       Num_Subgroups: 1
+ *         Subgroup #0:
+ *           BIS_Sync: 00000000000000000000000000000000
+ *           Metadata_Length: 0
+ */
+#define ADD_SRC_NO_SYNC \
+	BASS_CP_WRITE_CMD(0x02, 0x00, 0xF2, 0x69, 0x8B, 0xE8, 0x07, 0xC0, \
+			0x00, 0x34, 0x12, 0x00, 0x00, 0x10, 0x27, 0x01, \
+			0x00, 0x00, 0x00, 0x00, 0x00)
+
+/* ATT: Handle Value Notification (0x1b) len 22
+ *   Handle: _handle Type: Broadcast Receive State (0x2bc8)
+ *     Data: _id00F2698BE807C000341200_enc0100000000
+ *       Source_ID: _id
+ *       Source_Address_Type: Public Device or Public Identity Address
+ *       Source_Address: c0:07:e8:8b:69:f2
+ *       Source_Adv_SID: 0x00
+ *       Broadcast_ID: 0x001234
+ *       PA_Sync_State: Not synchronized to PA
+ *       BIG_Encryption: _enc
+ *       Num_Subgroups: 1
+ *         Subgroup #0:
+ *           BIS_Sync_State: 00000000000000000000000000000000
+ *           Metadata_Length: 0
+ */
+#define BCAST_RECV_STATE_NOTIFY(_handle, _id, _enc) \
+	IOV_DATA(0x1b, _handle, 0x00, _id, 0x00, 0xF2, 0x69, 0x8B, 0xE8, \
+			0x07, 0xC0, 0x00, 0x34, 0x12, 0x00, 0x00, _enc, \
+			0x01, 0x00, 0x00, 0x00, 0x00, 0x00)
+
+/* ATT: Write Command (0x52) len 2
+ *   Handle: 0x0009 Type: Broadcast Audio Scan Control Point (0x2bc7)
+ *     Data: 0500
+ *       Opcode: Remove Source
+ *       Source_ID: 0
+ * ATT: Handle Value Notification (0x1b) len 2
+ *   Handle: 0x0003 Type: Broadcast Receive State (0x2bc8)
+ */
+#define REMOVE_SRC \
+	BASS_CP_WRITE_CMD(0x05, 0x00), \
+	IOV_DATA(0x1b, 0x03, 0x00)
+
+#define ADD_SRC_READD \
+	EXCHANGE_MTU, \
+	BASS_FIND_BY_TYPE_VALUE, \
+	DISC_BASS_CHAR, \
+	BASS_FIND_INFO, \
+	BASS_WRITE_CHAR_DESC, \
+	BASS_READ_BCAST_RECV_STATE_CHARS, \
+	ADD_SRC_NO_SYNC, \
+	BCAST_RECV_STATE_NOTIFY(0x03, 0x00, 0x00), \
+	REMOVE_SRC, \
+	ADD_SRC_NO_SYNC, \
+	BCAST_RECV_STATE_NOTIFY(0x03, 0x00, 0x00)
+
+/* The second Broadcast Assistant adds the same source once the first one
+ * has been notified, and gets the second Broadcast Receive State.
+ */
+#define ADD_SRC_TWICE \
+	EXCHANGE_MTU, \
+	BASS_FIND_BY_TYPE_VALUE, \
+	DISC_BASS_CHAR, \
+	BASS_FIND_INFO, \
+	BASS_WRITE_CHAR_DESC, \
+	BASS_READ_BCAST_RECV_STATE_CHARS, \
+	ADD_SRC_NO_SYNC, \
+	BCAST_RECV_STATE_NOTIFY(0x03, 0x00, 0x00), \
+	IOV_NULL, \
+	BCAST_RECV_STATE_NOTIFY(0x06, 0x01, 0x00)
+
+/* ATT: Write Command (0x52) len 19
+ *   Handle: 0x0009 Type: Broadcast Audio Scan Control Point (0x2bc7)
+ *     Data: 0400693C4572685526613465597073275455
+ *       Opcode: Set Broadcast_Code
+ *       Source_ID: 0
+ *       Broadcast_Code: 0x55542773705965346126556872453c69
+ */
+#define SET_BCAST_CODE \
+	BASS_CP_WRITE_CMD(0x04, 0x00, 0x69, 0x3C, 0x45, 0x72, 0x68, \
+			0x55, 0x26, 0x61, 0x34, 0x65, 0x59, 0x70, \
+			0x73, 0x27, 0x54, 0x55)
+
+/* Setting the same Broadcast_Code again leaves the Broadcast Receive State
+ * unchanged, so it is not notified again.
+ */
+#define RECV_STATE_SKIP \
+	EXCHANGE_MTU, \
+	BASS_FIND_BY_TYPE_VALUE, \
+	DISC_BASS_CHAR, \
+	BASS_FIND_INFO, \
+	BASS_WRITE_CHAR_DESC, \
+	BASS_READ_BCAST_RECV_STATE_CHARS, \
+	ADD_SRC_NO_SYNC, \
+	BCAST_RECV_STATE_NOTIFY(0x03, 0x00, 0x00), \
+	SET_BCAST_CODE, \
+	BCAST_RECV_STATE_NOTIFY(0x03, 0x00, 0x02), \
+	SET_BCAST_CODE, \
+	IOV_NULL, \
+	REMOVE_SRC
+
+/* The session is detached and attached again with the same ATT bearer
+ * after the second notification, so the unchanged state is notified.
+ */
+#define RECV_STATE_REATTACH \
+	EXCHANGE_MTU, \
+	BASS_FIND_BY_TYPE_VALUE, \
+	DISC_BASS_CHAR, \
+	BASS_FIND_INFO, \
+	BASS_WRITE_CHAR_DESC, \
+	BASS_READ_BCAST_RECV_STATE_CHARS, \
+	ADD_SRC_NO_SYNC, \
+	BCAST_RECV_STATE_NOTIFY(0x03, 0x00, 0x00), \
+	SET_BCAST_CODE, \
+	BCAST_RECV_STATE_NOTIFY(0x03, 0x00, 0x02), \
+	SET_BCAST_CODE, \
+	BCAST_RECV_STATE_NOTIFY(0x03, 0x00, 0x02)
+
+/* The second Broadcast Assistant writes Add Source and Set Broadcast_Code
+ * in the same event, which only takes one notification of the final state.
+ */
+#define RECV_STATE_FLUSH \
+	EXCHANGE_MTU, \
+	BASS_FIND_BY_TYPE_VALUE, \
+	DISC_BASS_CHAR, \
+	BASS_FIND_INFO, \
+	BASS_WRITE_CHAR_DESC, \
+	BASS_READ_BCAST_RECV_STATE_CHARS, \
+	ADD_SRC_NO_SYNC, \
+	BCAST_RECV_STATE_NOTIFY(0x03, 0x00, 0x00), \
+	IOV_NULL, \
+	BCAST_RECV_STATE_NOTIFY(0x06, 0x01, 0x02)
+
 #define iov_data(args...) ((const struct iovec[]) { args })
 
 #define define_test(name, function, _cfg, args...)		\
@@ -515,6 +662,12 @@ static void test_teardown(const void *user_data)
 	struct test_data *data = (void *)user_data;
 
 	bt_bass_unref(data->bass);
+	bt_bass_unref(data->bass2);
+
+	if (data->att2) {
+		bt_att_unref(data->att2);
+		close(data->fd2);
+	}
 	bt_gatt_server_unref(data->server);
 	util_iov_free(data->iov, data->iovcnt);
 
@@ -634,9 +787,17 @@ static void gatt_notify_cb(struct gatt_db_attribute *attrib,
 	if (!ccc_state || !(ccc_state->value & 0x0001))
 		return;
 
+	/* Both Broadcast Assistants share the server database, so every
+	 * notification is checked on the tester IO.
+	 */
 	bt_gatt_server_send_notification(data->server,
 		gatt_db_attribute_get_handle(attrib),
 		value, len, false);
+
+	data->notify_count++;
+
+	if (data->notify_func)
+		data->notify_func(data);
 }
 
 static void test_server(const void *user_data)
@@ -682,6 +843,116 @@ static void test_server(const void *user_data)
 	bt_att_unref(att);
 }
 
+static void add_src_write_cb(struct gatt_db_attribute *attrib, int err,
+								void *user_data)
+{
+	g_assert_cmpint(err, ==, 0);
+}
+
+static gboolean add_src_second(gpointer user_data)
+{
+	struct test_data *data = user_data;
+	const uint8_t add_src[] = { 0x02, 0x00, 0xF2, 0x69, 0x8B, 0xE8, 0x07,
+					0xC0, 0x00, 0x34, 0x12, 0x00, 0x00,
+					0x10, 0x27, 0x01, 0x00, 0x00, 0x00,
+					0x00, 0x00 };
+	struct gatt_db_attribute *cp;
+
+	cp = gatt_db_get_attribute(data->db, 0x0009);
+	g_assert(cp);
+
+	g_assert(gatt_db_attribute_write(cp, 0, add_src, sizeof(add_src),
+					BT_ATT_OP_WRITE_CMD, data->att2,
+					add_src_write_cb, data));
+
+	return FALSE;
+}
+
+static void notify_add_src_second(struct test_data *data)
+{
+	if (data->notify_count == 1)
+		g_idle_add(add_src_second, data);
+}
+
+static gboolean add_src_set_code_second(gpointer user_data)
+{
+	struct test_data *data = user_data;
+	const uint8_t set_code[] = { 0x04, 0x01, 0x69, 0x3C, 0x45, 0x72,
+					0x68, 0x55, 0x26, 0x61, 0x34, 0x65,
+					0x59, 0x70, 0x73, 0x27, 0x54, 0x55 };
+	struct gatt_db_attribute *cp;
+
+	add_src_second(data);
+
+	cp = gatt_db_get_attribute(data->db, 0x0009);
+	g_assert(cp);
+
+	g_assert(gatt_db_attribute_write(cp, 0, set_code, sizeof(set_code),
+					BT_ATT_OP_WRITE_CMD, data->att2,
+					add_src_write_cb, data));
+
+	return FALSE;
+}
+
+static void notify_add_src_set_code_second(struct test_data *data)
+{
+	if (data->notify_count == 1)
+		g_idle_add(add_src_set_code_second, data);
+}
+
+static void notify_reattach(struct test_data *data)
+{
+	if (data->notify_count != 2)
+		return;
+
+	bt_bass_detach(data->bass);
+	bt_bass_attach(data->bass, NULL);
+}
+
+static void test_server_reattach(const void *user_data)
+{
+	struct test_data *data = (void *)user_data;
+
+	data->notify_func = notify_reattach;
+
+	test_server(user_data);
+}
+
+static void test_server_two(const void *user_data)
+{
+	struct test_data *data = (void *)user_data;
+	int fd[2];
+
+	test_server(user_data);
+
+	/* Second Broadcast Assistant on its own ATT bearer */
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fd));
+
+	data->fd2 = fd[1];
+	data->att2 = bt_att_new(fd[0], false);
+	g_assert(data->att2);
+
+	bt_att_set_close_on_unref(data->att2, true);
+
+	data->bass2 = bt_bass_new(data->db, NULL, BDADDR_ANY);
+	g_assert(data->bass2);
+
+	bt_bass_set_att(data->bass2, data->att2);
+	bt_bass_attach(data->bass2, NULL);
+
+	if (!data->notify_func)
+		data->notify_func = notify_add_src_second;
+}
+
+static void test_server_flush(const void *user_data)
+{
+	struct test_data *data = (void *)user_data;
+
+	data->notify_func = notify_add_src_set_code_second;
+
+	test_server_two(user_data);
+}
+
 static void test_sggit(void)
 {
 	/* BASS/SR/SGGIT/SER/BV-01-C [Service GGIT - Broadcast Scan]
@@ -812,12 +1083,74 @@ static void test_spe(void)
 				INVALID_SRC_ID);
 }
 
+static void test_src(void)
+{
+	/* Test Purpose:
+	 * Verify that a source removed with Remove Source can be added
+	 * again, reusing the same Broadcast Receive State and Source_ID.
+	 *
+	 * Pass verdict:
+	 * The IUT notifies the Broadcast Receive State for both Add Source
+	 * operations and an empty state for the Remove Source operation.
+	 */
+	define_test("BASS/SR/SRC/Re-add Source", test_server, NULL,
+				ADD_SRC_READD);
+
+	/* Test Purpose:
+	 * Verify that two Broadcast Assistants can add the same source.
+	 *
+	 * Pass verdict:
+	 * The IUT notifies a Broadcast Receive State for each Add Source
+	 * operation, with its own Source_ID.
+	 */
+	define_test("BASS/SR/SRC/Add Source twice", test_server_two, NULL,
+				ADD_SRC_TWICE);
+}
+
+static void test_recv_state(void)
+{
+	/* Test Purpose:
+	 * Verify that an unchanged Broadcast Receive State is not notified
+	 * again to the same client.
+	 *
+	 * Pass verdict:
+	 * The IUT does not notify the Broadcast Receive State when the same
+	 * Broadcast_Code is set twice.
+	 */
+	define_test("BASS/SR/RS/Skip unchanged", test_server, NULL,
+				RECV_STATE_SKIP);
+
+	/* Test Purpose:
+	 * Verify that the last notified values are forgotten when the
+	 * session detaches, even if the new ATT bearer has the same address.
+	 *
+	 * Pass verdict:
+	 * The IUT notifies the unchanged Broadcast Receive State after the
+	 * session has been attached again.
+	 */
+	define_test("BASS/SR/RS/Reattach", test_server_reattach, NULL,
+				RECV_STATE_REATTACH);
+
+	/* Test Purpose:
+	 * Verify that changes made to a Broadcast Receive State while
+	 * handling a single event are notified once.
+	 *
+	 * Pass verdict:
+	 * The IUT notifies the Broadcast Receive State added by the second
+	 * Broadcast Assistant once, with the Broadcast_Code already set.
+	 */
+	define_test("BASS/SR/RS/Deferred flush", test_server_flush, NULL,
+				RECV_STATE_FLUSH);
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
 
 	test_sggit();
 	test_spe();
+	test_src();
+	test_recv_state();
 
 	return tester_run();
 }
@@ -0,0 +1,312 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright 2024 NXP
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mesh/mesh-config-json.c"
+
+#define NUM_ELEMENTS	32
+#define NUM_MODELS	16
+#define NUM_APP_KEYS	4
+#define NUM_SUBS	4
+
+#define UNICAST		0x0100
+
+static const uint8_t test_uuid[16] = {
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+	0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+
+static uint8_t test_key[16] = {
+	0x7d, 0xd7, 0x36, 0x4c, 0xd8, 0x42, 0xad, 0x18,
+	0xc1, 0x7c, 0x2b, 0x82, 0x0c, 0x84, 0xc3, 0xd6
+};
+
+static uint8_t test_token[8] = {
+	0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+};
+
+static struct mesh_config *loaded_cfg;
+static bool verify_result;
+
+/* Bytes written by this process so far, as accounted by the kernel */
+static uint64_t get_bytes_written(void)
+{
+	unsigned long long wchar = 0;
+	char line[128];
+	FILE *f;
+
+	f = fopen("/proc/self/io", "r");
+	if (!f)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "wchar: %llu", &wchar) == 1)
+			break;
+	}
+
+	fclose(f);
+
+	return wchar;
+}
+
+static uint64_t get_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static off_t get_file_size(const char *fname)
+{
+	struct stat st;
+
+	if (stat(fname, &st) < 0)
+		return 0;
+
+	return st.st_size;
+}
+
+static void run_main_loop(void)
+{
+	int i;
+
+	/* Let pending idle saves and journal syncs run */
+	for (i = 0; i < 16; i++)
+		l_main_iterate(0);
+}
+
+static void init_node(struct mesh_config_node *node)
+{
+	int i, j;
+
+	memset(node, 0, sizeof(*node));
+
+	node->elements = l_queue_new();
+	node->ttl = 7;
+	node->crpl = 100;
+
+	for (i = 0; i < NUM_ELEMENTS; i++) {
+		struct mesh_config_element *ele;
+
+		ele = l_new(struct mesh_config_element, 1);
+		ele->index = i;
+		ele->models = l_queue_new();
+
+		for (j = 0; j < NUM_MODELS; j++) {
+			struct mesh_config_model *mod;
+
+			mod = l_new(struct mesh_config_model, 1);
+			mod->id = 0x1000 + j;
+			mod->sub_enabled = true;
+			mod->pub_enabled = true;
+			l_queue_push_tail(ele->models, mod);
+		}
+
+		l_queue_push_tail(node->elements, ele);
+	}
+}
+
+static bool configure_node(struct mesh_config *cfg, unsigned int *ops)
+{
+	struct mesh_config_pub pub;
+	struct mesh_config_sub sub;
+	int i, j, k;
+
+	memset(&pub, 0, sizeof(pub));
+	pub.ttl = 5;
+	pub.cnt = 1;
+	pub.interval = 50;
+
+	memset(&sub, 0, sizeof(sub));
+
+	for (i = 0; i < NUM_ELEMENTS; i++) {
+		for (j = 0; j < NUM_MODELS; j++) {
+			uint16_t ele_addr = UNICAST + i;
+			uint32_t id = 0x1000 + j;
+
+			if (!mesh_config_model_binding_add(cfg, ele_addr, id,
+							false, j % NUM_APP_KEYS))
+				return false;
+
+			for (k = 0; k < NUM_SUBS; k++) {
+				sub.addr.grp = 0xc000 + k;
+
+				if (!mesh_config_model_sub_add(cfg, ele_addr, id,
+								false, &sub))
+					return false;
+			}
+
+			pub.addr = 0xc100 + i;
+			pub.idx = j % NUM_APP_KEYS;
+
+			if (!mesh_config_model_pub_add(cfg, ele_addr, id,
+								false, &pub))
+				return false;
+
+			*ops += NUM_SUBS + 2;
+		}
+	}
+
+	return true;
+}
+
+static bool verify_node(struct mesh_config_node *node, const uint8_t uuid[16],
+				struct mesh_config *cfg, void *user_data)
+{
+	const struct l_queue_entry *ele_entry, *mod_entry;
+
+	verify_result = false;
+
+	if (node->unicast != UNICAST ||
+			l_queue_length(node->appkeys) != NUM_APP_KEYS ||
+			l_queue_length(node->elements) != NUM_ELEMENTS)
+		return false;
+
+	ele_entry = l_queue_get_entries(node->elements);
+
+	for (; ele_entry; ele_entry = ele_entry->next) {
+		struct mesh_config_element *ele = ele_entry->data;
+
+		if (l_queue_length(ele->models) != NUM_MODELS)
+			return false;
+
+		mod_entry = l_queue_get_entries(ele->models);
+
+		for (; mod_entry; mod_entry = mod_entry->next) {
+			struct mesh_config_model *mod = mod_entry->data;
+
+			if (mod->num_bindings != 1 ||
+						mod->num_subs != NUM_SUBS ||
+						!mod->pub)
+				return false;
+
+			if (mod->pub->addr != 0xc100 + ele->index)
+				return false;
+		}
+	}
+
+	loaded_cfg = cfg;
+	verify_result = true;
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	char dir_template[] = "/tmp/mesh-config-XXXXXX";
+	struct mesh_config_node node;
+	struct mesh_config *cfg;
+	uint64_t start_us, elapsed_us, start_bytes, written;
+	unsigned int ops = 0;
+	char *dir, *fname, *jname;
+	off_t snapshot_size;
+	int i;
+
+	l_log_set_stderr();
+
+	if (!l_main_init())
+		return EXIT_FAILURE;
+
+	dir = mkdtemp(dir_template);
+	if (!dir) {
+		l_main_exit();
+		return EXIT_FAILURE;
+	}
+
+	init_node(&node);
+
+	cfg = mesh_config_create(dir, test_uuid, &node);
+	l_queue_destroy(node.elements, free_element);
+
+	if (!cfg) {
+		l_error("Failed to create node configuration");
+		goto fail;
+	}
+
+	if (!mesh_config_write_unicast(cfg, UNICAST) ||
+			!mesh_config_write_iv_index(cfg, 0, false) ||
+			!mesh_config_write_token(cfg, test_token) ||
+			!mesh_config_write_device_key(cfg, test_key) ||
+			!mesh_config_net_key_add(cfg, 0, test_key))
+		goto fail;
+
+	for (i = 0; i < NUM_APP_KEYS; i++) {
+		if (!mesh_config_app_key_add(cfg, 0, i, test_key))
+			goto fail;
+	}
+
+	run_main_loop();
+
+	fname = l_strdup(cfg->node_dir_path);
+	jname = l_strdup(cfg->journal_path);
+
+	start_bytes = get_bytes_written();
+	start_us = get_time_us();
+
+	if (!configure_node(cfg, &ops)) {
+		l_error("Failed to configure models");
+		l_free(fname);
+		l_free(jname);
+		goto fail;
+	}
+
+	run_main_loop();
+
+	elapsed_us = get_time_us() - start_us;
+	written = get_bytes_written() - start_bytes;
+	snapshot_size = get_file_size(fname);
+
+	printf("Configured %u models with %u operations\n",
+					NUM_ELEMENTS * NUM_MODELS, ops);
+	printf("  Elapsed time:    %llu us (%llu us/op)\n",
+				(unsigned long long) elapsed_us,
+				(unsigned long long) elapsed_us / ops);
+	printf("  Bytes written:   %llu\n", (unsigned long long) written);
+	printf("  Snapshot size:   %lld\n", (long long) snapshot_size);
+	printf("  Journal size:    %lld\n", (long long) get_file_size(jname));
+	printf("  Full rewrites:   ~%llu bytes\n",
+			(unsigned long long) ops * snapshot_size);
+
+	mesh_config_release(cfg);
+	cfg = NULL;
+
+	l_free(fname);
+	l_free(jname);
+
+	/* Reload snapshot plus journal and check nothing was lost */
+	if (!mesh_config_load_nodes(dir, verify_node, NULL) || !verify_result) {
+		l_error("Node configuration did not survive reload");
+		goto fail;
+	}
+
+	run_main_loop();
+	mesh_config_release(loaded_cfg);
+
+	del_path(dir);
+	l_main_exit();
+
+	return EXIT_SUCCESS;
+
+fail:
+	mesh_config_release(cfg);
+	del_path(dir);
+	l_main_exit();
+
+	return EXIT_FAILURE;
+}
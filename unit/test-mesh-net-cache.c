@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright 2024 NXP
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ell/ell.h>
+
+#include "mesh/net-cache.h"
+
+#define CACHE_SIZE	200
+#define NUM_SOURCES	64
+#define NUM_LOOKUPS	1000000
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool test_duplicates(void)
+{
+	struct net_cache *cache;
+	bool result = false;
+	uint32_t seq;
+
+	cache = net_cache_new(CACHE_SIZE);
+	if (!cache)
+		return false;
+
+	if (net_cache_check(cache, 0x0001, 1, 0x12345678))
+		goto done;
+
+	if (!net_cache_check(cache, 0x0001, 1, 0x12345678))
+		goto done;
+
+	/* Same SEQ from another source, or another MIC, is a new message */
+	if (net_cache_check(cache, 0x0002, 1, 0x12345678) ||
+			net_cache_check(cache, 0x0001, 1, 0x87654321))
+		goto done;
+
+	/* Push the first message out of the cache */
+	for (seq = 2; seq < CACHE_SIZE + 2; seq++)
+		net_cache_check(cache, 0x0003, seq, seq);
+
+	if (net_cache_check(cache, 0x0001, 1, 0x12345678))
+		goto done;
+
+	/* The most recent entries must still be found */
+	if (!net_cache_check(cache, 0x0003, CACHE_SIZE + 1, CACHE_SIZE + 1))
+		goto done;
+
+	net_cache_clear(cache);
+
+	if (net_cache_check(cache, 0x0003, CACHE_SIZE + 1, CACHE_SIZE + 1))
+		goto done;
+
+	result = true;
+
+done:
+	net_cache_free(cache);
+	return result;
+}
+
+/*
+ * Emulate a relay node: every message is heard a few times, from
+ * the originator and from neighbouring relays, interleaved with
+ * traffic from other sources.
+ */
+static bool test_relay_traffic(void)
+{
+	struct net_cache *cache;
+	uint32_t seq[NUM_SOURCES];
+	uint64_t start, elapsed;
+	unsigned int i, dups = 0;
+
+	cache = net_cache_new(CACHE_SIZE);
+	if (!cache)
+		return false;
+
+	memset(seq, 0, sizeof(seq));
+
+	start = get_time_ns();
+
+	for (i = 0; i < NUM_LOOKUPS; i++) {
+		uint16_t src = (i / 3) % NUM_SOURCES;
+		uint32_t mic;
+
+		if (i % 3 == 0)
+			seq[src]++;
+
+		mic = seq[src] * 0x01000193 ^ src;
+
+		if (net_cache_check(cache, src + 1, seq[src], mic))
+			dups++;
+	}
+
+	elapsed = get_time_ns() - start;
+
+	net_cache_free(cache);
+
+	printf("Relay traffic: %u lookups, %u duplicates, %llu ns/lookup\n",
+				NUM_LOOKUPS, dups,
+				(unsigned long long) elapsed / NUM_LOOKUPS);
+
+	return dups == NUM_LOOKUPS - (NUM_LOOKUPS + 2) / 3;
+}
+
+int main(int argc, char *argv[])
+{
+	if (!test_duplicates()) {
+		fprintf(stderr, "Duplicate detection failed\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!test_relay_traffic()) {
+		fprintf(stderr, "Unexpected duplicate count\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -15,6 +15,7 @@
 #include <glib.h>
 
 #define NUM_WRITE_TESTS 100
+#define NUM_READ_BENCHMARK 100000
 
 #include "src/shared/tester.h"
 #include "profiles/midi/libmidi.h"
@@ -330,6 +331,95 @@ static void test_midi_reader(gconstpointer data)
 	tester_test_passed();
 }
 
+struct midi_read_data {
+	const struct midi_read_test *midi_test;
+	size_t events;
+};
+
+static void compare_read_events_cb(const snd_seq_event_t *ev, void *user_data)
+{
+	struct midi_read_data *data = user_data;
+	const struct midi_read_test *midi_test = data->midi_test;
+
+	g_assert_cmpint(data->events, <, midi_test->event_size);
+
+	compare_events(&midi_test->event[data->events++], ev);
+}
+
+static void test_midi_packet_reader(gconstpointer data)
+{
+	const struct midi_read_test *midi_test = data;
+	struct midi_read_data read_data = { .midi_test = midi_test };
+	struct midi_read_parser midi;
+	int err;
+	size_t i; /* ble_packet counter */
+
+	err = midi_read_init(&midi);
+	g_assert_cmpint(err, ==, 0);
+
+	for (i = 0; i < midi_test->ble_packet_size; i++) {
+		snd_seq_event_t ev;
+		bool ret;
+
+		snd_seq_ev_clear(&ev);
+
+		ret = midi_read_packet(&midi, midi_test->ble_packet[i].data,
+		                       midi_test->ble_packet[i].size, &ev,
+		                       compare_read_events_cb, &read_data);
+		g_assert(ret);
+	}
+
+	g_assert_cmpint(read_data.events, ==, midi_test->event_size);
+
+	midi_read_free(&midi);
+
+	tester_test_passed();
+}
+
+static void count_events_cb(const snd_seq_event_t *ev, void *user_data)
+{
+	size_t *events = user_data;
+
+	(*events)++;
+}
+
+static void test_midi_read_benchmark(gconstpointer data)
+{
+	const struct midi_read_test *midi_test = data;
+	struct midi_read_parser midi;
+	size_t packets = 0, events = 0;
+	gint64 start, elapsed;
+	int err, n;
+	size_t i; /* ble_packet counter */
+
+	err = midi_read_init(&midi);
+	g_assert_cmpint(err, ==, 0);
+
+	start = g_get_monotonic_time();
+
+	for (n = 0; n < NUM_READ_BENCHMARK; n++) {
+		for (i = 0; i < midi_test->ble_packet_size; i++) {
+			snd_seq_event_t ev;
+
+			snd_seq_ev_clear(&ev);
+
+			midi_read_packet(&midi, midi_test->ble_packet[i].data,
+			                 midi_test->ble_packet[i].size, &ev,
+			                 count_events_cb, &events);
+			packets++;
+		}
+	}
+
+	elapsed = g_get_monotonic_time() - start;
+
+	tester_print("%zu packets, %zu events, %" G_GINT64_FORMAT " ns/packet",
+	             packets, events, elapsed * 1000 / (gint64) packets);
+
+	midi_read_free(&midi);
+
+	tester_test_passed();
+}
+
 static const snd_seq_event_t event3[] = {
 	CONTROL_EVENT(PITCHBEND, 8, 0, 0),    /* Pitch Bend */
 	CONTROL_EVENT(CONTROLLER, 8, 63, 74), /* Control Change */
@@ -612,6 +702,10 @@ int main(int argc, char *argv[])
 	           &midi1, NULL, test_midi_reader, NULL);
 	tester_add("Raw BLE packets SysEx read",
 	           &midi2, NULL, test_midi_reader, NULL);
+	tester_add("Whole BLE packets read",
+	           &midi1, NULL, test_midi_packet_reader, NULL);
+	tester_add("Whole BLE packets SysEx read",
+	           &midi2, NULL, test_midi_packet_reader, NULL);
 	tester_add("ALSA Seq events to Raw BLE packets",
 	           &midi3, NULL, test_midi_writer, NULL);
 	tester_add("ALSA SysEx events to Raw BLE packets",
@@ -619,5 +713,13 @@ int main(int argc, char *argv[])
 	tester_add("Split ALSA SysEx events to raw BLE packets",
 	           &midi5, NULL, test_midi_writer, NULL);
 
+	/* Benchmarks only run when requested with --perf */
+	if (tester_use_perf()) {
+		tester_add("Whole BLE packets read benchmark",
+		           &midi1, NULL, test_midi_read_benchmark, NULL);
+		tester_add("Whole BLE packets SysEx read benchmark",
+		           &midi2, NULL, test_midi_read_benchmark, NULL);
+	}
+
 	return tester_run();
 }
@@ -17,6 +17,7 @@
 #include <stdbool.h>
 #include <inttypes.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/socket.h>
 
@@ -217,6 +218,20 @@ static const struct uhid_event ev_input = {
 	.type = UHID_INPUT,
 };
 
+static const uint8_t input_data[] = { 0xaa, 0xbb };
+
+static const uint8_t ev_input2[] = {
+	UHID_INPUT2, 0x00, 0x00, 0x00,	/* type */
+	0x03, 0x00,			/* size */
+	0x01, 0xaa, 0xbb,		/* report id + data */
+};
+
+static const uint8_t ev_input2_unnumbered[] = {
+	UHID_INPUT2, 0x00, 0x00, 0x00,	/* type */
+	0x02, 0x00,			/* size */
+	0xaa, 0xbb,			/* data */
+};
+
 static const struct uhid_event ev_output = {
 	.type = UHID_OUTPUT,
 };
@@ -245,6 +260,36 @@ static void test_client(gconstpointer data)
 	context_quit(context);
 }
 
+/* uHID takes exactly one event per write(), so the whole event must be
+ * received by a single read with nothing left behind.
+ */
+static void test_input2(gconstpointer data)
+{
+	struct context *context = create_context(data);
+	const struct test_pdu *pdu = &context->data->pdu_list[0];
+	uint8_t number = 0x00;
+	unsigned char buf[sizeof(struct uhid_event)];
+	ssize_t len;
+
+	if (g_str_equal(context->data->test_name, "/uhid/command/input2"))
+		number = 0x01;
+
+	g_assert_cmpint(bt_uhid_input(context->uhid, number, input_data,
+					sizeof(input_data)), ==, 0);
+
+	len = read(context->fd, buf, sizeof(buf));
+
+	util_hexdump('>', buf, len, test_debug, "uHID: ");
+
+	g_assert_cmpint(len, ==, pdu->size);
+	g_assert(memcmp(buf, pdu->data, pdu->size) == 0);
+
+	len = recv(context->fd, buf, sizeof(buf), MSG_DONTWAIT);
+	g_assert(len < 0 && errno == EAGAIN);
+
+	context_quit(context);
+}
+
 static void handle_output(struct uhid_event *ev, void *user_data)
 {
 	g_assert_cmpint(ev->type, ==, UHID_OUTPUT);
@@ -278,6 +323,9 @@ int main(int argc, char *argv[])
 	define_test("/uhid/command/feature_answer", test_client,
 						event(&ev_feature_answer));
 	define_test("/uhid/command/input", test_client, event(&ev_input));
+	define_test("/uhid/command/input2", test_input2, event(&ev_input2));
+	define_test("/uhid/command/input2/unnumbered", test_input2,
+					event(&ev_input2_unnumbered));
 
 	define_test("/uhid/event/output", test_server, event(&ev_output));
 	define_test("/uhid/event/feature", test_server, event(&ev_feature));
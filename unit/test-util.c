@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "src/shared/util.h"
+#include "src/shared/tester.h"
+
+/* Sampling Frequency, padding, Frame Duration and Channel Allocation */
+static const uint8_t ltv_caps[] = {
+	0x03, 0x01, 0x80, 0x00,
+	0x00,
+	0x02, 0x02, 0x01,
+	0x05, 0x03, 0x01, 0x00, 0x00, 0x00,
+};
+
+/* Same entries in a different order */
+static const uint8_t ltv_caps_reorder[] = {
+	0x05, 0x03, 0x01, 0x00, 0x00, 0x00,
+	0x02, 0x02, 0x01,
+	0x03, 0x01, 0x80, 0x00,
+};
+
+static void test_ltv_index_init(const void *data)
+{
+	uint8_t buf[sizeof(ltv_caps)];
+	struct util_ltv_index idx;
+	uint8_t *v, len;
+
+	memcpy(buf, ltv_caps, sizeof(buf));
+
+	g_assert(util_ltv_index_init(&idx, buf, sizeof(buf)));
+	g_assert(idx.num == 3);
+
+	/* Values are accessed in place */
+	v = util_ltv_index_get(&idx, 0x01, &len);
+	g_assert(v == &buf[2]);
+	g_assert(len == 2);
+
+	v = util_ltv_index_get(&idx, 0x03, &len);
+	g_assert(v == &buf[10]);
+	g_assert(len == 4);
+
+	g_assert(!util_ltv_index_get(&idx, 0x04, &len));
+
+	/* An empty blob has no entries */
+	g_assert(util_ltv_index_init(&idx, NULL, 0));
+	g_assert(idx.num == 0);
+	g_assert(!util_ltv_index_get(&idx, 0x01, NULL));
+
+	tester_test_passed();
+}
+
+static void test_ltv_index_duplicate(const void *data)
+{
+	uint8_t buf[] = { 0x02, 0x02, 0x01, 0x02, 0x02, 0x00 };
+	struct util_ltv_index idx;
+
+	g_assert(!util_ltv_index_init(&idx, buf, sizeof(buf)));
+
+	tester_test_passed();
+}
+
+static void test_ltv_index_truncated(const void *data)
+{
+	uint8_t buf[] = { 0x02, 0x02, 0x01, 0x03, 0x01, 0x80 };
+	struct util_ltv_index idx;
+
+	g_assert(!util_ltv_index_init(&idx, buf, sizeof(buf)));
+
+	/* The length octet alone is truncated too */
+	g_assert(!util_ltv_index_init(&idx, buf, 4));
+
+	g_assert(util_ltv_index_init(&idx, buf, 3));
+	g_assert(idx.num == 1);
+
+	tester_test_passed();
+}
+
+static void test_ltv_index_get_int(const void *data)
+{
+	uint8_t buf[sizeof(ltv_caps)];
+	struct util_ltv_index idx;
+	uint32_t v32;
+	uint16_t v16;
+	uint8_t v8;
+
+	memcpy(buf, ltv_caps, sizeof(buf));
+
+	g_assert(util_ltv_index_init(&idx, buf, sizeof(buf)));
+
+	g_assert(util_ltv_index_get_u8(&idx, 0x02, &v8));
+	g_assert(v8 == 0x01);
+
+	g_assert(util_ltv_index_get_le16(&idx, 0x01, &v16));
+	g_assert(v16 == 0x0080);
+
+	g_assert(util_ltv_index_get_le32(&idx, 0x03, &v32));
+	g_assert(v32 == 0x00000001);
+
+	/* Values shorter than the requested type are rejected */
+	g_assert(!util_ltv_index_get_le16(&idx, 0x02, &v16));
+	g_assert(!util_ltv_index_get_le32(&idx, 0x01, &v32));
+
+	/* Missing entries */
+	g_assert(!util_ltv_index_get_u8(&idx, 0x04, &v8));
+	g_assert(!util_ltv_index_get_le16(&idx, 0x04, &v16));
+	g_assert(!util_ltv_index_get_le32(&idx, 0x04, &v32));
+
+	tester_test_passed();
+}
+
+static void test_ltv_index_set(const void *data)
+{
+	uint8_t buf[sizeof(ltv_caps)];
+	struct util_ltv_index idx;
+	uint8_t value[] = { 0x02, 0x00, 0x00, 0x00 };
+	uint32_t v32;
+
+	memcpy(buf, ltv_caps, sizeof(buf));
+
+	g_assert(util_ltv_index_init(&idx, buf, sizeof(buf)));
+
+	g_assert(util_ltv_index_set(&idx, 0x03, value, sizeof(value)));
+	g_assert(util_ltv_index_get_le32(&idx, 0x03, &v32));
+	g_assert(v32 == 0x00000002);
+	g_assert(!memcmp(&buf[10], value, sizeof(value)));
+
+	/* The length must match and the entry must exist */
+	g_assert(!util_ltv_index_set(&idx, 0x03, value, 2));
+	g_assert(!util_ltv_index_set(&idx, 0x04, value, 1));
+
+	/* Other entries are left untouched */
+	g_assert(!memcmp(buf, ltv_caps, 10));
+
+	tester_test_passed();
+}
+
+static void test_ltv_index_equal(const void *data)
+{
+	uint8_t buf1[sizeof(ltv_caps)];
+	uint8_t buf2[sizeof(ltv_caps_reorder)];
+	struct util_ltv_index idx1, idx2;
+	uint8_t value = 0x00;
+
+	memcpy(buf1, ltv_caps, sizeof(buf1));
+	memcpy(buf2, ltv_caps_reorder, sizeof(buf2));
+
+	g_assert(util_ltv_index_init(&idx1, buf1, sizeof(buf1)));
+	g_assert(util_ltv_index_init(&idx2, buf2, sizeof(buf2)));
+
+	/* Entry order does not matter */
+	g_assert(util_ltv_index_equal(&idx1, &idx2));
+	g_assert(util_ltv_index_match(&idx1, &idx2, 0x01));
+
+	/* A different value */
+	g_assert(util_ltv_index_set(&idx2, 0x02, &value, sizeof(value)));
+	g_assert(!util_ltv_index_equal(&idx1, &idx2));
+	g_assert(!util_ltv_index_match(&idx1, &idx2, 0x02));
+
+	/* A missing entry */
+	g_assert(util_ltv_index_init(&idx2, buf2, 9));
+	g_assert(!util_ltv_index_equal(&idx1, &idx2));
+	g_assert(!util_ltv_index_match(&idx1, &idx2, 0x01));
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/util/ltv_index/init", NULL, NULL,
+					test_ltv_index_init, NULL);
+	tester_add("/util/ltv_index/duplicate", NULL, NULL,
+					test_ltv_index_duplicate, NULL);
+	tester_add("/util/ltv_index/truncated", NULL, NULL,
+					test_ltv_index_truncated, NULL);
+	tester_add("/util/ltv_index/get_int", NULL, NULL,
+					test_ltv_index_get_int, NULL);
+	tester_add("/util/ltv_index/set", NULL, NULL,
+					test_ltv_index_set, NULL);
+	tester_add("/util/ltv_index/equal", NULL, NULL,
+					test_ltv_index_equal, NULL);
+
+	return tester_run();
+}